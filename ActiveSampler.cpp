@@ -0,0 +1,400 @@
+#include "ActiveSampler.h"
+#include "ColorMath.h"
+#include "PatchSet.h"
+
+#include <algorithm>
+#include <cmath>
+
+// SSE2 is part of every x86-64 CPU, so it needs no detection
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ACTIVE_SSE2 1
+#endif
+
+namespace
+{
+    // ICtCp scaled so Euclidean distance is Delta E ITP (BT.2124 halves Ct)
+    const float ITP_SCALE[3] = { 720.0f, 360.0f, 720.0f };
+
+    // Length scales tried, in Delta E ITP; the middle one until there are enough measurements to choose
+    const float LENGTH_SCALES[] = { 10.0f, 20.0f, 40.0f, 80.0f, 160.0f };
+    const size_t DEFAULT_LENGTH_SCALE = 2;
+
+    // Length scales are chosen again each time the measurements double, up to this many. Trying one
+    // costs measurements^3 / 6, a few ms here, and past it a change would mean rebuilding the model
+    // from too many measurements.
+    const size_t MAX_SELECTION_MEASUREMENTS = 128;
+
+    // Measurements a model at a new length scale takes in per update. It starts once every length
+    // scale was tried after a doubling and catches up before the next one, and an update costs at
+    // most four times the usual.
+    const size_t REBUILD_PER_UPDATE = 3;
+
+    // Meter noise and model error, relative to the prior variance
+    const double NOISE_RATIO = 0.01;
+
+    // Weight of an unsurprising neighbor every candidate starts with, and the most one surprise counts,
+    // so a single noisy reading cannot draw all the measurements to itself
+    const double SURPRISE_PRIOR = 1.0;
+    const double MAX_SURPRISE = 100.0;
+
+    // Projections smaller than this are stored as 0. Far candidates would otherwise fill the columns
+    // with values whose products are denormal floats, which multiply many times slower.
+    const double MIN_PROJECTION = 1e-12;
+
+    // Keeps the likelihood finite for a display that measures exactly on target
+    const double MIN_SIGNAL_VARIANCE = 1e-12;
+
+    // dots += the four columns weighted by scales, over count entries
+    void AccumulateColumns(float* dots, const float* const columns[4], const float scales[4], size_t count)
+    {
+        size_t c = 0;
+#ifdef ACTIVE_SSE2
+        __m128 s0 = _mm_set1_ps(scales[0]);
+        __m128 s1 = _mm_set1_ps(scales[1]);
+        __m128 s2 = _mm_set1_ps(scales[2]);
+        __m128 s3 = _mm_set1_ps(scales[3]);
+        for (; c + 4 <= count; c += 4)
+        {
+            __m128 sum = _mm_add_ps(_mm_mul_ps(s0, _mm_loadu_ps(columns[0] + c)),
+                                    _mm_mul_ps(s1, _mm_loadu_ps(columns[1] + c)));
+            sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(s2, _mm_loadu_ps(columns[2] + c)),
+                                             _mm_mul_ps(s3, _mm_loadu_ps(columns[3] + c))));
+            _mm_storeu_ps(dots + c, _mm_add_ps(_mm_loadu_ps(dots + c), sum));
+        }
+#endif
+        for (; c < count; ++c)
+        {
+            dots[c] += scales[0] * columns[0][c] + scales[1] * columns[1][c] + scales[2] * columns[2][c] +
+                       scales[3] * columns[3][c];
+        }
+    }
+}
+
+void ActiveSampler::Reset(const PatchSet& set, size_t capacity)
+{
+    m_candidates = set.Size();
+    m_capacity = std::min(capacity, m_candidates);
+
+    m_targets.resize(m_candidates * 3);
+    m_coordinates.resize(m_candidates * 3);
+    for (size_t i = 0; i < m_candidates; ++i)
+    {
+        float target[3] = { set.r[i], set.g[i], set.b[i] };
+        Bt2020ToIctcp(target, &m_targets[i * 3]);
+        for (int k = 0; k < 3; ++k)
+            m_coordinates[i * 3 + k] = m_targets[i * 3 + k] * ITP_SCALE[k];
+    }
+
+    // Evenly spaced through the set, which for a space-filling set is spread over the gamut
+    size_t poolSize = std::min(m_candidates, ACTIVE_MAX_POOL);
+    m_pool.resize(poolSize);
+    m_slot.assign(m_candidates, poolSize);
+    for (size_t s = 0; s < poolSize; ++s)
+    {
+        m_pool[s] = s * m_candidates / poolSize;
+        m_slot[m_pool[s]] = s;
+    }
+
+    m_position.assign(m_candidates, 0);
+    m_order.clear();
+    m_residuals.clear();
+    m_surprises.clear();
+    StartModel(m_model, LENGTH_SCALES[DEFAULT_LENGTH_SCALE]);
+    m_rebuild = Model();
+    m_rebuilding = false;
+    m_selectionCount = 0;
+    for (int k = 0; k < 3; ++k)
+        m_means[k].clear();
+    m_dots.resize(poolSize);
+    FindNext();
+}
+
+void ActiveSampler::Add(size_t index, const Measurement& measured)
+{
+    if (index >= m_candidates || m_slot[index] == m_pool.size() || m_position[index] != 0 ||
+        m_order.size() >= m_capacity)
+        return;
+
+    float xyz[3];
+    float rgb[3];
+    float itp[3];
+    XyYToXyz(measured.luminance, measured.x, measured.y, xyz);
+    XyzToBt2020(xyz, rgb);
+    Bt2020ToIctcp(rgb, itp);
+
+    // Surprise once the model has enough measurements to predict with
+    double surprise = 0.0;
+    double signal = SignalVariance();
+    if (m_order.size() >= ACTIVE_MIN_MEASUREMENTS && signal > 0.0)
+    {
+        double predicted[3];
+        PredictResidual(index, predicted);
+        double error = 0.0;
+        for (int k = 0; k < 3; ++k)
+        {
+            double difference = (itp[k] - m_targets[index * 3 + k]) * ITP_SCALE[k] - predicted[k];
+            error += difference * difference;
+        }
+        double spread = signal * (std::max(m_model.variances[m_slot[index]], 0.0) + NOISE_RATIO);
+        surprise = std::min(error / spread, MAX_SURPRISE);
+    }
+
+    m_order.push_back(index);
+    m_position[index] = m_order.size();
+    m_surprises.push_back(surprise);
+    for (int k = 0; k < 3; ++k)
+        m_residuals.push_back((itp[k] - m_targets[index * 3 + k]) * ITP_SCALE[k]);
+    Extend(m_model);
+
+    size_t count = m_order.size();
+    if (m_rebuilding)
+    {
+        for (size_t n = 0; n < REBUILD_PER_UPDATE && m_rebuild.points < count; ++n)
+            Extend(m_rebuild);
+        if (m_rebuild.points == count)
+        {
+            m_model = std::move(m_rebuild);
+            m_rebuild = Model();
+            m_rebuilding = false;
+        }
+    }
+    if (!m_rebuilding && m_selectionCount == 0 && count >= ACTIVE_MIN_MEASUREMENTS &&
+        count <= MAX_SELECTION_MEASUREMENTS && (count & (count - 1)) == 0)
+    {
+        m_selectionCount = count;
+        m_selectionStep = 0;
+    }
+    if (m_selectionCount > 0)
+        SelectLengthScale();
+    SolveMeans();
+    FindNext();
+}
+
+// Matern 3/2: smooth between measurements, yet rough enough to follow the kink where a display clips
+double ActiveSampler::Kernel(size_t a, size_t b, float lengthScale) const
+{
+    const float* p = &m_coordinates[a * 3];
+    const float* q = &m_coordinates[b * 3];
+    float d0 = p[0] - q[0];
+    float d1 = p[1] - q[1];
+    float d2 = p[2] - q[2];
+    double r = std::sqrt(3.0 * (d0 * d0 + d1 * d1 + d2 * d2)) / lengthScale;
+    return (1.0 + r) * std::exp(-r);
+}
+
+void ActiveSampler::StartModel(Model& model, float lengthScale) const
+{
+    model = Model();
+    model.lengthScale = lengthScale;
+    // Address space for every column, so growing never copies them; pages are only touched as used
+    model.projections.reserve(m_capacity * m_pool.size());
+    model.variances.assign(m_pool.size(), 1.0);
+    model.surpriseSums.assign(m_pool.size(), 0.0);
+    model.surpriseWeights.assign(m_pool.size(), 0.0);
+}
+
+// Folds the next measurement into model as a new row of the Cholesky factor of the kernel matrix. The
+// new row is the measured candidate's projection, and every pooled candidate's projection gets one
+// more element, by which its variance shrinks.
+void ActiveSampler::Extend(Model& model)
+{
+    size_t point = model.points;
+    size_t chosen = m_order[point];
+    size_t poolSize = m_pool.size();
+    size_t slot = m_slot[chosen];
+    m_row.resize(point);
+    for (size_t i = 0; i < point; ++i)
+        m_row[i] = model.projections[i * poolSize + slot];
+    double pivot = std::sqrt(std::max(model.variances[slot], 0.0) + NOISE_RATIO);
+    model.factor.insert(model.factor.end(), m_row.begin(), m_row.end());
+    model.factor.push_back(pivot);
+
+    // Four columns at a time, so the projections stream through once; missing ones weigh 0
+    std::fill(m_dots.begin(), m_dots.end(), 0.0f);
+    for (size_t i = 0; i < point; i += 4)
+    {
+        const float* columns[4];
+        float scales[4];
+        for (size_t n = 0; n < 4; ++n)
+        {
+            bool present = i + n < point;
+            columns[n] = &model.projections[(present ? i + n : i) * poolSize];
+            scales[n] = present ? static_cast<float>(m_row[i + n]) : 0.0f;
+        }
+        AccumulateColumns(m_dots.data(), columns, scales, poolSize);
+    }
+
+    model.projections.resize((point + 1) * poolSize);
+    float* column = &model.projections[point * poolSize];
+    double surprise = m_surprises[point];
+    for (size_t c = 0; c < poolSize; ++c)
+    {
+        double kernel = Kernel(m_pool[c], chosen, model.lengthScale);
+        double v = (kernel - m_dots[c]) / pivot;
+        column[c] = std::fabs(v) < MIN_PROJECTION ? 0.0f : static_cast<float>(v);
+        model.variances[c] -= v * v;
+        if (surprise > 0.0)
+        {
+            model.surpriseSums[c] += kernel * surprise;
+            model.surpriseWeights[c] += kernel;
+        }
+    }
+
+    for (int k = 0; k < 3; ++k)
+    {
+        std::vector<double>& weights = model.weights[k];
+        double dot = 0.0;
+        for (size_t i = 0; i < point; ++i)
+            dot += m_row[i] * weights[i];
+        weights.push_back((m_residuals[point * 3 + k] - dot) / pivot);
+    }
+    ++model.points;
+}
+
+// Marginal likelihood of a length scale over the first count measurements, with the signal variance
+// of each channel at its maximum
+double ActiveSampler::LogLikelihood(size_t count, float lengthScale) const
+{
+    std::vector<double> factor(count * count);
+    std::vector<double> solved(count);
+    double logDeterminant = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (size_t j = 0; j <= i; ++j)
+        {
+            double sum = Kernel(m_order[i], m_order[j], lengthScale) + (i == j ? NOISE_RATIO : 0.0);
+            for (size_t p = 0; p < j; ++p)
+                sum -= factor[i * count + p] * factor[j * count + p];
+            factor[i * count + j] = i == j ? std::sqrt(std::max(sum, NOISE_RATIO)) : sum / factor[j * count + j];
+        }
+        logDeterminant += 2.0 * std::log(factor[i * count + i]);
+    }
+
+    double likelihood = 0.0;
+    for (int k = 0; k < 3; ++k)
+    {
+        double fit = 0.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            double sum = m_residuals[i * 3 + k];
+            for (size_t p = 0; p < i; ++p)
+                sum -= factor[i * count + p] * solved[p];
+            solved[i] = sum / factor[i * count + i];
+            fit += solved[i] * solved[i];
+        }
+        likelihood -= 0.5 * (count * std::log(fit / count + MIN_SIGNAL_VARIANCE) + logDeterminant);
+    }
+    return likelihood;
+}
+
+// Tries the next length scale on the measurements of the last doubling; after the last one, starts
+// rebuilding the model at the best if that is a different one
+void ActiveSampler::SelectLengthScale()
+{
+    float lengthScale = LENGTH_SCALES[m_selectionStep];
+    double likelihood = LogLikelihood(m_selectionCount, lengthScale);
+    if (m_selectionStep == 0 || likelihood > m_selectionLikelihood)
+    {
+        m_selectionBest = lengthScale;
+        m_selectionLikelihood = likelihood;
+    }
+    if (++m_selectionStep < sizeof(LENGTH_SCALES) / sizeof(LENGTH_SCALES[0]))
+        return;
+
+    m_selectionCount = 0;
+    if (m_selectionBest != m_model.lengthScale)
+    {
+        StartModel(m_rebuild, m_selectionBest);
+        m_rebuilding = true;
+    }
+}
+
+// K^-1 y by back substitution through the factor, so any patch is predicted from its kernel row alone
+void ActiveSampler::SolveMeans()
+{
+    size_t count = m_model.points;
+    for (int k = 0; k < 3; ++k)
+    {
+        std::vector<double>& means = m_means[k];
+        means = m_model.weights[k];
+        for (size_t i = count; i-- > 0;)
+        {
+            const double* row = &m_model.factor[i * (i + 1) / 2];
+            means[i] /= row[i];
+            for (size_t p = 0; p < i; ++p)
+                means[p] -= row[p] * means[i];
+        }
+    }
+}
+
+// Signal variance summed over the channels, so it scales the model's variances to squared Delta E ITP
+double ActiveSampler::SignalVariance() const
+{
+    size_t count = m_model.points;
+    double signal = 0.0;
+    for (int k = 0; k < 3; ++k)
+    {
+        for (double weight : m_model.weights[k])
+            signal += weight * weight;
+    }
+    return count > 0 ? signal / count : 0.0;
+}
+
+void ActiveSampler::PredictResidual(size_t index, double residual[3]) const
+{
+    residual[0] = residual[1] = residual[2] = 0.0;
+    for (size_t i = 0; i < m_model.points; ++i)
+    {
+        double kernel = Kernel(index, m_order[i], m_model.lengthScale);
+        for (int k = 0; k < 3; ++k)
+            residual[k] += kernel * m_means[k][i];
+    }
+}
+
+void ActiveSampler::FindNext()
+{
+    double worst = 0.0;
+    size_t worstIndex = m_candidates;
+    for (size_t s = 0; s < m_pool.size(); ++s)
+    {
+        size_t c = m_pool[s];
+        if (m_position[c] != 0)
+            continue;
+        double inflation = (SURPRISE_PRIOR + m_model.surpriseSums[s]) / (SURPRISE_PRIOR + m_model.surpriseWeights[s]);
+        double uncertainty = std::max(m_model.variances[s], 0.0) * inflation;
+        if (worstIndex == m_candidates || uncertainty > worst)
+        {
+            worst = uncertainty;
+            worstIndex = c;
+        }
+    }
+    m_next = m_order.size() < m_capacity ? worstIndex : m_candidates;
+
+    if (m_order.size() < ACTIVE_MIN_MEASUREMENTS && m_order.size() < m_candidates)
+        m_worstError = std::numeric_limits<float>::infinity();
+    else
+        m_worstError = static_cast<float>(std::sqrt(worst * SignalVariance()));
+}
+
+Measurement ActiveSampler::Predict(size_t index) const
+{
+    double residual[3];
+    PredictResidual(index, residual);
+    float itp[3];
+    for (int k = 0; k < 3; ++k)
+        itp[k] = m_targets[index * 3 + k] + static_cast<float>(residual[k]) / ITP_SCALE[k];
+
+    float rgb[3];
+    float xyz[3];
+    IctcpToBt2020(itp, rgb);
+    Bt2020ToXyz(rgb, xyz);
+    float sum = xyz[0] + xyz[1] + xyz[2];
+
+    Measurement measurement;
+    measurement.luminance = std::max(xyz[1], 0.0f);
+    measurement.x = sum > 0.0f ? xyz[0] / sum : 0.0f;
+    measurement.y = sum > 0.0f ? xyz[1] / sum : 0.0f;
+    measurement.valid = true;
+    return measurement;
+}
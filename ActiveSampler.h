@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Meter.h"
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+struct PatchSet;
+
+// Predictions are not trusted with fewer measurements than this
+const size_t ACTIVE_MIN_MEASUREMENTS = 16;
+
+// Candidates the model tracks uncertainties for; larger sets are sampled evenly
+const size_t ACTIVE_MAX_POOL = 8192;
+
+// What active sampling did over a session's learn commands
+struct ActiveSummary
+{
+    size_t candidates = 0;        // patches in the sets
+    size_t measured = 0;          // of those, measured
+    float worstError = 0.0f;      // least certain prediction left, Delta E ITP
+    double slowestUpdateMs = 0.0; // longest the model took to choose the next patch
+};
+
+// Chooses which patches of a set to measure, so a dense set can be profiled from a fraction of it.
+// A Gaussian process over the targets in ICtCp predicts how far each patch measures from its target,
+// in Delta E ITP, the report's error measure. The next patch is always the one whose prediction is
+// least certain, and measuring can stop once every prediction is within the error wanted.
+//
+// A stationary model is overconfident where the display changes abruptly, as where it clips. Before
+// each measurement is added, how far it lands from its prediction is compared with the predicted
+// spread, and nearby uncertainties are scaled by how surprising their neighbors were.
+//
+// Uncertainties are tracked for a pool of at most ACTIVE_MAX_POOL candidates spread evenly over the
+// set, and patches are chosen from it; every patch is predicted. Each measurement extends the Cholesky
+// factor by one row and every pooled candidate's projection onto it by one float, so an update costs
+// pool x measurements, a few ms at the 1024 measurement cap. The length scale is chosen by likelihood
+// while measurements double, up to 128, one length scale tried per update. A new one is
+// rebuilt alongside the current model a few measurements per update, and takes over once it has
+// caught up, before the next doubling.
+class ActiveSampler
+{
+public:
+    // Every patch of set is a candidate; at most capacity of them can be measured
+    void Reset(const PatchSet& set, size_t capacity);
+
+    size_t Candidates() const { return m_candidates; }
+    size_t Measured() const { return m_order.size(); }
+    bool IsMeasured(size_t index) const { return m_position[index] != 0; }
+
+    // Patch to measure next, Candidates() once capacity is reached
+    size_t Next() const { return m_next; }
+
+    // Adds the measurement of a patch and updates the model; patches outside the pool are ignored
+    void Add(size_t index, const Measurement& measured);
+
+    // Standard deviation of the predicted Delta E ITP of the least certain unmeasured patch of the pool,
+    // infinite with too few measurements
+    float WorstError() const { return m_worstError; }
+
+    // Length scale of the model in Delta E ITP
+    float LengthScale() const { return m_model.lengthScale; }
+
+    // What the model predicts the meter reads for a patch that was not measured
+    Measurement Predict(size_t index) const;
+
+private:
+    // The factor and projections for one length scale
+    struct Model
+    {
+        float lengthScale = 0.0f;
+        size_t points = 0;                    // measurements folded in
+        std::vector<float> projections;       // per measurement, L^-1 k of every pooled candidate
+        std::vector<double> factor;           // rows of L, row p packed with p + 1 entries
+        std::vector<double> variances;        // per pooled candidate, prior variance less what is explained
+        std::vector<double> surpriseSums;     // per pooled candidate, nearby surprises weighted by the kernel
+        std::vector<double> surpriseWeights;  // per pooled candidate, the kernel weights of those
+        std::vector<double> weights[3];       // per channel and measurement, L^-1 y
+    };
+
+    double Kernel(size_t a, size_t b, float lengthScale) const;
+    void StartModel(Model& model, float lengthScale) const;
+    void Extend(Model& model);
+    double LogLikelihood(size_t count, float lengthScale) const;
+    void SelectLengthScale();
+    void SolveMeans();
+    void FindNext();
+    double SignalVariance() const;
+    void PredictResidual(size_t index, double residual[3]) const;
+
+    size_t m_candidates = 0;
+    size_t m_capacity = 0;
+    std::vector<float> m_targets;      // ICtCp per candidate
+    std::vector<float> m_coordinates;  // per candidate, scaled so distances are Delta E ITP
+    std::vector<size_t> m_position;    // per candidate, 1 + when it was measured, 0 if it was not
+    std::vector<size_t> m_order;       // candidates measured, in order
+    std::vector<double> m_residuals;   // per measurement, measured minus target in the same scaling
+    std::vector<double> m_surprises;   // per measurement, squared error against its prediction relative to the spread
+
+    std::vector<size_t> m_pool;        // candidates the uncertainties are tracked for
+    std::vector<size_t> m_slot;        // per candidate, its place in the pool, m_pool.size() if none
+
+    Model m_model;
+    Model m_rebuild;                   // at a newly chosen length scale, while it catches up
+    bool m_rebuilding = false;
+    size_t m_selectionCount = 0;       // measurements the length scales are being tried on, 0 if none
+    size_t m_selectionStep = 0;        // next length scale to try
+    float m_selectionBest = 0.0f;
+    double m_selectionLikelihood = 0.0;
+    std::vector<double> m_means[3];    // per channel and measurement, K^-1 y of m_model
+    std::vector<double> m_row;         // scratch: the factor's newest row
+    std::vector<float> m_dots;         // scratch: per pooled candidate, the new row times its projection
+
+    size_t m_next = 0;
+    float m_worstError = std::numeric_limits<float>::infinity();
+};
@@ -0,0 +1,244 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    const size_t PAGE_SIZE = 4096;
+    const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    size_t RoundUp(size_t value, size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    // size bytes of whole pages, huge ones if asked for and the system grants them; null on failure
+    void* MapPages(size_t size, bool hugePages, bool& huge)
+    {
+        huge = false;
+#ifdef _WIN32
+        if (hugePages && GetLargePageMinimum() > 0 && size % GetLargePageMinimum() == 0)
+        {
+            void* data = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (data)
+            {
+                huge = true;
+                return data;
+            }
+        }
+        return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+        if (!hugePages)
+        {
+            void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            return data == MAP_FAILED ? nullptr : data;
+        }
+
+        // Transparent huge pages need 2 MB alignment, so map one huge page more and trim both ends
+        size_t padded = size + HUGE_PAGE_SIZE;
+        void* mapped = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            return nullptr;
+        uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+        uintptr_t aligned = RoundUp(start, HUGE_PAGE_SIZE);
+        if (aligned > start)
+            munmap(mapped, aligned - start);
+        if (aligned + size < start + padded)
+            munmap(reinterpret_cast<void*>(aligned + size), start + padded - aligned - size);
+#ifdef MADV_HUGEPAGE
+        huge = madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE) == 0;
+#endif
+        return reinterpret_cast<void*>(aligned);
+#endif
+    }
+
+    void UnmapPages(void* data, size_t size)
+    {
+#ifdef _WIN32
+        (void)size;
+        VirtualFree(data, 0, MEM_RELEASE);
+#else
+        munmap(data, size);
+#endif
+    }
+}
+
+std::string FormatBytes(size_t bytes)
+{
+    char buffer[32];
+    if (bytes >= 1024 * 1024)
+        std::snprintf(buffer, sizeof(buffer), "%.1f MiB", bytes / (1024.0 * 1024.0));
+    else
+        std::snprintf(buffer, sizeof(buffer), "%.1f KiB", bytes / 1024.0);
+    return buffer;
+}
+
+std::string FormatArenaStats(const ArenaStats& stats)
+{
+    std::string text = stats.name + ": " + FormatBytes(stats.highWater) + " high water, " +
+                       FormatBytes(stats.reserved) + " reserved in " + std::to_string(stats.blocks) +
+                       (stats.blocks == 1 ? " block" : " blocks");
+    if (stats.hugeBytes > 0)
+        text += ", " + FormatBytes(stats.hugeBytes) + " on huge pages";
+    return text + "\n";
+}
+
+Arena::Arena(const char* name, size_t blockSize, std::pmr::memory_resource* upstream)
+    : m_name(name), m_blockSize(std::max<size_t>(blockSize, 256)), m_upstream(upstream)
+{
+}
+
+Arena::~Arena()
+{
+    ReleaseBlocks();
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment)
+{
+    // The current block, then blocks kept from earlier frames, then a new one
+    for (;;)
+    {
+        if (m_current < m_blocks.size())
+        {
+            const Block& block = m_blocks[m_current];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+            size_t offset = RoundUp(base + m_offset, alignment) - base;
+            if (offset + bytes <= block.size)
+            {
+                m_used += offset + bytes - m_offset;
+                m_offset = offset + bytes;
+                m_highWater = std::max(m_highWater, m_used);
+                ++m_allocations;
+                return block.data + offset;
+            }
+            if (m_current + 1 < m_blocks.size())
+            {
+                ++m_current;
+                m_offset = 0;
+                continue;
+            }
+        }
+
+        // Allocations too big for a block get a block of their own
+        AddBlock(std::max(m_blockSize, bytes + alignment));
+        m_current = m_blocks.size() - 1;
+        m_offset = 0;
+    }
+}
+
+void Arena::Reset()
+{
+    // One block that holds what all of them did, so the next frame bumps through a single block
+    if (m_blocks.size() > 1)
+    {
+        size_t total = 0;
+        for (const Block& block : m_blocks)
+            total += block.size;
+        ReleaseBlocks();
+        AddBlock(total);
+    }
+    m_current = 0;
+    m_offset = 0;
+    m_used = 0;
+    m_allocations = 0;
+}
+
+ArenaStats Arena::Stats() const
+{
+    ArenaStats stats;
+    stats.name = m_name;
+    stats.used = m_used;
+    stats.highWater = m_highWater;
+    stats.blocks = m_blocks.size();
+    stats.allocations = m_allocations;
+    for (const Block& block : m_blocks)
+        stats.reserved += block.size;
+    return stats;
+}
+
+void Arena::AddBlock(size_t size)
+{
+    char* data = static_cast<char*>(m_upstream->allocate(size, alignof(std::max_align_t)));
+    m_blocks.push_back({ data, size });
+}
+
+void Arena::ReleaseBlocks()
+{
+    for (const Block& block : m_blocks)
+        m_upstream->deallocate(block.data, block.size, alignof(std::max_align_t));
+    m_blocks.clear();
+}
+
+PagePool::PagePool(const char* name, bool hugePages)
+    : m_name(name), m_hugePages(hugePages)
+{
+}
+
+PagePool::~PagePool()
+{
+    for (const Block& block : m_blocks)
+        UnmapPages(block.data, block.size);
+}
+
+void* PagePool::do_allocate(size_t bytes, size_t alignment)
+{
+    if (alignment > PAGE_SIZE)
+        throw std::bad_alloc();
+
+    // Same request, same rounded size, so a freed frame fits the next one of its resolution exactly
+    size_t size = RoundUp(std::max<size_t>(bytes, 1), m_hugePages ? HUGE_PAGE_SIZE : PAGE_SIZE);
+    auto reuse = std::find_if(m_blocks.begin(), m_blocks.end(),
+                             [&](const Block& block) { return !block.inUse && block.size == size; });
+    if (reuse == m_blocks.end())
+    {
+        bool huge = false;
+        void* data = MapPages(size, m_hugePages, huge);
+        if (!data)
+            throw std::bad_alloc();
+        m_blocks.push_back({ data, size, huge, false });
+        reuse = m_blocks.end() - 1;
+    }
+
+    reuse->inUse = true;
+    m_used += reuse->size;
+    m_highWater = std::max(m_highWater, m_used);
+    ++m_allocations;
+    return reuse->data;
+}
+
+void PagePool::do_deallocate(void* pointer, size_t, size_t)
+{
+    auto block = std::find_if(m_blocks.begin(), m_blocks.end(),
+                              [&](const Block& candidate) { return candidate.data == pointer; });
+    if (block != m_blocks.end() && block->inUse)
+    {
+        block->inUse = false;
+        m_used -= block->size;
+    }
+}
+
+ArenaStats PagePool::Stats() const
+{
+    ArenaStats stats;
+    stats.name = m_name;
+    stats.used = m_used;
+    stats.highWater = m_highWater;
+    stats.blocks = m_blocks.size();
+    stats.allocations = m_allocations;
+    for (const Block& block : m_blocks)
+    {
+        stats.reserved += block.size;
+        stats.hugeBytes += block.huge ? block.size : 0;
+    }
+    return stats;
+}
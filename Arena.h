@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Usage of one arena or pool, for telemetry
+struct ArenaStats
+{
+    std::string name;
+    size_t used = 0;        // bytes handed out since the last reset
+    size_t highWater = 0;   // most bytes ever handed out between resets
+    size_t reserved = 0;    // bytes held from the system
+    size_t blocks = 0;
+    size_t allocations = 0; // since the last reset
+    size_t hugeBytes = 0;   // of reserved, on huge pages (on Linux, advised to be)
+};
+
+// "1.5 MiB", or KiB below that
+std::string FormatBytes(size_t bytes);
+
+std::string FormatArenaStats(const ArenaStats& stats);
+
+// Bump allocator for data that lives until the next Reset, like everything built for one frame.
+// Deallocation does nothing; Reset frees it all at once and keeps the blocks, folded into one
+// when the last frame needed several, so a steady loop stops allocating after its first frames.
+// Not thread safe: each render thread or session has its own.
+class Arena : public std::pmr::memory_resource
+{
+public:
+    explicit Arena(const char* name, size_t blockSize = 64 * 1024,
+                   std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+    ~Arena() override;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void Reset();
+    ArenaStats Stats() const;
+
+private:
+    struct Block
+    {
+        char* data;
+        size_t size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    void AddBlock(size_t size);
+    void ReleaseBlocks();
+
+    std::string m_name;
+    size_t m_blockSize;
+    std::pmr::memory_resource* m_upstream;
+    std::vector<Block> m_blocks;
+    size_t m_current = 0;     // block being bumped
+    size_t m_offset = 0;      // into it
+    size_t m_used = 0;
+    size_t m_highWater = 0;
+    size_t m_allocations = 0;
+};
+
+// Fixed-size blocks for large buffers such as full frames, straight from the system in whole pages.
+// Freed blocks go on a free list and come back for the next buffer of the same size, so reallocating
+// a frame of the same resolution costs nothing. With hugePages, blocks are backed by 2 MB pages where
+// the system allows (transparent huge pages on Linux, large pages on Windows with the lock memory
+// privilege), which saves TLB misses when a pass streams a whole frame.
+class PagePool : public std::pmr::memory_resource
+{
+public:
+    explicit PagePool(const char* name, bool hugePages = false);
+    ~PagePool() override;
+
+    PagePool(const PagePool&) = delete;
+    PagePool& operator=(const PagePool&) = delete;
+
+    ArenaStats Stats() const;
+
+private:
+    struct Block
+    {
+        void* data;
+        size_t size;  // rounded up to whole pages
+        bool huge;
+        bool inUse;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::string m_name;
+    bool m_hugePages;
+    std::vector<Block> m_blocks;
+    size_t m_used = 0;
+    size_t m_highWater = 0;
+    size_t m_allocations = 0;
+};
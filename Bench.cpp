@@ -0,0 +1,371 @@
+#include "Arena.h"
+#include "Bench.h"
+#include "CpuRenderer.h"
+#include "DrawList.h"
+#include "Energy.h"
+#include "FalseColor.h"
+#include "Flicker.h"
+#include "GainMap.h"
+#include "Half.h"
+#include "Layout.h"
+#include "Modes.h"
+#include "PatchSet.h"
+#include "Pattern.h"
+#include "Scopes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+    EnergyCounter* g_benchEnergy = nullptr;
+}
+
+void SetBenchEnergyCounter(EnergyCounter* counter)
+{
+    g_benchEnergy = counter;
+}
+
+BenchResult MeasureBenchmark(const std::string& name, size_t iterations, const std::function<void()>& body)
+{
+    BenchResult result;
+    result.name = name;
+    result.iterations = std::max<size_t>(iterations, 1);
+
+    body();
+
+    // Counters are too coarse for single calls, so energy covers the whole timed loop
+    std::vector<double> times(result.iterations);
+    double total = 0.0;
+    double startJoules = 0.0;
+    bool energy = g_benchEnergy && g_benchEnergy->Read(startJoules);
+    for (double& time : times)
+    {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        time = std::chrono::duration<double, std::milli>(end - start).count();
+        total += time;
+    }
+    double endJoules = 0.0;
+    if (energy && g_benchEnergy->Read(endJoules))
+        result.meanMj = (endJoules - startJoules) * 1000.0 / static_cast<double>(times.size());
+
+    std::sort(times.begin(), times.end());
+    result.meanMs = total / static_cast<double>(times.size());
+    result.p50Ms = times[(times.size() - 1) / 2];
+    result.p99Ms = times[std::min(times.size() - 1, static_cast<size_t>(times.size() * 0.99))];
+    return result;
+}
+
+void PrintBenchResults(const std::vector<BenchResult>& results)
+{
+    bool energy = std::any_of(results.begin(), results.end(), [](const BenchResult& result)
+    {
+        return result.meanMj >= 0.0;
+    });
+    std::printf("%-36s %8s %10s %10s %10s", "benchmark", "iters", "mean ms", "p50 ms", "p99 ms");
+    if (energy)
+        std::printf(" %10s", "mean mJ");
+    std::printf("\n");
+    for (const BenchResult& result : results)
+    {
+        std::printf("%-36s %8zu %10.4f %10.4f %10.4f", result.name.c_str(), result.iterations,
+                    result.meanMs, result.p50Ms, result.p99Ms);
+        if (result.meanMj >= 0.0)
+            std::printf(" %10.4f", result.meanMj);
+        else if (energy)
+            std::printf(" %10s", "-");
+        if (!result.note.empty())
+            std::printf("  %s", result.note.c_str());
+        std::printf("\n");
+    }
+}
+
+std::vector<BenchResult> RunCoreBenchmarks(int width, int height, size_t iterations)
+{
+    std::vector<BenchResult> results;
+
+    SessionView view;
+    view.mode = BrightnessMode::MaxWhite;
+    view.brightness = 800.0f;
+    view.increment = 10.0f;
+    PatternLayout layout = ComputePatternLayout(width, height, 1.0f);
+
+    // Pattern building runs once per frame on every backend
+    Pattern pattern;
+    results.push_back(MeasureBenchmark("pattern build", iterations * 100, [&]()
+    {
+        pattern = BuildCalibrationPattern(view, layout);
+    }));
+
+    // Mode dispatch: the registry's indirect call against the same policy called directly,
+    // over a batch of frames so the clock overhead does not dominate
+    const size_t FRAMES = 1000;
+    Pattern reused = pattern;
+    results.push_back(MeasureBenchmark("mode dispatch, direct", iterations, [&]()
+    {
+        for (size_t frame = 0; frame < FRAMES; ++frame)
+            BuildMaxWhitePatternDirect(view, layout, reused);
+    }));
+    results.back().note = "per 1000 frames";
+
+    results.push_back(MeasureBenchmark("mode dispatch, registry", iterations, [&]()
+    {
+        for (size_t frame = 0; frame < FRAMES; ++frame)
+            GetModeInfo(view.mode).buildPattern(view, layout, reused);
+    }));
+    results.back().note = "per 1000 frames";
+
+    SessionView cycling = view;
+    results.push_back(MeasureBenchmark("mode dispatch, registry all modes", iterations, [&]()
+    {
+        for (size_t frame = 0; frame < FRAMES; ++frame)
+        {
+            cycling.mode = static_cast<BrightnessMode>(frame % MODE_COUNT);
+            GetModeInfo(cycling.mode).buildPattern(cycling, layout, reused);
+        }
+    }));
+    results.back().note = "per 1000 frames";
+
+    // The frame loop's allocations: the pattern, a constant APL surround, and a renderer's scratch
+    // with the label rasterized and every rect turned into a clear, on the heap or a frame arena
+    auto buildFrame = [&](std::pmr::memory_resource* resource)
+    {
+        Pattern framePattern(resource);
+        BuildCalibrationPattern(view, layout, framePattern);
+        FillSurround(framePattern, width, height, 100.0f, 1000.0f);
+        std::pmr::vector<PatternRect> rects(framePattern.rects.begin(), framePattern.rects.end(), resource);
+        RasterizeLabel(framePattern.label, rects);
+        std::pmr::vector<PixelRect> clears(resource);
+        for (const PatternRect& rect : rects)
+            clears.push_back(rect.rect);
+    };
+
+    results.push_back(MeasureBenchmark("frame loop, heap", iterations, [&]()
+    {
+        for (size_t frame = 0; frame < FRAMES; ++frame)
+            buildFrame(std::pmr::new_delete_resource());
+    }));
+    results.back().note = "per 1000 frames";
+
+    Arena frameArena("frame arena");
+    results.push_back(MeasureBenchmark("frame loop, frame arena", iterations, [&]()
+    {
+        for (size_t frame = 0; frame < FRAMES; ++frame)
+        {
+            frameArena.Reset();
+            buildFrame(&frameArena);
+        }
+    }));
+    ArenaStats arenaStats = frameArena.Stats();
+    char arenaNote[96];
+    std::snprintf(arenaNote, sizeof(arenaNote), "per 1000 frames, %zu bytes high water", arenaStats.highWater);
+    results.back().note = arenaNote;
+
+    char size[32];
+    std::snprintf(size, sizeof(size), "%dx%d", width, height);
+
+    FrameBuffer frame;
+    frame.Resize(width, height, FrameEncoding::ScRgbHalf);
+    results.push_back(MeasureBenchmark("cpu render scRGB FP16", iterations, [&]()
+    {
+        RenderPatternCpu(pattern, frame);
+    }));
+    results.back().note = size;
+
+    // Uniformity correction: a panel dimming towards its corners, corrected while rendering
+    // and as a pass over a finished frame
+    GainGrid grid;
+    grid.columns = 9;
+    grid.rows = 9;
+    for (int row = 0; row < grid.rows; ++row)
+    {
+        for (int column = 0; column < grid.columns; ++column)
+        {
+            float dx = (column - 4) / 4.0f;
+            float dy = (row - 4) / 4.0f;
+            grid.gains.push_back(1.0f + 0.1f * (dx * dx + dy * dy) / 2.0f);
+        }
+    }
+    GainMap gainMap;
+    gainMap.SetGrid(grid);
+    const char* kernel = GainMap::Vectorized() ? "F16C" : "scalar";
+    char gainNote[64];
+    std::snprintf(gainNote, sizeof(gainNote), "%s, %s", size, kernel);
+
+    results.push_back(MeasureBenchmark("cpu render scRGB FP16 + gain map", iterations, [&]()
+    {
+        RenderPatternCpu(pattern, frame, gainMap);
+    }));
+    results.back().note = gainNote;
+
+    results.push_back(MeasureBenchmark("gain map apply, full frame", iterations, [&]()
+    {
+        gainMap.Apply(frame);
+    }));
+    std::snprintf(gainNote, sizeof(gainNote), "%s, %s, %u threads", size, kernel,
+                  std::max(1u, std::thread::hardware_concurrency()));
+    results.back().note = gainNote;
+
+    // Scopes and false color over the rendered pattern and over noise, where no two neighbors match
+    FrameBuffer noiseFrame;
+    noiseFrame.Resize(width, height, FrameEncoding::ScRgbHalf);
+    uint32_t noise = 1;
+    uint16_t* halves = noiseFrame.Half();
+    for (size_t i = 0; i < static_cast<size_t>(width) * height * 4; ++i)
+    {
+        noise = noise * 1664525u + 1013904223u;
+        halves[i] = FloatToHalf((noise >> 8) * (12.5f / 16777216.0f));
+    }
+
+    // The overlay's sample grid, which should take a few ms on any frame, and every pixel for scale
+    ScopeSettings scopeSettings;
+    ScopeSettings everyPixel;
+    everyPixel.sampleColumns = 0;
+    everyPixel.sampleRows = 0;
+    Scopes scopes;
+    char scopeNote[96];
+    std::snprintf(scopeNote, sizeof(scopeNote), "%s, %dx%d samples, %s, %u threads", size, scopeSettings.sampleColumns,
+                  scopeSettings.sampleRows, ScopesVectorized() ? "F16C" : "scalar",
+                  std::max(1u, std::thread::hardware_concurrency()));
+    std::snprintf(gainNote, sizeof(gainNote), "%s, every pixel, %s, %u threads", size,
+                  ScopesVectorized() ? "F16C" : "scalar", std::max(1u, std::thread::hardware_concurrency()));
+    RenderPatternCpu(pattern, frame);
+    results.push_back(MeasureBenchmark("scopes, full frame", iterations, [&]()
+    {
+        ComputeScopes(frame, scopeSettings, scopes);
+    }));
+    results.back().note = scopeNote;
+
+    results.push_back(MeasureBenchmark("scopes, noise frame", iterations, [&]()
+    {
+        ComputeScopes(noiseFrame, scopeSettings, scopes);
+    }));
+    results.back().note = scopeNote;
+
+    results.push_back(MeasureBenchmark("scopes, noise frame, every pixel", iterations / 10, [&]()
+    {
+        ComputeScopes(noiseFrame, everyPixel, scopes);
+    }));
+    results.back().note = gainNote;
+
+    // Sorting a frame with the scope overlay into batches, thousands of small rects over larger ones
+    ComputeScopes(frame, scopeSettings, scopes);
+    Pattern overlaid = pattern;
+    AddScopeOverlay(scopes, width, height, overlaid);
+    DrawListStats drawStats;
+    results.push_back(MeasureBenchmark("draw list, scope overlay", iterations, [&]()
+    {
+        frameArena.Reset();
+        DrawList draws(&frameArena);
+        draws.Record(overlaid, width, height, true);
+        draws.Optimize();
+        drawStats = draws.Stats();
+    }));
+    char drawNote[96];
+    std::snprintf(drawNote, sizeof(drawNote), "%zu rects in %zu runs to %zu batches", drawStats.recorded,
+                  drawStats.runs, drawStats.batches);
+    results.back().note = drawNote;
+
+    FalseColor falseColor;
+    falseColor.SetRange(0.05f, 800.0f);
+    std::snprintf(gainNote, sizeof(gainNote), "%s, %s, %u threads", size, FalseColor::Vectorized() ? "F16C" : "scalar",
+                  std::max(1u, std::thread::hardware_concurrency()));
+    results.push_back(MeasureBenchmark("false color, full frame", iterations, [&]()
+    {
+        falseColor.Apply(frame);
+    }));
+    results.back().note = gainNote;
+
+    // Mapped noise is still a different color every pixel or so
+    results.push_back(MeasureBenchmark("false color, noise frame", iterations, [&]()
+    {
+        falseColor.Apply(noiseFrame);
+    }));
+    results.back().note = gainNote;
+
+    // The same passes over a frame on huge pages, where the system grants them
+    PagePool hugePages("frame pool", true);
+    FrameBuffer hugeFrame(&hugePages);
+    hugeFrame.Resize(width, height, FrameEncoding::ScRgbHalf);
+    const char* backing = hugePages.Stats().hugeBytes > 0 ? "huge pages" : "huge pages refused";
+    std::snprintf(gainNote, sizeof(gainNote), "%s, %s", size, backing);
+    results.push_back(MeasureBenchmark("cpu render scRGB FP16, huge pages", iterations, [&]()
+    {
+        RenderPatternCpu(pattern, hugeFrame);
+    }));
+    results.back().note = gainNote;
+
+    results.push_back(MeasureBenchmark("gain map apply, huge pages", iterations, [&]()
+    {
+        gainMap.Apply(hugeFrame);
+    }));
+    results.back().note = gainNote;
+
+    frame.Resize(width, height, FrameEncoding::Hdr10Pq);
+    results.push_back(MeasureBenchmark("cpu render HDR10 PQ", iterations, [&]()
+    {
+        RenderPatternCpu(pattern, frame);
+    }));
+    results.back().note = size;
+
+    // Profiling patch sets: generation, a streaming kernel over the arrays, and serialization
+    const size_t PATCHES = 100000;
+    PatchSet patches;
+    results.push_back(MeasureBenchmark("patch set sobol", iterations / 10, [&]()
+    {
+        patches.Clear();
+        GenerateSobol(PATCHES, 0, 0.0f, 1000.0f, patches);
+    }));
+    results.back().note = "100k patches";
+
+    std::vector<float> luminance;
+    results.push_back(MeasureBenchmark("patch set luminance", iterations, [&]()
+    {
+        ComputePatchLuminance(patches, luminance);
+    }));
+    results.back().note = "100k patches";
+
+    std::vector<uint8_t> serialized;
+    results.push_back(MeasureBenchmark("patch set serialize", iterations / 10, [&]()
+    {
+        serialized = SerializePatchSet(patches);
+    }));
+    results.back().note = "100k patches";
+
+    results.push_back(MeasureBenchmark("patch set deserialize", iterations / 10, [&]()
+    {
+        DeserializePatchSet(serialized.data(), serialized.size(), patches);
+    }));
+    results.back().note = "100k patches";
+
+    // A flicker sweep as a meter takes it: 100 levels, each a 1 s capture at 20 kHz, from PWM
+    // barely on to PWM nearly always on
+    const size_t FLICKER_LEVELS = 100;
+    const float FLICKER_RATE = 20000.0f;
+    std::vector<FlickerCapture> captures(FLICKER_LEVELS);
+    for (size_t i = 0; i < FLICKER_LEVELS; ++i)
+    {
+        FlickerWaveform waveform;
+        waveform.frequency = 240.0f;
+        waveform.duty = static_cast<float>(i + 1) / (FLICKER_LEVELS + 1);
+        waveform.mean = 10.0f * (i + 1);
+        waveform.noise = 0.002f;
+        SynthesizeFlicker(waveform, FLICKER_RATE, static_cast<size_t>(FLICKER_RATE), static_cast<uint32_t>(i + 1),
+                          captures[i]);
+        captures[i].level = waveform.mean;
+    }
+    results.push_back(MeasureBenchmark("flicker sweep", std::max<size_t>(iterations / 20, 1), [&]()
+    {
+        AnalyzeFlicker(captures);
+    }));
+    char flickerNote[96];
+    std::snprintf(flickerNote, sizeof(flickerNote), "100 levels of 1 s at 20 kHz, %u threads",
+                  std::max(1u, std::thread::hardware_concurrency()));
+    results.back().note = flickerNote;
+
+    return results;
+}
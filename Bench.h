@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+class EnergyCounter;
+
+struct BenchResult
+{
+    std::string name;
+    size_t iterations = 0;
+    double meanMs = 0.0;
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    double meanMj = -1.0; // energy per iteration, negative without a counter
+    std::string note;
+};
+
+// Energy counter every later benchmark reads before and after its timed calls; null stops it
+void SetBenchEnergyCounter(EnergyCounter* counter);
+
+// Time each call of body separately after one warm-up call
+BenchResult MeasureBenchmark(const std::string& name, size_t iterations, const std::function<void()>& body);
+
+void PrintBenchResults(const std::vector<BenchResult>& results);
+
+// Backend independent benchmarks: pattern building and the CPU reference renderer
+std::vector<BenchResult> RunCoreBenchmarks(int width, int height, size_t iterations);
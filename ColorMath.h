@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// scRGB encodes 80 nits as 1.0 in linear BT.709
+const float SCRGB_WHITE_NITS = 80.0f;
+
+// SMPTE ST 2084 constants
+const float PQ_M1 = 2610.0f / 16384.0f;
+const float PQ_M2 = 2523.0f / 4096.0f * 128.0f;
+const float PQ_C1 = 3424.0f / 4096.0f;
+const float PQ_C2 = 2413.0f / 4096.0f * 32.0f;
+const float PQ_C3 = 2392.0f / 4096.0f * 32.0f;
+const float PQ_MAX_NITS = 10000.0f;
+
+// Absolute luminance in nits to a PQ signal in [0, 1]
+inline float PqEncode(float nits)
+{
+    float y = std::pow(std::clamp(nits / PQ_MAX_NITS, 0.0f, 1.0f), PQ_M1);
+    return std::pow((PQ_C1 + PQ_C2 * y) / (1.0f + PQ_C3 * y), PQ_M2);
+}
+
+// PQ signal in [0, 1] to absolute luminance in nits
+inline float PqDecode(float signal)
+{
+    float e = std::pow(std::clamp(signal, 0.0f, 1.0f), 1.0f / PQ_M2);
+    float y = std::max(e - PQ_C1, 0.0f) / (PQ_C2 - PQ_C3 * e);
+    return PQ_MAX_NITS * std::pow(y, 1.0f / PQ_M1);
+}
+
+// Linear BT.709 primaries to linear BT.2020 primaries
+inline void Bt709ToBt2020(const float in[3], float out[3])
+{
+    out[0] = 0.627404f * in[0] + 0.329283f * in[1] + 0.043313f * in[2];
+    out[1] = 0.069097f * in[0] + 0.919540f * in[1] + 0.011362f * in[2];
+    out[2] = 0.016391f * in[0] + 0.088013f * in[1] + 0.895595f * in[2];
+}
+
+// Linear BT.2020 primaries to linear BT.709 primaries
+inline void Bt2020ToBt709(const float in[3], float out[3])
+{
+    out[0] = 1.660491f * in[0] - 0.587641f * in[1] - 0.072850f * in[2];
+    out[1] = -0.124550f * in[0] + 1.132900f * in[1] - 0.008349f * in[2];
+    out[2] = -0.018151f * in[0] - 0.100579f * in[1] + 1.118730f * in[2];
+}
+
+// Relative luminance of linear BT.709 RGB
+inline float Bt709Luminance(float r, float g, float b)
+{
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+// Relative luminance of linear BT.2020 RGB
+inline float Bt2020Luminance(float r, float g, float b)
+{
+    return 0.262700f * r + 0.677998f * g + 0.059302f * b;
+}
+
+// Linear BT.2020 RGB to CIE 1931 XYZ, D65 white
+inline void Bt2020ToXyz(const float in[3], float out[3])
+{
+    out[0] = 0.636958f * in[0] + 0.144617f * in[1] + 0.168881f * in[2];
+    out[1] = 0.262700f * in[0] + 0.677998f * in[1] + 0.059302f * in[2];
+    out[2] = 0.000000f * in[0] + 0.028073f * in[1] + 1.060985f * in[2];
+}
+
+// CIE 1931 XYZ to linear BT.2020 RGB
+inline void XyzToBt2020(const float in[3], float out[3])
+{
+    out[0] = 1.716651f * in[0] - 0.355671f * in[1] - 0.253366f * in[2];
+    out[1] = -0.666684f * in[0] + 1.616481f * in[1] + 0.015769f * in[2];
+    out[2] = 0.017640f * in[0] - 0.042771f * in[1] + 0.942103f * in[2];
+}
+
+// Luminance and chromaticity to XYZ; a chromaticity with y = 0 is treated as black
+inline void XyYToXyz(float luminance, float x, float y, float out[3])
+{
+    float scale = y > 0.0f ? luminance / y : 0.0f;
+    out[0] = x * scale;
+    out[1] = y > 0.0f ? luminance : 0.0f;
+    out[2] = (1.0f - x - y) * scale;
+}
+
+// Linear BT.2020 RGB in nits to ICtCp (BT.2100, PQ)
+inline void Bt2020ToIctcp(const float in[3], float out[3])
+{
+    float l = PqEncode((1688.0f * in[0] + 2146.0f * in[1] + 262.0f * in[2]) / 4096.0f);
+    float m = PqEncode((683.0f * in[0] + 2951.0f * in[1] + 462.0f * in[2]) / 4096.0f);
+    float s = PqEncode((99.0f * in[0] + 309.0f * in[1] + 3688.0f * in[2]) / 4096.0f);
+    out[0] = 0.5f * l + 0.5f * m;
+    out[1] = (6610.0f * l - 13613.0f * m + 7003.0f * s) / 4096.0f;
+    out[2] = (17933.0f * l - 17390.0f * m - 543.0f * s) / 4096.0f;
+}
+
+// ICtCp (BT.2100, PQ) to linear BT.2020 RGB in nits
+inline void IctcpToBt2020(const float in[3], float out[3])
+{
+    float l = PqDecode(in[0] + 0.008609f * in[1] + 0.111030f * in[2]);
+    float m = PqDecode(in[0] - 0.008609f * in[1] - 0.111030f * in[2]);
+    float s = PqDecode(in[0] + 0.560031f * in[1] - 0.320627f * in[2]);
+    out[0] = 3.436607f * l - 2.506452f * m + 0.069845f * s;
+    out[1] = -0.791330f * l + 1.983600f * m - 0.192271f * s;
+    out[2] = -0.025950f * l - 0.098914f * m + 1.124864f * s;
+}
+
+// Color difference of two ICtCp colors (BT.2124); 1 is about one just noticeable difference
+inline float DeltaEItp(const float a[3], const float b[3])
+{
+    float di = a[0] - b[0];
+    float dt = 0.5f * (a[1] - b[1]);
+    float dp = a[2] - b[2];
+    return 720.0f * std::sqrt(di * di + dt * dt + dp * dp);
+}
@@ -0,0 +1,128 @@
+#include "CpuRenderer.h"
+#include "ColorMath.h"
+#include "GainMap.h"
+#include "Half.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    template <typename PixelType>
+    void FillRect(FrameBuffer& frame, const PixelRect& rect, PixelType pixel)
+    {
+        int left = std::max(rect.left, 0);
+        int top = std::max(rect.top, 0);
+        int right = std::min(rect.right, frame.width);
+        int bottom = std::min(rect.bottom, frame.height);
+        if (left >= right || top >= bottom)
+            return;
+
+        PixelType* pixels = reinterpret_cast<PixelType*>(frame.data.data());
+        for (int y = top; y < bottom; ++y)
+            std::fill(pixels + static_cast<size_t>(y) * frame.width + left,
+                      pixels + static_cast<size_t>(y) * frame.width + right, pixel);
+    }
+
+    template <typename PixelType, typename Encoder>
+    void RenderWith(const Pattern& pattern, FrameBuffer& frame, Encoder encode)
+    {
+        PixelRect full;
+        full.right = frame.width;
+        full.bottom = frame.height;
+        FillRect(frame, full, static_cast<PixelType>(encode(pattern.background)));
+
+        for (const PatternRect& rect : pattern.rects)
+            FillRect(frame, rect.rect, static_cast<PixelType>(encode(rect.color)));
+
+        // Scratch from wherever the pattern lives, the frame arena in a frame loop
+        std::pmr::vector<PatternRect> glyphs(pattern.rects.get_allocator().resource());
+        RasterizeLabel(pattern.label, glyphs);
+        if (!glyphs.empty())
+        {
+            PixelType pixel = static_cast<PixelType>(encode(pattern.label.color));
+            for (const PatternRect& glyph : glyphs)
+                FillRect(frame, glyph.rect, pixel);
+        }
+    }
+}
+
+uint64_t EncodeScRgbPixel(const ScRgb& color)
+{
+    return static_cast<uint64_t>(FloatToHalf(color.r)) |
+           (static_cast<uint64_t>(FloatToHalf(color.g)) << 16) |
+           (static_cast<uint64_t>(FloatToHalf(color.b)) << 32) |
+           (static_cast<uint64_t>(FloatToHalf(1.0f)) << 48);
+}
+
+uint32_t EncodePqPixel(const ScRgb& color)
+{
+    float bt709[3] = { color.r * SCRGB_WHITE_NITS, color.g * SCRGB_WHITE_NITS, color.b * SCRGB_WHITE_NITS };
+    float bt2020[3];
+    Bt709ToBt2020(bt709, bt2020);
+
+    uint32_t code[3];
+    for (int c = 0; c < 3; ++c)
+        code[c] = static_cast<uint32_t>(std::lround(PqEncode(bt2020[c]) * 1023.0f));
+    return code[0] | (code[1] << 10) | (code[2] << 20) | (3u << 30);
+}
+
+void RenderPatternCpu(const Pattern& pattern, FrameBuffer& frame)
+{
+    if (frame.encoding == FrameEncoding::ScRgbHalf)
+        RenderWith<uint64_t>(pattern, frame, EncodeScRgbPixel);
+    else
+        RenderWith<uint32_t>(pattern, frame, EncodePqPixel);
+}
+
+void RenderDrawListCpu(const DrawList& list, FrameBuffer& frame)
+{
+    auto replay = [&](auto encode)
+    {
+        using PixelType = decltype(encode(list.Background()));
+        PixelRect full;
+        full.right = frame.width;
+        full.bottom = frame.height;
+        FillRect(frame, full, encode(list.Background()));
+
+        for (const DrawBatch& batch : list.Batches())
+        {
+            PixelType pixel = encode(batch.color);
+            for (size_t i = batch.first; i < batch.first + batch.count; ++i)
+                FillRect(frame, list.Rects()[i].rect, pixel);
+        }
+    };
+
+    if (frame.encoding == FrameEncoding::ScRgbHalf)
+        replay(EncodeScRgbPixel);
+    else
+        replay(EncodePqPixel);
+}
+
+void RenderPatternCpu(const Pattern& pattern, FrameBuffer& frame, GainMap& gainMap)
+{
+    if (frame.encoding != FrameEncoding::ScRgbHalf || gainMap.Empty())
+        return RenderPatternCpu(pattern, frame);
+
+    // Black stays black at any gain, so it keeps the plain fill
+    auto fill = [&](const PixelRect& rect, const ScRgb& color)
+    {
+        if (color.r == 0.0f && color.g == 0.0f && color.b == 0.0f)
+            FillRect(frame, rect, EncodeScRgbPixel(color));
+        else
+            gainMap.FillRect(frame, rect, color);
+    };
+
+    PixelRect full;
+    full.right = frame.width;
+    full.bottom = frame.height;
+    fill(full, pattern.background);
+
+    for (const PatternRect& rect : pattern.rects)
+        fill(rect.rect, rect.color);
+
+    std::pmr::vector<PatternRect> glyphs(pattern.rects.get_allocator().resource());
+    RasterizeLabel(pattern.label, glyphs);
+    for (const PatternRect& glyph : glyphs)
+        fill(glyph.rect, pattern.label.color);
+}
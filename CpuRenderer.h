@@ -0,0 +1,24 @@
+#pragma once
+
+#include "DrawList.h"
+#include "FrameBuffer.h"
+#include "Pattern.h"
+
+class GainMap;
+
+#include <cstdint>
+
+// One RGBA FP16 pixel as stored in memory, alpha 1
+uint64_t EncodeScRgbPixel(const ScRgb& color);
+
+// One A2B10G10R10 pixel, PQ encoded in BT.2020, alpha 1
+uint32_t EncodePqPixel(const ScRgb& color);
+
+// Reference renderer: the exact pixels every backend is expected to produce
+void RenderPatternCpu(const Pattern& pattern, FrameBuffer& frame);
+
+// A recorded draw list replayed batch by batch, which must give the same pixels as its pattern
+void RenderDrawListCpu(const DrawList& list, FrameBuffer& frame);
+
+// Same pattern with each pixel scaled by a uniformity gain map; scRGB frames only
+void RenderPatternCpu(const Pattern& pattern, FrameBuffer& frame, GainMap& gainMap);
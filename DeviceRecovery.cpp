@@ -0,0 +1,165 @@
+#include "DeviceRecovery.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+    double NowMs()
+    {
+        using namespace std::chrono;
+        return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+std::string FormatRecoveryStats(const RecoveryStats& stats)
+{
+    char buffer[160];
+    std::snprintf(buffer, sizeof(buffer), "device recovery: %zu %s, %zu %s in %zu %s, last %.1f ms, worst %.1f ms",
+                  stats.losses, stats.losses == 1 ? "loss" : "losses", stats.recoveries,
+                  stats.recoveries == 1 ? "recovery" : "recoveries", stats.attempts,
+                  stats.attempts == 1 ? "attempt" : "attempts", stats.lastMs, stats.worstMs);
+    std::string text = buffer;
+    if (!stats.lastReason.empty())
+        text += " (" + stats.lastReason + ")";
+    if (!stats.lastError.empty())
+        text += ", last failure: " + stats.lastError;
+    return text + "\n";
+}
+
+void DeviceRecovery::AddStep(const std::string& name, CreateStep create)
+{
+    m_steps.push_back(Step{ name, std::move(create) });
+}
+
+void DeviceRecovery::SetRelease(std::function<void()> release)
+{
+    m_release = std::move(release);
+}
+
+bool DeviceRecovery::RunSteps(std::string& error)
+{
+    for (const Step& step : m_steps)
+    {
+        std::string stepError;
+        if (!step.create(stepError))
+        {
+            error = step.name + (stepError.empty() ? " failed" : ": " + stepError);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DeviceRecovery::Create(std::string& error)
+{
+    if (RunSteps(error))
+        return true;
+    if (m_release)
+        m_release();
+    return false;
+}
+
+void DeviceRecovery::ReportLost(const std::string& reason)
+{
+    // Later calls of the same frame usually fail too; the first one is the one to report
+    if (m_lost)
+        return;
+    m_lost = true;
+    m_lostAt = NowMs();
+    ++m_stats.losses;
+    m_stats.lastReason = reason;
+}
+
+bool DeviceRecovery::Recover()
+{
+    if (!m_lost)
+        return true;
+
+    for (int attempt = 0; attempt < std::max(1, m_policy.attempts); ++attempt)
+    {
+        if (attempt > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_policy.retryMs));
+
+        ++m_stats.attempts;
+        if (m_release)
+            m_release();
+        std::string error;
+        if (RunSteps(error))
+        {
+            m_lost = false;
+            ++m_stats.recoveries;
+            m_stats.lastMs = NowMs() - m_lostAt;
+            m_stats.worstMs = std::max(m_stats.worstMs, m_stats.lastMs);
+            return true;
+        }
+        m_stats.lastError = error;
+    }
+    return false;
+}
+
+bool FaultyDevice::CreateDevice(std::string& error)
+{
+    if (m_plan.createMs > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_plan.createMs));
+    if (!AdapterCurrent())
+    {
+        error = "adapter removed";
+        return false;
+    }
+    if (m_refusals > 0)
+    {
+        --m_refusals;
+        error = "driver still resetting";
+        return false;
+    }
+    m_alive = true;
+    ++m_generation;
+    return true;
+}
+
+bool FaultyDevice::CreateObject(const std::string& name, std::string& error)
+{
+    if (!m_alive)
+    {
+        error = "no device for " + name;
+        return false;
+    }
+    m_objects.push_back(name);
+    return true;
+}
+
+void FaultyDevice::Release()
+{
+    m_objects.clear();
+    m_alive = false;
+}
+
+bool FaultyDevice::Use(const std::string& name) const
+{
+    return m_alive && std::find(m_objects.begin(), m_objects.end(), name) != m_objects.end();
+}
+
+bool FaultyDevice::Present(std::string& error)
+{
+    ++m_frames;
+    if (!m_alive)
+    {
+        error = "Present: no device";
+        return false;
+    }
+    if (m_plan.loseEvery > 0 && m_frames % m_plan.loseEvery == 0)
+    {
+        // The objects stay listed until released, as COM references outlive a removed device
+        m_alive = false;
+        m_refusals = m_plan.failedCreates;
+        ++m_losses;
+        if (m_plan.replaceAdapterEvery > 0 && m_losses % m_plan.replaceAdapterEvery == 0)
+            ++m_systemAdapter;
+        error = "Present: device removed";
+        return false;
+    }
+    return true;
+}
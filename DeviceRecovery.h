@@ -0,0 +1,118 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// How hard Recover tries. A driver reset can refuse new devices for a while, so failed rebuilds
+// are retried after a wait.
+struct RecoveryPolicy
+{
+    int attempts = 10; // rebuilds per Recover call
+    int retryMs = 25;  // wait between them
+};
+
+struct RecoveryStats
+{
+    size_t losses = 0;
+    size_t recoveries = 0;
+    size_t attempts = 0;     // rebuilds tried, the failed ones included
+    double lastMs = 0.0;     // from the loss being reported to the device working again
+    double worstMs = 0.0;
+    std::string lastReason;  // where the last loss was seen
+    std::string lastError;   // why the last failed rebuild failed
+};
+
+// "device recovery: 2 losses, 2 recoveries in 3 attempts, last 41.5 ms, worst 62.0 ms (Present: ...)"
+std::string FormatRecoveryStats(const RecoveryStats& stats);
+
+// Rebuilds a backend's device objects after the device is lost, as after a driver reset or a
+// removed GPU. The objects are listed as a manifest: steps that each create a group of them in
+// order, and one release that drops all of them, however far the steps got. Only device objects
+// belong in it; the session, the layout and everything else the frames are built from live
+// outside and carry on unchanged.
+class DeviceRecovery
+{
+public:
+    using CreateStep = std::function<bool(std::string& error)>;
+
+    explicit DeviceRecovery(const RecoveryPolicy& policy = RecoveryPolicy()) : m_policy(policy) {}
+
+    void AddStep(const std::string& name, CreateStep create);
+    void SetRelease(std::function<void()> release);
+
+    // The first build, not retried; on failure error names the step
+    bool Create(std::string& error);
+
+    // A call returned a device lost code; reason says which, like "Present: 0x887A0005"
+    void ReportLost(const std::string& reason);
+    bool IsLost() const { return m_lost; }
+
+    // While lost, before the next frame: release everything and run the steps again, retrying
+    // as the policy says. True once the device works; when every attempt failed it stays lost
+    // and the next call tries again.
+    bool Recover();
+
+    const RecoveryStats& Stats() const { return m_stats; }
+
+private:
+    bool RunSteps(std::string& error);
+
+    struct Step
+    {
+        std::string name;
+        CreateStep create;
+    };
+
+    RecoveryPolicy m_policy;
+    std::vector<Step> m_steps;
+    std::function<void()> m_release;
+    bool m_lost = false;
+    double m_lostAt = 0.0; // ms on the steady clock
+    RecoveryStats m_stats;
+};
+
+// When and how a FaultyDevice fails
+struct DeviceFaultPlan
+{
+    int loseEvery = 0;     // frames between losses, 0 for never
+    int failedCreates = 0; // device creations refused after each loss, as while a driver resets
+    int createMs = 0;      // time creating the device takes; other objects are free
+    int replaceAdapterEvery = 0; // losses between adapter replacements, as by a driver upgrade, 0 for never
+};
+
+// Stand-in for a GPU device that is lost on a schedule, for driving DeviceRecovery without one.
+// Objects are tracked by name and belong to the device they were created on, so a frame that
+// uses one the manifest did not rebuild fails like a call on a released object would.
+class FaultyDevice
+{
+public:
+    explicit FaultyDevice(const DeviceFaultPlan& plan) : m_plan(plan) {}
+
+    // A replaced adapter takes no new devices until it is enumerated again
+    bool AdapterCurrent() const { return m_adapter == m_systemAdapter; }
+    void EnumerateAdapter() { m_adapter = m_systemAdapter; }
+
+    bool CreateDevice(std::string& error);
+    bool CreateObject(const std::string& name, std::string& error);
+    void Release();
+
+    // True when the object exists on the current device
+    bool Use(const std::string& name) const;
+
+    // Ends a frame; false with a reason when this is the frame the device is lost on
+    bool Present(std::string& error);
+
+    int Generation() const { return m_generation; } // devices created so far
+
+private:
+    DeviceFaultPlan m_plan;
+    bool m_alive = false;
+    int m_generation = 0;
+    int m_refusals = 0;   // creations still to refuse
+    int m_losses = 0;
+    int m_adapter = 0;       // the adapter devices are created on
+    int m_systemAdapter = 0; // the one the system has now
+    size_t m_frames = 0;
+    std::vector<std::string> m_objects;
+};
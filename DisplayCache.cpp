@@ -0,0 +1,168 @@
+#include "DisplayCache.h"
+#include "Edid.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+    // Round down to 1, 2 or 5 times a power of ten so labels stay readable
+    float NiceStep(float value)
+    {
+        float magnitude = std::pow(10.0f, std::floor(std::log10(value)));
+        float normalized = value / magnitude;
+        if (normalized >= 5.0f)
+            return 5.0f * magnitude;
+        if (normalized >= 2.0f)
+            return 2.0f * magnitude;
+        return magnitude;
+    }
+
+    void SeedMaxWhite(CalibrationSeed& seed, float peak)
+    {
+        seed.maxWhiteIncrement = std::clamp(NiceStep(peak / 200.0f), 1.0f, 10.0f);
+        // A peak advertised below one step still starts a step up rather than at black
+        seed.maxWhite = std::clamp(std::round(peak / seed.maxWhiteIncrement) * seed.maxWhiteIncrement,
+                                   seed.maxWhiteIncrement, 10000.0f);
+        seed.maxWhiteRange = std::clamp(std::ceil(peak * 2.0f / 1000.0f) * 1000.0f, 1000.0f, 10000.0f);
+    }
+
+    void SeedMinBlack(CalibrationSeed& seed, float black)
+    {
+        seed.minBlackIncrement = std::clamp(NiceStep(black / 10.0f), 0.0001f, 0.01f);
+        seed.minBlack = std::min(std::round(black / seed.minBlackIncrement) * seed.minBlackIncrement, 1.0f);
+        seed.minBlackRange = std::clamp(black * 10.0f, 0.1f, 1.0f);
+    }
+}
+
+bool DisplayCache::Load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string hash;
+        DisplayRecord record;
+        if (!(fields >> hash >> record.maxWhite >> record.minBlack))
+            continue;
+        m_records[std::strtoull(hash.c_str(), nullptr, 16)] = record;
+    }
+    return true;
+}
+
+bool DisplayCache::Save(const std::string& path) const
+{
+    // Write a sibling file and rename so a crash never leaves a truncated cache
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        if (!file)
+            return false;
+        // Enough digits to read back the same floats
+        file.precision(std::numeric_limits<float>::max_digits10);
+        for (const auto& entry : m_records)
+        {
+            char hash[17];
+            std::snprintf(hash, sizeof(hash), "%016" PRIx64, entry.first);
+            file << hash << ' ' << entry.second.maxWhite << ' ' << entry.second.minBlack << '\n';
+        }
+        if (!file)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+const DisplayRecord* DisplayCache::Find(uint64_t displayHash) const
+{
+    auto it = m_records.find(displayHash);
+    return it != m_records.end() ? &it->second : nullptr;
+}
+
+void DisplayCache::Store(uint64_t displayHash, const DisplayRecord& record)
+{
+    if (record.maxWhite <= 0.0f && record.minBlack < 0.0f)
+        return;
+    DisplayRecord& stored = m_records[displayHash];
+    if (record.maxWhite > 0.0f)
+        stored.maxWhite = record.maxWhite;
+    if (record.minBlack >= 0.0f)
+        stored.minBlack = record.minBlack;
+}
+
+CalibrationSeed SeedCalibration(const DisplayInfo* info, const DisplayRecord* cached)
+{
+    CalibrationSeed seed;
+
+    if (info)
+    {
+        const AdvertisedLuminance& luminance = info->luminance;
+        float peak = luminance.maxLuminance > 0.0f ? luminance.maxLuminance : luminance.maxFrameAverage;
+        if (peak > 0.0f)
+        {
+            SeedMaxWhite(seed, peak);
+            seed.source = SeedSource::Advertised;
+        }
+        if (luminance.minLuminance > 0.0f)
+        {
+            SeedMinBlack(seed, luminance.minLuminance);
+            seed.source = SeedSource::Advertised;
+        }
+    }
+
+    if (cached)
+    {
+        if (cached->maxWhite > 0.0f)
+        {
+            SeedMaxWhite(seed, cached->maxWhite);
+            seed.maxWhite = std::min(cached->maxWhite, seed.maxWhiteRange);
+            seed.source = SeedSource::Cached;
+        }
+        if (cached->minBlack >= 0.0f)
+        {
+            // A black of exactly 0 is a valid result on emissive panels
+            SeedMinBlack(seed, std::max(cached->minBlack, 0.0001f));
+            seed.minBlack = std::min(cached->minBlack, seed.minBlackRange);
+            seed.source = SeedSource::Cached;
+        }
+    }
+
+    return seed;
+}
+
+std::string GetDataDirectory()
+{
+    std::filesystem::path directory;
+#ifdef _WIN32
+    const char* base = std::getenv("LOCALAPPDATA");
+    directory = base ? std::filesystem::path(base) : std::filesystem::temp_directory_path();
+    directory /= "hdr-calib";
+#else
+    const char* base = std::getenv("XDG_DATA_HOME");
+    const char* home = std::getenv("HOME");
+    if (base && *base)
+        directory = base;
+    else if (home)
+        directory = std::filesystem::path(home) / ".local" / "share";
+    else
+        directory = std::filesystem::temp_directory_path();
+    directory /= "hdr-calib";
+#endif
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    return directory.string();
+}
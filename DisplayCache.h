@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+struct DisplayInfo;
+
+// Result of a finished or interrupted session on one display. A level that was never
+// calibrated is negative, and storing it keeps the level cached before.
+struct DisplayRecord
+{
+    float maxWhite = -1.0f; // nits
+    float minBlack = -1.0f; // nits
+};
+
+// Previous calibration results keyed by DisplayIdentity::Hash()
+class DisplayCache
+{
+public:
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+
+    const DisplayRecord* Find(uint64_t displayHash) const;
+    void Store(uint64_t displayHash, const DisplayRecord& record);
+
+private:
+    std::map<uint64_t, DisplayRecord> m_records;
+};
+
+enum class SeedSource
+{
+    Defaults,
+    Advertised,
+    Cached
+};
+
+// Starting levels and adjustment ranges for a session
+struct CalibrationSeed
+{
+    SeedSource source = SeedSource::Defaults;
+    float maxWhite = 800.0f;
+    float minBlack = 0.1f;
+    float maxWhiteIncrement = 10.0f;
+    float minBlackIncrement = 0.01f;
+    float maxWhiteRange = 10000.0f;
+    float minBlackRange = 1.0f;
+};
+
+// Cached results win over advertised luminance, which wins over the defaults.
+// Known displays start close to their answer, so they also get finer steps;
+// a cached level is the starting level as it was calibrated, not rounded to them.
+CalibrationSeed SeedCalibration(const DisplayInfo* info, const DisplayRecord* cached);
+
+// Per-user directory for the cache and other state files, created on demand
+std::string GetDataDirectory();
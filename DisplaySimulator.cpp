@@ -0,0 +1,155 @@
+#include "DisplaySimulator.h"
+#include "ColorMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    float RequestedNits(const ScRgb& color)
+    {
+        return std::max(0.0f, Bt709Luminance(color.r, color.g, color.b) * SCRGB_WHITE_NITS);
+    }
+
+    // Color on top at one pixel; rects are drawn in order, so the last one containing it wins
+    const ScRgb& ColorAt(const Pattern& pattern, int x, int y)
+    {
+        for (auto it = pattern.rects.rbegin(); it != pattern.rects.rend(); ++it)
+        {
+            const PixelRect& rect = it->rect;
+            if (x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom)
+                return it->color;
+        }
+        return pattern.background;
+    }
+}
+
+DisplaySimulator::DisplaySimulator(const PanelModel& model)
+    : m_model(model)
+{
+    m_from = m_model.black;
+    m_limitFrom = m_limitTarget = m_model.peak10;
+}
+
+void DisplaySimulator::SetProbe(float x, float y)
+{
+    m_probeX = std::clamp(x, 0.0f, 1.0f);
+    m_probeY = std::clamp(y, 0.0f, 1.0f);
+}
+
+void DisplaySimulator::Show(const Pattern& pattern, int width, int height, double timeMs)
+{
+    // Where the light and the limiter were when the frame changed
+    m_from = Settled(timeMs);
+    m_limitFrom = AllowedPeak(timeMs);
+
+    const float peak = std::max(m_model.peak10, 1.0f);
+    m_averageLevel = PatternAverageNits(pattern, width, height, peak) / peak;
+
+    // Up to a 10% window the panel reaches its peak; larger bright areas fall off towards
+    // the full field level, interpolated in log luminance over log area
+    float fullField = std::clamp(m_model.fullField, 1.0f, peak);
+    float t = m_averageLevel <= 0.1f ? 0.0f : std::log(m_averageLevel / 0.1f) / std::log(10.0f);
+    m_limitTarget = peak * std::pow(fullField / peak, std::clamp(t, 0.0f, 1.0f));
+
+    // Squared distance from the center is 0.5 in the corners
+    float dx = m_probeX - 0.5f;
+    float dy = m_probeY - 0.5f;
+    m_probeFalloff = 1.0f - m_model.vignette * std::min(1.0f, 2.0f * (dx * dx + dy * dy));
+
+    int probeX = std::min(width - 1, static_cast<int>(m_probeX * width));
+    int probeY = std::min(height - 1, static_cast<int>(m_probeY * height));
+    const ScRgb& probed = ColorAt(pattern, probeX, probeY);
+    m_requested = RequestedNits(probed);
+    m_changeMs = timeMs;
+
+    // The panel covers BT.2020: components outside it are clipped, black keeps the previous chromaticity
+    const float bt709[3] = { probed.r, probed.g, probed.b };
+    float bt2020[3];
+    float xyz[3];
+    Bt709ToBt2020(bt709, bt2020);
+    for (float& component : bt2020)
+        component = std::max(component, 0.0f);
+    Bt2020ToXyz(bt2020, xyz);
+    float sum = xyz[0] + xyz[1] + xyz[2];
+    if (sum > 0.0f)
+    {
+        m_x = xyz[0] / sum;
+        m_y = xyz[1] / sum;
+    }
+}
+
+float DisplaySimulator::Luminance(double timeMs) const
+{
+    if (m_model.warmup <= 0.0f || m_model.warmupMinutes <= 0.0f)
+        return Settled(timeMs);
+    double minutes = std::max(0.0, timeMs) / 60000.0;
+    float missing = m_model.warmup * static_cast<float>(std::exp(-minutes / m_model.warmupMinutes));
+    return Settled(timeMs) * (1.0f - std::min(missing, 1.0f));
+}
+
+float DisplaySimulator::Settled(double timeMs) const
+{
+    float target = Displayed(m_requested, AllowedPeak(timeMs));
+    if (m_model.settleMs <= 0.0f)
+        return target;
+    double elapsed = std::max(0.0, timeMs - m_changeMs);
+    float remaining = static_cast<float>(std::exp(-elapsed / m_model.settleMs));
+    return target + (m_from - target) * remaining;
+}
+
+float DisplaySimulator::AllowedPeak(double timeMs) const
+{
+    if (m_model.limiterMs <= 0.0f)
+        return m_limitTarget;
+    double elapsed = std::max(0.0, timeMs - m_changeMs);
+    float remaining = static_cast<float>(std::exp(-elapsed / m_model.limiterMs));
+    return m_limitTarget + (m_limitFrom - m_limitTarget) * remaining;
+}
+
+double DisplaySimulator::SettleTimeMs(float tolerance) const
+{
+    // The pixels start off by pixel and close exponentially; the limiter moves the target by at
+    // most limit, shrinking with its own time constant. Their sum only falls, so bisect it.
+    float start = Displayed(m_requested, m_limitFrom);
+    float final = Displayed(m_requested, m_limitTarget);
+    double pixel = m_model.settleMs > 0.0f ? std::abs(m_from - start) : 0.0;
+    double limit = m_model.limiterMs > 0.0f ? std::abs(start - final) : 0.0;
+    double allowed = std::max(static_cast<double>(tolerance) * final, 1e-6);
+    auto error = [&](double ms)
+    {
+        return (pixel > 0.0 ? pixel * std::exp(-ms / m_model.settleMs) : 0.0) +
+               (limit > 0.0 ? limit * std::exp(-ms / m_model.limiterMs) : 0.0);
+    };
+    if (error(0.0) <= allowed)
+        return 0.0;
+
+    double low = 0.0;
+    double high = 1.0;
+    while (error(high) > allowed)
+        high *= 2.0;
+    for (int i = 0; i < 40; ++i)
+    {
+        double middle = 0.5 * (low + high);
+        (error(middle) > allowed ? low : high) = middle;
+    }
+    return high;
+}
+
+float DisplaySimulator::Instantaneous(double timeMs) const
+{
+    float luminance = Luminance(timeMs);
+    if (m_model.pwmHz <= 0.0f || m_model.pwmDuty >= 1.0f)
+        return luminance;
+
+    // Square wave with the same mean as the steady output
+    double periodMs = 1000.0 / m_model.pwmHz;
+    double phase = std::fmod(timeMs, periodMs) / periodMs;
+    float duty = std::max(m_model.pwmDuty, 0.01f);
+    return phase < duty ? luminance / duty : 0.0f;
+}
+
+float DisplaySimulator::Displayed(float requested, float allowedPeak) const
+{
+    return std::max(m_model.black, m_model.gain * m_probeFalloff * std::min(requested, allowedPeak));
+}
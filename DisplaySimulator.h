@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Pattern.h"
+
+// Light output of an HDR panel, enough to run the calibration steps without one
+struct PanelModel
+{
+    float peak10 = 1000.0f;   // nits a 10% window reaches
+    float fullField = 400.0f; // nits a full white screen reaches before the power limiter dims it
+    float black = 0.05f;      // light leaking through at 0 nits
+    float gain = 1.0f;        // luminance error, 1 is accurate
+    float pwmHz = 0.0f;       // backlight modulation, 0 for none
+    float pwmDuty = 1.0f;     // share of each period the backlight is on
+    float settleMs = 0.0f;    // time constant of the response to a new frame
+    float limiterMs = 0.0f;   // time constant of the power limiter following a new average picture level
+    float vignette = 0.0f;    // share of the light lost in the corners, falling off with distance squared
+    float warmup = 0.0f;      // share of the light missing at power-on (time 0), recovering exponentially
+    float warmupMinutes = 10.0f; // time constant of that recovery
+};
+
+// Simulated display measured at one point, where a meter sits; the center unless moved.
+// Times are milliseconds on the caller's clock, which only has to move forward.
+class DisplaySimulator
+{
+public:
+    explicit DisplaySimulator(const PanelModel& model = PanelModel());
+
+    const PanelModel& Model() const { return m_model; }
+    void SetModel(const PanelModel& model) { m_model = model; }
+
+    // Where the meter sits, as a share of the screen width and height; applies from the next Show
+    void SetProbe(float x, float y);
+    float ProbeX() const { return m_probeX; }
+    float ProbeY() const { return m_probeY; }
+
+    // Start showing a frame; the luminance at the probe moves towards it from what was shown before
+    void Show(const Pattern& pattern, int width, int height, double timeMs);
+
+    // Mean light at the probe, ignoring PWM; a panel still warming up gives less
+    float Luminance(double timeMs) const;
+
+    // Light at the probe at one instant, including PWM
+    float Instantaneous(double timeMs) const;
+
+    // CIE 1931 chromaticity at the probe; the panel reproduces the requested color exactly
+    float ChromaticityX() const { return m_x; }
+    float ChromaticityY() const { return m_y; }
+
+    // Frame average of the signal relative to a full white screen at the 10% peak, 0 to 1
+    float AveragePictureLevel() const { return m_averageLevel; }
+
+    // Time from the last Show until the light at the probe is within tolerance (a share) of where
+    // it ends up, as an upper bound from the pixel response and the power limiter
+    double SettleTimeMs(float tolerance) const;
+
+private:
+    float Displayed(float requested, float allowedPeak) const;
+    float AllowedPeak(double timeMs) const;
+    float Settled(double timeMs) const; // Luminance before warm-up
+
+    float m_probeX = 0.5f;
+    float m_probeY = 0.5f;
+    float m_probeFalloff = 1.0f; // vignette at the probe
+
+    PanelModel m_model;
+    float m_from = 0.0f;
+    float m_requested = 0.0f;   // nits asked for at the probe
+    double m_changeMs = 0.0;
+    float m_averageLevel = 0.0f;
+    float m_limitFrom = 0.0f;   // peak the limiter allowed when the frame changed
+    float m_limitTarget = 0.0f; // peak it settles at for this frame
+    float m_x = 0.3127f; // D65 until something is shown
+    float m_y = 0.3290f;
+};
@@ -0,0 +1,273 @@
+#include "DrawList.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    // Grid cell of the spatial hash Optimize uses to find rects that might overlap
+    const int CELL_SIZE = 32;
+
+    bool SameColor(const ScRgb& a, const ScRgb& b)
+    {
+        return a.r == b.r && a.g == b.g && a.b == b.b;
+    }
+
+    bool ColorLess(const ScRgb& a, const ScRgb& b)
+    {
+        if (a.r != b.r)
+            return a.r < b.r;
+        if (a.g != b.g)
+            return a.g < b.g;
+        return a.b < b.b;
+    }
+
+    bool Contains(const PixelRect& outer, const PixelRect& inner)
+    {
+        return outer.left <= inner.left && outer.top <= inner.top && outer.right >= inner.right &&
+               outer.bottom >= inner.bottom;
+    }
+
+    bool Overlaps(const PixelRect& a, const PixelRect& b)
+    {
+        return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+    }
+
+    // Rects listed under every cell they touch, each cell a linked list through one entry array
+    class RectGrid
+    {
+    public:
+        RectGrid(int width, int height, std::pmr::memory_resource* resource)
+            : m_columns((width + CELL_SIZE - 1) / CELL_SIZE),
+              m_heads(static_cast<size_t>(m_columns) * ((height + CELL_SIZE - 1) / CELL_SIZE), -1, resource),
+              m_entries(resource)
+        {
+        }
+
+        void Insert(const PixelRect& rect, int index)
+        {
+            for (int row = rect.top / CELL_SIZE; row <= (rect.bottom - 1) / CELL_SIZE; ++row)
+            {
+                for (int column = rect.left / CELL_SIZE; column <= (rect.right - 1) / CELL_SIZE; ++column)
+                {
+                    int& head = m_heads[static_cast<size_t>(row) * m_columns + column];
+                    m_entries.push_back(Entry{ index, head });
+                    head = static_cast<int>(m_entries.size()) - 1;
+                }
+            }
+        }
+
+        // Calls visit(index) for each rect listed under the cell holding pixel x, y
+        template <typename Visit>
+        void VisitCell(int x, int y, Visit visit) const
+        {
+            for (int e = m_heads[static_cast<size_t>(y / CELL_SIZE) * m_columns + x / CELL_SIZE]; e >= 0;
+                 e = m_entries[e].next)
+            {
+                if (!visit(m_entries[e].rect))
+                    return;
+            }
+        }
+
+        // The same for every cell the rect touches; a rect listed under several is visited as often
+        template <typename Visit>
+        void VisitRect(const PixelRect& rect, Visit visit) const
+        {
+            for (int row = rect.top / CELL_SIZE; row <= (rect.bottom - 1) / CELL_SIZE; ++row)
+            {
+                for (int column = rect.left / CELL_SIZE; column <= (rect.right - 1) / CELL_SIZE; ++column)
+                {
+                    for (int e = m_heads[static_cast<size_t>(row) * m_columns + column]; e >= 0;
+                         e = m_entries[e].next)
+                        visit(m_entries[e].rect);
+                }
+            }
+        }
+
+    private:
+        struct Entry
+        {
+            int rect;
+            int next; // -1 ends the cell's list
+        };
+
+        int m_columns;
+        std::pmr::vector<int> m_heads;
+        std::pmr::vector<Entry> m_entries;
+    };
+}
+
+DrawList::DrawList(std::pmr::memory_resource* resource)
+    : m_resource(resource), m_rects(resource), m_batches(resource)
+{
+}
+
+void DrawList::Record(const Pattern& pattern, int width, int height, bool label)
+{
+    m_width = std::max(width, 0);
+    m_height = std::max(height, 0);
+    m_background = pattern.background;
+    m_rects.clear();
+    m_rects.reserve(pattern.rects.size());
+    m_stats = DrawListStats();
+
+    const ScRgb* lastColor = nullptr;
+    auto add = [&](const PatternRect& rect)
+    {
+        ++m_stats.recorded;
+        if (!lastColor || !SameColor(*lastColor, rect.color))
+            ++m_stats.runs;
+        lastColor = &rect.color;
+
+        PatternRect clipped = rect;
+        clipped.rect.left = std::max(rect.rect.left, 0);
+        clipped.rect.top = std::max(rect.rect.top, 0);
+        clipped.rect.right = std::min(rect.rect.right, m_width);
+        clipped.rect.bottom = std::min(rect.rect.bottom, m_height);
+        if (clipped.rect.left < clipped.rect.right && clipped.rect.top < clipped.rect.bottom)
+            m_rects.push_back(clipped);
+        else
+            ++m_stats.hidden;
+    };
+
+    for (const PatternRect& rect : pattern.rects)
+        add(rect);
+
+    if (label)
+    {
+        std::pmr::vector<PatternRect> glyphs(m_resource);
+        RasterizeLabel(pattern.label, glyphs);
+        for (const PatternRect& glyph : glyphs)
+            add(glyph);
+    }
+
+    BuildBatches();
+}
+
+void DrawList::Optimize()
+{
+    // A rect over the whole target is the background of everything after it
+    for (size_t i = m_rects.size(); i-- > 0;)
+    {
+        const PixelRect& rect = m_rects[i].rect;
+        if (rect.left == 0 && rect.top == 0 && rect.right == m_width && rect.bottom == m_height)
+        {
+            m_background = m_rects[i].color;
+            m_rects.erase(m_rects.begin(), m_rects.begin() + i + 1);
+            m_stats.hidden += i + 1;
+            break;
+        }
+    }
+
+    int count = static_cast<int>(m_rects.size());
+    if (count == 0)
+        return BuildBatches();
+
+    // Back to front, a rect inside one drawn after it is never seen. A rect that contains it
+    // contains its top left pixel, so only that cell's list is searched.
+    std::pmr::vector<char> visible(count, 1, m_resource);
+    {
+        RectGrid later(m_width, m_height, m_resource);
+        for (int i = count - 1; i >= 0; --i)
+        {
+            const PixelRect& rect = m_rects[i].rect;
+            later.VisitCell(rect.left, rect.top, [&](int j)
+            {
+                if (Contains(m_rects[j].rect, rect))
+                    visible[i] = 0;
+                return visible[i] != 0;
+            });
+            if (visible[i])
+                later.Insert(rect, i);
+            else
+                ++m_stats.hidden;
+        }
+    }
+
+    // Front to back, each rect goes in the first layer above every earlier rect it overlaps,
+    // or in the same layer as one of the same color. Within a layer no two overlapping rects
+    // differ in color, so each layer can be drawn in any order.
+    std::pmr::vector<int> layers(count, 0, m_resource);
+    std::pmr::vector<int> order(m_resource);
+    order.reserve(count);
+    {
+        RectGrid earlier(m_width, m_height, m_resource);
+        for (int i = 0; i < count; ++i)
+        {
+            if (!visible[i])
+                continue;
+            const PatternRect& rect = m_rects[i];
+            int layer = 0;
+            earlier.VisitRect(rect.rect, [&](int j)
+            {
+                if (Overlaps(m_rects[j].rect, rect.rect))
+                    layer = std::max(layer, layers[j] + (SameColor(m_rects[j].color, rect.color) ? 0 : 1));
+            });
+            layers[i] = layer;
+            earlier.Insert(rect.rect, i);
+            order.push_back(i);
+        }
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        if (layers[a] != layers[b])
+            return layers[a] < layers[b];
+        return ColorLess(m_rects[a].color, m_rects[b].color);
+    });
+
+    std::pmr::vector<PatternRect> sorted(m_resource);
+    sorted.reserve(order.size());
+    for (int i : order)
+        sorted.push_back(m_rects[i]);
+    m_rects.swap(sorted);
+
+    BuildBatches();
+}
+
+void DrawList::BuildBatches()
+{
+    m_batches.clear();
+    for (size_t i = 0; i < m_rects.size(); ++i)
+    {
+        if (m_batches.empty() || !SameColor(m_batches.back().color, m_rects[i].color))
+        {
+            DrawBatch batch;
+            batch.color = m_rects[i].color;
+            batch.first = i;
+            m_batches.push_back(batch);
+        }
+        ++m_batches.back().count;
+    }
+    m_stats.rects = m_rects.size();
+    m_stats.batches = m_batches.size();
+}
+
+std::string FormatDrawListStats(const DrawListStats& stats)
+{
+    char buffer[160];
+    std::snprintf(buffer, sizeof(buffer), "draw list: %zu rects in %zu color runs, %zu in %zu batches, %zu hidden\n",
+                  stats.recorded, stats.runs, stats.rects, stats.batches, stats.hidden);
+    return buffer;
+}
+
+std::string FormatDrawList(const DrawList& list)
+{
+    char buffer[160];
+    std::snprintf(buffer, sizeof(buffer), "draw list %dx%d, background %g %g %g\n", list.Width(), list.Height(),
+                  list.Background().r, list.Background().g, list.Background().b);
+    std::string text = buffer;
+    for (const DrawBatch& batch : list.Batches())
+    {
+        std::snprintf(buffer, sizeof(buffer), "batch %g %g %g, %zu %s\n", batch.color.r, batch.color.g,
+                      batch.color.b, batch.count, batch.count == 1 ? "rect" : "rects");
+        text += buffer;
+        for (size_t i = batch.first; i < batch.first + batch.count; ++i)
+        {
+            const PixelRect& rect = list.Rects()[i].rect;
+            std::snprintf(buffer, sizeof(buffer), "  %d %d %d %d\n", rect.left, rect.top, rect.right, rect.bottom);
+            text += buffer;
+        }
+    }
+    return text;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Pattern.h"
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Rects of one color drawn together: one brush color on Direct2D, one clear call on Vulkan
+struct DrawBatch
+{
+    ScRgb color;
+    size_t first = 0; // into DrawList::Rects
+    size_t count = 0;
+};
+
+// Commands before and after Optimize; before counts what drawing the pattern rect by rect issues
+struct DrawListStats
+{
+    size_t recorded = 0; // rects as the pattern lists them, label glyphs included
+    size_t runs = 0;     // color changes drawing them in that order
+    size_t hidden = 0;   // dropped as off screen or covered by a later rect
+    size_t rects = 0;    // left to draw
+    size_t batches = 0;
+};
+
+// A frame's rect fills, recorded from a pattern and replayed by any backend.
+// Optimize drops rects nothing of which would be seen and sorts the rest into as few color
+// batches as painter's order allows: rects that overlap keep their order unless they have the
+// same color, so every pixel ends up the color drawing the pattern in order gives it.
+// Storage, the spatial grid Optimize uses included, comes from the given resource, the frame
+// arena in a frame loop.
+class DrawList
+{
+public:
+    explicit DrawList(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // The pattern's rects clipped to a width x height target, in order, each color change a batch.
+    // With label, the label's glyphs too, for backends that have no text renderer of their own.
+    void Record(const Pattern& pattern, int width, int height, bool label);
+
+    void Optimize();
+
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    const ScRgb& Background() const { return m_background; }
+    const std::pmr::vector<PatternRect>& Rects() const { return m_rects; }
+    const std::pmr::vector<DrawBatch>& Batches() const { return m_batches; }
+    const DrawListStats& Stats() const { return m_stats; }
+
+private:
+    void BuildBatches();
+
+    std::pmr::memory_resource* m_resource;
+    int m_width = 0;
+    int m_height = 0;
+    ScRgb m_background;
+    std::pmr::vector<PatternRect> m_rects;
+    std::pmr::vector<DrawBatch> m_batches;
+    DrawListStats m_stats;
+};
+
+// "draw list: 412 rects in 57 color runs, 398 in 9 batches, 14 hidden"
+std::string FormatDrawListStats(const DrawListStats& stats);
+
+// The whole command stream as text, a line per batch and per rect, for comparing runs exactly
+std::string FormatDrawList(const DrawList& list);
@@ -0,0 +1,168 @@
+#include "Drift.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Warm-up time constants tried, log spaced; panels take minutes to an hour or two
+    const double MIN_TIME_CONSTANT_MS = 60000.0;
+    const double MAX_TIME_CONSTANT_MS = 240.0 * 60000.0;
+    const int TIME_CONSTANT_STEPS = 48;
+
+    // Drift amounts tried before refining around the best
+    const float MIN_AMOUNT = -0.5f;
+    const float MAX_AMOUNT = 0.9f;
+    const int AMOUNT_STEPS = 57;
+    const int REFINE_STEPS = 24;
+
+    // Cost of a drift amount, relative to the sum of squared readings. References that cannot tell
+    // drift from scale, like short segments all over the screen, then fit no drift instead of any
+    const double AMOUNT_PRIOR = 1e-4;
+
+    // Sums over one segment's references for one time constant, e = exp(-t / timeConstant)
+    struct SegmentSums
+    {
+        double n = 0.0;
+        double y = 0.0;
+        double yy = 0.0;
+        double e = 0.0;
+        double ee = 0.0;
+        double ye = 0.0;
+    };
+
+    // Squared error left once every segment takes its best scale for this amount:
+    // with m = 1 - amount * e, the scale is sum(y m) / sum(m m)
+    double Residual(const std::vector<SegmentSums>& segments, double prior, double amount)
+    {
+        double residual = prior * amount * amount;
+        for (const SegmentSums& s : segments)
+        {
+            double ym = s.y - amount * s.ye;
+            double mm = s.n - 2.0 * amount * s.e + amount * amount * s.ee;
+            residual += mm > 0.0 ? s.yy - ym * ym / mm : s.yy;
+        }
+        return residual;
+    }
+}
+
+void DriftModel::Reset()
+{
+    m_references.clear();
+    m_segment = 0;
+    m_fit = DriftFit();
+}
+
+void DriftModel::NewSegment()
+{
+    if (!m_references.empty() && m_references.back().segment == m_segment)
+        ++m_segment;
+}
+
+void DriftModel::AddReference(double timeMs, float luminance)
+{
+    if (luminance <= 0.0f)
+        return;
+    m_references.push_back({ timeMs, luminance, m_segment });
+    Refit();
+}
+
+void DriftModel::Refit()
+{
+    // Every segment adds a scale; the drift itself adds two more parameters, and one reading
+    // beyond those keeps a single noisy reading from being fitted exactly
+    int segments = m_segment + 1;
+    if (m_references.size() < static_cast<size_t>(segments) + 3 ||
+        m_references.back().timeMs <= m_references.front().timeMs)
+        return;
+
+    double total = 0.0;
+    for (const Reference& reference : m_references)
+        total += static_cast<double>(reference.luminance) * reference.luminance;
+
+    double prior = AMOUNT_PRIOR * total;
+    std::vector<SegmentSums> sums(segments);
+    DriftFit best;
+    double bestResidual = 0.0;
+    for (int step = 0; step < TIME_CONSTANT_STEPS; ++step)
+    {
+        double timeConstant = MIN_TIME_CONSTANT_MS *
+            std::pow(MAX_TIME_CONSTANT_MS / MIN_TIME_CONSTANT_MS, step / (TIME_CONSTANT_STEPS - 1.0));
+
+        std::fill(sums.begin(), sums.end(), SegmentSums());
+        for (const Reference& reference : m_references)
+        {
+            SegmentSums& s = sums[reference.segment];
+            double e = std::exp(-std::max(0.0, reference.timeMs) / timeConstant);
+            double y = reference.luminance;
+            s.n += 1.0;
+            s.y += y;
+            s.yy += y * y;
+            s.e += e;
+            s.ee += e * e;
+            s.ye += y * e;
+        }
+
+        // Coarse scan of the amount, then a golden section search around the best
+        double spacing = (MAX_AMOUNT - MIN_AMOUNT) / (AMOUNT_STEPS - 1.0);
+        double amount = MIN_AMOUNT;
+        double residual = Residual(sums, prior, amount);
+        for (int i = 1; i < AMOUNT_STEPS; ++i)
+        {
+            double candidate = MIN_AMOUNT + i * spacing;
+            double candidateResidual = Residual(sums, prior, candidate);
+            if (candidateResidual < residual)
+            {
+                amount = candidate;
+                residual = candidateResidual;
+            }
+        }
+
+        const double GOLDEN = 0.6180339887498949;
+        double low = std::max<double>(MIN_AMOUNT, amount - spacing);
+        double high = std::min<double>(MAX_AMOUNT, amount + spacing);
+        for (int i = 0; i < REFINE_STEPS; ++i)
+        {
+            double a = high - GOLDEN * (high - low);
+            double b = low + GOLDEN * (high - low);
+            if (Residual(sums, prior, a) < Residual(sums, prior, b))
+                high = b;
+            else
+                low = a;
+        }
+        double refined = 0.5 * (low + high);
+        double refinedResidual = Residual(sums, prior, refined);
+        if (refinedResidual < residual)
+        {
+            amount = refined;
+            residual = refinedResidual;
+        }
+
+        if (!best.valid || residual < bestResidual)
+        {
+            best.valid = true;
+            best.amount = static_cast<float>(amount);
+            best.timeConstantMs = timeConstant;
+            bestResidual = residual;
+        }
+    }
+
+    best.residual = std::sqrt(std::max(0.0, bestResidual) / total);
+    m_fit = best;
+}
+
+float DriftModel::Correction(double timeMs) const
+{
+    if (!m_fit.valid)
+        return 1.0f;
+    double remaining = m_fit.amount * std::exp(-std::max(0.0, timeMs) / m_fit.timeConstantMs);
+    return static_cast<float>(1.0 / (1.0 - remaining));
+}
+
+double DriftModel::SettledMs(float tolerance) const
+{
+    double amount = std::abs(m_fit.amount);
+    if (!m_fit.valid || tolerance <= 0.0f || amount <= tolerance)
+        return 0.0;
+    return m_fit.timeConstantMs * std::log(amount / tolerance);
+}
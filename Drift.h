@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Warm-up drift of a panel, relative to its settled output:
+// light(t) = settled * (1 - amount * exp(-t / timeConstant)), t in ms since power-on
+struct DriftFit
+{
+    bool valid = false;
+    float amount = 0.0f;         // share of the light missing at power-on; negative for a panel that starts bright
+    double timeConstantMs = 0.0;
+    double residual = 0.0;       // RMS relative error of the references against the fit
+};
+
+// What drift compensation did for one session
+struct DriftSummary
+{
+    size_t references = 0;       // reference patches measured
+    size_t corrected = 0;        // other readings corrected
+    DriftFit fit;                // the last fit
+    double settledMs = 0.0;      // when the fit says the drift fell below the tolerance
+    double firstReadingMs = 0.0; // when measuring started
+    double referenceMs = 0.0;    // time spent measuring references
+    double savedMs = 0.0;        // warm-up wait avoided, less the time spent on references
+};
+
+// Online fit of the drift model to repeated readings of one reference patch.
+// The reference may be measured in several places, such as across the screen for uniformity:
+// each place starts a segment with a scale of its own, and all segments share one drift.
+class DriftModel
+{
+public:
+    void Reset();
+
+    // Later references belong to a new segment
+    void NewSegment();
+
+    // Adds a reference reading and refits
+    void AddReference(double timeMs, float luminance);
+
+    size_t References() const { return m_references.size(); }
+    const DriftFit& Fit() const { return m_fit; }
+
+    // Factor that turns a reading taken at timeMs into what the settled panel reads; 1 until fitted
+    float Correction(double timeMs) const;
+
+    // When the drift falls within tolerance of the settled output, 0 if it already has
+    double SettledMs(float tolerance) const;
+
+private:
+    struct Reference
+    {
+        double timeMs;
+        float luminance;
+        int segment;
+    };
+
+    void Refit();
+
+    std::vector<Reference> m_references;
+    int m_segment = 0;
+    DriftFit m_fit;
+};
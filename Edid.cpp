@@ -0,0 +1,350 @@
+#include "Edid.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <setupapi.h>
+#else
+#include <filesystem>
+#endif
+
+namespace
+{
+    const size_t EDID_BLOCK_SIZE = 128;
+    const uint8_t EDID_HEADER[8] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+
+    const uint8_t EXTENSION_CTA = 0x02;
+    const uint8_t EXTENSION_DISPLAYID = 0x70;
+
+    const uint8_t CTA_TAG_EXTENDED = 7;
+    const uint8_t CTA_EXTENDED_HDR_STATIC_METADATA = 6;
+
+    const uint8_t DISPLAYID_PRODUCT_ID_V1 = 0x00;
+    const uint8_t DISPLAYID_PRODUCT_ID_V2 = 0x20;
+    const uint8_t DISPLAYID_DISPLAY_PARAMETERS_V2 = 0x21;
+
+    bool ChecksumValid(const uint8_t* block, size_t size)
+    {
+        uint8_t sum = 0;
+        for (size_t i = 0; i < size; ++i)
+            sum = static_cast<uint8_t>(sum + block[i]);
+        return sum == 0;
+    }
+
+    // IEEE 754 binary16, used by DisplayID 2.x for luminance in nits
+    float HalfToFloat(uint16_t half)
+    {
+        int exponent = (half >> 10) & 0x1F;
+        int mantissa = half & 0x3FF;
+        float sign = (half & 0x8000) ? -1.0f : 1.0f;
+        if (exponent == 0)
+            return sign * std::ldexp(static_cast<float>(mantissa), -24);
+        if (exponent == 31)
+            return 0.0f; // Inf/NaN are never meaningful luminance
+        return sign * std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+    }
+
+    // Descriptor text is up to 13 bytes terminated by a line feed and padded with spaces
+    std::string DescriptorText(const uint8_t* text, size_t length)
+    {
+        std::string result;
+        for (size_t i = 0; i < length && text[i] != 0x0A && text[i] != 0x00; ++i)
+        {
+            if (text[i] >= 0x20 && text[i] < 0x7F)
+                result += static_cast<char>(text[i]);
+        }
+        while (!result.empty() && result.back() == ' ')
+            result.pop_back();
+        return result;
+    }
+
+    void ParseBaseBlock(const uint8_t* block, DisplayIdentity& identity)
+    {
+        uint16_t vendor = static_cast<uint16_t>((block[8] << 8) | block[9]);
+        for (int shift = 10; shift >= 0; shift -= 5)
+        {
+            int letter = (vendor >> shift) & 0x1F;
+            identity.manufacturer += (letter >= 1 && letter <= 26) ? static_cast<char>('A' + letter - 1) : '?';
+        }
+        identity.productCode = static_cast<uint16_t>(block[10] | (block[11] << 8));
+        identity.serialNumber = static_cast<uint32_t>(block[12]) | (static_cast<uint32_t>(block[13]) << 8) |
+                                (static_cast<uint32_t>(block[14]) << 16) | (static_cast<uint32_t>(block[15]) << 24);
+
+        // Four 18-byte descriptors; display descriptors start with a zero pixel clock
+        for (size_t offset = 54; offset + 18 <= 126; offset += 18)
+        {
+            const uint8_t* descriptor = block + offset;
+            if (descriptor[0] != 0 || descriptor[1] != 0)
+                continue;
+            if (descriptor[3] == 0xFC)
+                identity.name = DescriptorText(descriptor + 5, 13);
+            else if (descriptor[3] == 0xFF)
+                identity.serialText = DescriptorText(descriptor + 5, 13);
+        }
+    }
+
+    void ParseCtaBlock(const uint8_t* block, DisplayInfo& info)
+    {
+        // Data block collection runs from byte 4 up to the detailed timing offset
+        size_t end = block[2];
+        if (end < 4 || end > EDID_BLOCK_SIZE - 1)
+            end = EDID_BLOCK_SIZE - 1;
+
+        size_t offset = 4;
+        while (offset < end)
+        {
+            uint8_t tag = block[offset] >> 5;
+            size_t length = block[offset] & 0x1F;
+            const uint8_t* payload = block + offset + 1;
+            if (offset + 1 + length > end)
+                break;
+
+            if (tag == CTA_TAG_EXTENDED && length >= 3 && payload[0] == CTA_EXTENDED_HDR_STATIC_METADATA)
+            {
+                AdvertisedLuminance& luminance = info.luminance;
+                info.hasCtaHdrBlock = true;
+                luminance.supportsPq = (payload[1] & 0x04) != 0;
+                luminance.supportsHlg = (payload[1] & 0x08) != 0;
+
+                // Coded values per CTA-861-G: max = 50 * 2^(cv / 32), min = max * (cv / 255)^2 / 100
+                float maxLuminance = 0.0f;
+                if (length >= 4 && payload[3] != 0)
+                {
+                    maxLuminance = 50.0f * std::pow(2.0f, payload[3] / 32.0f);
+                    luminance.maxLuminance = maxLuminance;
+                }
+                if (length >= 5 && payload[4] != 0)
+                    luminance.maxFrameAverage = 50.0f * std::pow(2.0f, payload[4] / 32.0f);
+                if (length >= 6 && maxLuminance > 0.0f)
+                {
+                    float cv = payload[5] / 255.0f;
+                    luminance.minLuminance = maxLuminance * cv * cv / 100.0f;
+                }
+            }
+
+            offset += 1 + length;
+        }
+    }
+
+    // A DisplayID section: version, payload bytes, product type, extension count, data blocks
+    void ParseDisplayIdSection(const uint8_t* section, size_t size, DisplayInfo& info)
+    {
+        if (size < 5)
+            return;
+
+        size_t end = 4 + static_cast<size_t>(section[1]);
+        if (end > size)
+            end = size;
+
+        size_t offset = 4;
+        while (offset + 3 <= end)
+        {
+            uint8_t tag = section[offset];
+            size_t length = section[offset + 2];
+            const uint8_t* payload = section + offset + 3;
+            if (offset + 3 + length > end)
+                break;
+            if (tag == 0 && length == 0)
+                break; // padding
+
+            if ((tag == DISPLAYID_PRODUCT_ID_V1 || tag == DISPLAYID_PRODUCT_ID_V2) && length >= 12 &&
+                info.identity.manufacturer.empty())
+            {
+                DisplayIdentity& identity = info.identity;
+                if (tag == DISPLAYID_PRODUCT_ID_V1)
+                {
+                    identity.manufacturer = DescriptorText(payload, 3);
+                }
+                else
+                {
+                    char oui[7];
+                    std::snprintf(oui, sizeof(oui), "%02X%02X%02X", payload[0], payload[1], payload[2]);
+                    identity.manufacturer = oui;
+                }
+                identity.productCode = static_cast<uint16_t>(payload[3] | (payload[4] << 8));
+                identity.serialNumber = static_cast<uint32_t>(payload[5]) | (static_cast<uint32_t>(payload[6]) << 8) |
+                                        (static_cast<uint32_t>(payload[7]) << 16) |
+                                        (static_cast<uint32_t>(payload[8]) << 24);
+                size_t nameLength = payload[11];
+                if (12 + nameLength <= length)
+                    identity.name = DescriptorText(payload + 12, nameLength);
+            }
+            else if (tag == DISPLAYID_DISPLAY_PARAMETERS_V2 && length >= 27)
+            {
+                // Native luminance fields are binary16 nits at payload offsets 21, 23 and 25
+                float fullCoverage = HalfToFloat(static_cast<uint16_t>(payload[21] | (payload[22] << 8)));
+                float tenPercent = HalfToFloat(static_cast<uint16_t>(payload[23] | (payload[24] << 8)));
+                float minimum = HalfToFloat(static_cast<uint16_t>(payload[25] | (payload[26] << 8)));
+
+                // Prefer DisplayID values over CTA coded values; they are the panel's native figures
+                AdvertisedLuminance& luminance = info.luminance;
+                info.hasDisplayIdParameters = true;
+                if (tenPercent > 0.0f)
+                    luminance.maxLuminance = tenPercent;
+                if (fullCoverage > 0.0f)
+                    luminance.maxFrameAverage = fullCoverage;
+                if (minimum > 0.0f)
+                    luminance.minLuminance = minimum;
+            }
+
+            offset += 3 + length;
+        }
+    }
+
+    const uint64_t FNV_OFFSET = 14695981039346656037ull;
+    const uint64_t FNV_PRIME = 1099511628211ull;
+
+    void HashBytes(uint64_t& hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+    }
+}
+
+uint64_t DisplayIdentity::Hash() const
+{
+    // FNV-1a over the identity fields, each string terminated so fields cannot run together
+    uint64_t hash = FNV_OFFSET;
+    HashBytes(hash, manufacturer.c_str(), manufacturer.size() + 1);
+    uint8_t product[2] = { static_cast<uint8_t>(productCode), static_cast<uint8_t>(productCode >> 8) };
+    HashBytes(hash, product, sizeof(product));
+    uint8_t serial[4] = { static_cast<uint8_t>(serialNumber), static_cast<uint8_t>(serialNumber >> 8),
+                          static_cast<uint8_t>(serialNumber >> 16), static_cast<uint8_t>(serialNumber >> 24) };
+    HashBytes(hash, serial, sizeof(serial));
+    HashBytes(hash, serialText.c_str(), serialText.size() + 1);
+    HashBytes(hash, name.c_str(), name.size() + 1);
+    return hash;
+}
+
+bool ParseDisplayDescriptor(const uint8_t* data, size_t size, DisplayInfo& info)
+{
+    info = DisplayInfo();
+    if (!data || size == 0)
+        return false;
+
+    // Bare DisplayID structure (version 1.x or 2.x in the first byte)
+    if (size < EDID_BLOCK_SIZE || std::memcmp(data, EDID_HEADER, sizeof(EDID_HEADER)) != 0)
+    {
+        if (data[0] < 0x10 || data[0] > 0x2F)
+            return false;
+        ParseDisplayIdSection(data, size, info);
+        return !info.identity.manufacturer.empty() || info.hasDisplayIdParameters;
+    }
+
+    ParseBaseBlock(data, info.identity);
+
+    size_t extensions = data[126];
+    for (size_t i = 1; i <= extensions; ++i)
+    {
+        if ((i + 1) * EDID_BLOCK_SIZE > size)
+            break;
+        const uint8_t* block = data + i * EDID_BLOCK_SIZE;
+        if (!ChecksumValid(block, EDID_BLOCK_SIZE))
+            continue;
+
+        if (block[0] == EXTENSION_CTA)
+            ParseCtaBlock(block, info);
+        else if (block[0] == EXTENSION_DISPLAYID)
+            ParseDisplayIdSection(block + 1, EDID_BLOCK_SIZE - 1, info);
+    }
+
+    return true;
+}
+
+bool LoadBinaryFile(const std::string& path, std::vector<uint8_t>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !data.empty();
+}
+
+#ifdef _WIN32
+
+// GUID_DEVINTERFACE_MONITOR from ntddvdeo.h
+static const GUID MONITOR_INTERFACE_GUID = { 0xe6f07b5f, 0xee97, 0x4a90, { 0xb0, 0x76, 0x33, 0xf5, 0x7b, 0xf4, 0xea, 0xa7 } };
+
+bool ReadSystemEdid(const std::wstring& gdiDeviceName, std::vector<uint8_t>& data)
+{
+    // Monitor device interface path for the adapter output, e.g. \\?\DISPLAY#GSM5B7F#...
+    DISPLAY_DEVICEW monitor = {};
+    monitor.cb = sizeof(monitor);
+    if (!EnumDisplayDevicesW(gdiDeviceName.c_str(), 0, &monitor, EDD_GET_DEVICE_INTERFACE_NAME))
+        return false;
+
+    HDEVINFO devInfo = SetupDiGetClassDevsW(&MONITOR_INTERFACE_GUID, nullptr, nullptr,
+                                            DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+    if (devInfo == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool found = false;
+    SP_DEVICE_INTERFACE_DATA deviceInterface = {};
+    deviceInterface.cbSize = sizeof(deviceInterface);
+    for (DWORD index = 0;
+         !found && SetupDiEnumDeviceInterfaces(devInfo, nullptr, &MONITOR_INTERFACE_GUID, index, &deviceInterface);
+         ++index)
+    {
+        DWORD required = 0;
+        SetupDiGetDeviceInterfaceDetailW(devInfo, &deviceInterface, nullptr, 0, &required, nullptr);
+        if (required == 0)
+            continue;
+
+        std::vector<BYTE> buffer(required);
+        auto detail = reinterpret_cast<SP_DEVICE_INTERFACE_DETAIL_DATA_W*>(buffer.data());
+        detail->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA_W);
+        SP_DEVINFO_DATA device = {};
+        device.cbSize = sizeof(device);
+        if (!SetupDiGetDeviceInterfaceDetailW(devInfo, &deviceInterface, detail, required, nullptr, &device))
+            continue;
+        if (_wcsicmp(detail->DevicePath, monitor.DeviceID) != 0)
+            continue;
+
+        // The EDID the OS read from the display is cached in the device hardware key
+        HKEY key = SetupDiOpenDevRegKey(devInfo, &device, DICS_FLAG_GLOBAL, 0, DIREG_DEV, KEY_READ);
+        if (key == INVALID_HANDLE_VALUE)
+            continue;
+
+        DWORD type = 0;
+        DWORD size = 0;
+        if (RegQueryValueExW(key, L"EDID", nullptr, &type, nullptr, &size) == ERROR_SUCCESS && size > 0)
+        {
+            data.resize(size);
+            found = RegQueryValueExW(key, L"EDID", nullptr, &type, data.data(), &size) == ERROR_SUCCESS;
+        }
+        RegCloseKey(key);
+    }
+
+    SetupDiDestroyDeviceInfoList(devInfo);
+    return found;
+}
+
+#else
+
+std::vector<SystemEdid> ReadSystemEdids()
+{
+    std::vector<SystemEdid> result;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/class/drm", error))
+    {
+        std::filesystem::path edidPath = entry.path() / "edid";
+        SystemEdid edid;
+        if (!std::filesystem::exists(edidPath, error) || !LoadBinaryFile(edidPath.string(), edid.data))
+            continue;
+        edid.connector = entry.path().filename().string();
+        result.push_back(std::move(edid));
+    }
+    return result;
+}
+
+#endif
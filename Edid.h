@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Stable identity of a physical display, independent of the port it is connected to
+struct DisplayIdentity
+{
+    std::string manufacturer; // three letter PNP id, or OUI hex for DisplayID-only displays
+    uint16_t productCode = 0;
+    uint32_t serialNumber = 0;
+    std::string serialText;   // monitor serial number descriptor
+    std::string name;         // monitor name descriptor
+
+    uint64_t Hash() const;
+};
+
+// Luminance the display advertises, all values in nits (0 when not advertised)
+struct AdvertisedLuminance
+{
+    bool supportsPq = false;
+    bool supportsHlg = false;
+    float maxLuminance = 0.0f;    // desired content max / peak on a small window
+    float maxFrameAverage = 0.0f; // desired content max frame-average / full field
+    float minLuminance = 0.0f;
+};
+
+struct DisplayInfo
+{
+    DisplayIdentity identity;
+    AdvertisedLuminance luminance;
+    bool hasCtaHdrBlock = false;         // CTA-861 HDR static metadata data block found
+    bool hasDisplayIdParameters = false; // DisplayID 2.x display parameters block found
+};
+
+// Parse an EDID (base block plus extensions) or a bare DisplayID structure.
+// All offsets are bounds checked; malformed blocks are skipped rather than trusted.
+bool ParseDisplayDescriptor(const uint8_t* data, size_t size, DisplayInfo& info);
+
+bool LoadBinaryFile(const std::string& path, std::vector<uint8_t>& data);
+
+#ifdef _WIN32
+// EDID of the monitor attached to a GDI device such as \\.\DISPLAY1
+bool ReadSystemEdid(const std::wstring& gdiDeviceName, std::vector<uint8_t>& data);
+#else
+// EDIDs of all connected DRM connectors, keyed by connector name such as card0-DP-1
+struct SystemEdid
+{
+    std::string connector;
+    std::vector<uint8_t> data;
+};
+
+std::vector<SystemEdid> ReadSystemEdids();
+#endif
@@ -0,0 +1,159 @@
+#include "Energy.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    const char* POWERCAP_PATH = "/sys/class/powercap";
+    const char* RAPL_PACKAGE_PREFIX = "intel-rapl:"; // AMD packages are listed under the same name
+    // The shortest RAPL wrap is about 20 s, a 4 kJ range under 200 W
+    const std::chrono::seconds READ_INTERVAL(1);
+
+    bool ReadMicrojoules(const std::string& path, uint64_t& value)
+    {
+        std::ifstream file(path);
+        return static_cast<bool>(file >> value);
+    }
+}
+
+bool RaplCounter::Open(std::string& error)
+{
+    m_domains.clear();
+    m_joules = 0.0;
+
+    // Packages are intel-rapl:N; their cores and uncore are intel-rapl:N:M, already counted in them
+    std::error_code code;
+    for (const auto& entry : std::filesystem::directory_iterator(POWERCAP_PATH, code))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, std::strlen(RAPL_PACKAGE_PREFIX), RAPL_PACKAGE_PREFIX) != 0 ||
+            name.find(':', std::strlen(RAPL_PACKAGE_PREFIX)) != std::string::npos)
+            continue;
+
+        Domain domain;
+        domain.path = (entry.path() / "energy_uj").string();
+        if (!ReadMicrojoules((entry.path() / "max_energy_range_uj").string(), domain.rangeUj) ||
+            !ReadMicrojoules(domain.path, domain.lastUj))
+        {
+            error = "cannot read " + domain.path + " (RAPL counters usually need root)";
+            m_domains.clear();
+            return false;
+        }
+        m_domains.push_back(domain);
+    }
+
+    if (m_domains.empty())
+    {
+        error = std::string("no RAPL package domains under ") + POWERCAP_PATH;
+        return false;
+    }
+    return true;
+}
+
+bool RaplCounter::Read(double& joules)
+{
+    for (Domain& domain : m_domains)
+    {
+        uint64_t value = 0;
+        if (!ReadMicrojoules(domain.path, value))
+            return false;
+        uint64_t moved = value >= domain.lastUj ? value - domain.lastUj : domain.rangeUj - domain.lastUj + value;
+        m_joules += static_cast<double>(moved) * 1e-6;
+        domain.lastUj = value;
+    }
+    joules = m_joules;
+    return true;
+}
+
+FakeEnergyCounter::FakeEnergyCounter(double watts)
+    : m_watts(watts), m_start(std::chrono::steady_clock::now())
+{
+}
+
+bool FakeEnergyCounter::Read(double& joules)
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+    joules = m_watts * elapsed.count();
+    return true;
+}
+
+std::string FakeEnergyCounter::Name() const
+{
+    char buffer[48];
+    std::snprintf(buffer, sizeof(buffer), "fake %g W", m_watts);
+    return buffer;
+}
+
+std::unique_ptr<EnergyCounter> OpenEnergyCounter(const std::string& source, std::string& error)
+{
+    if (source == "rapl")
+    {
+        auto rapl = std::make_unique<RaplCounter>();
+        if (!rapl->Open(error))
+            return nullptr;
+        return rapl;
+    }
+
+    const std::string FAKE = "fake:";
+    if (source.compare(0, FAKE.size(), FAKE) == 0)
+    {
+        char* end = nullptr;
+        double watts = std::strtod(source.c_str() + FAKE.size(), &end);
+        if (end != source.c_str() + FAKE.size() && *end == '\0' && watts >= 0.0)
+            return std::make_unique<FakeEnergyCounter>(watts);
+    }
+
+    error = "unknown energy source " + source + ", expected rapl or fake:<watts>";
+    return nullptr;
+}
+
+void EnergyTracker::Start()
+{
+    std::string source = m_counter ? m_counter->Name() : std::string();
+    m_stats = EnergyStats();
+    m_stats.source = source;
+    m_start = std::chrono::steady_clock::now();
+    m_lastRead = m_start;
+    if (m_counter && !m_counter->Read(m_startJoules))
+        m_counter = nullptr;
+}
+
+void EnergyTracker::Frame()
+{
+    ++m_stats.frames;
+    if (!m_counter)
+        return;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - m_lastRead < READ_INTERVAL)
+        return;
+    // The counter keeps the running total; this read only moves its last value past any wrap
+    double joules = 0.0;
+    if (!m_counter->Read(joules))
+        m_counter = nullptr;
+    m_lastRead = now;
+}
+
+void EnergyTracker::Stop()
+{
+    m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    double joules = 0.0;
+    if (m_counter && m_counter->Read(joules))
+        m_stats.joules = joules - m_startJoules;
+    else
+        m_counter = nullptr;
+}
+
+std::string FormatEnergyStats(const EnergyStats& stats)
+{
+    double frames = static_cast<double>(stats.frames > 0 ? stats.frames : 1);
+    char buffer[200];
+    std::snprintf(buffer, sizeof(buffer),
+                  "energy (%s): %.2f J in %.1f s over %zu frames, %.2f mJ and %.1f ms per frame, %.2f W\n",
+                  stats.source.c_str(), stats.joules, stats.seconds, stats.frames, stats.joules * 1000.0 / frames,
+                  stats.seconds * 1000.0 / frames, stats.seconds > 0.0 ? stats.joules / stats.seconds : 0.0);
+    return buffer;
+}
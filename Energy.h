@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A running total of the energy a platform counter has seen. Only differences between two
+// reads mean anything.
+class EnergyCounter
+{
+public:
+    virtual ~EnergyCounter() = default;
+
+    virtual bool Read(double& joules) = 0;
+    virtual std::string Name() const = 0;
+};
+
+// RAPL package domains through powercap on Linux, summed over the sockets. The hardware counters
+// wrap, after minutes to hours depending on load; each read adds what it moved since the last.
+// They are readable by root only on most distributions.
+class RaplCounter : public EnergyCounter
+{
+public:
+    // False with a reason when there are no readable package domains
+    bool Open(std::string& error);
+
+    bool Read(double& joules) override;
+    std::string Name() const override { return "RAPL"; }
+
+private:
+    struct Domain
+    {
+        std::string path;       // energy_uj
+        uint64_t rangeUj = 0;   // where the counter wraps
+        uint64_t lastUj = 0;
+    };
+
+    std::vector<Domain> m_domains;
+    double m_joules = 0.0;
+};
+
+// Constant power on the steady clock, for machines without counters and for checking the reports
+class FakeEnergyCounter : public EnergyCounter
+{
+public:
+    explicit FakeEnergyCounter(double watts);
+
+    bool Read(double& joules) override;
+    std::string Name() const override;
+
+private:
+    double m_watts;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// "rapl" or "fake:<watts>"; null with a reason when the source is unknown or cannot be read
+std::unique_ptr<EnergyCounter> OpenEnergyCounter(const std::string& source, std::string& error);
+
+struct EnergyStats
+{
+    std::string source;
+    size_t frames = 0;
+    double joules = 0.0;
+    double seconds = 0.0;
+};
+
+// Energy over a stretch of frames. Frames read the counter once a second at most, often enough
+// that a RAPL counter never wraps twice between reads however long the session runs, and rarely
+// enough that it costs nothing measurable. Without a counter it only counts.
+class EnergyTracker
+{
+public:
+    explicit EnergyTracker(EnergyCounter* counter) : m_counter(counter) {}
+
+    void Start();
+    void Frame();
+    void Stop();
+
+    bool Measured() const { return m_counter != nullptr; }
+    const EnergyStats& Stats() const { return m_stats; }
+
+private:
+    EnergyCounter* m_counter;
+    EnergyStats m_stats;
+    double m_startJoules = 0.0;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_lastRead;
+};
+
+// "energy (RAPL): 12.41 J in 10.0 s over 600 frames, 20.68 mJ and 16.7 ms per frame, 1.24 W"
+std::string FormatEnergyStats(const EnergyStats& stats);
@@ -0,0 +1,244 @@
+#include "FalseColor.h"
+#include "ColorMath.h"
+#include "Half.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define FALSE_COLOR_F16C 1
+#define FALSE_COLOR_TARGET __attribute__((target("avx,f16c")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define FALSE_COLOR_F16C 1
+#define FALSE_COLOR_TARGET
+#endif
+
+namespace
+{
+    const int EDGES = FALSE_COLOR_BANDS - 1;
+    const int BAND_ROWS = 32; // rows a thread takes at a time
+
+    // Purple where black is crushed, blue through orange from shadows to highlights, red where
+    // white clips; all at moderate levels so the view is comfortable on a bright panel
+    const ScRgb BAND_COLORS[FALSE_COLOR_BANDS] = {
+        { 0.50f, 0.00f, 0.80f },
+        { 0.05f, 0.15f, 1.00f },
+        { 0.00f, 0.70f, 0.90f },
+        { 0.05f, 0.80f, 0.10f },
+        { 0.55f, 0.90f, 0.00f },
+        { 1.00f, 0.85f, 0.00f },
+        { 1.00f, 0.45f, 0.00f },
+        { 1.00f, 0.00f, 0.00f },
+    };
+
+    int BandOf(const float* edges, float luminance)
+    {
+        int band = 0;
+        for (int i = 0; i < EDGES; ++i)
+            band += luminance > edges[i] ? 1 : 0;
+        return band;
+    }
+
+    void MapSpanScalar(uint16_t* pixels, const float* edges, const uint64_t* table, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            uint16_t* pixel = pixels + i * 4;
+            float luminance = Bt709Luminance(HalfToFloat(pixel[0]), HalfToFloat(pixel[1]), HalfToFloat(pixel[2]));
+            std::memcpy(pixel, &table[BandOf(edges, luminance)], sizeof(uint64_t));
+        }
+    }
+
+#ifdef FALSE_COLOR_F16C
+    bool DetectF16c()
+    {
+        unsigned int regs[4] = {};
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        for (int i = 0; i < 4; ++i)
+            regs[i] = static_cast<unsigned int>(info[i]);
+#else
+        if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+            return false;
+#endif
+        const unsigned int OSXSAVE = 1u << 27, AVX = 1u << 28, F16C = 1u << 29;
+        if ((regs[2] & (OSXSAVE | AVX | F16C)) != (OSXSAVE | AVX | F16C))
+            return false;
+
+        // The OS has to save the YMM registers too
+#ifdef _MSC_VER
+        unsigned long long enabled = _xgetbv(0);
+#else
+        unsigned int low, high;
+        __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        unsigned long long enabled = (static_cast<unsigned long long>(high) << 32) | low;
+#endif
+        return (enabled & 6) == 6;
+    }
+
+    const bool HAS_F16C = DetectF16c();
+
+    // Four pixels per step. Two pairs widen to floats and are weighted by the luminance
+    // coefficients; two horizontal adds leave the four luminances in lanes 0, 4, 1 and 5.
+    // Each edge a luminance is above adds one to its band, which indexes the table.
+    // Runs of the pixels just mapped, like the flat areas of a pattern, reuse the result.
+    FALSE_COLOR_TARGET void MapSpanF16c(uint16_t* pixels, const float* edges, const uint64_t* table, int count)
+    {
+        __m256 weights = _mm256_setr_ps(0.2126f, 0.7152f, 0.0722f, 0.0f, 0.2126f, 0.7152f, 0.0722f, 0.0f);
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 limits[EDGES];
+        for (int i = 0; i < EDGES; ++i)
+            limits[i] = _mm256_set1_ps(edges[i]);
+
+        __m128i lastLow = _mm_setzero_si128();
+        __m128i lastHigh = _mm_setzero_si128();
+        __m128i mappedLow = _mm_set_epi64x(static_cast<long long>(table[0]), static_cast<long long>(table[0]));
+        __m128i mappedHigh = mappedLow;
+        int quads = count / 4;
+        for (int i = 0; i < quads; ++i)
+        {
+            __m128i* quad = reinterpret_cast<__m128i*>(pixels + i * 16);
+            __m128i low = _mm_loadu_si128(quad);
+            __m128i high = _mm_loadu_si128(quad + 1);
+            __m128i same = _mm_and_si128(_mm_cmpeq_epi16(low, lastLow), _mm_cmpeq_epi16(high, lastHigh));
+            if (_mm_movemask_epi8(same) != 0xFFFF)
+            {
+                lastLow = low;
+                lastHigh = high;
+                __m256 a = _mm256_mul_ps(_mm256_cvtph_ps(low), weights);
+                __m256 b = _mm256_mul_ps(_mm256_cvtph_ps(high), weights);
+                __m256 sums = _mm256_hadd_ps(a, b);
+                __m256 luminance = _mm256_hadd_ps(sums, sums);
+
+                __m256 band = _mm256_setzero_ps();
+                for (int e = 0; e < EDGES; ++e)
+                    band = _mm256_add_ps(band, _mm256_and_ps(_mm256_cmp_ps(luminance, limits[e], _CMP_GT_OQ), one));
+                alignas(32) int bands[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(bands), _mm256_cvttps_epi32(band));
+
+                mappedLow = _mm_set_epi64x(static_cast<long long>(table[bands[4]]),
+                                           static_cast<long long>(table[bands[0]]));
+                mappedHigh = _mm_set_epi64x(static_cast<long long>(table[bands[5]]),
+                                            static_cast<long long>(table[bands[1]]));
+            }
+            _mm_storeu_si128(quad, mappedLow);
+            _mm_storeu_si128(quad + 1, mappedHigh);
+        }
+        int done = quads * 4;
+        MapSpanScalar(pixels + done * 4, edges, table, count - done);
+    }
+#endif
+
+    void MapSpan(uint16_t* pixels, const float* edges, const uint64_t* table, int count)
+    {
+#ifdef FALSE_COLOR_F16C
+        if (HAS_F16C)
+            return MapSpanF16c(pixels, edges, table, count);
+#endif
+        MapSpanScalar(pixels, edges, table, count);
+    }
+}
+
+FalseColor::FalseColor()
+{
+    for (int band = 0; band < FALSE_COLOR_BANDS; ++band)
+    {
+        const ScRgb& color = BAND_COLORS[band];
+        uint16_t pixel[4] = { FloatToHalf(color.r), FloatToHalf(color.g), FloatToHalf(color.b), FloatToHalf(1.0f) };
+        std::memcpy(&m_pixels[band], pixel, sizeof(pixel));
+    }
+
+    // Until a range is set, black to the scRGB reference white
+    SetRange(0.0f, SCRGB_WHITE_NITS);
+}
+
+bool FalseColor::SetRange(float blackNits, float whiteNits)
+{
+    blackNits = std::max(blackNits, 0.0f);
+    whiteNits = std::max(whiteNits, blackNits);
+    if (blackNits == m_blackNits && whiteNits == m_whiteNits)
+        return false;
+
+    m_blackNits = blackNits;
+    m_whiteNits = whiteNits;
+    float blackSignal = PqEncode(blackNits);
+    float whiteSignal = PqEncode(whiteNits);
+    m_edges[0] = blackNits / SCRGB_WHITE_NITS;
+    m_edges[EDGES - 1] = whiteNits / SCRGB_WHITE_NITS;
+    for (int i = 1; i < EDGES - 1; ++i)
+    {
+        float signal = blackSignal + (whiteSignal - blackSignal) * i / (EDGES - 1);
+        m_edges[i] = PqDecode(signal) / SCRGB_WHITE_NITS;
+    }
+    return true;
+}
+
+const ScRgb& FalseColor::BandColor(int band) const
+{
+    return BAND_COLORS[std::min(std::max(band, 0), FALSE_COLOR_BANDS - 1)];
+}
+
+int FalseColor::Band(const ScRgb& color) const
+{
+    return BandOf(m_edges, Bt709Luminance(color.r, color.g, color.b));
+}
+
+void FalseColor::Apply(Pattern& pattern) const
+{
+    pattern.background = Map(pattern.background);
+    for (PatternRect& rect : pattern.rects)
+        rect.color = Map(rect.color);
+    pattern.label.color = Map(pattern.label.color);
+}
+
+bool FalseColor::Vectorized()
+{
+#ifdef FALSE_COLOR_F16C
+    return HAS_F16C;
+#else
+    return false;
+#endif
+}
+
+void FalseColor::ApplyRows(FrameBuffer& frame, int top, int bottom) const
+{
+    size_t row = static_cast<size_t>(frame.width) * 4;
+    for (int y = top; y < bottom; ++y)
+        MapSpan(frame.Half() + y * row, m_edges, m_pixels, frame.width);
+}
+
+bool FalseColor::Apply(FrameBuffer& frame, unsigned threadCount) const
+{
+    if (frame.encoding != FrameEncoding::ScRgbHalf)
+        return false;
+    if (frame.width <= 0 || frame.height <= 0)
+        return true;
+
+    int bands = (frame.height + BAND_ROWS - 1) / BAND_ROWS;
+    threadCount = threadCount ? threadCount : std::thread::hardware_concurrency();
+    threadCount = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(bands)));
+
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int band = next++; band < bands; band = next++)
+            ApplyRows(frame, band * BAND_ROWS, std::min(frame.height, (band + 1) * BAND_ROWS));
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "FrameBuffer.h"
+#include "Pattern.h"
+
+#include <cstdint>
+
+// Bands of the false color view: at or below black, six steps between black and white, and clipped
+const int FALSE_COLOR_BANDS = 8;
+
+// Shows each pixel's luminance as a color band relative to the calibrated black and white levels,
+// so crushed shadows and clipped highlights stand out. Band edges are evenly spaced in PQ between
+// the two levels, roughly evenly spaced in what the eye sees. A pixel's band is the number of edges
+// its luminance is above, and its color comes from a table of one encoded pixel per band.
+class FalseColor
+{
+public:
+    FalseColor();
+
+    // Levels in nits; true when the band edges moved
+    bool SetRange(float blackNits, float whiteNits);
+    float BlackNits() const { return m_blackNits; }
+    float WhiteNits() const { return m_whiteNits; }
+
+    // Luminance of the top of each band but the last in scRGB units (1 is 80 nits), for shaders
+    float Edge(int index) const { return m_edges[index]; }
+    const ScRgb& BandColor(int band) const;
+
+    int Band(const ScRgb& color) const;
+    ScRgb Map(const ScRgb& color) const { return BandColor(Band(color)); }
+
+    // Every color of a pattern, which is exact for backends that only fill rects
+    void Apply(Pattern& pattern) const;
+
+    // Every pixel of an FP16 scRGB frame, alpha included. Rows are split over threadCount
+    // threads (0 is one per hardware thread).
+    bool Apply(FrameBuffer& frame, unsigned threadCount = 0) const;
+
+    // True when the kernel uses F16C rather than converting one half at a time
+    static bool Vectorized();
+
+private:
+    void ApplyRows(FrameBuffer& frame, int top, int bottom) const;
+
+    float m_blackNits = -1.0f;
+    float m_whiteNits = -1.0f;
+    float m_edges[FALSE_COLOR_BANDS - 1] = {};
+    uint64_t m_pixels[FALSE_COLOR_BANDS] = {}; // RGBA FP16 per band
+};
@@ -0,0 +1,386 @@
+#include "Flicker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <random>
+#include <thread>
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+
+    // Complex lanes per batch; each lane carries two real windows
+    const size_t BATCH_LANES = 8;
+
+    size_t FloorPowerOfTwo(size_t value)
+    {
+        size_t result = 1;
+        while (result * 2 <= value)
+            result *= 2;
+        return result;
+    }
+
+    // Robust min/max: a single sensor spike should not read as 100% flicker
+    float Percentile(std::vector<float>& values, double fraction)
+    {
+        size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    struct Scratch
+    {
+        std::vector<float> re;
+        std::vector<float> im;
+        std::vector<double> power;
+        std::vector<float> signal;
+    };
+
+    // Welch-averaged one-sided power spectrum of a mean-removed, Hann-windowed signal.
+    // Windows are packed two per complex lane and split after the transform.
+    size_t AccumulateSpectrum(const FftPlan& plan, const std::vector<float>& window,
+                              const float* signal, size_t length, Scratch& scratch)
+    {
+        const size_t n = plan.Size();
+        const size_t hop = n / 2;
+        const size_t windowCount = (length - n) / hop + 1;
+        const size_t perBatch = BATCH_LANES * 2;
+
+        scratch.re.resize(n * BATCH_LANES);
+        scratch.im.resize(n * BATCH_LANES);
+        scratch.power.assign(n / 2 + 1, 0.0);
+
+        for (size_t first = 0; first < windowCount; first += perBatch)
+        {
+            // Load up to 2 * BATCH_LANES windows; missing windows are zero
+            for (size_t lane = 0; lane < BATCH_LANES; ++lane)
+            {
+                size_t a = first + lane * 2;
+                size_t b = a + 1;
+                const float* sa = a < windowCount ? signal + a * hop : nullptr;
+                const float* sb = b < windowCount ? signal + b * hop : nullptr;
+                for (size_t k = 0; k < n; ++k)
+                {
+                    scratch.re[k * BATCH_LANES + lane] = sa ? sa[k] * window[k] : 0.0f;
+                    scratch.im[k * BATCH_LANES + lane] = sb ? sb[k] * window[k] : 0.0f;
+                }
+            }
+
+            plan.ForwardBatch(scratch.re.data(), scratch.im.data(), BATCH_LANES);
+
+            // Split Z = A + iB into the spectra of both real windows:
+            // |A[k]|^2 = |Z[k] + conj(Z[n-k])|^2 / 4, |B[k]|^2 = |Z[k] - conj(Z[n-k])|^2 / 4
+            for (size_t k = 0; k <= n / 2; ++k)
+            {
+                const float* zr = &scratch.re[k * BATCH_LANES];
+                const float* zi = &scratch.im[k * BATCH_LANES];
+                const float* nr = &scratch.re[((n - k) % n) * BATCH_LANES];
+                const float* ni = &scratch.im[((n - k) % n) * BATCH_LANES];
+                double sum = 0.0;
+                for (size_t lane = 0; lane < BATCH_LANES; ++lane)
+                {
+                    float sumRe = zr[lane] + nr[lane];
+                    float difIm = zi[lane] - ni[lane];
+                    float sumIm = zi[lane] + ni[lane];
+                    float difRe = zr[lane] - nr[lane];
+                    sum += 0.25 * (sumRe * sumRe + difIm * difIm + sumIm * sumIm + difRe * difRe);
+                }
+                scratch.power[k] += sum;
+            }
+        }
+
+        for (double& p : scratch.power)
+            p /= static_cast<double>(windowCount);
+        return windowCount;
+    }
+
+    FlickerResult AnalyzeCapture(const FlickerCapture& capture, const FftPlan* plan,
+                                 const std::vector<float>* window, const FlickerOptions& options,
+                                 Scratch& scratch)
+    {
+        FlickerResult result;
+        result.level = capture.level;
+
+        const size_t length = capture.samples.size();
+        if (length == 0 || capture.sampleRate <= 0.0f)
+            return result;
+
+        // Remove the dark offset and the mean so DC leakage does not mask low frequencies
+        std::vector<float>& signal = scratch.signal;
+        signal.resize(length);
+        double total = 0.0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            signal[i] = capture.samples[i] - capture.darkOffset;
+            total += signal[i];
+        }
+        const double mean = total / static_cast<double>(length);
+        result.meanSignal = static_cast<float>(mean);
+        if (mean <= 0.0)
+            return result;
+
+        // Dominant component from the averaged spectrum
+        if (plan)
+        {
+            std::vector<float> centered(signal.begin(), signal.end());
+            for (float& v : centered)
+                v -= static_cast<float>(mean);
+            AccumulateSpectrum(*plan, *window, centered.data(), length, scratch);
+
+            const size_t n = plan->Size();
+            const double binWidth = capture.sampleRate / static_cast<double>(n);
+            double maxFrequency = options.maxFrequency > 0.0f ? options.maxFrequency : capture.sampleRate / 2.0;
+            size_t firstBin = std::max<size_t>(2, static_cast<size_t>(std::ceil(options.minFrequency / binWidth)));
+            size_t lastBin = std::min<size_t>(n / 2 - 2, static_cast<size_t>(maxFrequency / binWidth));
+
+            // Components are compared by the power of their whole main lobe, +-2 bins with Hann. A
+            // single bin loses up to 1.4 dB when the component falls between bins, enough for the
+            // second harmonic of a narrow PWM pulse to outscore its fundamental.
+            size_t peak = 0;
+            double lobe = 0.0;
+            for (size_t k = firstBin; k <= lastBin; ++k)
+            {
+                double sum = scratch.power[k - 2] + scratch.power[k - 1] + scratch.power[k] + scratch.power[k + 1] +
+                             scratch.power[k + 2];
+                if (peak == 0 || sum > lobe)
+                {
+                    peak = k;
+                    lobe = sum;
+                }
+            }
+
+            // The strongest bin of that lobe, for the interpolation
+            if (peak != 0)
+            {
+                size_t strongest = peak;
+                for (size_t k = std::max(peak - 1, firstBin); k <= std::min(peak + 1, lastBin); ++k)
+                {
+                    if (scratch.power[k] > scratch.power[strongest])
+                        strongest = k;
+                }
+                peak = strongest;
+            }
+
+            if (peak != 0)
+            {
+                // Parseval over the main lobe gives the sinusoid amplitude
+                lobe = 0.0;
+                for (size_t k = peak - 2; k <= peak + 2; ++k)
+                    lobe += scratch.power[k];
+                double amplitude = std::sqrt(lobe * 32.0 / (3.0 * static_cast<double>(n) * n));
+
+                if (amplitude / mean >= options.detectionThreshold)
+                {
+                    // Parabolic interpolation on log power refines the peak between bins
+                    double l = std::log(scratch.power[peak - 1] + 1e-30);
+                    double c = std::log(scratch.power[peak] + 1e-30);
+                    double r = std::log(scratch.power[peak + 1] + 1e-30);
+                    double denom = l - 2.0 * c + r;
+                    double offset = denom != 0.0 ? 0.5 * (l - r) / denom : 0.0;
+                    result.frequency = static_cast<float>((peak + offset) * binWidth);
+                }
+            }
+        }
+
+        // Flicker index over a whole number of periods so partial cycles do not bias it
+        size_t span = length;
+        if (result.frequency > 0.0f)
+        {
+            double period = capture.sampleRate / result.frequency;
+            size_t periods = static_cast<size_t>(length / period);
+            if (periods > 0)
+                span = static_cast<size_t>(periods * period);
+        }
+
+        double spanTotal = 0.0;
+        for (size_t i = 0; i < span; ++i)
+            spanTotal += signal[i];
+        double spanMean = spanTotal / static_cast<double>(span);
+        double above = 0.0;
+        for (size_t i = 0; i < span; ++i)
+            above += std::max(0.0, signal[i] - spanMean);
+        result.flickerIndex = spanTotal > 0.0 ? static_cast<float>(above / spanTotal) : 0.0f;
+
+        // Percent flicker from robust extremes; this reorders the scratch signal
+        float low = std::max(0.0f, Percentile(signal, 0.001));
+        float high = Percentile(signal, 0.999);
+        result.modulationDepth = high + low > 0.0f ? 100.0f * (high - low) / (high + low) : 0.0f;
+
+        return result;
+    }
+}
+
+FftPlan::FftPlan(size_t size)
+    : m_size(size)
+{
+    unsigned bits = 0;
+    while ((size_t(1) << bits) < size)
+        ++bits;
+
+    m_bitReverse.resize(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        unsigned reversed = 0;
+        for (unsigned b = 0; b < bits; ++b)
+            reversed |= ((i >> b) & 1u) << (bits - 1 - b);
+        m_bitReverse[i] = reversed;
+    }
+
+    // Forward twiddles exp(-2 pi i k / n)
+    m_cos.resize(size / 2);
+    m_sin.resize(size / 2);
+    for (size_t k = 0; k < size / 2; ++k)
+    {
+        double angle = 2.0 * PI * static_cast<double>(k) / static_cast<double>(size);
+        m_cos[k] = static_cast<float>(std::cos(angle));
+        m_sin[k] = static_cast<float>(-std::sin(angle));
+    }
+}
+
+void FftPlan::ForwardBatch(float* re, float* im, size_t batch) const
+{
+    const size_t n = m_size;
+
+    // Bit-reversal permutation swaps whole rows of the batch
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t j = m_bitReverse[i];
+        if (i < j)
+        {
+            std::swap_ranges(re + i * batch, re + (i + 1) * batch, re + j * batch);
+            std::swap_ranges(im + i * batch, im + (i + 1) * batch, im + j * batch);
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        const size_t half = len / 2;
+        const size_t step = n / len;
+        for (size_t start = 0; start < n; start += len)
+        {
+            for (size_t k = 0; k < half; ++k)
+            {
+                const float wr = m_cos[k * step];
+                const float wi = m_sin[k * step];
+                float* ar = re + (start + k) * batch;
+                float* ai = im + (start + k) * batch;
+                float* br = re + (start + k + half) * batch;
+                float* bi = im + (start + k + half) * batch;
+                for (size_t b = 0; b < batch; ++b)
+                {
+                    float tr = br[b] * wr - bi[b] * wi;
+                    float ti = br[b] * wi + bi[b] * wr;
+                    br[b] = ar[b] - tr;
+                    bi[b] = ai[b] - ti;
+                    ar[b] += tr;
+                    ai[b] += ti;
+                }
+            }
+        }
+    }
+}
+
+std::vector<FlickerResult> AnalyzeFlicker(const std::vector<FlickerCapture>& captures,
+                                          const FlickerOptions& options)
+{
+    std::vector<FlickerResult> results(captures.size());
+
+    // Captures shorter than the requested window use the largest power of two that fits.
+    // Plans and windows are built up front and shared read-only by the workers.
+    std::map<size_t, std::unique_ptr<FftPlan>> plans;
+    std::map<size_t, std::vector<float>> windows;
+    std::vector<size_t> sizes(captures.size(), 0);
+    for (size_t i = 0; i < captures.size(); ++i)
+    {
+        size_t size = std::min(FloorPowerOfTwo(std::max<size_t>(options.fftSize, 1)),
+                               FloorPowerOfTwo(std::max<size_t>(captures[i].samples.size(), 1)));
+        if (size < 64)
+            continue;
+        sizes[i] = size;
+        if (!plans.count(size))
+        {
+            plans[size] = std::make_unique<FftPlan>(size);
+            std::vector<float>& window = windows[size];
+            window.resize(size);
+            for (size_t k = 0; k < size; ++k)
+                window[k] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * PI * k / size));
+        }
+    }
+
+    unsigned threadCount = options.threadCount ? options.threadCount : std::thread::hardware_concurrency();
+    threadCount = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(captures.size())));
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        Scratch scratch;
+        for (size_t i = next++; i < captures.size(); i = next++)
+        {
+            const FftPlan* plan = sizes[i] ? plans.at(sizes[i]).get() : nullptr;
+            const std::vector<float>* window = sizes[i] ? &windows.at(sizes[i]) : nullptr;
+            results[i] = AnalyzeCapture(captures[i], plan, window, options, scratch);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return results;
+}
+
+void SynthesizeFlicker(const FlickerWaveform& waveform, float sampleRate, size_t count, uint32_t seed,
+                       FlickerCapture& capture)
+{
+    // A square wave of this depth and duty has high and low levels averaging to the mean
+    const double mean = waveform.mean;
+    const double depth = waveform.frequency > 0.0f && waveform.duty < 1.0f ? waveform.depth : 0.0;
+    const bool pwm = waveform.duty > 0.0f && waveform.duty < 1.0f;
+    double high = mean * (1.0 + depth);
+    double low = mean * (1.0 - depth);
+    if (pwm)
+    {
+        double sum = 2.0 * mean / (1.0 + depth * (2.0 * waveform.duty - 1.0));
+        high = 0.5 * sum * (1.0 + depth);
+        low = 0.5 * sum * (1.0 - depth);
+    }
+
+    std::mt19937 random(seed);
+    std::normal_distribution<float> normal(0.0f, waveform.noise * waveform.mean);
+    capture.sampleRate = sampleRate;
+    capture.darkOffset = 0.0f;
+    capture.samples.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        double cycles = waveform.frequency * (static_cast<double>(i) + 0.5) / sampleRate;
+        double phase = cycles - std::floor(cycles);
+        double value = pwm ? (phase < waveform.duty ? high : low) : mean * (1.0 + depth * std::sin(2.0 * PI * phase));
+        capture.samples[i] = static_cast<float>(value) + (waveform.noise > 0.0f ? normal(random) : 0.0f);
+    }
+}
+
+FlickerResult ExpectedFlicker(const FlickerWaveform& waveform)
+{
+    FlickerResult result;
+    result.meanSignal = waveform.mean;
+    if (waveform.frequency <= 0.0f || waveform.depth <= 0.0f || waveform.duty >= 1.0f)
+        return result;
+
+    // A sine spends a share depth / pi of its area above the mean. A square wave's area above the
+    // mean is duty (1 - duty) (high - low) per period.
+    double depth = waveform.depth;
+    double duty = waveform.duty;
+    result.frequency = waveform.frequency;
+    result.modulationDepth = static_cast<float>(100.0 * depth);
+    if (duty > 0.0 && duty < 1.0)
+        result.flickerIndex = static_cast<float>(2.0 * duty * (1.0 - duty) * depth / (1.0 + depth * (2.0 * duty - 1.0)));
+    else
+        result.flickerIndex = static_cast<float>(depth / PI);
+    return result;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One high-rate light sensor capture taken while a single level was displayed
+struct FlickerCapture
+{
+    float level = 0.0f;         // nits shown in the measured patch
+    float sampleRate = 0.0f;    // sensor samples per second
+    float darkOffset = 0.0f;    // sensor reading with the patch at 0 nits
+    std::vector<float> samples; // linear sensor readings
+};
+
+struct FlickerResult
+{
+    float level = 0.0f;
+    float frequency = 0.0f;       // Hz of the dominant flicker component, 0 if none found
+    float modulationDepth = 0.0f; // percent flicker: (max - min) / (max + min) * 100
+    float flickerIndex = 0.0f;    // area above the mean divided by the total area, per period
+    float meanSignal = 0.0f;      // mean sensor reading after dark offset removal
+};
+
+struct FlickerOptions
+{
+    size_t fftSize = 4096;             // samples per window, power of two
+    float minFrequency = 20.0f;        // ignore slow drift below this
+    float maxFrequency = 0.0f;         // 0 means up to Nyquist
+    float detectionThreshold = 0.002f; // minimum component amplitude relative to the mean
+    unsigned threadCount = 0;          // 0 means one per hardware thread
+};
+
+// Radix-2 FFT over a batch of interleaved transforms.
+// Sample k of lane b lives at index k * batch + b, so every butterfly
+// touches contiguous memory and loads its twiddle factor once per batch.
+class FftPlan
+{
+public:
+    explicit FftPlan(size_t size);
+
+    size_t Size() const { return m_size; }
+    void ForwardBatch(float* re, float* im, size_t batch) const;
+
+private:
+    size_t m_size;
+    std::vector<unsigned> m_bitReverse;
+    std::vector<float> m_cos;
+    std::vector<float> m_sin;
+};
+
+// Analyze all captures of a sweep, one result per capture in the same order
+std::vector<FlickerResult> AnalyzeFlicker(const std::vector<FlickerCapture>& captures,
+                                          const FlickerOptions& options = {});
+
+// A light of known flicker, for checking the analysis and timing it
+struct FlickerWaveform
+{
+    float frequency = 0.0f; // Hz
+    float mean = 100.0f;    // sensor reading averaged over a period
+    float depth = 1.0f;     // (max - min) / (max + min); 1 turns the light off between pulses
+    float duty = 0.0f;      // share of each period a PWM square wave is high, 0 for a sine, 1 for steady
+    float noise = 0.0f;     // standard deviation as a share of the mean
+};
+
+// The waveform at the middle of each sample interval from phase 0, with noise repeating for the same seed
+void SynthesizeFlicker(const FlickerWaveform& waveform, float sampleRate, size_t count, uint32_t seed,
+                       FlickerCapture& capture);
+
+// What AnalyzeFlicker should find in a noiseless capture of the waveform
+FlickerResult ExpectedFlicker(const FlickerWaveform& waveform);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+enum class FrameEncoding
+{
+    ScRgbHalf, // RGBA FP16, linear BT.709, 1.0 = 80 nits
+    Hdr10Pq    // A2B10G10R10 unorm, PQ encoded BT.2020, red in the low bits
+};
+
+// CPU copy of a rendered frame with tightly packed rows.
+// Pixels come from the heap unless a resource is given, such as a huge page PagePool.
+struct FrameBuffer
+{
+    FrameBuffer() = default;
+    explicit FrameBuffer(std::pmr::memory_resource* resource) : data(resource) {}
+
+    int width = 0;
+    int height = 0;
+    FrameEncoding encoding = FrameEncoding::ScRgbHalf;
+    std::pmr::vector<uint8_t> data;
+
+    static size_t BytesPerPixel(FrameEncoding encoding)
+    {
+        return encoding == FrameEncoding::ScRgbHalf ? 8 : 4;
+    }
+
+    size_t RowPitch() const { return static_cast<size_t>(width) * BytesPerPixel(encoding); }
+
+    void Resize(int newWidth, int newHeight, FrameEncoding newEncoding)
+    {
+        width = newWidth;
+        height = newHeight;
+        encoding = newEncoding;
+        data.resize(RowPitch() * static_cast<size_t>(height));
+    }
+
+    uint16_t* Half() { return reinterpret_cast<uint16_t*>(data.data()); }
+    const uint16_t* Half() const { return reinterpret_cast<const uint16_t*>(data.data()); }
+    uint32_t* Packed() { return reinterpret_cast<uint32_t*>(data.data()); }
+    const uint32_t* Packed() const { return reinterpret_cast<const uint32_t*>(data.data()); }
+};
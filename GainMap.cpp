@@ -0,0 +1,446 @@
+#include "GainMap.h"
+#include "ColorMath.h"
+#include "Half.h"
+#include "MeasurementReport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define GAIN_MAP_F16C 1
+#define GAIN_MAP_TARGET __attribute__((target("avx,f16c")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define GAIN_MAP_F16C 1
+#define GAIN_MAP_TARGET
+#endif
+
+namespace
+{
+    const float MIN_NITS = 1.0f;     // darker patches are mostly meter noise
+    const float MIN_GAIN = 0.5f;     // corrections beyond these are a bad measurement, not the panel
+    const float MAX_GAIN = 2.0f;
+    const size_t READ_CHUNK = 8192;
+    const int BAND_ROWS = 32;        // rows a thread takes at a time
+    const int TILE = 32;             // pixels a side of the tiles ScalePattern cuts rects into
+
+    // Channels per pixel in the lane tables; alpha's lane is always 1
+    const int LANES = 4;
+
+    void ScaleSpanScalar(uint16_t* pixels, const float* upper, const float* lower, float weight, int count)
+    {
+        for (int i = 0; i < count * LANES; i += LANES)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                float gain = upper[i + c] + (lower[i + c] - upper[i + c]) * weight;
+                pixels[i + c] = FloatToHalf(HalfToFloat(pixels[i + c]) * gain);
+            }
+        }
+    }
+
+    void FillSpanScalar(uint16_t* pixels, const float* upper, const float* lower, float weight, const float color[4],
+                        int count)
+    {
+        for (int i = 0; i < count * LANES; i += LANES)
+        {
+            for (int c = 0; c < LANES; ++c)
+                pixels[i + c] = FloatToHalf(color[c] * (upper[i + c] + (lower[i + c] - upper[i + c]) * weight));
+        }
+    }
+
+#ifdef GAIN_MAP_F16C
+    bool DetectF16c()
+    {
+        unsigned int regs[4] = {};
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        for (int i = 0; i < 4; ++i)
+            regs[i] = static_cast<unsigned int>(info[i]);
+#else
+        if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+            return false;
+#endif
+        const unsigned int OSXSAVE = 1u << 27, AVX = 1u << 28, F16C = 1u << 29;
+        if ((regs[2] & (OSXSAVE | AVX | F16C)) != (OSXSAVE | AVX | F16C))
+            return false;
+
+        // The OS has to save the YMM registers too
+#ifdef _MSC_VER
+        unsigned long long enabled = _xgetbv(0);
+#else
+        unsigned int low, high;
+        __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        unsigned long long enabled = (static_cast<unsigned long long>(high) << 32) | low;
+#endif
+        return (enabled & 6) == 6;
+    }
+
+    const bool HAS_F16C = DetectF16c();
+
+    // Eight pixels, one cache line, per step. Halves widen to floats, scale and round back to
+    // nearest even. Lines that are black apart from alpha stay black, and are not written, so
+    // the dark surround of a pattern is only read.
+    GAIN_MAP_TARGET void ScaleSpanF16c(uint16_t* pixels, const float* upper, const float* lower, float weight,
+                                       int count)
+    {
+        __m256 lowerWeight = _mm256_set1_ps(weight);
+        __m256 upperWeight = _mm256_set1_ps(1.0f - weight);
+        __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+        int lines = count / 8;
+        for (int i = 0; i < lines; ++i)
+        {
+            __m128i* line = reinterpret_cast<__m128i*>(pixels + i * 32);
+            __m128i pairs[4];
+            for (int p = 0; p < 4; ++p)
+                pairs[p] = _mm_loadu_si128(line + p);
+            __m128i any = _mm_or_si128(_mm_or_si128(pairs[0], pairs[1]), _mm_or_si128(pairs[2], pairs[3]));
+            if (_mm_testz_si128(any, colorMask))
+                continue;
+
+            for (int p = 0; p < 4; ++p)
+            {
+                size_t lane = static_cast<size_t>(i) * 32 + p * 8;
+                __m256 gain = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(upper + lane), upperWeight),
+                                            _mm256_mul_ps(_mm256_loadu_ps(lower + lane), lowerWeight));
+                __m256 value = _mm256_mul_ps(_mm256_cvtph_ps(pairs[p]), gain);
+                _mm_storeu_si128(line + p, _mm256_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT));
+            }
+        }
+        int done = lines * 8;
+        ScaleSpanScalar(pixels + done * LANES, upper + done * LANES, lower + done * LANES, weight, count - done);
+    }
+
+    GAIN_MAP_TARGET void FillSpanF16c(uint16_t* pixels, const float* upper, const float* lower, float weight,
+                                      const float color[4], int count)
+    {
+        __m256 lowerWeight = _mm256_set1_ps(weight);
+        __m256 upperWeight = _mm256_set1_ps(1.0f - weight);
+        __m256 colors = _mm256_setr_ps(color[0], color[1], color[2], color[3], color[0], color[1], color[2], color[3]);
+        int pairs = count / 2;
+        for (int i = 0; i < pairs; ++i)
+        {
+            __m256 gain = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(upper + i * 8), upperWeight),
+                                        _mm256_mul_ps(_mm256_loadu_ps(lower + i * 8), lowerWeight));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i * 8),
+                             _mm256_cvtps_ph(_mm256_mul_ps(colors, gain), _MM_FROUND_TO_NEAREST_INT));
+        }
+        if (count & 1)
+            FillSpanScalar(pixels + pairs * 8, upper + pairs * 8, lower + pairs * 8, weight, color, 1);
+    }
+#endif
+
+    void ScaleSpan(uint16_t* pixels, const float* upper, const float* lower, float weight, int count)
+    {
+#ifdef GAIN_MAP_F16C
+        if (HAS_F16C)
+            return ScaleSpanF16c(pixels, upper, lower, weight, count);
+#endif
+        ScaleSpanScalar(pixels, upper, lower, weight, count);
+    }
+
+    void FillSpan(uint16_t* pixels, const float* upper, const float* lower, float weight, const float color[4],
+                  int count)
+    {
+#ifdef GAIN_MAP_F16C
+        if (HAS_F16C)
+            return FillSpanF16c(pixels, upper, lower, weight, color, count);
+#endif
+        FillSpanScalar(pixels, upper, lower, weight, color, count);
+    }
+
+    // Position of a pixel center between cell centers: the cell at or before it and the weight of the next.
+    // Outside the first and last centers the edge cell applies unchanged.
+    void Locate(int pixel, int pixels, int cells, int& cell, float& weight)
+    {
+        float position = (pixel + 0.5f) * cells / pixels - 0.5f;
+        position = std::min(std::max(position, 0.0f), static_cast<float>(cells - 1));
+        cell = std::min(static_cast<int>(position), cells - 1);
+        weight = position - cell;
+    }
+
+    struct Cell
+    {
+        double ratio = 0.0;
+        size_t count = 0;
+    };
+}
+
+bool BuildGainGrid(const std::string& sessionPath, int columns, int rows, GainGrid& grid, std::string& error)
+{
+    if (columns < 1 || rows < 1)
+    {
+        error = "the gain grid needs at least one column and row";
+        return false;
+    }
+
+    MeasurementReader reader;
+    if (!reader.Open(sessionPath))
+    {
+        error = "cannot open " + sessionPath;
+        return false;
+    }
+
+    // Mean measured-to-target ratio per cell, as the report's uniformity section bins it
+    std::vector<Cell> cells(static_cast<size_t>(columns) * rows);
+    std::vector<PatchMeasurement> chunk;
+    for (reader.Read(chunk, READ_CHUNK); !chunk.empty(); reader.Read(chunk, READ_CHUNK))
+    {
+        for (const PatchMeasurement& patch : chunk)
+        {
+            float targetNits = Bt2020Luminance(patch.target[0], patch.target[1], patch.target[2]);
+            if (!patch.measured.valid || targetNits < MIN_NITS || patch.screenX < 0.0f || patch.screenX > 1.0f ||
+                patch.screenY < 0.0f || patch.screenY > 1.0f)
+                continue;
+            int column = std::min(columns - 1, static_cast<int>(patch.screenX * columns));
+            int row = std::min(rows - 1, static_cast<int>(patch.screenY * rows));
+            Cell& cell = cells[static_cast<size_t>(row) * columns + column];
+            ++cell.count;
+            cell.ratio += patch.measured.luminance / targetNits;
+        }
+    }
+
+    const Cell& center = cells[static_cast<size_t>(rows / 2) * columns + columns / 2];
+    if (center.count == 0 || center.ratio <= 0.0)
+    {
+        error = "no usable patches in the center cell of " + sessionPath;
+        return false;
+    }
+
+    double reference = center.ratio / center.count;
+    grid.columns = columns;
+    grid.rows = rows;
+    grid.gains.assign(cells.size(), 1.0f);
+    for (size_t i = 0; i < cells.size(); ++i)
+    {
+        if (cells[i].count > 0 && cells[i].ratio > 0.0)
+            cells[i].ratio = reference / (cells[i].ratio / cells[i].count);
+        else
+            cells[i].count = 0;
+    }
+
+    // Cells without patches blend the measured ones by inverse squared distance, so a sparse
+    // measurement still gives a smooth map
+    for (int row = 0; row < rows; ++row)
+    {
+        for (int column = 0; column < columns; ++column)
+        {
+            size_t index = static_cast<size_t>(row) * columns + column;
+            double gain = cells[index].ratio;
+            if (cells[index].count == 0)
+            {
+                double total = 0.0;
+                double weights = 0.0;
+                for (size_t other = 0; other < cells.size(); ++other)
+                {
+                    if (cells[other].count == 0)
+                        continue;
+                    double dx = static_cast<double>(other % columns) - column;
+                    double dy = static_cast<double>(other / columns) - row;
+                    double weight = 1.0 / (dx * dx + dy * dy);
+                    total += weight * cells[other].ratio;
+                    weights += weight;
+                }
+                gain = total / weights;
+            }
+            grid.gains[index] = std::min(MAX_GAIN, std::max(MIN_GAIN, static_cast<float>(gain)));
+        }
+    }
+    return true;
+}
+
+std::string FormatGainGrid(const GainGrid& grid)
+{
+    std::string text;
+    char cell[16];
+    for (int row = 0; row < grid.rows; ++row)
+    {
+        for (int column = 0; column < grid.columns; ++column)
+        {
+            std::snprintf(cell, sizeof(cell), column ? " %6.3f" : "%6.3f", grid.At(column, row));
+            text += cell;
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+void GainMap::SetGrid(const GainGrid& grid)
+{
+    m_grid = grid;
+    m_width = 0;
+    m_height = 0;
+}
+
+bool GainMap::Vectorized()
+{
+#ifdef GAIN_MAP_F16C
+    return HAS_F16C;
+#else
+    return false;
+#endif
+}
+
+void GainMap::Prepare(int width, int height)
+{
+    if (width == m_width && height == m_height)
+        return;
+
+    m_width = width;
+    m_height = height;
+    m_lanes.assign(static_cast<size_t>(m_grid.rows) * width * LANES, 1.0f);
+    for (int x = 0; x < width; ++x)
+    {
+        int column;
+        float weight;
+        Locate(x, width, m_grid.columns, column, weight);
+        int next = std::min(column + 1, m_grid.columns - 1);
+        for (int row = 0; row < m_grid.rows; ++row)
+        {
+            float gain = m_grid.At(column, row) + (m_grid.At(next, row) - m_grid.At(column, row)) * weight;
+            float* lanes = &m_lanes[(static_cast<size_t>(row) * width + x) * LANES];
+            lanes[0] = lanes[1] = lanes[2] = gain;
+        }
+    }
+
+    m_rowCell.resize(height);
+    m_rowWeight.resize(height);
+    for (int y = 0; y < height; ++y)
+        Locate(y, height, m_grid.rows, m_rowCell[y], m_rowWeight[y]);
+}
+
+void GainMap::ApplyRows(FrameBuffer& frame, int top, int bottom) const
+{
+    size_t laneRow = static_cast<size_t>(frame.width) * LANES;
+    for (int y = top; y < bottom; ++y)
+    {
+        int cell = m_rowCell[y];
+        const float* upper = &m_lanes[cell * laneRow];
+        const float* lower = &m_lanes[std::min(cell + 1, m_grid.rows - 1) * laneRow];
+        ScaleSpan(frame.Half() + y * laneRow, upper, lower, m_rowWeight[y], frame.width);
+    }
+}
+
+bool GainMap::Apply(FrameBuffer& frame, unsigned threadCount)
+{
+    if (frame.encoding != FrameEncoding::ScRgbHalf)
+        return false;
+    if (Empty() || frame.width <= 0 || frame.height <= 0)
+        return true;
+
+    Prepare(frame.width, frame.height);
+
+    int bands = (frame.height + BAND_ROWS - 1) / BAND_ROWS;
+    threadCount = threadCount ? threadCount : std::thread::hardware_concurrency();
+    threadCount = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(bands)));
+
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int band = next++; band < bands; band = next++)
+            ApplyRows(frame, band * BAND_ROWS, std::min(frame.height, (band + 1) * BAND_ROWS));
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return true;
+}
+
+void GainMap::FillRect(FrameBuffer& frame, const PixelRect& rect, const ScRgb& color)
+{
+    int left = std::max(rect.left, 0);
+    int top = std::max(rect.top, 0);
+    int right = std::min(rect.right, frame.width);
+    int bottom = std::min(rect.bottom, frame.height);
+    if (Empty() || left >= right || top >= bottom || frame.encoding != FrameEncoding::ScRgbHalf)
+        return;
+
+    Prepare(frame.width, frame.height);
+
+    const float pixel[4] = { color.r, color.g, color.b, 1.0f };
+    size_t laneRow = static_cast<size_t>(frame.width) * LANES;
+    for (int y = top; y < bottom; ++y)
+    {
+        int cell = m_rowCell[y];
+        size_t offset = static_cast<size_t>(left) * LANES;
+        const float* upper = &m_lanes[cell * laneRow + offset];
+        const float* lower = &m_lanes[std::min(cell + 1, m_grid.rows - 1) * laneRow + offset];
+        FillSpan(frame.Half() + y * laneRow + offset, upper, lower, m_rowWeight[y], pixel, right - left);
+    }
+}
+
+void GainMap::ScalePattern(Pattern& pattern, int width, int height)
+{
+    if (Empty() || width <= 0 || height <= 0)
+        return;
+
+    // Black stays black whatever the gain, so it is kept whole
+    auto black = [](const ScRgb& color) { return color.r == 0.0f && color.g == 0.0f && color.b == 0.0f; };
+    std::pmr::vector<PatternRect> tiles(pattern.rects.get_allocator().resource());
+    auto split = [&](const PixelRect& rect, const ScRgb& color)
+    {
+        if (black(color))
+        {
+            tiles.push_back({ rect, color });
+            return;
+        }
+        int left = std::max(rect.left, 0);
+        int right = std::min(rect.right, width);
+        int bottom = std::min(rect.bottom, height);
+        for (int top = std::max(rect.top, 0); top < bottom;)
+        {
+            int tileBottom = std::min(bottom, (top / TILE + 1) * TILE);
+            for (int x = left; x < right;)
+            {
+                int tileRight = std::min(right, (x / TILE + 1) * TILE);
+                float gain = GainAt((x + tileRight) / 2, (top + tileBottom) / 2, width, height);
+                PatternRect tile;
+                tile.rect = { x, top, tileRight, tileBottom };
+                tile.color = { color.r * gain, color.g * gain, color.b * gain };
+                tiles.push_back(tile);
+                x = tileRight;
+            }
+            top = tileBottom;
+        }
+    };
+
+    // A background that shows becomes tiles under the rects
+    if (!black(pattern.background))
+        split({ 0, 0, width, height }, pattern.background);
+    for (const PatternRect& rect : pattern.rects)
+        split(rect.rect, rect.color);
+
+    // The label's glyphs too, as the CPU renderer scales them, so it goes as rects
+    std::pmr::vector<PatternRect> glyphs(pattern.rects.get_allocator().resource());
+    RasterizeLabel(pattern.label, glyphs);
+    for (const PatternRect& glyph : glyphs)
+        split(glyph.rect, glyph.color);
+    pattern.label.text.clear();
+    pattern.rects.swap(tiles);
+}
+
+float GainMap::GainAt(int x, int y, int width, int height)
+{
+    if (Empty() || x < 0 || y < 0 || x >= width || y >= height)
+        return 1.0f;
+
+    Prepare(width, height);
+
+    size_t laneRow = static_cast<size_t>(m_width) * LANES;
+    int cell = m_rowCell[y];
+    float upper = m_lanes[cell * laneRow + static_cast<size_t>(x) * LANES];
+    float lower = m_lanes[std::min(cell + 1, m_grid.rows - 1) * laneRow + static_cast<size_t>(x) * LANES];
+    return upper + (lower - upper) * m_rowWeight[y];
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "FrameBuffer.h"
+#include "Layout.h"
+#include "Pattern.h"
+
+#include <string>
+#include <vector>
+
+// Luminance corrections at the centers of a coarse grid of screen cells, row-major; 1 leaves a cell alone
+struct GainGrid
+{
+    int columns = 0;
+    int rows = 0;
+    std::vector<float> gains;
+
+    bool Empty() const { return gains.empty(); }
+    float At(int column, int row) const { return gains[static_cast<size_t>(row) * columns + column]; }
+};
+
+// Gains from a session file measured across the screen (see MeasurementReport): every cell is
+// scaled so it measures like the center cell. Cells without patches are filled in from the
+// measured ones.
+bool BuildGainGrid(const std::string& sessionPath, int columns, int rows, GainGrid& grid, std::string& error);
+
+std::string FormatGainGrid(const GainGrid& grid);
+
+// Per-pixel gain map interpolated bilinearly between cell centers, for FP16 scRGB frames.
+// The map for a resolution is built on first use and kept until the size or grid changes.
+// It is stored as one row of pixel gains per grid row, small enough to stay in cache,
+// and each frame row blends the two grid rows around it.
+class GainMap
+{
+public:
+    void SetGrid(const GainGrid& grid);
+    const GainGrid& Grid() const { return m_grid; }
+    bool Empty() const { return m_grid.Empty(); }
+
+    // Multiplies red, green and blue by the gain under each pixel, leaving alpha alone.
+    // Rows are split over threadCount threads (0 is one per hardware thread).
+    bool Apply(FrameBuffer& frame, unsigned threadCount = 0);
+
+    // Fills rect with color scaled by the gain under each pixel, in one pass instead of a fill and an Apply.
+    // Does nothing without a grid.
+    void FillRect(FrameBuffer& frame, const PixelRect& rect, const ScRgb& color);
+
+    // For renderers that only clear rects, such as the Vulkan one: splits a non-black background and
+    // every non-black rect, label glyphs included, into tiles on a screen-aligned grid, each scaled by
+    // the gain at its center.
+    void ScalePattern(Pattern& pattern, int width, int height);
+
+    // Gain under one pixel of a width x height frame
+    float GainAt(int x, int y, int width, int height);
+
+    // True when the kernels use F16C rather than converting one half at a time
+    static bool Vectorized();
+
+private:
+    void Prepare(int width, int height);
+    void ApplyRows(FrameBuffer& frame, int top, int bottom) const;
+
+    GainGrid m_grid;
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<float> m_lanes;     // per grid row, gains for each pixel's four channels (alpha 1)
+    std::vector<int> m_rowCell;     // per frame row, the grid row above it
+    std::vector<float> m_rowWeight; // per frame row, weight of the grid row below it
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// IEEE 754 binary16 conversions for FP16 frame buffers
+
+inline float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    uint32_t bits;
+
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Subnormal half becomes a normal float
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Round to nearest even, overflow to infinity, underflow through subnormals
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+    if (magnitude >= 0x7F800000u)
+        return static_cast<uint16_t>(sign | 0x7C00 | (magnitude > 0x7F800000u ? 0x200 : 0));
+    if (magnitude >= 0x477FF000u)
+        return static_cast<uint16_t>(sign | 0x7C00); // rounds past 65504
+    if (magnitude < 0x38800000u)
+    {
+        // Subnormal or zero half
+        if (magnitude < 0x33000000u)
+            return sign;
+        uint32_t exponent = magnitude >> 23;
+        uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t result = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (result & 1)))
+            ++result;
+        return static_cast<uint16_t>(sign | result);
+    }
+
+    uint32_t result = ((magnitude - 0x38000000u) >> 13);
+    uint32_t remainder = magnitude & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1)))
+        ++result;
+    return static_cast<uint16_t>(sign | result);
+}
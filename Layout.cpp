@@ -0,0 +1,47 @@
+#include "Layout.h"
+
+#include <algorithm>
+#include <cmath>
+
+PatternLayout ComputePatternLayout(int width, int height, float dpiScale)
+{
+    PatternLayout layout;
+    width = std::max(width, 0);
+    height = std::max(height, 0);
+    dpiScale = dpiScale > 0.0f ? dpiScale : 1.0f;
+
+    // Outer size and inner size differ by an even amount so the margin is whole on both sides
+    int outerSize = std::max(2, static_cast<int>(std::lround(height / 6.0)));
+    int innerSize = outerSize / 2;
+    if ((outerSize - innerSize) % 2 != 0)
+        ++innerSize;
+    int margin = (outerSize - innerSize) / 2;
+
+    layout.outer.left = (width - outerSize) / 2;
+    layout.outer.top = (height - outerSize) / 2;
+    layout.outer.right = layout.outer.left + outerSize;
+    layout.outer.bottom = layout.outer.top + outerSize;
+
+    layout.inner.left = layout.outer.left + margin;
+    layout.inner.top = layout.outer.top + margin;
+    layout.inner.right = layout.inner.left + innerSize;
+    layout.inner.bottom = layout.inner.top + innerSize;
+
+    // Window sized by area, so it is the same share of every screen shape up to 10:1, where it fills the height
+    int windowSize = std::min({ static_cast<int>(std::lround(std::sqrt(0.1 * width * height))), width, height });
+    layout.window.left = (width - windowSize) / 2;
+    layout.window.top = (height - windowSize) / 2;
+    layout.window.right = layout.window.left + windowSize;
+    layout.window.bottom = layout.window.top + windowSize;
+
+    // Text scales with DPI; the label is the same gap below the outer square as the inner margin
+    layout.fontSize = 24.0f * dpiScale;
+    int labelHeight = static_cast<int>(std::ceil(40.0f * dpiScale));
+    int labelWidth = std::min(std::max(outerSize, static_cast<int>(std::ceil(layout.fontSize * 8.0f))), width);
+    layout.label.left = (width - labelWidth) / 2;
+    layout.label.right = layout.label.left + labelWidth;
+    layout.label.top = std::min(layout.outer.bottom + margin, std::max(height - labelHeight, layout.outer.bottom));
+    layout.label.bottom = layout.label.top + labelHeight;
+
+    return layout;
+}
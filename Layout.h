@@ -0,0 +1,28 @@
+#pragma once
+
+// Integer pixel rectangle, right and bottom exclusive
+struct PixelRect
+{
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+
+    int Width() const { return right - left; }
+    int Height() const { return bottom - top; }
+};
+
+// Where the calibration pattern goes on a back buffer of a given size.
+// All patch edges land on whole pixels so no edge is blended by antialiasing,
+// and the inner patch has the same whole-pixel margin on every side.
+struct PatternLayout
+{
+    PixelRect outer;  // outer square, 1/6 of the screen height
+    PixelRect inner;  // inner square, half the outer size, centered in it
+    PixelRect label;  // text box below the outer square
+    PixelRect window; // centered square covering 10% of the screen area
+    float fontSize = 0.0f; // pixels
+};
+
+// width and height are native back buffer pixels, dpiScale is DPI / 96
+PatternLayout ComputePatternLayout(int width, int height, float dpiScale);
@@ -0,0 +1,151 @@
+#include "LevelDetect.h"
+#include "ColorMath.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    // How far the tracking reading must be from the flat one for there to be an edge between them:
+    // this many times the spread of the two flat readings, a share of the flat level, or a floor in nits
+    const float NOISE_MARGIN = 4.0f;
+    const float MIN_MARGIN_SHARE = 0.01f;
+    const float MIN_MARGIN_NITS = 0.001f;
+
+    const float BRACKET_CODES = 2.0f; // first bracket either side of the guess, in resolution steps
+}
+
+bool GetLevelEdge(BrightnessMode mode, LevelEdge& edge)
+{
+    switch (mode)
+    {
+    case BrightnessMode::MaxWhite:
+    case BrightnessMode::FullFieldPeak:
+    case BrightnessMode::Window10:
+        edge = LevelEdge::Clip;
+        return true;
+    case BrightnessMode::MinBlack:
+        edge = LevelEdge::Crush;
+        return true;
+    default:
+        return false;
+    }
+}
+
+LevelDetectResult DetectLevelEdge(LevelEdge edge, const ReadLevel& read, const LevelDetectOptions& options)
+{
+    LevelDetectResult result;
+    result.edge = edge;
+    const bool clip = edge == LevelEdge::Clip;
+
+    float low = std::max(options.lowNits, 0.0f);
+    float high = std::min(options.highNits, PQ_MAX_NITS);
+    float anchor = clip ? std::clamp(options.anchorNits, low, high) : high;
+    float flatEnd = clip ? high : low;
+    if (!(low < high) || anchor == flatEnd)
+    {
+        result.error = "nothing to search between the anchor and the end of the range";
+        return result;
+    }
+
+    auto measure = [&](float level, float& luminance)
+    {
+        if (result.readings >= options.maxReadings)
+        {
+            result.error = "no edge within " + std::to_string(options.maxReadings) + " readings";
+            return false;
+        }
+        ++result.readings;
+        Measurement measurement;
+        if (!read(level, measurement) || !measurement.valid)
+        {
+            result.error = "meter read failed";
+            return false;
+        }
+        luminance = measurement.luminance;
+        return true;
+    };
+
+    // The flat segment, with its noise, and the slope of the tracking one through zero
+    float first = 0.0f;
+    float second = 0.0f;
+    float tracking = 0.0f;
+    if (!measure(flatEnd, first) || !measure(flatEnd, second) || !measure(anchor, tracking))
+        return result;
+    float flat = 0.5f * (first + second);
+    float margin = std::max({ NOISE_MARGIN * std::abs(first - second), MIN_MARGIN_SHARE * flat, MIN_MARGIN_NITS });
+    result.flatNits = flat;
+    if (clip ? tracking >= flat - margin || tracking <= 0.0f : tracking <= flat + margin)
+    {
+        char message[128];
+        std::snprintf(message, sizeof(message), "no change between %g nits (%g) and %g nits (%g)", anchor,
+                      tracking, flatEnd, flat);
+        result.error = message;
+        return result;
+    }
+    float slope = tracking / anchor;
+
+    // A reading is beyond the edge when the flat segment explains it better than the tracking one.
+    // Everything is searched in PQ, where one step is as visible at 0.05 nits as at 1000.
+    float below = PqEncode(clip ? anchor : low); // known not beyond
+    float above = PqEncode(clip ? high : anchor); // known beyond
+    auto beyond = [&](float signal, bool& isBeyond)
+    {
+        float level = PqDecode(signal);
+        float luminance = 0.0f;
+        if (!measure(level, luminance))
+            return false;
+        bool flatter = std::abs(luminance - flat) <= std::abs(luminance - slope * level);
+        isBeyond = flatter == clip;
+        return true;
+    };
+
+    result.estimate = std::clamp(flat / slope, PqDecode(below), PqDecode(above));
+    float guess = PqEncode(result.estimate);
+
+    // Bracket the guess, widening on the side the edge turns out to be
+    bool isBeyond = false;
+    for (float step = BRACKET_CODES * options.resolution; guess - step > below; step *= 2.0f)
+    {
+        if (!beyond(guess - step, isBeyond))
+            return result;
+        (isBeyond ? above : below) = guess - step;
+        if (!isBeyond)
+            break;
+    }
+    for (float step = BRACKET_CODES * options.resolution; guess + step < above; step *= 2.0f)
+    {
+        if (!beyond(guess + step, isBeyond))
+            return result;
+        (isBeyond ? above : below) = guess + step;
+        if (isBeyond)
+            break;
+    }
+
+    while (above - below > options.resolution)
+    {
+        float middle = 0.5f * (below + above);
+        if (!beyond(middle, isBeyond))
+            return result;
+        (isBeyond ? above : below) = middle;
+    }
+
+    // Both segments predict the same light at the guess, so a reading there cannot tell the sides
+    // apart; when the last code holds it, the guess is closer than either end
+    result.level = guess >= below && guess <= above ? result.estimate : PqDecode(clip ? above : below);
+    result.found = true;
+    return result;
+}
+
+std::string FormatLevelDetectResult(const LevelDetectResult& result)
+{
+    const char* edge = result.edge == LevelEdge::Clip ? "clip" : "crush";
+    char buffer[256];
+    if (result.found)
+        std::snprintf(buffer, sizeof(buffer), "%s at %.4g nits (flat at %.4g nits, first guess %.4g) in %zu readings\n",
+                      edge, result.level, result.flatNits, result.estimate, result.readings);
+    else
+        std::snprintf(buffer, sizeof(buffer), "%s not found after %zu readings: %s\n", edge, result.readings,
+                      result.error.c_str());
+    return buffer;
+}
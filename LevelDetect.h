@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Meter.h"
+#include "Modes.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Where the response of a mode stops following its level: the clip point of a white mode,
+// above which more signal gives no more light, or the crush point of black, below which
+// less signal gives no less
+enum class LevelEdge
+{
+    Clip,
+    Crush
+};
+
+// Clip for the modes that adjust a white level, crush for min black; false for paper white,
+// which has no edge to find
+bool GetLevelEdge(BrightnessMode mode, LevelEdge& edge);
+
+// Shows the mode's pattern at level and reads it once the light has settled
+using ReadLevel = std::function<bool(float level, Measurement& measurement)>;
+
+struct LevelDetectOptions
+{
+    float lowNits = 0.0f;      // range searched
+    float highNits = 10000.0f;
+    float anchorNits = 100.0f; // a level a clip search may take as below the clip; a crush search uses highNits
+    float resolution = 1.0f / 1023.0f; // PQ signal the search stops at, one 10 bit code
+    size_t maxReadings = 20;
+};
+
+struct LevelDetectResult
+{
+    bool found = false;
+    std::string error;
+    LevelEdge edge = LevelEdge::Clip;
+    float level = 0.0f;    // nits: the lowest level that clips, or the highest that is crushed
+    float estimate = 0.0f; // the first guess, from the flat and tracking readings alone
+    float flatNits = 0.0f; // light where the response is flat: the peak or the black level
+    size_t readings = 0;
+};
+
+// Finds the edge in a handful of readings. Two readings of the flat end give its level and noise,
+// and one at the anchor the slope of the part that follows the signal. Where the two segments
+// meet is the first guess, bracketed two codes either side in PQ and bisected. Each reading is
+// put on the segment that explains it better, so one noisy reading at the edge moves the result
+// by a code, not to the other end of the range.
+LevelDetectResult DetectLevelEdge(LevelEdge edge, const ReadLevel& read, const LevelDetectOptions& options);
+
+// "clip at 998.4 nits (flat at 1000.2 nits, first guess 1001.0) in 7 readings"
+std::string FormatLevelDetectResult(const LevelDetectResult& result);
@@ -0,0 +1,2001 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <unistd.h>
+#include "Arena.h"
+#include "Bench.h"
+#include "ColorMath.h"
+#include "CpuRenderer.h"
+#include "DeviceRecovery.h"
+#include "DisplayCache.h"
+#include "DrawList.h"
+#include "Edid.h"
+#include "Energy.h"
+#include "FalseColor.h"
+#include "GainMap.h"
+#include "Half.h"
+#include "Layout.h"
+#include "LevelDetect.h"
+#include "MeasurementReport.h"
+#include "MemoryLedger.h"
+#include "PatchSet.h"
+#include "Prefetch.h"
+#include "Pattern.h"
+#include "PresentDiagnostics.h"
+#include "Scopes.h"
+#include "Script.h"
+#include "Session.h"
+#include "VulkanRenderer.h"
+#include "Workflow.h"
+
+// Linux entry point: drives a display directly through Vulkan, or renders offscreen
+// on any Vulkan implementation (including software ones) for testing and benchmarks.
+
+struct Options
+{
+    VulkanOptions vulkan;
+    std::string edidPath;
+    std::string workflowPath; // file, or "default"
+    std::string presentRecording; // analyze a recording made with --present-diagnostics on Windows
+    std::vector<std::string> scripts; // run headless against the simulator, each in its own session
+    unsigned scriptJobs = 0;          // 0 is one thread per hardware thread
+    std::string patchSpec;            // kind:count[:peak nits], written to patchPath
+    std::string patchPath;
+    std::string reportSession;        // session file from a patches script command
+    std::string reportPrefix;         // writes <prefix>.csv and <prefix>.html
+    std::string gainMapSession;       // session measured across the screen, for uniformity correction
+    float aplNits = 0.0f;             // grey surround holding the average picture level, 0 for black
+    bool falseColor = false;          // start with the false color view; f toggles it
+    int scopeInterval = 0;            // scopes of every nth frame drawn over it, 0 for none
+    int deviceFaultInterval = 0;      // run recovery against a fake device lost every nth frame
+    int memorySoakFrames = 0;         // simulate a long session and check its memory stays bounded
+    int fuzzEdids = 0;                // parse this many mutated EDID and DisplayID blocks
+    bool layoutGrid = false;
+    int concurrentSessions = 0;       // sessions driven side by side on their own threads
+    std::string playPath;             // patch set played in real time, without and with prefetching
+    int holdFrames = 6;               // frames each played patch stays up
+    size_t prefetch = 2;              // patches rendered ahead when playing
+    std::string energySource;         // rapl or fake:<watts>, read by the frame loop and --bench
+    bool freshSession = false;
+    bool verify = false;
+    bool bench = false;
+    bool drawList = false;
+    bool detectLevels = false;
+    bool detectFlicker = false;       // analyze synthetic PWM and sine captures of known flicker
+    bool aplSettle = false;           // time simulated limiters settling with and without the surround
+    int frames = 0; // 0 runs until quit
+};
+
+CalibrationSession g_session;
+volatile std::sig_atomic_t g_quit = 0;
+std::atomic<bool> g_workflowDone{ false };
+
+bool ParseOptions(int argc, char** argv, Options& options);
+void SeedSession(const Options& options);
+std::string GetSessionPath();
+void SaveDisplayResult();
+WorkflowReport RunWorkflow(const Workflow& workflow);
+int RunInteractive(VulkanRenderer& renderer, const Options& options);
+int RunVerify(VulkanRenderer& renderer);
+void GetVerifyViews(SessionView (&views)[2]);
+int RunDrawList(const Options& options);
+int RunDeviceFaults(const Options& options);
+int RunMemorySoak(const Options& options);
+int RunFuzzEdid(const Options& options);
+int RunLayoutGrid();
+int RunConcurrentSessions(const Options& options);
+int RunPlay(const Options& options);
+int RunBench(const Options& options);
+int RunPresentReport(const std::string& path);
+int CheckPresentRecordings(const std::string& directory);
+int RunScriptFiles(const Options& options);
+int RunLevelDetect(const Options& options);
+int RunFlickerDetect();
+int RunAplSettle(const Options& options);
+int RunPatchGenerator(const Options& options);
+int RunReport(const Options& options);
+int RunGainMap(const Options& options);
+std::unique_ptr<EnergyCounter> OpenEnergyOption(const Options& options);
+bool ReadInput(InputFrame& input, bool& quit, bool& falseColor, bool& memory);
+uint32_t TickMs();
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr,
+                     "usage: hdr-calib [--offscreen] [--pq] [--software] [--width N] [--height N]\n"
+                     "                 [--frames N] [--edid FILE] [--fresh] [--workflow FILE|default]\n"
+                     "                 [--verify] [--bench] [--present-report FILE]\n"
+                     "                 [--script FILE]... [--jobs N] [--patches KIND:COUNT[:PEAK] FILE]\n"
+                     "                 [--report SESSION PREFIX] [--gain-map SESSION] [--apl NITS]\n"
+                     "                 [--false-color] [--scopes N] [--draw-list] [--device-faults N]\n"
+                     "                 [--play PATCHSET] [--hold N] [--prefetch N] [--detect-levels]\n"
+                     "                 [--energy rapl|fake:WATTS] [--memory-soak N] [--fuzz-edid N]\n"
+                     "                 [--layout-grid] [--concurrent-sessions N] [--detect-flicker]\n"
+                     "                 [--apl-settle]\n");
+        return 2;
+    }
+
+    // Benchmarks and verification never touch the session files
+    if (options.bench)
+        return options.gainMapSession.empty() ? RunBench(options) : RunGainMap(options);
+    if (options.drawList)
+        return RunDrawList(options);
+    if (options.deviceFaultInterval > 0)
+        return RunDeviceFaults(options);
+    if (options.memorySoakFrames > 0)
+        return RunMemorySoak(options);
+    if (options.fuzzEdids > 0)
+        return RunFuzzEdid(options);
+    if (options.layoutGrid)
+        return RunLayoutGrid();
+    if (options.concurrentSessions > 0)
+        return RunConcurrentSessions(options);
+    if (!options.presentRecording.empty())
+        return RunPresentReport(options.presentRecording);
+    if (!options.scripts.empty())
+        return RunScriptFiles(options);
+    if (options.detectLevels)
+        return RunLevelDetect(options);
+    if (options.detectFlicker)
+        return RunFlickerDetect();
+    if (options.aplSettle)
+        return RunAplSettle(options);
+    if (!options.patchSpec.empty())
+        return RunPatchGenerator(options);
+    if (!options.reportSession.empty())
+        return RunReport(options);
+    if (!options.playPath.empty())
+        return RunPlay(options);
+
+    VulkanRenderer renderer;
+    if (!renderer.Init(options.vulkan))
+    {
+        std::fprintf(stderr, "Vulkan init failed: %s\n", renderer.Status().c_str());
+        return 1;
+    }
+    std::printf("%s: %s, %dx%d\n", renderer.DeviceName().c_str(), renderer.Status().c_str(),
+                renderer.Width(), renderer.Height());
+
+    if (options.verify)
+        return RunVerify(renderer);
+
+    SeedSession(options);
+    g_session.OpenStore(GetSessionPath(), options.freshSession);
+
+    Workflow workflow;
+    if (!options.workflowPath.empty())
+    {
+        std::string error;
+        bool loaded = true;
+        if (options.workflowPath == "default")
+            workflow = Workflow::Default(1);
+        else
+            loaded = workflow.Load(options.workflowPath, error);
+        if (!loaded || !workflow.Validate(1, error))
+        {
+            std::fprintf(stderr, "workflow: %s\n", error.c_str());
+            g_session.CloseStore();
+            return 2;
+        }
+    }
+
+    // The workflow runs on its own thread and ends the interactive loop when it is done
+    WorkflowReport report;
+    std::thread workflowThread;
+    if (!options.workflowPath.empty())
+        workflowThread = std::thread([&]() { report = RunWorkflow(workflow); });
+
+    int result = RunInteractive(renderer, options);
+
+    if (workflowThread.joinable())
+    {
+        g_session.CancelSteps();
+        workflowThread.join();
+        std::printf("%s", FormatWorkflowReport(report).c_str());
+    }
+
+    SaveDisplayResult();
+    g_session.CloseStore();
+    return result;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--offscreen") == 0)
+            options.vulkan.present = false;
+        else if (strcmp(arg, "--pq") == 0)
+            options.vulkan.encoding = FrameEncoding::Hdr10Pq;
+        else if (strcmp(arg, "--software") == 0)
+            options.vulkan.preferSoftware = true;
+        else if (strcmp(arg, "--width") == 0 && hasValue)
+            options.vulkan.width = atoi(argv[++i]);
+        else if (strcmp(arg, "--height") == 0 && hasValue)
+            options.vulkan.height = atoi(argv[++i]);
+        else if (strcmp(arg, "--frames") == 0 && hasValue)
+            options.frames = atoi(argv[++i]);
+        else if (strcmp(arg, "--edid") == 0 && hasValue)
+            options.edidPath = argv[++i];
+        else if (strcmp(arg, "--fresh") == 0)
+            options.freshSession = true;
+        else if (strcmp(arg, "--workflow") == 0 && hasValue)
+            options.workflowPath = argv[++i];
+        else if (strcmp(arg, "--verify") == 0)
+            options.verify = true;
+        else if (strcmp(arg, "--bench") == 0)
+            options.bench = true;
+        else if (strcmp(arg, "--draw-list") == 0)
+            options.drawList = true;
+        else if (strcmp(arg, "--detect-levels") == 0)
+            options.detectLevels = true;
+        else if (strcmp(arg, "--detect-flicker") == 0)
+            options.detectFlicker = true;
+        else if (strcmp(arg, "--apl-settle") == 0)
+            options.aplSettle = true;
+        else if (strcmp(arg, "--layout-grid") == 0)
+            options.layoutGrid = true;
+        else if (strcmp(arg, "--energy") == 0 && hasValue)
+            options.energySource = argv[++i];
+        else if (strcmp(arg, "--device-faults") == 0 && hasValue)
+            options.deviceFaultInterval = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--memory-soak") == 0 && hasValue)
+            options.memorySoakFrames = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--fuzz-edid") == 0 && hasValue)
+            options.fuzzEdids = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--concurrent-sessions") == 0 && hasValue)
+            options.concurrentSessions = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--play") == 0 && hasValue)
+            options.playPath = argv[++i];
+        else if (strcmp(arg, "--hold") == 0 && hasValue)
+            options.holdFrames = std::max(1, atoi(argv[++i]));
+        else if (strcmp(arg, "--prefetch") == 0 && hasValue)
+            options.prefetch = static_cast<size_t>(std::max(1, atoi(argv[++i])));
+        else if (strcmp(arg, "--present-report") == 0 && hasValue)
+            options.presentRecording = argv[++i];
+        else if (strcmp(arg, "--script") == 0 && hasValue)
+            options.scripts.push_back(argv[++i]);
+        else if (strcmp(arg, "--patches") == 0 && i + 2 < argc)
+        {
+            options.patchSpec = argv[++i];
+            options.patchPath = argv[++i];
+        }
+        else if (strcmp(arg, "--report") == 0 && i + 2 < argc)
+        {
+            options.reportSession = argv[++i];
+            options.reportPrefix = argv[++i];
+        }
+        else if (strcmp(arg, "--apl") == 0 && hasValue)
+            options.aplNits = std::max(0.0f, static_cast<float>(atof(argv[++i])));
+        else if (strcmp(arg, "--false-color") == 0)
+            options.falseColor = true;
+        else if (strcmp(arg, "--scopes") == 0 && hasValue)
+            options.scopeInterval = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--gain-map") == 0 && hasValue)
+            options.gainMapSession = argv[++i];
+        else if (strcmp(arg, "--jobs") == 0 && hasValue)
+            options.scriptJobs = static_cast<unsigned>(std::max(0, atoi(argv[++i])));
+        else
+            return false;
+    }
+
+    // Verification needs the offscreen readback
+    if (options.verify)
+        options.vulkan.present = false;
+    return options.vulkan.width > 0 && options.vulkan.height > 0;
+}
+
+void SeedSession(const Options& options)
+{
+    // Prefer an EDID file from the command line, then the first connected DRM connector
+    std::vector<uint8_t> edid;
+    DisplayInfo info;
+    bool haveInfo = false;
+    if (!options.edidPath.empty())
+    {
+        haveInfo = LoadBinaryFile(options.edidPath, edid) && ParseDisplayDescriptor(edid.data(), edid.size(), info);
+    }
+    else
+    {
+        for (const SystemEdid& system : ReadSystemEdids())
+        {
+            if (ParseDisplayDescriptor(system.data.data(), system.data.size(), info))
+            {
+                haveInfo = true;
+                break;
+            }
+        }
+    }
+
+    DisplayCache cache;
+    cache.Load(GetDataDirectory() + "/displays.txt");
+
+    uint64_t displayHash = 0;
+    const DisplayRecord* cached = nullptr;
+    if (haveInfo && !info.identity.manufacturer.empty())
+    {
+        displayHash = info.identity.Hash();
+        cached = cache.Find(displayHash);
+    }
+
+    g_session.Seed(SeedCalibration(haveInfo ? &info : nullptr, cached), displayHash);
+}
+
+std::string GetSessionPath()
+{
+    char name[64];
+    uint64_t displayHash = g_session.DisplayHash();
+    if (displayHash != 0)
+        std::snprintf(name, sizeof(name), "/session-%016llx.dat", static_cast<unsigned long long>(displayHash));
+    else
+        std::snprintf(name, sizeof(name), "/session-output0.dat");
+    return GetDataDirectory() + name;
+}
+
+void SaveDisplayResult()
+{
+    uint64_t displayHash = g_session.DisplayHash();
+    if (displayHash == 0)
+        return;
+
+    std::string path = GetDataDirectory() + "/displays.txt";
+    DisplayCache cache;
+    cache.Load(path);
+    cache.Store(displayHash, g_session.Result());
+    cache.Save(path);
+}
+
+WorkflowReport RunWorkflow(const Workflow& workflow)
+{
+    WorkflowReport report = workflow.Run([](const StepRequest& request)
+    {
+        return RunStepOnSession(g_session, request);
+    });
+    FinishWorkflowOnSession(g_session, report);
+    g_workflowDone = true;
+    return report;
+}
+
+int RunInteractive(VulkanRenderer& renderer, const Options& options)
+{
+    // Raw keyboard on the controlling terminal; restored on every exit path below
+    termios saved = {};
+    bool haveTerminal = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved) == 0;
+    if (haveTerminal)
+    {
+        termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+
+    std::signal(SIGINT, [](int) { g_quit = 1; });
+    std::signal(SIGTERM, [](int) { g_quit = 1; });
+
+    // The renderer holds every device object, so rebuilding it after a lost device is the whole
+    // recovery; the session and everything else the frames are built from carry on
+    DeviceRecovery recovery;
+    recovery.AddStep("Vulkan renderer", [&](std::string& error)
+    {
+        if (renderer.Init(options.vulkan))
+            return true;
+        error = renderer.Status();
+        return false;
+    });
+    recovery.SetRelease([&]() { renderer.Shutdown(); });
+
+    // Memory by subsystem: the arenas and the scope frame are charged as they allocate, the
+    // renderer's images and scratch are declared from their sizes
+    MemoryLedger memory;
+    TrackedResource patternMemory(memory, "patterns");
+    TrackedResource scopeMemory(memory, "scopes");
+    auto declareRendererMemory = [&]()
+    {
+        memory.Declare("vulkan images", renderer.ImageBytes());
+        memory.Declare("vulkan frame arena", renderer.FrameArenaStats().reserved);
+    };
+    declareRendererMemory();
+    bool showMemory = false;
+    WorkingSet workingSet;
+
+    PatternLayout layout = ComputePatternLayout(renderer.Width(), renderer.Height(), 1.0f);
+    int layoutWidth = renderer.Width();
+    int layoutHeight = renderer.Height();
+    Arena frameArena("frame arena", 64 * 1024, &patternMemory);
+
+    // Uniformity correction; the renderer only clears rects, so the pattern's rects are scaled instead
+    GainMap gainMap;
+    if (!options.gainMapSession.empty())
+    {
+        GainGrid grid;
+        std::string error;
+        if (BuildGainGrid(options.gainMapSession, 9, 9, grid, error))
+        {
+            gainMap.SetGrid(grid);
+            std::printf("gains from %s\n%s", options.gainMapSession.c_str(), FormatGainGrid(grid).c_str());
+        }
+        else
+        {
+            std::fprintf(stderr, "gain map not applied: %s\n", error.c_str());
+        }
+    }
+    FalseColor falseColor;
+    bool showFalseColor = options.falseColor;
+    FrameBuffer scopeFrame(&scopeMemory);
+    Scopes scopes;
+    std::unique_ptr<EnergyCounter> energyCounter = OpenEnergyOption(options);
+    EnergyTracker energy(energyCounter.get());
+    energy.Start();
+    int result = 0;
+    for (int frame = 0; !g_quit && !g_workflowDone && (options.frames == 0 || frame < options.frames); ++frame)
+    {
+        InputFrame input;
+        bool quit = false;
+        if (haveTerminal && ReadInput(input, quit, showFalseColor, showMemory))
+            g_session.ApplyInput(input, TickMs());
+        if (quit)
+            break;
+
+        // Input keeps reaching the session while the device is down; the display may come back
+        // in another mode
+        if (recovery.IsLost())
+        {
+            if (!recovery.Recover())
+                continue;
+            layout = ComputePatternLayout(renderer.Width(), renderer.Height(), 1.0f);
+            declareRendererMemory();
+        }
+
+        // Everything built for the frame comes from the arena, freed all at once by the next Reset
+        frameArena.Reset();
+        Pattern pattern(&frameArena);
+        BuildCalibrationPattern(g_session.View(), layout, pattern);
+
+        // The surround is clipped where the display clips, at the max white level found so far
+        if (options.aplNits > 0.0f)
+        {
+            float maxWhite = g_session.GetLevel(BrightnessMode::MaxWhite);
+            FillSurround(pattern, renderer.Width(), renderer.Height(), options.aplNits,
+                         maxWhite > 0.0f ? maxWhite : g_session.GetMaxBrightness());
+        }
+
+        // The false color view shows the levels the pattern asks for, without the gains, as on Windows
+        if (!showFalseColor)
+            gainMap.ScalePattern(pattern, renderer.Width(), renderer.Height());
+
+        // Bands relative to the levels found so far. The renderer only clears rects, so mapping
+        // the pattern's colors maps every pixel exactly.
+        if (showFalseColor)
+        {
+            float white = g_session.GetLevel(BrightnessMode::MaxWhite);
+            falseColor.SetRange(g_session.GetLevel(BrightnessMode::MinBlack),
+                                white > 0.0f ? white : g_session.GetMaxBrightness());
+            falseColor.Apply(pattern);
+        }
+
+        // Scopes of what is sent, from the reference renderer's copy of the frame; the overlay
+        // itself is left out
+        if (options.scopeInterval > 0)
+        {
+            if (frame % options.scopeInterval == 0)
+            {
+                scopeFrame.Resize(renderer.Width(), renderer.Height(), renderer.Encoding());
+                RenderPatternCpu(pattern, scopeFrame);
+                ComputeScopes(scopeFrame, ScopeSettings(), scopes);
+            }
+            AddScopeOverlay(scopes, renderer.Width(), renderer.Height(), pattern);
+        }
+
+        // Memory figures as of the last frame, over the top left corner
+        if (showMemory)
+        {
+            declareRendererMemory();
+            ReadWorkingSet(workingSet);
+            AddMemoryOverlay(memory, workingSet, renderer.Width(), renderer.Height(), pattern);
+        }
+
+        // Presenting paces the loop on vsync; offscreen frames run as fast as the device allows
+        if (!renderer.RenderFrame(pattern))
+        {
+            if (renderer.DeviceLost())
+            {
+                recovery.ReportLost("RenderFrame: VK_ERROR_DEVICE_LOST");
+                continue;
+            }
+            std::fprintf(stderr, "frame %d failed\n", frame);
+            result = 1;
+            break;
+        }
+        energy.Frame();
+
+        // A swapchain rebuilt after it went out of date may come back at another size
+        if (renderer.Width() != layoutWidth || renderer.Height() != layoutHeight)
+        {
+            layoutWidth = renderer.Width();
+            layoutHeight = renderer.Height();
+            layout = ComputePatternLayout(layoutWidth, layoutHeight, 1.0f);
+            declareRendererMemory();
+        }
+    }
+    energy.Stop();
+
+    if (haveTerminal)
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    std::printf("%s%s", FormatArenaStats(frameArena.Stats()).c_str(),
+                FormatArenaStats(renderer.FrameArenaStats()).c_str());
+    std::printf("%s", FormatDrawListStats(renderer.DrawStats()).c_str());
+    if (scopes.pixels > 0)
+        std::printf("%s", FormatScopes(scopes).c_str());
+    if (recovery.Stats().losses > 0)
+        std::printf("%s", FormatRecoveryStats(recovery.Stats()).c_str());
+    if (energy.Measured())
+        std::printf("%s", FormatEnergyStats(energy.Stats()).c_str());
+    declareRendererMemory();
+    ReadWorkingSet(workingSet);
+    std::printf("%s", FormatMemoryReport(memory, workingSet).c_str());
+    return result;
+}
+
+std::unique_ptr<EnergyCounter> OpenEnergyOption(const Options& options)
+{
+    if (options.energySource.empty())
+        return nullptr;
+    std::string error;
+    std::unique_ptr<EnergyCounter> counter = OpenEnergyCounter(options.energySource, error);
+    if (!counter)
+        std::fprintf(stderr, "energy not measured: %s\n", error.c_str());
+    return counter;
+}
+
+bool ReadInput(InputFrame& input, bool& quit, bool& falseColor, bool& memory)
+{
+    // Terminals only report presses, so each arrow press is a held button for this frame;
+    // the key repeat of the terminal provides auto-repeat
+    pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&pfd, 1, 0) <= 0)
+        return true;
+
+    char buffer[64];
+    ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+    for (ssize_t i = 0; i < count; ++i)
+    {
+        if (buffer[i] == 0x1B && i + 2 < count && buffer[i + 1] == '[')
+        {
+            if (buffer[i + 2] == 'C')
+                input.right = true;
+            else if (buffer[i + 2] == 'D')
+                input.left = true;
+            i += 2;
+        }
+        else if (buffer[i] == 0x1B || buffer[i] == 'q')
+        {
+            quit = true;
+        }
+        else if (buffer[i] == ' ')
+        {
+            input.toggle = true;
+        }
+        else if (buffer[i] == 'f')
+        {
+            falseColor = !falseColor;
+        }
+        else if (buffer[i] == 'm')
+        {
+            memory = !memory;
+        }
+        else if (buffer[i] == '\n' || buffer[i] == '\r')
+        {
+            input.confirm = true;
+        }
+    }
+    return true;
+}
+
+uint32_t TickMs()
+{
+    using namespace std::chrono;
+    return static_cast<uint32_t>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+void GetVerifyViews(SessionView (&views)[2])
+{
+    // Both modes, with a label that exercises every glyph width
+    views[0].mode = BrightnessMode::MaxWhite;
+    views[0].brightness = 812.5f;
+    views[0].increment = 0.5f;
+    views[1].mode = BrightnessMode::MinBlack;
+    views[1].brightness = 0.0475f;
+    views[1].increment = 0.0001f;
+}
+
+int RunVerify(VulkanRenderer& renderer)
+{
+    SessionView views[2];
+    GetVerifyViews(views);
+
+    PatternLayout layout = ComputePatternLayout(renderer.Width(), renderer.Height(), 1.0f);
+    int failures = 0;
+    for (const SessionView& view : views)
+    {
+        Pattern pattern = BuildCalibrationPattern(view, layout);
+
+        FrameBuffer gpu;
+        if (!renderer.RenderFrame(pattern) || !renderer.ReadBack(gpu))
+        {
+            std::fprintf(stderr, "render or readback failed\n");
+            return 1;
+        }
+
+        FrameBuffer reference;
+        reference.Resize(gpu.width, gpu.height, gpu.encoding);
+        RenderPatternCpu(pattern, reference);
+
+        // FP16 clears may round differently from the CPU conversion by one ulp;
+        // PQ values are snapped to whole codes and must match within one code
+        size_t mismatches = 0;
+        size_t pixels = static_cast<size_t>(gpu.width) * gpu.height;
+        for (size_t i = 0; i < pixels; ++i)
+        {
+            bool same = true;
+            if (gpu.encoding == FrameEncoding::ScRgbHalf)
+            {
+                for (size_t c = 0; c < 4; ++c)
+                    same = same && std::abs(gpu.Half()[i * 4 + c] - reference.Half()[i * 4 + c]) <= 1;
+            }
+            else
+            {
+                for (int shift = 0; shift < 30; shift += 10)
+                {
+                    int a = (gpu.Packed()[i] >> shift) & 0x3FF;
+                    int b = (reference.Packed()[i] >> shift) & 0x3FF;
+                    same = same && std::abs(a - b) <= 1;
+                }
+            }
+            if (!same)
+            {
+                if (mismatches == 0)
+                    std::fprintf(stderr, "first mismatch at %zu,%zu\n", i % gpu.width, i / gpu.width);
+                ++mismatches;
+            }
+        }
+
+        std::printf("%s: %zu of %zu pixels differ\n", pattern.label.text.c_str(), mismatches, pixels);
+        std::printf("%s", FormatDrawListStats(renderer.DrawStats()).c_str());
+        failures += mismatches != 0;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+int RunDrawList(const Options& options)
+{
+    // The verification patterns with the scope overlay over them, thousands of small rects on
+    // top of larger ones. Prints each optimized command stream, which is exact and stable enough
+    // to diff against a saved copy, and checks that replaying it gives the pattern's pixels.
+    SessionView views[2];
+    GetVerifyViews(views);
+
+    int width = options.vulkan.width;
+    int height = options.vulkan.height;
+    PatternLayout layout = ComputePatternLayout(width, height, 1.0f);
+    int failures = 0;
+    for (const SessionView& view : views)
+    {
+        Pattern pattern = BuildCalibrationPattern(view, layout);
+
+        FrameBuffer reference;
+        reference.Resize(width, height, options.vulkan.encoding);
+        RenderPatternCpu(pattern, reference);
+        Scopes scopes;
+        ComputeScopes(reference, ScopeSettings(), scopes);
+        AddScopeOverlay(scopes, width, height, pattern);
+        RenderPatternCpu(pattern, reference);
+
+        DrawList list;
+        list.Record(pattern, width, height, true);
+        list.Optimize();
+        FrameBuffer replayed;
+        replayed.Resize(width, height, options.vulkan.encoding);
+        RenderDrawListCpu(list, replayed);
+
+        bool same = replayed.data == reference.data;
+        std::printf("%s%s%s: replay %s\n", FormatDrawList(list).c_str(), FormatDrawListStats(list.Stats()).c_str(),
+                    pattern.label.text.c_str(), same ? "matches" : "differs");
+        failures += !same;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+int RunDeviceFaults(const Options& options)
+{
+    // The Windows build's manifest on a fake device that is lost every n frames and refuses the
+    // first two rebuilds, as a driver does while it resets. Every third loss also replaces the
+    // adapter, as a driver upgrade does. Every frame uses every object, and input keeps moving
+    // the session through the losses.
+    DeviceFaultPlan plan;
+    plan.loseEvery = options.deviceFaultInterval;
+    plan.failedCreates = 2;
+    plan.createMs = 5;
+    plan.replaceAdapterEvery = 3;
+    FaultyDevice device(plan);
+
+    const char* OBJECTS[] = { "swap chain", "post pass", "Direct2D context", "target bitmap", "brushes",
+                              "text format" };
+    DeviceRecovery recovery;
+    recovery.AddStep("DXGI adapter", [&](std::string&)
+    {
+        if (!device.AdapterCurrent())
+            device.EnumerateAdapter();
+        return true;
+    });
+    recovery.AddStep("D3D device and swap chain", [&](std::string& error)
+    {
+        return device.CreateDevice(error) && device.CreateObject(OBJECTS[0], error);
+    });
+    recovery.AddStep("post pass", [&](std::string& error) { return device.CreateObject(OBJECTS[1], error); });
+    recovery.AddStep("Direct2D and DirectWrite", [&](std::string& error)
+    {
+        for (int i = 2; i < 6; ++i)
+        {
+            if (!device.CreateObject(OBJECTS[i], error))
+                return false;
+        }
+        return true;
+    });
+    recovery.SetRelease([&]() { device.Release(); });
+
+    std::string error;
+    if (!recovery.Create(error))
+    {
+        std::fprintf(stderr, "device: %s\n", error.c_str());
+        return 1;
+    }
+
+    CalibrationSession session;
+    session.Seed(SeedCalibration(nullptr, nullptr), 0);
+    float startBrightness = session.View().brightness;
+    int frames = options.frames > 0 ? options.frames : 600;
+    int presses = 0;
+    int drawn = 0;
+    int failures = 0;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        InputFrame input;
+        input.right = frame % 4 == 0;
+        presses += input.right;
+        session.ApplyInput(input, static_cast<uint32_t>(frame) * 16);
+
+        if (recovery.IsLost() && !recovery.Recover())
+            continue;
+
+        Pattern pattern = BuildCalibrationPattern(session.View(), ComputePatternLayout(1920, 1080, 1.0f));
+        for (const char* object : OBJECTS)
+        {
+            if (!device.Use(object))
+            {
+                std::fprintf(stderr, "frame %d: %s missing after recovery\n", frame, object);
+                ++failures;
+            }
+        }
+        if (!device.Present(error))
+            recovery.ReportLost(error);
+        else
+            ++drawn;
+    }
+
+    RecoveryStats stats = recovery.Stats();
+    std::printf("%d of %d frames drawn on %d devices, %d presses moved %.1f to %.1f nits\n%s", drawn, frames,
+                device.Generation(), presses, startBrightness, session.View().brightness,
+                FormatRecoveryStats(stats).c_str());
+    // Each loss may cost the frame it happened on, and no more
+    bool recovered = stats.recoveries == stats.losses - (recovery.IsLost() ? 1 : 0) &&
+                     drawn + static_cast<int>(stats.losses) >= frames;
+    return failures == 0 && recovered ? 0 : 1;
+}
+
+int RunMemorySoak(const Options& options)
+{
+    // A long session without a display: input moving the levels and modes, the scope and memory
+    // overlays, a CPU reference frame now and then, and a scripted meter session every so often
+    // for measurement data. After a warm-up no account may reach a new peak, and the working set
+    // may only grow by allocator slack.
+    const int WARMUP_SHARE = 4;        // the first quarter of the frames
+    const int TOGGLE_INTERVAL = 100;   // every mode well within the warm-up
+    const int SCOPE_INTERVAL = 30;
+    const int RENDER_INTERVAL = 10;
+    const int SCRIPT_INTERVAL = 1000;
+    const size_t SLACK_BYTES = 2 * 1024 * 1024;
+
+    int width = options.vulkan.width;
+    int height = options.vulkan.height;
+    int frames = options.memorySoakFrames;
+
+    MemoryLedger memory;
+    TrackedResource patternMemory(memory, "patterns");
+    TrackedResource scopeMemory(memory, "scopes");
+    TrackedResource frameMemory(memory, "reference frames");
+    Arena frameArena("frame arena", 64 * 1024, &patternMemory);
+    FrameBuffer scopeFrame(&scopeMemory);
+    FrameBuffer referenceFrame(&frameMemory);
+    Scopes scopes;
+    WorkingSet workingSet;
+
+    Script script;
+    std::string error;
+    if (!script.Parse("mode maxwhite\ndetect\nmode minblack\ndetect\nread\nflicker 2000 1024\n", error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+    }
+    ScriptRunOptions scriptOptions;
+    scriptOptions.width = width;
+    scriptOptions.height = height;
+    ScriptResult measured; // the last meter session, as a session keeps its latest readings
+
+    CalibrationSession session;
+    session.Seed(SeedCalibration(nullptr, nullptr), 0);
+    PatternLayout layout = ComputePatternLayout(width, height, 1.0f);
+
+    std::vector<MemoryAccount> warm;
+    WorkingSet warmSet;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        InputFrame input;
+        input.right = frame % 4 == 0;
+        input.left = frame % 4 == 2;
+        input.toggle = frame % TOGGLE_INTERVAL == 0;
+        session.ApplyInput(input, static_cast<uint32_t>(frame) * 16);
+
+        frameArena.Reset();
+        Pattern pattern(&frameArena);
+        BuildCalibrationPattern(session.View(), layout, pattern);
+        if (frame % SCOPE_INTERVAL == 0)
+        {
+            scopeFrame.Resize(width, height, FrameEncoding::ScRgbHalf);
+            RenderPatternCpu(pattern, scopeFrame);
+            ComputeScopes(scopeFrame, ScopeSettings(), scopes);
+        }
+        AddScopeOverlay(scopes, width, height, pattern);
+        ReadWorkingSet(workingSet);
+        AddMemoryOverlay(memory, workingSet, width, height, pattern);
+
+        DrawList draws(&frameArena);
+        draws.Record(pattern, width, height, true);
+        draws.Optimize();
+        if (frame % RENDER_INTERVAL == 0)
+        {
+            referenceFrame.Resize(width, height, FrameEncoding::ScRgbHalf);
+            RenderPatternCpu(pattern, referenceFrame);
+        }
+
+        if (frame % SCRIPT_INTERVAL == 0)
+        {
+            measured = RunScriptHeadless("soak", script, scriptOptions);
+            size_t bytes = measured.readings.capacity() * sizeof(ScriptReading) + measured.sessionArena.reserved;
+            for (const FlickerResult& flicker : measured.flicker)
+                bytes += sizeof(flicker);
+            memory.Declare("measurements", bytes);
+        }
+
+        if (frame + 1 == frames / WARMUP_SHARE)
+        {
+            warm = memory.Accounts();
+            ReadWorkingSet(warmSet);
+        }
+    }
+    ReadWorkingSet(workingSet);
+    std::printf("%d frames at %dx%d\n%s", frames, width, height, FormatMemoryReport(memory, workingSet).c_str());
+
+    int failures = 0;
+    for (const MemoryAccount& account : memory.Accounts())
+    {
+        auto before = std::find_if(warm.begin(), warm.end(),
+                                   [&](const MemoryAccount& entry) { return entry.name == account.name; });
+        if (before == warm.end() || account.peak > before->peak)
+        {
+            std::printf("%s grew after the warm-up: peak %s\n", account.name.c_str(),
+                        FormatBytes(account.peak).c_str());
+            ++failures;
+        }
+    }
+    size_t growth = workingSet.current > warmSet.current ? workingSet.current - warmSet.current : 0;
+    std::printf("working set %s after the warm-up, %s at the end\n", FormatBytes(warmSet.current).c_str(),
+                FormatBytes(workingSet.current).c_str());
+    if (growth > SLACK_BYTES)
+    {
+        std::printf("working set grew by %s\n", FormatBytes(growth).c_str());
+        ++failures;
+    }
+    std::printf("memory %s\n", failures == 0 ? "bounded" : "NOT bounded");
+    return failures == 0 ? 0 : 1;
+}
+
+// Sets the last byte of each whole 128 byte block so the block sums to 0
+void FixEdidChecksums(std::vector<uint8_t>& data)
+{
+    for (size_t block = 0; block + 128 <= data.size(); block += 128)
+    {
+        uint8_t sum = 0;
+        for (size_t i = block; i < block + 127; ++i)
+            sum = static_cast<uint8_t>(sum + data[i]);
+        data[block + 127] = static_cast<uint8_t>(-sum);
+    }
+}
+
+// EDID with the name and serial descriptors, a CTA-861 extension holding the HDR static metadata
+// block and a DisplayID 2.x extension with product identification and display parameters
+std::vector<uint8_t> BuildSampleEdid()
+{
+    const size_t BLOCK = 128;
+    const uint8_t HEADER[8] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+    std::vector<uint8_t> edid(3 * BLOCK, 0);
+
+    uint8_t* base = edid.data();
+    std::memcpy(base, HEADER, sizeof(HEADER));
+    base[8] = 0x10; // DEL
+    base[9] = 0xAC;
+    base[10] = 0xF1;
+    base[11] = 0xA0;
+    base[12] = 0x4C;
+    base[13] = 0x33;
+    base[54 + 3] = 0xFC;
+    std::memcpy(base + 54 + 5, "FUZZ HDR\n    ", 13);
+    base[72 + 3] = 0xFF;
+    std::memcpy(base + 72 + 5, "SN0042\n      ", 13);
+    base[126] = 2;
+
+    // HDR static metadata: SDR and PQ, 1015 nits max, 400 frame average, 0.05 min
+    uint8_t* cta = base + BLOCK;
+    const uint8_t HDR_BLOCK[] = { (7 << 5) | 6, 6, 0x05, 0x01, 0x9F, 0x69, 0x23 };
+    cta[0] = 0x02;
+    cta[1] = 3;
+    cta[2] = static_cast<uint8_t>(4 + sizeof(HDR_BLOCK));
+    std::memcpy(cta + 4, HDR_BLOCK, sizeof(HDR_BLOCK));
+
+    uint8_t* section = base + 2 * BLOCK + 1;
+    base[2 * BLOCK] = 0x70;
+    section[0] = 0x20;
+    size_t offset = 4;
+    const uint8_t PRODUCT[] = { 0x20, 0, 20, 0x00, 0x14, 0x22, 0xF1, 0xA0, 0x4C, 0x33, 0, 0, 10, 30, 8,
+                                'F', 'U', 'Z', 'Z', ' ', 'H', 'D', 'R' };
+    std::memcpy(section + offset, PRODUCT, sizeof(PRODUCT));
+    offset += sizeof(PRODUCT);
+
+    // Display parameters with native luminance as binary16 nits: full coverage, 10% and minimum
+    uint8_t* parameters = section + offset;
+    parameters[0] = 0x21;
+    parameters[2] = 29;
+    const float LUMINANCE[] = { 400.0f, 1000.0f, 0.05f };
+    for (int i = 0; i < 3; ++i)
+    {
+        uint16_t half = FloatToHalf(LUMINANCE[i]);
+        parameters[3 + 21 + 2 * i] = static_cast<uint8_t>(half);
+        parameters[3 + 22 + 2 * i] = static_cast<uint8_t>(half >> 8);
+    }
+    offset += 3 + 29;
+    section[1] = static_cast<uint8_t>(offset - 4);
+    FixEdidChecksums(edid);
+    return edid;
+}
+
+// Parses a copy that ends where an unreadable page starts, so any read past its end faults
+bool ParseGuarded(const std::vector<uint8_t>& data, DisplayInfo& info)
+{
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t dataSize = (data.size() + page - 1) / page * page;
+    void* mapped = mmap(nullptr, dataSize + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+        return ParseDisplayDescriptor(data.data(), data.size(), info);
+
+    uint8_t* guard = static_cast<uint8_t*>(mapped) + dataSize;
+    mprotect(guard, page, PROT_NONE);
+    uint8_t* copy = guard - data.size();
+    if (!data.empty())
+        std::memcpy(copy, data.data(), data.size());
+    bool parsed = ParseDisplayDescriptor(copy, data.size(), info);
+    munmap(mapped, dataSize + page);
+    return parsed;
+}
+
+// What the parser and the seed it leads to got out of bounds, or empty
+std::string CheckDisplayInfo(const DisplayInfo& info)
+{
+    const DisplayIdentity& identity = info.identity;
+    auto printable = [](const std::string& text)
+    {
+        return std::all_of(text.begin(), text.end(), [](char c) { return c >= 0x20 && c < 0x7F; });
+    };
+    if (identity.manufacturer.size() > 6 || !printable(identity.manufacturer))
+        return "manufacturer \"" + identity.manufacturer + "\"";
+    if (identity.name.size() > 13 + 255 || !printable(identity.name))
+        return "name \"" + identity.name + "\"";
+    if (identity.serialText.size() > 13 || !printable(identity.serialText))
+        return "serial \"" + identity.serialText + "\"";
+
+    // Half floats reach 65504 nits and CTA coded values about 12500
+    const AdvertisedLuminance& luminance = info.luminance;
+    for (float nits : { luminance.maxLuminance, luminance.maxFrameAverage, luminance.minLuminance })
+    {
+        if (!std::isfinite(nits) || nits < 0.0f || nits > 65504.0f)
+            return "luminance " + std::to_string(nits);
+    }
+    if ((luminance.supportsPq || luminance.supportsHlg) && !info.hasCtaHdrBlock)
+        return "transfer functions without an HDR block";
+
+    CalibrationSeed seed = SeedCalibration(&info, nullptr);
+    if (!(seed.maxWhiteIncrement > 0.0f && seed.maxWhite >= seed.maxWhiteIncrement && seed.maxWhite <= 10000.0f &&
+          seed.maxWhite <= seed.maxWhiteRange))
+        return "max white " + std::to_string(seed.maxWhite) + " by " + std::to_string(seed.maxWhiteIncrement) +
+               " up to " + std::to_string(seed.maxWhiteRange);
+    if (!(seed.minBlackIncrement > 0.0f && seed.minBlack >= 0.0f && seed.minBlack <= seed.minBlackRange &&
+          seed.minBlackRange <= 1.0f))
+        return "min black " + std::to_string(seed.minBlack) + " by " + std::to_string(seed.minBlackIncrement) +
+               " up to " + std::to_string(seed.minBlackRange);
+    return std::string();
+}
+
+int RunFuzzEdid(const Options& options)
+{
+    // Mutated copies of a sample EDID, of its DisplayID section alone and of --edid's file. Each
+    // copy has bits flipped, bytes set to edge values, most likely at the offsets holding lengths
+    // and counts, and is cut short or extended; most then get valid checksums so the extensions
+    // are parsed rather than skipped. A parse may fail but may not read past the end, and what it
+    // yields, and the seed made from it, must stay within what the formats can express.
+    std::vector<std::vector<uint8_t>> seeds;
+    seeds.push_back(BuildSampleEdid());
+    seeds.push_back(std::vector<uint8_t>(seeds[0].begin() + 257, seeds[0].end()));
+    std::vector<uint8_t> file;
+    if (!options.edidPath.empty() && LoadBinaryFile(options.edidPath, file))
+        seeds.push_back(file);
+
+    int failures = 0;
+    DisplayInfo info;
+    for (const std::vector<uint8_t>& seed : seeds)
+    {
+        std::string problem = ParseGuarded(seed, info) ? CheckDisplayInfo(info) : "rejected";
+        if (!problem.empty())
+        {
+            std::printf("seed of %zu bytes: %s\n", seed.size(), problem.c_str());
+            ++failures;
+        }
+    }
+    ParseGuarded(seeds[0], info);
+    if (info.identity.name != "FUZZ HDR" || !info.hasCtaHdrBlock || !info.hasDisplayIdParameters ||
+        info.luminance.maxLuminance != 1000.0f)
+    {
+        std::printf("sample EDID parsed as \"%s\" at %.1f nits\n", info.identity.name.c_str(),
+                    info.luminance.maxLuminance);
+        ++failures;
+    }
+
+    // Length and count bytes of the sample: extension count, CTA data block end and block header,
+    // DisplayID payload size and block lengths
+    const size_t STRUCTURE[] = { 126, 130, 132, 133, 258, 263, 286 };
+    const uint8_t EDGES[] = { 0x00, 0x01, 0x04, 0x1F, 0x20, 0x7F, 0x80, 0xFE, 0xFF };
+    std::mt19937 random(1);
+    auto below = [&](size_t limit) { return limit ? static_cast<size_t>(random() % limit) : 0; };
+
+    int parsed = 0;
+    int hdrBlocks = 0;
+    int displayIdBlocks = 0;
+    for (int i = 0; i < options.fuzzEdids; ++i)
+    {
+        size_t from = below(seeds.size());
+        std::vector<uint8_t> data = seeds[from];
+        for (size_t edits = 1 + below(4); edits > 0 && !data.empty(); --edits)
+        {
+            switch (below(5))
+            {
+            case 0:
+                data[below(data.size())] ^= static_cast<uint8_t>(1u << below(8));
+                break;
+            case 1:
+            {
+                size_t at = from == 0 && below(2) ? STRUCTURE[below(std::size(STRUCTURE))] : below(data.size());
+                if (at < data.size())
+                    data[at] = EDGES[below(std::size(EDGES))];
+                break;
+            }
+            case 2:
+                data[below(data.size())] = static_cast<uint8_t>(random());
+                break;
+            case 3:
+                data.resize(below(data.size() + 1));
+                break;
+            default:
+                for (size_t extra = 1 + below(256); extra > 0; --extra)
+                    data.push_back(static_cast<uint8_t>(random()));
+                break;
+            }
+        }
+        if (from != 1 && below(4) != 0)
+            FixEdidChecksums(data);
+
+        bool ok = ParseGuarded(data, info);
+        std::string problem = CheckDisplayInfo(info);
+        DisplayInfo again;
+        if (ParseGuarded(data, again) != ok || again.identity.Hash() != info.identity.Hash())
+            problem = "parsing twice differs";
+        if (!problem.empty())
+        {
+            if (failures < 10)
+                std::printf("input %d, %zu bytes from seed %zu: %s\n", i, data.size(), from, problem.c_str());
+            ++failures;
+        }
+        parsed += ok;
+        hdrBlocks += info.hasCtaHdrBlock;
+        displayIdBlocks += info.hasDisplayIdParameters;
+    }
+
+    std::printf("%d inputs from %zu seeds: %d parsed, %d rejected, %d with an HDR block, %d with DisplayID "
+                "parameters, %d out of bounds\n",
+                options.fuzzEdids, seeds.size(), parsed, options.fuzzEdids - parsed, hdrBlocks, displayIdBlocks,
+                failures);
+    return failures == 0 ? 0 : 1;
+}
+
+// What is wrong with a layout for a width x height screen, or empty
+std::string CheckPatternLayout(const PatternLayout& layout, int width, int height)
+{
+    struct Named
+    {
+        const char* name;
+        const PixelRect& rect;
+    };
+    const Named RECTS[] = { { "outer", layout.outer }, { "inner", layout.inner }, { "label", layout.label },
+                            { "window", layout.window } };
+    for (const Named& named : RECTS)
+    {
+        const PixelRect& rect = named.rect;
+        if (rect.Width() <= 0 || rect.Height() <= 0 || rect.left < 0 || rect.top < 0 || rect.right > width ||
+            rect.bottom > height)
+        {
+            char text[96];
+            std::snprintf(text, sizeof(text), "%s %d,%d to %d,%d", named.name, rect.left, rect.top, rect.right,
+                          rect.bottom);
+            return text;
+        }
+    }
+
+    // Square patches, the outer and window ones centered to the pixel and the inner one exactly
+    const PixelRect& outer = layout.outer;
+    const PixelRect& inner = layout.inner;
+    if (outer.Width() != outer.Height() || inner.Width() != inner.Height() ||
+        layout.window.Width() != layout.window.Height())
+        return "patch not square";
+    if (std::abs(outer.left - (width - outer.right)) > 1 || std::abs(outer.top - (height - outer.bottom)) > 1 ||
+        std::abs(layout.window.left - (width - layout.window.right)) > 1 ||
+        std::abs(layout.window.top - (height - layout.window.bottom)) > 1)
+        return "patch off center";
+    int margin = inner.left - outer.left;
+    if (margin <= 0 || inner.top - outer.top != margin || outer.right - inner.right != margin ||
+        outer.bottom - inner.bottom != margin)
+        return "inner square not centered in the outer one";
+
+    // The label is below the outer square, never over it
+    if (layout.label.top < outer.bottom)
+        return "label overlaps the outer square";
+    return std::string();
+}
+
+int RunLayoutGrid()
+{
+    // Common display modes in landscape and portrait, then a sweep of odd sizes, each at every
+    // scale Windows offers from 100% to 500%
+    const int MODES[][2] = { { 1024, 768 },  { 1280, 720 },  { 1280, 800 },  { 1366, 768 },  { 1440, 900 },
+                             { 1600, 900 },  { 1680, 1050 }, { 1920, 1080 }, { 1920, 1200 }, { 2560, 1080 },
+                             { 2560, 1440 }, { 2560, 1600 }, { 2880, 1800 }, { 3440, 1440 }, { 3840, 1600 },
+                             { 3840, 2160 }, { 5120, 1440 }, { 5120, 2880 }, { 7680, 4320 } };
+    std::vector<std::pair<int, int>> sizes;
+    for (const auto& mode : MODES)
+    {
+        sizes.emplace_back(mode[0], mode[1]);
+        sizes.emplace_back(mode[1], mode[0]);
+    }
+    for (int width = 800; width <= 7680; width += 97)
+    {
+        for (int height = 600; height <= 4320; height += 89)
+            sizes.emplace_back(width, height);
+    }
+
+    int layouts = 0;
+    int failures = 0;
+    for (const auto& size : sizes)
+    {
+        for (int percent = 100; percent <= 500; percent += 25)
+        {
+            float dpiScale = percent / 100.0f;
+            std::string problem = CheckPatternLayout(ComputePatternLayout(size.first, size.second, dpiScale),
+                                                     size.first, size.second);
+            ++layouts;
+            if (!problem.empty())
+            {
+                if (failures < 10)
+                    std::printf("%dx%d at %d%%: %s\n", size.first, size.second, percent, problem.c_str());
+                ++failures;
+            }
+        }
+    }
+    std::printf("%d layouts over %zu sizes, %d wrong\n", layouts, sizes.size(), failures);
+    return failures == 0 ? 0 : 1;
+}
+
+namespace
+{
+// What one display's session ends with, from the levels of every mode and the stored snapshot
+struct SessionOutcome
+{
+    BrightnessMode mode = BrightnessMode::MaxWhite;
+    float levels[MODE_COUNT] = {};
+    DisplayRecord record;
+    uint32_t completedSteps = 0;
+    float stepLevels[SESSION_MAX_STEPS] = {};
+};
+
+// Display n's own calibration: distinct cached results give each session different starting levels and
+// increments, and distinct input rhythms move them differently
+CalibrationSeed ConcurrentSeed(int display)
+{
+    DisplayRecord cached;
+    cached.maxWhite = 300.0f + 150.0f * display;
+    cached.minBlack = 0.02f * (display + 1);
+    return SeedCalibration(nullptr, &cached);
+}
+
+uint32_t ConcurrentWorkflowHash(int display)
+{
+    return 0x9e3779b9u * static_cast<uint32_t>(display + 1);
+}
+
+// Yielding between frames lets the other threads in even on one core
+void DriveSession(CalibrationSession& session, int display, int frames, bool yield)
+{
+    const int STEP_INTERVAL = 97;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        InputFrame input;
+        input.right = frame % (3 + display) == 0;
+        input.left = frame % (5 + 2 * display) == 1;
+        input.toggle = frame % (150 + 25 * display) == 0;
+        session.ApplyInput(input, static_cast<uint32_t>(frame) * 16);
+        if (frame % STEP_INTERVAL == STEP_INTERVAL - 1)
+        {
+            size_t step = static_cast<size_t>(frame / STEP_INTERVAL) % SESSION_MAX_STEPS;
+            session.CompleteStep(ConcurrentWorkflowHash(display), step, session.GetCurrentBrightness());
+        }
+        if (yield)
+            std::this_thread::yield();
+    }
+}
+
+SessionOutcome CollectOutcome(const CalibrationSession& session, int display)
+{
+    SessionOutcome outcome;
+    outcome.mode = session.GetMode();
+    for (size_t i = 0; i < MODE_COUNT; ++i)
+        outcome.levels[i] = session.GetLevel(static_cast<BrightnessMode>(i));
+    outcome.record = session.Result();
+    for (size_t step = 0; step < SESSION_MAX_STEPS; ++step)
+    {
+        float level = 0.0f;
+        if (session.StepCompleted(ConcurrentWorkflowHash(display), step, level))
+        {
+            outcome.completedSteps |= 1u << step;
+            outcome.stepLevels[step] = level;
+        }
+    }
+    return outcome;
+}
+
+std::string CompareOutcome(const SessionOutcome& got, const SessionOutcome& expected)
+{
+    char text[128];
+    if (got.mode != expected.mode)
+        return "ended in another mode";
+    for (size_t i = 0; i < MODE_COUNT; ++i)
+    {
+        if (got.levels[i] != expected.levels[i])
+        {
+            std::snprintf(text, sizeof(text), "%s at %.4f nits, alone %.4f",
+                          GetModeInfo(static_cast<BrightnessMode>(i)).name, got.levels[i], expected.levels[i]);
+            return text;
+        }
+    }
+    if (got.record.maxWhite != expected.record.maxWhite || got.record.minBlack != expected.record.minBlack)
+        return "result differs";
+    if (got.completedSteps != expected.completedSteps)
+    {
+        std::snprintf(text, sizeof(text), "steps %08x, alone %08x", got.completedSteps, expected.completedSteps);
+        return text;
+    }
+    for (size_t step = 0; step < SESSION_MAX_STEPS; ++step)
+    {
+        if (got.stepLevels[step] != expected.stepLevels[step])
+        {
+            std::snprintf(text, sizeof(text), "step %zu at %.4f nits, alone %.4f", step, got.stepLevels[step],
+                          expected.stepLevels[step]);
+            return text;
+        }
+    }
+    return std::string();
+}
+}
+
+int RunConcurrentSessions(const Options& options)
+{
+    // Several displays calibrated at once, as on Windows: each session gets its own input thread,
+    // a render thread reading it every frame and a session file. Every session must end exactly
+    // where the same input leaves it when it runs alone, its render thread must only ever see its
+    // own increments, and its file must resume it and no other display.
+    int displays = options.concurrentSessions;
+    int frames = options.frames > 0 ? options.frames : 5000;
+
+    std::vector<SessionOutcome> expected(displays);
+    for (int display = 0; display < displays; ++display)
+    {
+        CalibrationSession session;
+        session.Seed(ConcurrentSeed(display), display + 1);
+        DriveSession(session, display, frames, false);
+        expected[display] = CollectOutcome(session, display);
+    }
+
+    std::error_code ec;
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path(ec) / ("hdr-calib-sessions-" + std::to_string(getpid()));
+    std::filesystem::create_directories(directory, ec);
+    auto sessionPath = [&](int display)
+    {
+        return (directory / ("session-" + std::to_string(display) + ".dat")).string();
+    };
+
+    std::vector<std::unique_ptr<CalibrationSession>> sessions;
+    for (int display = 0; display < displays; ++display)
+    {
+        sessions.push_back(std::make_unique<CalibrationSession>());
+        sessions[display]->Seed(ConcurrentSeed(display), display + 1);
+        if (!sessions[display]->OpenStore(sessionPath(display), true))
+        {
+            std::fprintf(stderr, "cannot open %s\n", sessionPath(display).c_str());
+            std::filesystem::remove_all(directory, ec);
+            return 1;
+        }
+    }
+
+    std::vector<std::atomic<int>> foreignViews(displays);
+    std::vector<std::atomic<bool>> inputDone(displays);
+    std::vector<int> renderedFrames(displays, 0);
+    std::vector<std::thread> threads;
+    for (int display = 0; display < displays; ++display)
+    {
+        threads.emplace_back([&, display]()
+        {
+            DriveSession(*sessions[display], display, frames, true);
+            inputDone[display] = true;
+        });
+        threads.emplace_back([&, display]()
+        {
+            float increments[MODE_COUNT];
+            for (size_t i = 0; i < MODE_COUNT; ++i)
+                increments[i] = GetModeInfo(static_cast<BrightnessMode>(i)).seed(ConcurrentSeed(display)).increment;
+            PatternLayout layout = ComputePatternLayout(1920, 1080, 1.0f);
+            Arena arena("render arena", 16 * 1024);
+            do
+            {
+                SessionView view = sessions[display]->View();
+                if (view.increment != increments[ModeIndex(view.mode)])
+                    ++foreignViews[display];
+                arena.Reset();
+                Pattern pattern(&arena);
+                BuildCalibrationPattern(view, layout, pattern);
+                ++renderedFrames[display];
+                std::this_thread::yield();
+            } while (!inputDone[display]);
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    int failures = 0;
+    for (int display = 0; display < displays; ++display)
+    {
+        std::string problem = CompareOutcome(CollectOutcome(*sessions[display], display), expected[display]);
+        sessions[display]->CloseStore();
+
+        if (problem.empty() && foreignViews[display] > 0)
+            problem = std::to_string(foreignViews[display]) + " frames saw another session's increment";
+
+        // Reopened from its file, the session resumes; a session of another display must not
+        CalibrationSession resumed;
+        resumed.Seed(ConcurrentSeed(display), display + 1);
+        if (!resumed.OpenStore(sessionPath(display), false))
+            problem = "session file lost";
+        else if (problem.empty())
+            problem = CompareOutcome(CollectOutcome(resumed, display), expected[display]);
+        resumed.CloseStore();
+
+        CalibrationSession other;
+        other.Seed(ConcurrentSeed(display), displays + display + 1);
+        if (other.OpenStore(sessionPath(display), false) && problem.empty() &&
+            other.GetLevel(BrightnessMode::MaxWhite) != ConcurrentSeed(display).maxWhite)
+            problem = "resumed on another display";
+        other.CloseStore();
+
+        const SessionOutcome& outcome = expected[display];
+        std::printf("display %d: max white %.1f nits, min black %.4f nits, %d frames rendered%s%s\n", display,
+                    outcome.record.maxWhite, outcome.record.minBlack, renderedFrames[display],
+                    problem.empty() ? "" : ": ", problem.c_str());
+        failures += !problem.empty();
+    }
+    std::filesystem::remove_all(directory, ec);
+
+    std::printf("%d sessions on %d threads over %d frames, %d differ from running alone\n", displays,
+                2 * displays, frames, failures);
+    return failures == 0 ? 0 : 1;
+}
+
+int RunBench(const Options& options)
+{
+    const size_t ITERATIONS = 200;
+    int width = options.vulkan.width;
+    int height = options.vulkan.height;
+
+    // Idle power first, as the floor every energy figure below sits on
+    std::unique_ptr<EnergyCounter> energy = OpenEnergyOption(options);
+    if (energy)
+    {
+        const double IDLE_SECONDS = 0.5;
+        double before = 0.0;
+        double after = 0.0;
+        if (energy->Read(before))
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double>(IDLE_SECONDS));
+            if (energy->Read(after))
+                std::printf("idle power (%s): %.2f W\n", energy->Name().c_str(), (after - before) / IDLE_SECONDS);
+        }
+    }
+    SetBenchEnergyCounter(energy.get());
+
+    std::vector<BenchResult> results = RunCoreBenchmarks(width, height, ITERATIONS);
+
+    // Offscreen Vulkan frames, measured end to end including the readback copy
+    VulkanOptions vulkanOptions = options.vulkan;
+    vulkanOptions.present = false;
+    VulkanRenderer renderer;
+    if (renderer.Init(vulkanOptions))
+    {
+        SessionView view;
+        view.brightness = 800.0f;
+        view.increment = 10.0f;
+        Pattern pattern = BuildCalibrationPattern(view, ComputePatternLayout(width, height, 1.0f));
+
+        const char* name = renderer.Encoding() == FrameEncoding::ScRgbHalf ? "vulkan offscreen scRGB FP16"
+                                                                            : "vulkan offscreen HDR10 PQ";
+        results.push_back(MeasureBenchmark(name, ITERATIONS, [&]()
+        {
+            renderer.RenderFrame(pattern);
+        }));
+        results.back().note = renderer.DeviceName();
+    }
+    else
+    {
+        std::fprintf(stderr, "Vulkan benchmarks skipped: %s\n", renderer.Status().c_str());
+    }
+
+    PrintBenchResults(results);
+    SetBenchEnergyCounter(nullptr);
+    return 0;
+}
+
+int RunPresentReport(const std::string& path)
+{
+    std::error_code error;
+    if (std::filesystem::is_directory(path, error))
+        return CheckPresentRecordings(path);
+
+    PresentConfig config;
+    std::vector<PresentSample> samples;
+    int64_t ticksPerSecond = 0;
+    if (!LoadPresentRecording(path, config, samples, ticksPerSecond))
+    {
+        std::fprintf(stderr, "cannot read present recording %s\n", path.c_str());
+        return 1;
+    }
+
+    PresentReport report = AnalyzePresentation(config, samples, ticksPerSecond);
+    std::printf("%s", FormatPresentReport(report).c_str());
+    return report.warnings.empty() ? 0 : 3;
+}
+
+int CheckPresentRecordings(const std::string& directory)
+{
+    // Every <name>.rec in the directory against the report it should give, kept beside it as <name>.txt
+    std::vector<std::filesystem::path> recordings;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+    {
+        if (entry.path().extension() == ".rec")
+            recordings.push_back(entry.path());
+    }
+    std::sort(recordings.begin(), recordings.end());
+
+    int failures = 0;
+    for (const std::filesystem::path& recording : recordings)
+    {
+        std::filesystem::path expectedPath = recording;
+        expectedPath.replace_extension(".txt");
+        std::ifstream file(expectedPath);
+        std::string expected((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        PresentConfig config;
+        std::vector<PresentSample> samples;
+        int64_t ticksPerSecond = 0;
+        std::string report;
+        if (LoadPresentRecording(recording.string(), config, samples, ticksPerSecond))
+            report = FormatPresentReport(AnalyzePresentation(config, samples, ticksPerSecond));
+
+        std::string name = recording.filename().string();
+        if (!file)
+            std::printf("%s: no %s\n", name.c_str(), expectedPath.filename().string().c_str());
+        else if (report.empty())
+            std::printf("%s: cannot read the recording\n", name.c_str());
+        else if (report != expected)
+            std::printf("%s: report differs, expected\n%sgot\n%s", name.c_str(), expected.c_str(), report.c_str());
+        else
+            std::printf("%s: %s", name.c_str(), report.substr(0, report.find('\n') + 1).c_str());
+        failures += !file || report != expected;
+    }
+    std::printf("%zu of %zu recordings give the expected report\n", recordings.size() - failures,
+                recordings.size());
+    return failures == 0 && !recordings.empty() ? 0 : 1;
+}
+
+int RunScriptFiles(const Options& options)
+{
+    // Every script is checked before any of them runs
+    std::vector<ScriptJob> jobs(options.scripts.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        std::string error;
+        jobs[i].name = options.scripts[i];
+        if (!jobs[i].script.Load(options.scripts[i], error))
+        {
+            std::fprintf(stderr, "%s: %s\n", options.scripts[i].c_str(), error.c_str());
+            return 2;
+        }
+    }
+
+    ScriptRunOptions runOptions;
+    runOptions.width = options.vulkan.width;
+    runOptions.height = options.vulkan.height;
+    std::vector<ScriptResult> results = RunScripts(jobs, runOptions, options.scriptJobs);
+
+    size_t failed = 0;
+    for (const ScriptResult& result : results)
+    {
+        std::printf("%s", FormatScriptResult(result).c_str());
+        failed += !result.ok;
+    }
+    std::printf("%zu of %zu scripts passed\n", results.size() - failed, results.size());
+    return failed == 0 ? 0 : 1;
+}
+
+int RunLevelDetect(const Options& options)
+{
+    // Panels from a dim LCD to a bright OLED, some with slow pixels or a slow power limiter
+    struct DetectPanel
+    {
+        float peak10, fullField, black, gain, settleMs, limiterMs;
+    };
+    const DetectPanel PANELS[] = {
+        { 1000.0f, 400.0f, 0.05f, 1.0f, 0.0f, 0.0f },
+        { 600.0f, 350.0f, 0.1f, 1.05f, 0.0f, 0.0f },
+        { 1500.0f, 600.0f, 0.02f, 0.95f, 30.0f, 0.0f },
+        { 4000.0f, 1000.0f, 0.005f, 1.0f, 0.0f, 300.0f },
+        { 800.0f, 250.0f, 0.002f, 1.02f, 5.0f, 100.0f },
+    };
+    const float MAX_ERROR_CODES = 2.0f;
+
+    int width = options.vulkan.width;
+    int height = options.vulkan.height;
+    PatternLayout layout = ComputePatternLayout(width, height, 1.0f);
+
+    // Each panel is a script, so the detect command runs as written
+    std::vector<ScriptJob> jobs;
+    for (const DetectPanel& panel : PANELS)
+    {
+        char text[256];
+        std::snprintf(text, sizeof(text),
+                      "panel peak10 %g\npanel fullfield %g\npanel black %g\npanel gain %g\npanel settle %g\n"
+                      "panel limiter %g\ndetect maxwhite\ndetect minblack\n",
+                      panel.peak10, panel.fullField, panel.black, panel.gain, panel.settleMs, panel.limiterMs);
+        ScriptJob job;
+        job.name = "panel " + std::to_string(jobs.size() + 1);
+        std::string error;
+        if (!job.script.Parse(text, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 2;
+        }
+        jobs.push_back(job);
+    }
+
+    ScriptRunOptions runOptions;
+    runOptions.width = width;
+    runOptions.height = height;
+    std::vector<ScriptResult> results = RunScripts(jobs, runOptions, options.scriptJobs);
+
+    // Where the edges really are: the light of the flat end without noise, over the gain
+    auto settled = [&](const DetectPanel& panel, BrightnessMode mode, float level)
+    {
+        PanelModel model;
+        model.peak10 = panel.peak10;
+        model.fullField = panel.fullField;
+        model.black = panel.black;
+        model.gain = panel.gain;
+        DisplaySimulator display(model);
+        SessionView view;
+        view.mode = mode;
+        view.brightness = level;
+        display.Show(BuildCalibrationPattern(view, layout), width, height, 0.0);
+        return display.Luminance(0.0) / panel.gain;
+    };
+
+    size_t detections = 0;
+    size_t readings = 0;
+    float worstCodes = 0.0f;
+    int failures = 0;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const DetectPanel& panel = PANELS[i];
+        std::printf("%s: peak %g, full field %g, black %g nits, gain %.2f, settle %g ms, limiter %g ms\n",
+                    results[i].name.c_str(), panel.peak10, panel.fullField, panel.black, panel.gain,
+                    panel.settleMs, panel.limiterMs);
+        for (const ScriptDetection& detection : results[i].detections)
+        {
+            const LevelDetectResult& found = detection.result;
+            float truth = found.edge == LevelEdge::Clip ? settled(panel, detection.mode, PQ_MAX_NITS)
+                                                        : settled(panel, detection.mode, 0.0f);
+            float codes = (PqEncode(found.level) - PqEncode(truth)) * 1023.0f;
+            std::printf("  %-8s %s  truth %.4g nits, off by %+.1f codes\n", GetModeInfo(detection.mode).key,
+                        FormatLevelDetectResult(found).c_str(), truth, codes);
+            ++detections;
+            readings += found.readings;
+            worstCodes = std::max(worstCodes, std::abs(codes));
+            failures += !found.found || std::abs(codes) > MAX_ERROR_CODES;
+        }
+        failures += !results[i].ok;
+    }
+    std::printf("%zu detections in %.1f readings on average, worst %.1f PQ codes off\n", detections,
+                detections ? static_cast<double>(readings) / detections : 0.0, worstCodes);
+    return failures == 0 ? 0 : 1;
+}
+
+int RunFlickerDetect()
+{
+    // PWM backlights from barely on to nearly always on, mains ripple, and a steady light.
+    // Captures are 1 s at 20 kHz with the emulated meter's noise, as the flicker command takes them.
+    const FlickerWaveform WAVEFORMS[] = {
+        { 240.0f, 200.0f, 1.0f, 0.5f, 0.002f },
+        { 120.0f, 50.0f, 1.0f, 0.1f, 0.002f },
+        { 480.0f, 400.0f, 1.0f, 0.8f, 0.002f },
+        { 2000.0f, 100.0f, 0.6f, 0.3f, 0.002f }, // 10 samples a period, 3 of them high
+        { 100.0f, 300.0f, 0.3f, 0.0f, 0.002f },
+        { 60.0f, 80.0f, 0.05f, 0.0f, 0.002f },
+        { 1000.0f, 150.0f, 0.8f, 0.0f, 0.002f },
+        { 0.0f, 500.0f, 0.0f, 0.0f, 0.002f },
+    };
+    const float SAMPLE_RATE = 20000.0f;
+    const float MAX_FREQUENCY_ERROR = 1.0f; // Hz
+    const float MAX_PERCENT_ERROR = 1.0f;   // percentage points
+    const float MAX_INDEX_ERROR = 0.01f;
+
+    std::vector<FlickerCapture> captures;
+    for (const FlickerWaveform& waveform : WAVEFORMS)
+    {
+        captures.emplace_back();
+        SynthesizeFlicker(waveform, SAMPLE_RATE, static_cast<size_t>(SAMPLE_RATE),
+                          static_cast<uint32_t>(captures.size()), captures.back());
+        captures.back().level = waveform.mean;
+    }
+    std::vector<FlickerResult> results = AnalyzeFlicker(captures);
+
+    float worstFrequency = 0.0f;
+    float worstPercent = 0.0f;
+    float worstIndex = 0.0f;
+    int failures = 0;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const FlickerWaveform& waveform = WAVEFORMS[i];
+        FlickerResult expected = ExpectedFlicker(waveform);
+        const FlickerResult& found = results[i];
+        float frequencyError = std::abs(found.frequency - expected.frequency);
+        float percentError = std::abs(found.modulationDepth - expected.modulationDepth);
+        float indexError = std::abs(found.flickerIndex - expected.flickerIndex);
+        bool ok = frequencyError <= MAX_FREQUENCY_ERROR && percentError <= MAX_PERCENT_ERROR &&
+                  indexError <= MAX_INDEX_ERROR;
+
+        char shape[48];
+        if (waveform.frequency <= 0.0f)
+            std::snprintf(shape, sizeof(shape), "steady");
+        else if (waveform.duty > 0.0f)
+            std::snprintf(shape, sizeof(shape), "PWM %g Hz, duty %g", waveform.frequency, waveform.duty);
+        else
+            std::snprintf(shape, sizeof(shape), "sine %g Hz", waveform.frequency);
+        std::printf("%-24s %.1f Hz (%g), %.1f%% flicker (%.1f), index %.3f (%.3f)%s\n", shape, found.frequency,
+                    expected.frequency, found.modulationDepth, expected.modulationDepth, found.flickerIndex,
+                    expected.flickerIndex, ok ? "" : "  WRONG");
+        worstFrequency = std::max(worstFrequency, frequencyError);
+        worstPercent = std::max(worstPercent, percentError);
+        worstIndex = std::max(worstIndex, indexError);
+        failures += !ok;
+    }
+    std::printf("%zu captures, %d wrong; worst off by %.2f Hz, %.2f points of percent flicker, %.4f flicker index\n",
+                results.size(), failures, worstFrequency, worstPercent, worstIndex);
+    return failures == 0 ? 0 : 1;
+}
+
+int RunAplSettle(const Options& options)
+{
+    // Panels whose power limiter follows the average picture level, from half a second to five
+    struct SettlePanel
+    {
+        float peak10, fullField, settleMs, limiterMs;
+    };
+    const SettlePanel PANELS[] = {
+        { 1000.0f, 400.0f, 20.0f, 2000.0f },
+        { 1500.0f, 600.0f, 5.0f, 500.0f },
+        { 4000.0f, 1000.0f, 0.0f, 300.0f },
+        { 800.0f, 250.0f, 30.0f, 5000.0f },
+    };
+    const int CYCLES = 3;
+
+    // A full field pattern sets the average picture level to its own level, so that is the level the
+    // surround holds unless --apl asks for another
+    auto aplFor = [&](const SettlePanel& panel) { return options.aplNits > 0.0f ? options.aplNits : panel.fullField; };
+
+    // Each panel twice: full field at its full field level and max white at 70% of its peak, in turn,
+    // first over black and then over the surround
+    std::vector<ScriptJob> jobs;
+    for (const SettlePanel& panel : PANELS)
+    {
+        for (int surround = 0; surround < 2; ++surround)
+        {
+            char line[160];
+            std::snprintf(line, sizeof(line), "panel peak10 %g\npanel fullfield %g\npanel settle %g\npanel limiter %g\n",
+                          panel.peak10, panel.fullField, panel.settleMs, panel.limiterMs);
+            std::string text = line;
+            if (surround)
+            {
+                std::snprintf(line, sizeof(line), "apl %g\n", aplFor(panel));
+                text += line;
+            }
+            // Five limiter time constants per pattern, so each switch starts from a settled limiter
+            float waitMs = std::max(5000.0f, 5.0f * panel.limiterMs);
+            for (int cycle = 0; cycle < CYCLES; ++cycle)
+            {
+                std::snprintf(line, sizeof(line), "mode fullfield\nlevel %g\nwait %g\nread\n"
+                              "mode maxwhite\nlevel %g\nwait %g\nread\n", panel.fullField, waitMs,
+                              0.7f * panel.peak10, waitMs);
+                text += line;
+            }
+
+            ScriptJob job;
+            job.name = "panel " + std::to_string(jobs.size() / 2 + 1) + (surround ? ", apl" : "");
+            std::string error;
+            if (!job.script.Parse(text, error))
+            {
+                std::fprintf(stderr, "%s\n", error.c_str());
+                return 2;
+            }
+            jobs.push_back(job);
+        }
+    }
+
+    ScriptRunOptions runOptions;
+    runOptions.width = options.vulkan.width;
+    runOptions.height = options.vulkan.height;
+    std::vector<ScriptResult> results = RunScripts(jobs, runOptions, options.scriptJobs);
+
+    double blackTotal = 0.0;
+    double surroundTotal = 0.0;
+    int failures = 0;
+    for (size_t i = 0; i < std::size(PANELS); ++i)
+    {
+        const SettlePanel& panel = PANELS[i];
+        const ScriptResult& black = results[i * 2];
+        const ScriptResult& surround = results[i * 2 + 1];
+        bool ok = black.ok && surround.ok && surround.settleMs < black.settleMs;
+        std::printf("panel %zu: peak %g, full field %g nits, settle %g ms, limiter %g ms: %.0f ms over black, "
+                    "%.0f ms at apl %g%s\n", i + 1, panel.peak10, panel.fullField, panel.settleMs, panel.limiterMs,
+                    black.settleMs, surround.settleMs, aplFor(panel), ok ? "" : "  NOT FASTER");
+        blackTotal += black.settleMs;
+        surroundTotal += surround.settleMs;
+        failures += !ok;
+    }
+    std::printf("frames settled within 1%% in %.0f ms on average over black, %.0f ms over the surround\n",
+                blackTotal / std::size(PANELS), surroundTotal / std::size(PANELS));
+    return failures == 0 ? 0 : 1;
+}
+
+int RunPatchGenerator(const Options& options)
+{
+    // lattice and surface count steps per axis; sobol and grey count patches
+    std::string kind = options.patchSpec.substr(0, options.patchSpec.find(':'));
+    size_t count = 0;
+    float peak = 1000.0f;
+    const char* numbers = std::strchr(options.patchSpec.c_str(), ':');
+    if (numbers)
+        std::sscanf(numbers, ":%zu:%f", &count, &peak);
+
+    auto start = std::chrono::steady_clock::now();
+    PatchSet set;
+    if (kind == "lattice")
+        GenerateLattice(count, 0.0f, peak, set);
+    else if (kind == "sobol")
+        GenerateSobol(count, 0, 0.0f, peak, set);
+    else if (kind == "grey")
+        GeneratePqGreyscale(count, 0.0f, peak, set);
+    else if (kind == "surface")
+        GenerateGamutSurface(count, 0.0f, peak, set);
+    if (set.Size() == 0)
+    {
+        std::fprintf(stderr, "expected lattice, sobol, grey or surface and a count, got %s\n",
+                     options.patchSpec.c_str());
+        return 2;
+    }
+    double generateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!SavePatchSet(options.patchPath, set))
+    {
+        std::fprintf(stderr, "cannot write %s\n", options.patchPath.c_str());
+        return 1;
+    }
+    std::printf("%zu patches up to %g nits in %.2f ms, written to %s\n", set.Size(), peak, generateMs,
+                options.patchPath.c_str());
+    return 0;
+}
+
+int RunReport(const Options& options)
+{
+    ReportSummary summary;
+    std::string error;
+    if (!GenerateMeasurementReport(options.reportSession, options.reportPrefix, ReportOptions(), summary, error))
+    {
+        std::fprintf(stderr, "report: %s\n", error.c_str());
+        return 1;
+    }
+    std::printf("%zu patches, delta E ITP mean %.2f, p95 %.2f, max %.2f; %s.html written in %.2f s\n",
+                summary.patches, summary.meanDeltaE, summary.p95DeltaE, summary.maxDeltaE,
+                options.reportPrefix.c_str(), summary.seconds);
+    if (summary.skippedLines > 0)
+        std::printf("%zu unreadable lines skipped\n", summary.skippedLines);
+    return 0;
+}
+
+int RunGainMap(const Options& options)
+{
+    // The CPU renderer's per-pixel correction, and the tiled rects the Vulkan frame loop clears instead
+    const int GRID_COLUMNS = 9;
+    const int GRID_ROWS = 9;
+    GainGrid grid;
+    std::string error;
+    if (!BuildGainGrid(options.gainMapSession, GRID_COLUMNS, GRID_ROWS, grid, error))
+    {
+        std::fprintf(stderr, "gain map: %s\n", error.c_str());
+        return 1;
+    }
+    std::printf("gains from %s\n%s", options.gainMapSession.c_str(), FormatGainGrid(grid).c_str());
+
+    int width = options.vulkan.width;
+    int height = options.vulkan.height;
+    GainMap gainMap;
+    gainMap.SetGrid(grid);
+    Pattern pattern = BuildCalibrationPattern(g_session.View(), ComputePatternLayout(width, height, 1.0f));
+    FrameBuffer frame;
+    frame.Resize(width, height, FrameEncoding::ScRgbHalf);
+
+    BenchResult render = MeasureBenchmark("render", 50, [&]() { RenderPatternCpu(pattern, frame, gainMap); });
+    BenchResult apply = MeasureBenchmark("apply", 50, [&]() { gainMap.Apply(frame); });
+    std::printf("%dx%d, %s kernel: corrected render %.2f ms, pass over a finished frame %.2f ms\n", width, height,
+                GainMap::Vectorized() ? "F16C" : "scalar", render.meanMs, apply.meanMs);
+
+    Pattern scaled;
+    BenchResult scale = MeasureBenchmark("scale", 50, [&]()
+    {
+        scaled = pattern;
+        gainMap.ScalePattern(scaled, width, height);
+    });
+    FrameBuffer tiled;
+    tiled.Resize(width, height, FrameEncoding::ScRgbHalf);
+    RenderPatternCpu(pattern, frame, gainMap);
+    RenderPatternCpu(scaled, tiled);
+    float worst = 0.0f;
+    for (size_t i = 0; i < frame.data.size() / sizeof(uint16_t); ++i)
+    {
+        float exact = HalfToFloat(frame.Half()[i]);
+        if (exact > 0.0f)
+            worst = std::max(worst, std::abs(HalfToFloat(tiled.Half()[i]) - exact) / exact);
+    }
+    std::printf("scaled for clears: %zu rects in %.2f ms, within %.2f%% of the per-pixel correction\n",
+                scaled.rects.size(), scale.meanMs, worst * 100.0f);
+    return 0;
+}
+
+int RunPlay(const Options& options)
+{
+    PatchSet set;
+    if (!LoadPatchSet(options.playPath, set))
+    {
+        std::fprintf(stderr, "cannot read patch set %s\n", options.playPath.c_str());
+        return 1;
+    }
+
+    SequenceOptions sequence;
+    sequence.width = options.vulkan.width;
+    sequence.height = options.vulkan.height;
+    sequence.encoding = options.vulkan.encoding;
+    sequence.holdFrames = options.holdFrames;
+    sequence.aplNits = options.aplNits;
+    if (!options.gainMapSession.empty())
+    {
+        std::string error;
+        if (!BuildGainGrid(options.gainMapSession, 9, 9, sequence.gainGrid, error))
+        {
+            std::fprintf(stderr, "gain map: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    // Frames go to the renderer when it starts, at its size and encoding, and are only timed without it
+    VulkanRenderer renderer;
+    if (renderer.Init(options.vulkan))
+    {
+        sequence.width = renderer.Width();
+        sequence.height = renderer.Height();
+        sequence.encoding = renderer.Encoding();
+        sequence.present = [&renderer](const FrameBuffer& frame) { return renderer.PresentFrame(frame); };
+        std::printf("%s: %s\n", renderer.DeviceName().c_str(), renderer.Status().c_str());
+    }
+    else
+    {
+        std::printf("Vulkan init failed: %s, timing only\n", renderer.Status().c_str());
+    }
+
+    // The same sequence twice: each patch rendered on the frame it first appears, then ahead of time
+    std::printf("%zu patches at %dx%d, %d frames each at %.0f Hz%s\n", set.Size(), sequence.width, sequence.height,
+                sequence.holdFrames, sequence.refreshHz, sequence.gainGrid.Empty() ? "" : ", gain map");
+    SequenceStats inlineStats = PlaySequence(set, sequence);
+    std::printf("%s", FormatSequenceStats(inlineStats, sequence).c_str());
+    sequence.lookahead = options.prefetch;
+    SequenceStats prefetchStats = PlaySequence(set, sequence);
+    std::printf("%s", FormatSequenceStats(prefetchStats, sequence).c_str());
+
+    if (sequence.present && (inlineStats.presented < set.Size() || prefetchStats.presented < set.Size()))
+    {
+        std::fprintf(stderr, "presenting a frame failed%s\n", renderer.DeviceLost() ? ": device lost" : "");
+        return 1;
+    }
+    return 0;
+}
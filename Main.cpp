@@ -1,59 +1,199 @@
 #include <windows.h>
 #include <d3d11.h>
-#include <dxgi1_4.h>
+#include <d3dcompiler.h>
+#include <dxgi1_6.h>
 #include <d2d1_1.h>
 #include <dwrite.h>
 #include <xinput.h>
 #include <wrl/client.h>
 #include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Arena.h"
+#include "Edid.h"
+#include "FalseColor.h"
+#include "DisplayCache.h"
+#include "CpuRenderer.h"
+#include "DeviceRecovery.h"
+#include "DrawList.h"
+#include "GainMap.h"
+#include "MemoryLedger.h"
+#include "Scopes.h"
+#include "Session.h"
+#include "Layout.h"
+#include "Pattern.h"
+#include "Workflow.h"
+#include "PresentDiagnostics.h"
 
 using Microsoft::WRL::ComPtr;
 
-enum class BrightnessMode
+// Memory by subsystem, across all outputs; the trackers outlive every Display that allocates through them
+MemoryLedger g_memory;
+TrackedResource g_patternMemory(g_memory, "patterns");
+TrackedResource g_scopeMemory(g_memory, "scopes");
+
+// One output being calibrated: its window, its own device objects and its own session.
+// Device objects are per display so render threads never share a device context.
+struct Display
 {
-    MaxWhite,  // Outer rect shown, 0-10000 nits, 10 nit increments
-    MinBlack   // Outer rect hidden, 0-1 nits, 0.01 nit increments
+    int index = 0;                  // position in g_displays, also the gamepad that drives it
+    std::wstring deviceName;        // GDI name such as \\.\DISPLAY1
+    RECT bounds = {};               // desktop coordinates of the output, physical pixels
+    int width = 0;                  // back buffer size, owned by the render thread after startup
+    int height = 0;
+    HWND hwnd = nullptr;
+    PatternLayout layout;
+
+    // Set by the window thread, applied by the render thread before its next frame
+    std::atomic<bool> resizePending{ false };
+    std::atomic<int> pendingWidth{ 0 };
+    std::atomic<int> pendingHeight{ 0 };
+    std::atomic<UINT> dpi{ USER_DEFAULT_SCREEN_DPI };
+
+    ComPtr<IDXGIFactory1> factory;  // the adapter and output were enumerated on it
+    ComPtr<IDXGIAdapter1> adapter;
+    ComPtr<IDXGIOutput> output;
+    ComPtr<ID3D11Device> d3dDevice;
+    ComPtr<ID3D11DeviceContext> d3dContext;
+    ComPtr<IDXGISwapChain3> swapChain;
+    ComPtr<IDXGISwapChainMedia> swapChainMedia; // presentation mode statistics, when supported
+    ComPtr<ID2D1Factory1> d2dFactory;
+    ComPtr<ID2D1Device> d2dDevice;
+    ComPtr<ID2D1DeviceContext> d2dContext;
+    ComPtr<ID2D1Bitmap1> d2dTargetBitmap;
+    ComPtr<ID2D1SolidColorBrush> patchBrush;
+    ComPtr<ID2D1SolidColorBrush> textBrush;
+    ComPtr<IDWriteTextFormat> textFormat;
+
+    // Post pass, with --gain-map or --false-color: D2D draws into sceneTexture and a full screen
+    // pass copies it to the back buffer, scaled by the gain grid the sampler interpolates
+    // or mapped to false color bands
+    ComPtr<ID3D11Texture2D> sceneTexture;
+    ComPtr<ID3D11ShaderResourceView> sceneView;
+    ComPtr<ID3D11RenderTargetView> backBufferView;
+    ComPtr<ID3D11ShaderResourceView> gainView;
+    ComPtr<ID3D11SamplerState> gainSampler;
+    ComPtr<ID3D11VertexShader> postVertexShader;
+    ComPtr<ID3D11PixelShader> gainPixelShader;
+    ComPtr<ID3D11PixelShader> falseColorShader;
+    ComPtr<ID3D11Buffer> falseColorConstants;
+    ComPtr<ID3DBlob> postVertexCode;     // compiled once and kept, so rebuilding the pass is quick
+    ComPtr<ID3DBlob> postPixelCode;
+    ComPtr<ID3DBlob> falseColorCode;
+    FalseColor falseColor; // render thread only
+
+    // Every object above made on the device, as a manifest of steps that rebuild them after the
+    // device is lost; render thread only after startup
+    DeviceRecovery recovery;
+
+    // Scopes, with --scopes: the reference renderer's copy of what the passes send, every nth frame
+    GainMap scopeGainMap;
+    FrameBuffer scopeFrame{ &g_scopeMemory };
+    Scopes scopes;
+    int scopeCountdown = 0;
+
+    CalibrationSession session;
+    Arena frameArena{ "frame arena", 64 * 1024, &g_patternMemory }; // render thread only, reset every frame
+    DrawListStats drawStats;                   // of the last frame
+    std::vector<PresentSample> presentSamples; // render thread only, with --present-diagnostics
+    std::thread renderThread;
+    std::atomic<bool> renderFinished{ false };
 };
 
 // Global variables
-ComPtr<ID3D11Device> g_d3dDevice;
-ComPtr<ID3D11DeviceContext> g_d3dContext;
-ComPtr<IDXGISwapChain3> g_swapChain;
-ComPtr<ID2D1Factory1> g_d2dFactory;
-ComPtr<ID2D1Device> g_d2dDevice;
-ComPtr<ID2D1DeviceContext> g_d2dContext;
-ComPtr<ID2D1Bitmap1> g_d2dTargetBitmap;
-ComPtr<ID2D1SolidColorBrush> g_whiteBrush;
-ComPtr<ID2D1SolidColorBrush> g_innerBrush;
-ComPtr<ID2D1SolidColorBrush> g_textBrush;
 ComPtr<IDWriteFactory> g_dwriteFactory;
-ComPtr<IDWriteTextFormat> g_textFormat;
-
-HWND g_hwnd = nullptr;
-BrightnessMode g_mode = BrightnessMode::MaxWhite;
-float g_brightnessMaxWhite = 800.0f; // nits (0-10000)
-float g_brightnessMinBlack = 0.1f;   // nits (0-1)
-int g_screenWidth = 0;
-int g_screenHeight = 0;
+std::vector<std::unique_ptr<Display>> g_displays;
+std::atomic<bool> g_running{ true };
+std::string g_edidPath;              // --edid <file> overrides the EDID read from the OS
+bool g_freshSession = false;         // --fresh ignores the persisted session
+int g_outputIndex = -1;              // --output <n> calibrates a single output
+std::string g_workflowPath;          // --workflow <file|default> runs a sequence of steps
+std::thread g_workflowThread;
+std::atomic<bool> g_workflowCancel{ false };
+DWORD g_mainThreadId = 0;
+bool g_presentDiagnostics = false;   // --present-diagnostics records present statistics
+std::string g_gainMapPath;           // --gain-map <session> corrects uniformity from a measured session
+float g_aplNits = 0.0f;              // --apl <nits> holds the average picture level with a grey surround
+bool g_falseColor = false;           // --false-color starts in the false color view, which F toggles
+std::atomic<bool> g_showFalseColor{ false };
+int g_scopeInterval = 0;             // --scopes <n> draws scopes of every nth frame over it
+std::atomic<bool> g_showMemory{ false }; // M draws the memory accounts over the pattern
+GainGrid g_gainGrid;
 
 // Forward declarations
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
-bool InitD3D();
-bool InitD2D();
+bool EnumerateDisplays();
+bool RefreshAdapter(Display& display, std::string& error);
+bool InitD3D(Display& display);
+bool InitD2D(Display& display);
+bool CreateTargetBitmap(Display& display);
+void LoadGainGrid();
+bool InitPostPass(Display& display);
+void ApplyPostPass(Display& display);
+bool CreateTextFormat(Display& display);
+void AddDeviceManifest(Display& display);
+void ReleaseDeviceObjects(Display& display);
+std::string DeviceLossReason(Display& display, const char* call, HRESULT hr);
+void FitWindowToMonitor(HWND hwnd);
+void ResizeSwapChain(Display& display);
+void SeedFromDisplay(Display& display);
+std::string GetSessionPath(const Display& display);
+void SaveDisplayResults();
 void ProcessInput();
-float GetCurrentBrightness();
-void SetCurrentBrightness(float brightness);
-float GetIncrement();
-float GetMaxBrightness();
-void ToggleMode();
-void Render();
+void RunWorkflow();
+void StopWorkflow();
+void RenderLoop(Display* display);
+void DeclareDeviceMemory(Display& display);
+D2D1_RECT_F ToRectF(const PixelRect& rect);
+void Render(Display& display);
+void RecordPresent(Display& display, int64_t presentTicks);
+void WritePresentDiagnostics(Display& display);
+void StopRenderThreads();
+void WriteMemoryReport();
 void CleanUp();
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 {
-    // Get screen dimensions
-    g_screenWidth = GetSystemMetrics(SM_CXSCREEN);
-    g_screenHeight = GetSystemMetrics(SM_CYSCREEN);
+    // Work in physical pixels on every monitor so DWM never scales the swap chain
+    if (!SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2))
+        SetProcessDPIAware();
+
+    // Parse command line
+    for (int i = 1; i < __argc; ++i)
+    {
+        if (strcmp(__argv[i], "--edid") == 0 && i + 1 < __argc)
+            g_edidPath = __argv[++i];
+        else if (strcmp(__argv[i], "--fresh") == 0)
+            g_freshSession = true;
+        else if (strcmp(__argv[i], "--output") == 0 && i + 1 < __argc)
+            g_outputIndex = atoi(__argv[++i]);
+        else if (strcmp(__argv[i], "--workflow") == 0 && i + 1 < __argc)
+            g_workflowPath = __argv[++i];
+        else if (strcmp(__argv[i], "--present-diagnostics") == 0)
+            g_presentDiagnostics = true;
+        else if (strcmp(__argv[i], "--gain-map") == 0 && i + 1 < __argc)
+            g_gainMapPath = __argv[++i];
+        else if (strcmp(__argv[i], "--false-color") == 0)
+            g_falseColor = true;
+        else if (strcmp(__argv[i], "--scopes") == 0 && i + 1 < __argc)
+            g_scopeInterval = atoi(__argv[++i]);
+        else if (strcmp(__argv[i], "--apl") == 0 && i + 1 < __argc)
+        {
+            // windows.h defines max as a macro, so clamp by hand
+            g_aplNits = static_cast<float>(atof(__argv[++i]));
+            if (g_aplNits < 0.0f)
+                g_aplNits = 0.0f;
+        }
+    }
+
+    if (!g_gainMapPath.empty())
+        LoadGainGrid();
+    g_showFalseColor = g_falseColor;
 
     // Register window class
     WNDCLASSEXW wc = {};
@@ -65,34 +205,79 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
     wc.lpszClassName = L"HDRCalibClass";
     RegisterClassExW(&wc);
 
-    // Create fullscreen window
-    g_hwnd = CreateWindowExW(
-        0,
-        L"HDRCalibClass",
-        L"HDR Calibration",
-        WS_POPUP,
-        0, 0,
-        g_screenWidth, g_screenHeight,
-        nullptr,
-        nullptr,
-        hInstance,
-        nullptr
-    );
-
-    if (!g_hwnd)
+    // Find every output attached to the desktop
+    if (!EnumerateDisplays())
         return -1;
 
-    ShowWindow(g_hwnd, SW_SHOW);
-    UpdateWindow(g_hwnd);
+    // Create a fullscreen window on each output
+    for (auto& display : g_displays)
+    {
+        display->hwnd = CreateWindowExW(
+            0,
+            L"HDRCalibClass",
+            L"HDR Calibration",
+            WS_POPUP,
+            display->bounds.left, display->bounds.top,
+            display->width, display->height,
+            nullptr,
+            nullptr,
+            hInstance,
+            nullptr
+        );
+
+        if (!display->hwnd)
+        {
+            CleanUp();
+            return -1;
+        }
+
+        SetWindowLongPtrW(display->hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(display.get()));
+        display->dpi = GetDpiForWindow(display->hwnd);
+
+        ShowWindow(display->hwnd, SW_SHOW);
+        UpdateWindow(display->hwnd);
+    }
+
+    // Create DirectWrite factory, shared by all render threads
+    HRESULT hr = DWriteCreateFactory(
+        DWRITE_FACTORY_TYPE_SHARED,
+        __uuidof(IDWriteFactory),
+        reinterpret_cast<IUnknown**>(g_dwriteFactory.GetAddressOf())
+    );
 
-    // Initialize DirectX 11 and Direct2D
-    if (!InitD3D() || !InitD2D())
+    if (FAILED(hr))
     {
         CleanUp();
         return -1;
     }
 
-    // Main message loop
+    // Pick starting levels and resume the session, then build the device objects
+    for (auto& display : g_displays)
+    {
+        SeedFromDisplay(*display);
+        display->session.OpenStore(GetSessionPath(*display), g_freshSession);
+        display->scopeGainMap.SetGrid(g_gainGrid);
+
+        AddDeviceManifest(*display);
+        std::string error;
+        if (!display->recovery.Create(error))
+        {
+            CleanUp();
+            return -1;
+        }
+    }
+
+    // One render thread per output, each paced by its own vsync
+    for (auto& display : g_displays)
+        display->renderThread = std::thread(RenderLoop, display.get());
+
+    // The workflow drives the sessions from its own threads and quits when it is done
+    g_mainThreadId = GetCurrentThreadId();
+    if (!g_workflowPath.empty())
+        g_workflowThread = std::thread(RunWorkflow);
+
+    // Main message loop; input is polled here and routed to each display's session
+    const DWORD INPUT_POLL_INTERVAL = 5; // milliseconds
     MSG msg = {};
     while (msg.message != WM_QUIT)
     {
@@ -104,21 +289,55 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
         else
         {
             ProcessInput();
-            Render();
+            MsgWaitForMultipleObjects(0, nullptr, FALSE, INPUT_POLL_INTERVAL, QS_ALLINPUT);
         }
     }
 
+    StopWorkflow();
+    StopRenderThreads();
+    SaveDisplayResults();
+    WriteMemoryReport();
     CleanUp();
     return static_cast<int>(msg.wParam);
 }
 
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
+    Display* display = reinterpret_cast<Display*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+
     switch (msg)
     {
     case WM_KEYDOWN:
         if (wParam == VK_ESCAPE)
             PostQuitMessage(0);
+        else if (wParam == 'F' && g_falseColor)
+            g_showFalseColor = !g_showFalseColor;
+        else if (wParam == 'M')
+            g_showMemory = !g_showMemory;
+        break;
+
+    case WM_SIZE:
+        // Hand the new client size to the render thread, which owns the swap chain
+        if (display && wParam != SIZE_MINIMIZED)
+        {
+            display->pendingWidth = LOWORD(lParam);
+            display->pendingHeight = HIWORD(lParam);
+            display->resizePending = true;
+        }
+        break;
+
+    case WM_DPICHANGED:
+        // The suggested rect is for a scaled window; a fullscreen window keeps covering its monitor
+        if (display)
+        {
+            display->dpi = HIWORD(wParam);
+            display->resizePending = true;
+        }
+        FitWindowToMonitor(hwnd);
+        break;
+
+    case WM_DISPLAYCHANGE:
+        FitWindowToMonitor(hwnd);
         break;
 
     case WM_DESTROY:
@@ -131,149 +350,154 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     return 0;
 }
 
-float GetCurrentBrightness()
+bool EnumerateDisplays()
 {
-    return g_mode == BrightnessMode::MaxWhite ? g_brightnessMaxWhite : g_brightnessMinBlack;
-}
-
-void SetCurrentBrightness(float brightness)
-{
-    if (g_mode == BrightnessMode::MaxWhite)
-        g_brightnessMaxWhite = brightness;
-    else
-        g_brightnessMinBlack = brightness;
-    
-    // Update the brush color
-    float scRGB = brightness / 80.0f;
-    g_innerBrush->SetColor(D2D1::ColorF(scRGB, scRGB, scRGB, 1.0f));
-}
-
-float GetIncrement()
-{
-    return g_mode == BrightnessMode::MaxWhite ? 10.0f : 0.01f;
-}
+    ComPtr<IDXGIFactory1> factory;
+    if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))))
+        return false;
 
-float GetMaxBrightness()
-{
-    return g_mode == BrightnessMode::MaxWhite ? 10000.0f : 1.0f;
-}
+    int outputIndex = 0;
+    ComPtr<IDXGIAdapter1> adapter;
+    for (UINT a = 0; factory->EnumAdapters1(a, &adapter) != DXGI_ERROR_NOT_FOUND; ++a)
+    {
+        ComPtr<IDXGIOutput> output;
+        for (UINT o = 0; adapter->EnumOutputs(o, &output) != DXGI_ERROR_NOT_FOUND; ++o)
+        {
+            DXGI_OUTPUT_DESC desc = {};
+            if (FAILED(output->GetDesc(&desc)) || !desc.AttachedToDesktop)
+                continue;
+
+            int current = outputIndex++;
+            if (g_outputIndex >= 0 && current != g_outputIndex)
+                continue;
+
+            auto display = std::make_unique<Display>();
+            display->index = static_cast<int>(g_displays.size());
+            display->deviceName = desc.DeviceName;
+            display->bounds = desc.DesktopCoordinates;
+            display->width = desc.DesktopCoordinates.right - desc.DesktopCoordinates.left;
+            display->height = desc.DesktopCoordinates.bottom - desc.DesktopCoordinates.top;
+            display->factory = factory;
+            display->adapter = adapter;
+            display->output = output;
+            g_displays.push_back(std::move(display));
+        }
+    }
 
-void ToggleMode()
-{
-    g_mode = (g_mode == BrightnessMode::MaxWhite) ? BrightnessMode::MinBlack : BrightnessMode::MaxWhite;
-    
-    // Update brush to reflect current mode's brightness
-    float scRGB = GetCurrentBrightness() / 80.0f;
-    g_innerBrush->SetColor(D2D1::ColorF(scRGB, scRGB, scRGB, 1.0f));
+    return !g_displays.empty();
 }
 
 void ProcessInput()
 {
-    static bool leftWasPressed = false;
-    static bool rightWasPressed = false;
     static bool bWasPressed = false;
-    static bool spaceWasPressed = false;
-    static DWORD leftPressStartTime = 0;
-    static DWORD rightPressStartTime = 0;
-    static DWORD lastRepeatTime = 0;
 
     DWORD currentTime = GetTickCount();
-    const DWORD REPEAT_DELAY = 1500; // 1.5 seconds
-    const DWORD REPEAT_INTERVAL = 200; // 0.2 seconds (5x per second)
-    const float INCREMENT = GetIncrement();
-    const float MAX_BRIGHTNESS = GetMaxBrightness();
-
-    // Check keyboard input
-    bool leftPressed = (GetAsyncKeyState(VK_LEFT) & 0x8000) != 0;
-    bool rightPressed = (GetAsyncKeyState(VK_RIGHT) & 0x8000) != 0;
-    bool spacePressed = (GetAsyncKeyState(VK_SPACE) & 0x8000) != 0;
-
-    // Check gamepad input
-    XINPUT_STATE state = {};
-    if (XInputGetState(0, &state) == ERROR_SUCCESS)
-    {
-        // D-Pad
-        leftPressed = leftPressed || (state.Gamepad.wButtons & XINPUT_GAMEPAD_DPAD_LEFT);
-        rightPressed = rightPressed || (state.Gamepad.wButtons & XINPUT_GAMEPAD_DPAD_RIGHT);
-
-        // Left stick
-        const SHORT STICK_THRESHOLD = 16000;
-        if (state.Gamepad.sThumbLX < -STICK_THRESHOLD)
-            leftPressed = true;
-        if (state.Gamepad.sThumbLX > STICK_THRESHOLD)
-            rightPressed = true;
-
-        // B button to quit
-        bool bPressed = (state.Gamepad.wButtons & XINPUT_GAMEPAD_B) != 0;
-        if (bPressed && !bWasPressed)
-            PostQuitMessage(0);
-        bWasPressed = bPressed;
-
-        // X button to toggle outer rectangle
-        bool xPressed = (state.Gamepad.wButtons & XINPUT_GAMEPAD_X) != 0;
-        spacePressed = spacePressed || xPressed;
-    }
 
-    // Handle space/X button to toggle mode
-    if (spacePressed && !spaceWasPressed)
-        ToggleMode();
-    spaceWasPressed = spacePressed;
+    // Check keyboard input; it drives the display whose window has focus
+    InputFrame keyboard;
+    keyboard.left = (GetAsyncKeyState(VK_LEFT) & 0x8000) != 0;
+    keyboard.right = (GetAsyncKeyState(VK_RIGHT) & 0x8000) != 0;
+    keyboard.toggle = (GetAsyncKeyState(VK_SPACE) & 0x8000) != 0;
+    keyboard.confirm = (GetAsyncKeyState(VK_RETURN) & 0x8000) != 0;
+    HWND foreground = GetForegroundWindow();
 
-    // Handle left input
-    if (leftPressed)
+    bool bPressed = false;
+    for (auto& display : g_displays)
     {
-        if (!leftWasPressed)
-        {
-            // Initial press
-            float newBrightness = max(0.0f, GetCurrentBrightness() - INCREMENT);
-            SetCurrentBrightness(newBrightness);
-            leftPressStartTime = currentTime;
-            lastRepeatTime = currentTime;
-        }
-        else if (currentTime - leftPressStartTime >= REPEAT_DELAY)
+        InputFrame input;
+        if (g_displays.size() == 1 || display->hwnd == foreground)
+            input = keyboard;
+
+        // Check gamepad input; gamepad N drives display N
+        XINPUT_STATE state = {};
+        if (display->index < XUSER_MAX_COUNT && XInputGetState(display->index, &state) == ERROR_SUCCESS)
         {
-            // Repeat after delay
-            if (currentTime - lastRepeatTime >= REPEAT_INTERVAL)
-            {
-                float newBrightness = max(0.0f, GetCurrentBrightness() - INCREMENT);
-                SetCurrentBrightness(newBrightness);
-                lastRepeatTime = currentTime;
-            }
+            // D-Pad
+            input.left = input.left || (state.Gamepad.wButtons & XINPUT_GAMEPAD_DPAD_LEFT);
+            input.right = input.right || (state.Gamepad.wButtons & XINPUT_GAMEPAD_DPAD_RIGHT);
+
+            // Left stick
+            const SHORT STICK_THRESHOLD = 16000;
+            if (state.Gamepad.sThumbLX < -STICK_THRESHOLD)
+                input.left = true;
+            if (state.Gamepad.sThumbLX > STICK_THRESHOLD)
+                input.right = true;
+
+            // B button to quit
+            bPressed = bPressed || (state.Gamepad.wButtons & XINPUT_GAMEPAD_B) != 0;
+
+            // X button to switch to the next mode
+            input.toggle = input.toggle || (state.Gamepad.wButtons & XINPUT_GAMEPAD_X) != 0;
+
+            // A button to confirm a workflow step
+            input.confirm = input.confirm || (state.Gamepad.wButtons & XINPUT_GAMEPAD_A) != 0;
         }
+
+        display->session.ApplyInput(input, currentTime);
     }
 
-    // Handle right input
-    if (rightPressed)
+    if (bPressed && !bWasPressed)
+        PostQuitMessage(0);
+    bWasPressed = bPressed;
+}
+
+void RunWorkflow()
+{
+    Workflow workflow;
+    std::string error;
+    bool loaded = true;
+    if (g_workflowPath == "default")
+        workflow = Workflow::Default(static_cast<int>(g_displays.size()));
+    else
+        loaded = workflow.Load(g_workflowPath, error);
+
+    std::string reportPath = GetDataDirectory() + "/workflow-report.txt";
+    FILE* file = nullptr;
+    if (!loaded || !workflow.Validate(static_cast<int>(g_displays.size()), error))
     {
-        if (!rightWasPressed)
+        // No console in a GUI app, so the reason goes to the report file
+        if (fopen_s(&file, reportPath.c_str(), "w") == 0 && file)
         {
-            // Initial press
-            float newBrightness = min(MAX_BRIGHTNESS, GetCurrentBrightness() + INCREMENT);
-            SetCurrentBrightness(newBrightness);
-            rightPressStartTime = currentTime;
-            lastRepeatTime = currentTime;
-        }
-        else if (currentTime - rightPressStartTime >= REPEAT_DELAY)
-        {
-            // Repeat after delay
-            if (currentTime - lastRepeatTime >= REPEAT_INTERVAL)
-            {
-                float newBrightness = min(MAX_BRIGHTNESS, GetCurrentBrightness() + INCREMENT);
-                SetCurrentBrightness(newBrightness);
-                lastRepeatTime = currentTime;
-            }
+            fprintf(file, "workflow not run: %s\n", error.c_str());
+            fclose(file);
         }
+        return;
     }
 
-    leftWasPressed = leftPressed;
-    rightWasPressed = rightPressed;
+    // Steps index outputs in the order they are calibrated, matching the gamepads
+    WorkflowReport report = workflow.Run([](const StepRequest& request)
+    {
+        return RunStepOnSession(g_displays[request.step->output]->session, request);
+    }, &g_workflowCancel);
+    for (auto& display : g_displays)
+        FinishWorkflowOnSession(display->session, report);
+
+    if (fopen_s(&file, reportPath.c_str(), "w") == 0 && file)
+    {
+        fputs(FormatWorkflowReport(report).c_str(), file);
+        fclose(file);
+    }
+
+    if (!g_workflowCancel)
+        PostThreadMessage(g_mainThreadId, WM_QUIT, 0, 0);
 }
 
-bool InitD3D()
+void StopWorkflow()
+{
+    // Wake any step waiting for a confirm so the workflow thread can finish
+    g_workflowCancel = true;
+    for (auto& display : g_displays)
+        display->session.CancelSteps();
+
+    if (g_workflowThread.joinable())
+        g_workflowThread.join();
+}
+
+bool InitD3D(Display& display)
 {
     HRESULT hr;
 
-    // Create D3D11 device and context
+    // Create D3D11 device and context on the adapter that drives this output
     D3D_FEATURE_LEVEL featureLevels[] = {
         D3D_FEATURE_LEVEL_11_1,
         D3D_FEATURE_LEVEL_11_0
@@ -288,8 +512,8 @@ bool InitD3D()
     ComPtr<ID3D11DeviceContext> context;
 
     hr = D3D11CreateDevice(
-        nullptr,
-        D3D_DRIVER_TYPE_HARDWARE,
+        display.adapter.Get(),
+        D3D_DRIVER_TYPE_UNKNOWN,
         nullptr,
         createDeviceFlags,
         featureLevels,
@@ -303,22 +527,16 @@ bool InitD3D()
     if (FAILED(hr))
         return false;
 
-    device.As(&g_d3dDevice);
-    context.As(&g_d3dContext);
+    device.As(&display.d3dDevice);
+    context.As(&display.d3dContext);
 
     // Create swap chain
-    ComPtr<IDXGIDevice1> dxgiDevice;
-    g_d3dDevice.As(&dxgiDevice);
-
-    ComPtr<IDXGIAdapter> dxgiAdapter;
-    dxgiDevice->GetAdapter(&dxgiAdapter);
-
     ComPtr<IDXGIFactory2> dxgiFactory;
-    dxgiAdapter->GetParent(IID_PPV_ARGS(&dxgiFactory));
+    display.adapter->GetParent(IID_PPV_ARGS(&dxgiFactory));
 
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-    swapChainDesc.Width = g_screenWidth;
-    swapChainDesc.Height = g_screenHeight;
+    swapChainDesc.Width = display.width;
+    swapChainDesc.Height = display.height;
     swapChainDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
     swapChainDesc.SampleDesc.Count = 1;
     swapChainDesc.SampleDesc.Quality = 0;
@@ -329,8 +547,8 @@ bool InitD3D()
 
     ComPtr<IDXGISwapChain1> swapChain1;
     hr = dxgiFactory->CreateSwapChainForHwnd(
-        g_d3dDevice.Get(),
-        g_hwnd,
+        display.d3dDevice.Get(),
+        display.hwnd,
         &swapChainDesc,
         nullptr,
         nullptr,
@@ -340,22 +558,228 @@ bool InitD3D()
     if (FAILED(hr))
         return false;
 
+    // Rendering happens off the window thread, so keep DXGI out of the message queue
+    dxgiFactory->MakeWindowAssociation(display.hwnd, DXGI_MWA_NO_WINDOW_CHANGES | DXGI_MWA_NO_ALT_ENTER);
+
     // Get IDXGISwapChain3 for color space setting
-    hr = swapChain1.As(&g_swapChain);
+    hr = swapChain1.As(&display.swapChain);
     if (FAILED(hr))
         return false;
 
+    // Optional: reports whether frames were composed, overlaid or flipped independently
+    swapChain1.As(&display.swapChainMedia);
+
     // Set scRGB color space
-    hr = g_swapChain->SetColorSpace1(DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709);
+    hr = display.swapChain->SetColorSpace1(DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709);
 
     return SUCCEEDED(hr);
 }
 
-bool InitD2D()
+bool RefreshAdapter(Display& display, std::string& error)
+{
+    // After a removal such as a driver upgrade or a swapped GPU the old factory is no longer
+    // current and devices cannot be created on its adapters; enumerate again on a new factory
+    if (display.factory && display.factory->IsCurrent())
+        return true;
+
+    ComPtr<IDXGIFactory1> factory;
+    if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))))
+    {
+        error = "CreateDXGIFactory1 failed";
+        return false;
+    }
+
+    // The output by its GDI name, or else the first attached output of the adapter with the same LUID
+    DXGI_ADAPTER_DESC1 previous = {};
+    bool havePrevious = display.adapter && SUCCEEDED(display.adapter->GetDesc1(&previous));
+    ComPtr<IDXGIAdapter1> foundAdapter;
+    ComPtr<IDXGIOutput> foundOutput;
+    bool byName = false;
+    ComPtr<IDXGIAdapter1> adapter;
+    for (UINT a = 0; !byName && factory->EnumAdapters1(a, &adapter) != DXGI_ERROR_NOT_FOUND; ++a)
+    {
+        DXGI_ADAPTER_DESC1 adapterDesc = {};
+        bool sameLuid = havePrevious && SUCCEEDED(adapter->GetDesc1(&adapterDesc)) &&
+                        adapterDesc.AdapterLuid.LowPart == previous.AdapterLuid.LowPart &&
+                        adapterDesc.AdapterLuid.HighPart == previous.AdapterLuid.HighPart;
+        ComPtr<IDXGIOutput> output;
+        for (UINT o = 0; adapter->EnumOutputs(o, &output) != DXGI_ERROR_NOT_FOUND; ++o)
+        {
+            DXGI_OUTPUT_DESC desc = {};
+            if (FAILED(output->GetDesc(&desc)) || !desc.AttachedToDesktop)
+                continue;
+            if (display.deviceName == desc.DeviceName)
+            {
+                foundAdapter = adapter;
+                foundOutput = output;
+                byName = true;
+                break;
+            }
+            if (sameLuid && !foundOutput)
+            {
+                foundAdapter = adapter;
+                foundOutput = output;
+            }
+        }
+    }
+
+    if (!foundAdapter)
+    {
+        error = "output no longer attached to any adapter";
+        return false;
+    }
+
+    display.factory = factory;
+    display.adapter = foundAdapter;
+    display.output = foundOutput;
+    return true;
+}
+
+void AddDeviceManifest(Display& display)
+{
+    // The adapter, found again if the GPU changed, DirectX 11, the post pass when there is one,
+    // then Direct2D on top of them
+    Display* target = &display;
+    display.recovery.AddStep("DXGI adapter", [target](std::string& error) { return RefreshAdapter(*target, error); });
+    display.recovery.AddStep("D3D device and swap chain", [target](std::string&) { return InitD3D(*target); });
+    if (!g_gainGrid.Empty() || g_falseColor)
+        display.recovery.AddStep("post pass", [target](std::string&) { return InitPostPass(*target); });
+    display.recovery.AddStep("Direct2D and DirectWrite", [target](std::string&) { return InitD2D(*target); });
+    display.recovery.SetRelease([target]() { ReleaseDeviceObjects(*target); });
+}
+
+void ReleaseDeviceObjects(Display& display)
+{
+    if (display.d2dContext)
+        display.d2dContext->SetTarget(nullptr);
+    display.swapChainMedia.Reset();
+    display.textFormat.Reset();
+    display.textBrush.Reset();
+    display.patchBrush.Reset();
+    display.d2dTargetBitmap.Reset();
+    display.falseColorConstants.Reset();
+    display.falseColorShader.Reset();
+    display.gainPixelShader.Reset();
+    display.postVertexShader.Reset();
+    display.gainSampler.Reset();
+    display.gainView.Reset();
+    display.backBufferView.Reset();
+    display.sceneView.Reset();
+    display.sceneTexture.Reset();
+    display.d2dContext.Reset();
+    display.d2dDevice.Reset();
+    display.d2dFactory.Reset();
+    display.swapChain.Reset();
+
+    // Destruction is deferred until the context flushes, and the window takes no new swap chain
+    // while the old one is still alive
+    if (display.d3dContext)
+    {
+        display.d3dContext->ClearState();
+        display.d3dContext->Flush();
+    }
+    display.d3dContext.Reset();
+    display.d3dDevice.Reset();
+}
+
+std::string DeviceLossReason(Display& display, const char* call, HRESULT hr)
+{
+    // For a removed device the device knows why, such as a hang or a driver upgrade
+    HRESULT removed = display.d3dDevice ? display.d3dDevice->GetDeviceRemovedReason() : S_OK;
+    char reason[96];
+    sprintf_s(reason, "%s: 0x%08lX, removed reason 0x%08lX", call, static_cast<unsigned long>(hr),
+              static_cast<unsigned long>(removed));
+    return reason;
+}
+
+void SeedFromDisplay(Display& display)
+{
+    // Prefer an EDID file from the command line, then the EDID the OS read from the display
+    std::vector<uint8_t> edid;
+    DisplayInfo info;
+    bool haveInfo = false;
+    if (!g_edidPath.empty())
+        haveInfo = LoadBinaryFile(g_edidPath, edid) && ParseDisplayDescriptor(edid.data(), edid.size(), info);
+    else if (ReadSystemEdid(display.deviceName, edid))
+        haveInfo = ParseDisplayDescriptor(edid.data(), edid.size(), info);
+
+    // Fall back to the luminance DXGI reports when the EDID has no HDR metadata
+    ComPtr<IDXGIOutput6> output6;
+    if (SUCCEEDED(display.output.As(&output6)))
+    {
+        DXGI_OUTPUT_DESC1 outputDesc1 = {};
+        if (SUCCEEDED(output6->GetDesc1(&outputDesc1)))
+        {
+            if (info.luminance.maxLuminance <= 0.0f)
+                info.luminance.maxLuminance = outputDesc1.MaxLuminance;
+            if (info.luminance.maxFrameAverage <= 0.0f)
+                info.luminance.maxFrameAverage = outputDesc1.MaxFullFrameLuminance;
+            if (info.luminance.minLuminance <= 0.0f)
+                info.luminance.minLuminance = outputDesc1.MinLuminance;
+            haveInfo = true;
+        }
+    }
+
+    DisplayCache cache;
+    cache.Load(GetDataDirectory() + "/displays.txt");
+
+    uint64_t displayHash = 0;
+    const DisplayRecord* cached = nullptr;
+    if (haveInfo && !info.identity.manufacturer.empty())
+    {
+        displayHash = info.identity.Hash();
+        cached = cache.Find(displayHash);
+    }
+
+    display.session.Seed(SeedCalibration(haveInfo ? &info : nullptr, cached), displayHash);
+}
+
+std::string GetSessionPath(const Display& display)
+{
+    // Known displays keep their session wherever they are plugged in
+    char name[64];
+    uint64_t displayHash = display.session.DisplayHash();
+    if (displayHash != 0)
+        sprintf_s(name, "/session-%016llx.dat", static_cast<unsigned long long>(displayHash));
+    else
+        sprintf_s(name, "/session-output%d.dat", display.index);
+    return GetDataDirectory() + name;
+}
+
+void SaveDisplayResults()
+{
+    std::string path = GetDataDirectory() + "/displays.txt";
+    DisplayCache cache;
+    cache.Load(path);
+
+    // Only displays with a known identity can be recognized next time
+    for (auto& display : g_displays)
+    {
+        uint64_t displayHash = display->session.DisplayHash();
+        if (displayHash != 0)
+            cache.Store(displayHash, display->session.Result());
+    }
+
+    cache.Save(path);
+}
+
+void FitWindowToMonitor(HWND hwnd)
+{
+    MONITORINFO monitorInfo = {};
+    monitorInfo.cbSize = sizeof(monitorInfo);
+    if (!GetMonitorInfoW(MonitorFromWindow(hwnd, MONITOR_DEFAULTTONEAREST), &monitorInfo))
+        return;
+
+    const RECT& rc = monitorInfo.rcMonitor;
+    SetWindowPos(hwnd, nullptr, rc.left, rc.top, rc.right - rc.left, rc.bottom - rc.top,
+                 SWP_NOZORDER | SWP_NOACTIVATE);
+}
+
+bool InitD2D(Display& display)
 {
     HRESULT hr;
 
-    // Create D2D factory
+    // Create D2D factory; each display's objects are only used by its render thread
     D2D1_FACTORY_OPTIONS options = {};
 #ifdef _DEBUG
     options.debugLevel = D2D1_DEBUG_LEVEL_INFORMATION;
@@ -364,7 +788,7 @@ bool InitD2D()
     hr = D2D1CreateFactory(
         D2D1_FACTORY_TYPE_SINGLE_THREADED,
         options,
-        g_d2dFactory.GetAddressOf()
+        display.d2dFactory.GetAddressOf()
     );
 
     if (FAILED(hr))
@@ -372,171 +796,741 @@ bool InitD2D()
 
     // Create D2D device
     ComPtr<IDXGIDevice> dxgiDevice;
-    g_d3dDevice.As(&dxgiDevice);
+    display.d3dDevice.As(&dxgiDevice);
 
-    hr = g_d2dFactory->CreateDevice(dxgiDevice.Get(), &g_d2dDevice);
+    hr = display.d2dFactory->CreateDevice(dxgiDevice.Get(), &display.d2dDevice);
     if (FAILED(hr))
         return false;
 
     // Create D2D device context
-    hr = g_d2dDevice->CreateDeviceContext(
+    hr = display.d2dDevice->CreateDeviceContext(
         D2D1_DEVICE_CONTEXT_OPTIONS_NONE,
-        &g_d2dContext
+        &display.d2dContext
     );
 
     if (FAILED(hr))
         return false;
 
-    // Get back buffer and create D2D bitmap
-    ComPtr<IDXGISurface> dxgiBackBuffer;
-    hr = g_swapChain->GetBuffer(0, IID_PPV_ARGS(&dxgiBackBuffer));
-    if (FAILED(hr))
-        return false;
+    // Patterns are laid out in whole back buffer pixels, so draw without antialiasing
+    display.d2dContext->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
 
-    D2D1_BITMAP_PROPERTIES1 bitmapProperties = {};
-    bitmapProperties.pixelFormat.format = DXGI_FORMAT_R16G16B16A16_FLOAT;
-    bitmapProperties.pixelFormat.alphaMode = D2D1_ALPHA_MODE_PREMULTIPLIED;
-    bitmapProperties.bitmapOptions = D2D1_BITMAP_OPTIONS_TARGET | D2D1_BITMAP_OPTIONS_CANNOT_DRAW;
+    if (!CreateTargetBitmap(display))
+        return false;
 
-    hr = g_d2dContext->CreateBitmapFromDxgiSurface(
-        dxgiBackBuffer.Get(),
-        &bitmapProperties,
-        &g_d2dTargetBitmap
+    // Patches and text take their colors from the pattern each frame
+    hr = display.d2dContext->CreateSolidColorBrush(
+        D2D1::ColorF(0.0f, 0.0f, 0.0f, 1.0f),
+        &display.patchBrush
     );
 
     if (FAILED(hr))
         return false;
 
-    g_d2dContext->SetTarget(g_d2dTargetBitmap.Get());
-
-    // Create white brush at 10000 nits (10000/80 = 125.0 in scRGB)
-    hr = g_d2dContext->CreateSolidColorBrush(
-        D2D1::ColorF(125.0f, 125.0f, 125.0f, 1.0f),
-        &g_whiteBrush
+    hr = display.d2dContext->CreateSolidColorBrush(
+        D2D1::ColorF(0.0f, 0.0f, 0.0f, 1.0f),
+        &display.textBrush
     );
 
     if (FAILED(hr))
         return false;
 
-    // Create inner brush with variable brightness
-    float innerScRGB = GetCurrentBrightness() / 80.0f;
-    hr = g_d2dContext->CreateSolidColorBrush(
-        D2D1::ColorF(innerScRGB, innerScRGB, innerScRGB, 1.0f),
-        &g_innerBrush
-    );
+    return CreateTextFormat(display);
+}
+
+bool CreateTargetBitmap(Display& display)
+{
+    HRESULT hr;
 
+    // Get back buffer and create D2D bitmap; its default 96 DPI makes one D2D unit one pixel
+    ComPtr<IDXGISurface> dxgiBackBuffer;
+    hr = display.swapChain->GetBuffer(0, IID_PPV_ARGS(&dxgiBackBuffer));
     if (FAILED(hr))
         return false;
 
-    // Create dark blue brush for text
-    hr = g_d2dContext->CreateSolidColorBrush(
-        D2D1::ColorF(0.0f, 0.0f, 0.5f, 1.0f),
-        &g_textBrush
-    );
+    // With a post pass D2D draws into a texture of the same size, and the pass writes the back buffer
+    if (display.gainPixelShader)
+    {
+        ComPtr<ID3D11Texture2D> backBuffer;
+        dxgiBackBuffer.As(&backBuffer);
+        hr = display.d3dDevice->CreateRenderTargetView(backBuffer.Get(), nullptr, &display.backBufferView);
+        if (FAILED(hr))
+            return false;
+
+        D3D11_TEXTURE2D_DESC sceneDesc = {};
+        backBuffer->GetDesc(&sceneDesc);
+        sceneDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        display.sceneTexture.Reset();
+        display.sceneView.Reset();
+        hr = display.d3dDevice->CreateTexture2D(&sceneDesc, nullptr, &display.sceneTexture);
+        if (FAILED(hr))
+            return false;
+        hr = display.d3dDevice->CreateShaderResourceView(display.sceneTexture.Get(), nullptr, &display.sceneView);
+        if (FAILED(hr))
+            return false;
+
+        dxgiBackBuffer.Reset();
+        display.sceneTexture.As(&dxgiBackBuffer);
+    }
 
-    if (FAILED(hr))
-        return false;
+    D2D1_BITMAP_PROPERTIES1 bitmapProperties = {};
+    bitmapProperties.pixelFormat.format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    bitmapProperties.pixelFormat.alphaMode = D2D1_ALPHA_MODE_PREMULTIPLIED;
+    bitmapProperties.bitmapOptions = D2D1_BITMAP_OPTIONS_TARGET | D2D1_BITMAP_OPTIONS_CANNOT_DRAW;
 
-    // Create DirectWrite factory
-    hr = DWriteCreateFactory(
-        DWRITE_FACTORY_TYPE_SHARED,
-        __uuidof(IDWriteFactory),
-        reinterpret_cast<IUnknown**>(g_dwriteFactory.GetAddressOf())
+    hr = display.d2dContext->CreateBitmapFromDxgiSurface(
+        dxgiBackBuffer.Get(),
+        &bitmapProperties,
+        &display.d2dTargetBitmap
     );
 
     if (FAILED(hr))
         return false;
 
-    // Create text format
+    display.d2dContext->SetTarget(display.d2dTargetBitmap.Get());
+
+    // Lay the pattern out for the actual back buffer size
+    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+    display.swapChain->GetDesc1(&swapChainDesc);
+    display.width = static_cast<int>(swapChainDesc.Width);
+    display.height = static_cast<int>(swapChainDesc.Height);
+    display.layout = ComputePatternLayout(display.width, display.height, display.dpi / 96.0f);
+
+    return true;
+}
+
+bool CreateTextFormat(Display& display)
+{
+    HRESULT hr;
+
+    // Create text format, sized in pixels for this monitor's DPI
+    display.textFormat.Reset();
     hr = g_dwriteFactory->CreateTextFormat(
         L"Arial",
         nullptr,
         DWRITE_FONT_WEIGHT_NORMAL,
         DWRITE_FONT_STYLE_NORMAL,
         DWRITE_FONT_STRETCH_NORMAL,
-        24.0f,
+        display.layout.fontSize,
         L"en-us",
-        &g_textFormat
+        &display.textFormat
     );
 
     if (FAILED(hr))
         return false;
 
-    g_textFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_CENTER);
-    g_textFormat->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_NEAR);
+    display.textFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_CENTER);
+    display.textFormat->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_NEAR);
 
     return SUCCEEDED(hr);
 }
 
-void Render()
+void LoadGainGrid()
 {
-    g_d2dContext->BeginDraw();
+    // No console in a GUI app, so the grid or the reason it was not built goes to a report file
+    const int GAIN_GRID_COLUMNS = 9; // as the uniformity section of the measurement report
+    const int GAIN_GRID_ROWS = 9;
+    std::string error;
+    bool built = BuildGainGrid(g_gainMapPath, GAIN_GRID_COLUMNS, GAIN_GRID_ROWS, g_gainGrid, error);
+
+    std::string reportPath = GetDataDirectory() + "/gain-map-report.txt";
+    FILE* file = nullptr;
+    if (fopen_s(&file, reportPath.c_str(), "w") == 0 && file)
+    {
+        if (built)
+            fprintf(file, "gains from %s\n%s", g_gainMapPath.c_str(), FormatGainGrid(g_gainGrid).c_str());
+        else
+            fprintf(file, "gain map not applied: %s\n", error.c_str());
+        fclose(file);
+    }
+}
 
-    // Clear to black
-    g_d2dContext->Clear(D2D1::ColorF(D2D1::ColorF::Black));
+// Full screen triangle from the vertex index. Pixel centers sample the gain grid between cell
+// centers with clamping at the edges, the same interpolation as GainMap on the CPU.
+// The false color shader looks up the band of each pixel's luminance as FalseColor does; it
+// leaves out the gains, so the bands show the levels the pattern asks for.
+const char POST_PASS_HLSL[] = R"(
+Texture2D<float4> scene : register(t0);
+Texture2D<float> gains : register(t1);
+SamplerState linearClamp : register(s0);
 
-    // Draw white rectangle in the center
-    float rectWidth = g_screenHeight / 6.0f;
-    float rectHeight = rectWidth;
-    float x = (g_screenWidth - rectWidth) / 2.0f;
-    float y = (g_screenHeight - rectHeight) / 2.0f;
+cbuffer FalseColorBands : register(b0)
+{
+    float4 edges[2];
+    float4 bandColors[8];
+};
 
-    if (g_mode == BrightnessMode::MaxWhite)
+struct VertexOut
+{
+    float4 position : SV_Position;
+    float2 uv : TEXCOORD0;
+};
+
+VertexOut VsMain(uint id : SV_VertexID)
+{
+    VertexOut output;
+    output.uv = float2((id << 1) & 2, id & 2);
+    output.position = float4(output.uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+    return output;
+}
+
+float4 PsMain(VertexOut input) : SV_Target
+{
+    float4 color = scene.Load(int3(input.position.xy, 0));
+    return float4(color.rgb * gains.SampleLevel(linearClamp, input.uv, 0), color.a);
+}
+
+float4 PsFalseColor(VertexOut input) : SV_Target
+{
+    float luminance = dot(scene.Load(int3(input.position.xy, 0)).rgb, float3(0.2126, 0.7152, 0.0722));
+    float band = dot(float4(luminance > edges[0]), 1.0) + dot(float4(luminance > edges[1]), 1.0);
+    return float4(bandColors[(uint)band].rgb, 1.0);
+}
+)";
+
+// Band edges and colors as PsFalseColor reads them; the eighth edge is never crossed
+struct FalseColorBands
+{
+    float edges[8];
+    float colors[FALSE_COLOR_BANDS][4];
+};
+
+FalseColorBands GetFalseColorBands(const FalseColor& falseColor)
+{
+    FalseColorBands bands = {};
+    for (int i = 0; i < FALSE_COLOR_BANDS - 1; ++i)
+        bands.edges[i] = falseColor.Edge(i);
+    bands.edges[7] = D3D11_FLOAT32_MAX;
+    for (int band = 0; band < FALSE_COLOR_BANDS; ++band)
     {
-        D2D1_RECT_F rect = D2D1::RectF(x, y, x + rectWidth, y + rectHeight);
-        g_d2dContext->FillRectangle(&rect, g_whiteBrush.Get());
+        const ScRgb& color = falseColor.BandColor(band);
+        bands.colors[band][0] = color.r;
+        bands.colors[band][1] = color.g;
+        bands.colors[band][2] = color.b;
+        bands.colors[band][3] = 1.0f;
     }
+    return bands;
+}
 
-    // Draw inner rectangle (1/2 size) centered in the outer rectangle
-    float innerWidth = rectWidth / 2.0f;
-    float innerHeight = rectHeight / 2.0f;
-    float innerX = x + (rectWidth - innerWidth) / 2.0f;
-    float innerY = y + (rectHeight - innerHeight) / 2.0f;
+bool InitPostPass(Display& display)
+{
+    HRESULT hr;
 
-    D2D1_RECT_F innerRect = D2D1::RectF(innerX, innerY, innerX + innerWidth, innerY + innerHeight);
-    g_d2dContext->FillRectangle(&innerRect, g_innerBrush.Get());
+    // Compiled once and kept for rebuilds after a lost device; the grid is tiny, so it needs no
+    // rebuilding when the size changes
+    if (!display.postVertexCode)
+    {
+        hr = D3DCompile(POST_PASS_HLSL, sizeof(POST_PASS_HLSL) - 1, "PostPass", nullptr, nullptr, "VsMain", "vs_5_0",
+                        D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &display.postVertexCode, nullptr);
+        if (FAILED(hr))
+            return false;
+    }
 
-    // Draw brightness text below large rectangle (same gap as to inner rectangle)
-    float gap = (rectWidth - innerWidth) / 2.0f;
-    float brightness = GetCurrentBrightness();
-    std::wstring text;
-    if (g_mode == BrightnessMode::MaxWhite)
-        text = std::to_wstring(static_cast<int>(brightness)) + L" nits";
-    else
-        text = std::to_wstring(brightness).substr(0, 4) + L" nits";
-    
-    D2D1_RECT_F textRect = D2D1::RectF(
-        x,
-        y + rectHeight + gap,
-        x + rectWidth,
-        y + rectHeight + gap + 40.0f
+    if (!display.postPixelCode)
+    {
+        hr = D3DCompile(POST_PASS_HLSL, sizeof(POST_PASS_HLSL) - 1, "PostPass", nullptr, nullptr, "PsMain", "ps_5_0",
+                        D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &display.postPixelCode, nullptr);
+        if (FAILED(hr))
+            return false;
+    }
+
+    ID3DBlob* vertexCode = display.postVertexCode.Get();
+    ID3DBlob* pixelCode = display.postPixelCode.Get();
+    hr = display.d3dDevice->CreateVertexShader(vertexCode->GetBufferPointer(), vertexCode->GetBufferSize(), nullptr,
+                                               &display.postVertexShader);
+    if (FAILED(hr))
+        return false;
+
+    // Without a gain map the scene is copied unchanged through a single gain of 1
+    GainGrid unity;
+    unity.columns = 1;
+    unity.rows = 1;
+    unity.gains.assign(1, 1.0f);
+    const GainGrid& grid = g_gainGrid.Empty() ? unity : g_gainGrid;
+
+    D3D11_TEXTURE2D_DESC gainDesc = {};
+    gainDesc.Width = static_cast<UINT>(grid.columns);
+    gainDesc.Height = static_cast<UINT>(grid.rows);
+    gainDesc.MipLevels = 1;
+    gainDesc.ArraySize = 1;
+    gainDesc.Format = DXGI_FORMAT_R32_FLOAT;
+    gainDesc.SampleDesc.Count = 1;
+    gainDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    gainDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA gainData = {};
+    gainData.pSysMem = grid.gains.data();
+    gainData.SysMemPitch = static_cast<UINT>(grid.columns * sizeof(float));
+
+    ComPtr<ID3D11Texture2D> gainTexture;
+    hr = display.d3dDevice->CreateTexture2D(&gainDesc, &gainData, &gainTexture);
+    if (FAILED(hr))
+        return false;
+
+    hr = display.d3dDevice->CreateShaderResourceView(gainTexture.Get(), nullptr, &display.gainView);
+    if (FAILED(hr))
+        return false;
+
+    D3D11_SAMPLER_DESC samplerDesc = {};
+    samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+    hr = display.d3dDevice->CreateSamplerState(&samplerDesc, &display.gainSampler);
+    if (FAILED(hr))
+        return false;
+
+    if (g_falseColor)
+    {
+        if (!display.falseColorCode)
+        {
+            hr = D3DCompile(POST_PASS_HLSL, sizeof(POST_PASS_HLSL) - 1, "PostPass", nullptr, nullptr, "PsFalseColor",
+                            "ps_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &display.falseColorCode, nullptr);
+            if (FAILED(hr))
+                return false;
+        }
+
+        ID3DBlob* falseColorCode = display.falseColorCode.Get();
+        hr = display.d3dDevice->CreatePixelShader(falseColorCode->GetBufferPointer(),
+                                                  falseColorCode->GetBufferSize(), nullptr,
+                                                  &display.falseColorShader);
+        if (FAILED(hr))
+            return false;
+
+        // Rewritten by ApplyPostPass whenever the calibrated levels move the band edges
+        FalseColorBands bands = GetFalseColorBands(display.falseColor);
+        D3D11_BUFFER_DESC bandsDesc = {};
+        bandsDesc.ByteWidth = sizeof(bands);
+        bandsDesc.Usage = D3D11_USAGE_DEFAULT;
+        bandsDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        D3D11_SUBRESOURCE_DATA bandsData = {};
+        bandsData.pSysMem = &bands;
+        hr = display.d3dDevice->CreateBuffer(&bandsDesc, &bandsData, &display.falseColorConstants);
+        if (FAILED(hr))
+            return false;
+    }
+
+    // Created last: CreateTargetBitmap redirects D2D to the scene texture when the pixel shader exists
+    hr = display.d3dDevice->CreatePixelShader(pixelCode->GetBufferPointer(), pixelCode->GetBufferSize(), nullptr,
+                                              &display.gainPixelShader);
+    return SUCCEEDED(hr);
+}
+
+void ApplyPostPass(Display& display)
+{
+    ID3D11DeviceContext* context = display.d3dContext.Get();
+
+    // False color bands run from the black level to the max white level found so far
+    ID3D11PixelShader* shader = display.gainPixelShader.Get();
+    if (g_showFalseColor && display.falseColorShader)
+    {
+        float white = display.session.GetLevel(BrightnessMode::MaxWhite);
+        if (display.falseColor.SetRange(display.session.GetLevel(BrightnessMode::MinBlack),
+                                        white > 0.0f ? white : display.session.GetMaxBrightness()))
+        {
+            FalseColorBands bands = GetFalseColorBands(display.falseColor);
+            context->UpdateSubresource(display.falseColorConstants.Get(), 0, nullptr, &bands, 0, 0);
+        }
+        shader = display.falseColorShader.Get();
+    }
+
+    D3D11_VIEWPORT viewport = {};
+    viewport.Width = static_cast<float>(display.width);
+    viewport.Height = static_cast<float>(display.height);
+    viewport.MaxDepth = 1.0f;
+
+    ID3D11RenderTargetView* target = display.backBufferView.Get();
+    ID3D11ShaderResourceView* views[] = { display.sceneView.Get(), display.gainView.Get() };
+    ID3D11SamplerState* sampler = display.gainSampler.Get();
+    ID3D11Buffer* constants = display.falseColorConstants.Get();
+    context->OMSetRenderTargets(1, &target, nullptr);
+    context->RSSetViewports(1, &viewport);
+    context->IASetInputLayout(nullptr);
+    context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    context->VSSetShader(display.postVertexShader.Get(), nullptr, 0);
+    context->PSSetShader(shader, nullptr, 0);
+    context->PSSetShaderResources(0, 2, views);
+    context->PSSetSamplers(0, 1, &sampler);
+    context->PSSetConstantBuffers(0, 1, &constants);
+    context->Draw(3, 0);
+
+    // Unbind the scene so D2D can draw into it again next frame
+    ID3D11ShaderResourceView* none[] = { nullptr, nullptr };
+    context->PSSetShaderResources(0, 2, none);
+    context->OMSetRenderTargets(0, nullptr, nullptr);
+}
+
+void RenderLoop(Display* display)
+{
+    DeclareDeviceMemory(*display);
+    while (g_running)
+    {
+        // A lost device is rebuilt before anything draws again. Recover waits between failed
+        // attempts, so a device that stays gone does not spin the thread.
+        if (display->recovery.IsLost())
+        {
+            if (!display->recovery.Recover())
+                continue;
+            char output[32];
+            sprintf_s(output, "output %d: ", display->index);
+            OutputDebugStringA((output + FormatRecoveryStats(display->recovery.Stats())).c_str());
+            DeclareDeviceMemory(*display);
+        }
+
+        if (display->resizePending.exchange(false))
+        {
+            ResizeSwapChain(*display);
+            DeclareDeviceMemory(*display);
+        }
+        Render(*display);
+    }
+
+    if (g_presentDiagnostics)
+        WritePresentDiagnostics(*display);
+    display->renderFinished = true;
+}
+
+// What the device holds for this output, from the sizes it was created with: two FP16 back
+// buffers, and with a post pass a scene texture of the same size and the gain grid
+void DeclareDeviceMemory(Display& display)
+{
+    const size_t PIXEL_BYTES = 8; // R16G16B16A16_FLOAT
+    size_t frameBytes = static_cast<size_t>(display.width) * display.height * PIXEL_BYTES;
+
+    char name[64];
+    sprintf_s(name, "output %d swap chain", display.index);
+    g_memory.Declare(name, display.swapChain ? 2 * frameBytes : 0);
+
+    size_t postBytes = 0;
+    if (display.sceneTexture)
+        postBytes = frameBytes + (g_gainGrid.Empty() ? 1 : g_gainGrid.gains.size()) * sizeof(float);
+    sprintf_s(name, "output %d post pass", display.index);
+    g_memory.Declare(name, postBytes);
+
+    sprintf_s(name, "output %d present samples", display.index);
+    g_memory.Declare(name, display.presentSamples.capacity() * sizeof(PresentSample));
+}
+
+void ResizeSwapChain(Display& display)
+{
+    int width = display.pendingWidth;
+    int height = display.pendingHeight;
+    float previousFontSize = display.layout.fontSize;
+
+    // Resize the buffers in place; the device, brushes and session all survive
+    if (width > 0 && height > 0 && (width != display.width || height != display.height))
+    {
+        display.d2dContext->SetTarget(nullptr);
+        display.d2dTargetBitmap.Reset();
+        display.backBufferView.Reset();
+        display.d3dContext->ClearState();
+        display.d3dContext->Flush();
+
+        HRESULT hr = display.swapChain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, 0);
+        if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
+            display.recovery.ReportLost(DeviceLossReason(display, "ResizeBuffers", hr));
+        if (FAILED(hr))
+            return;
+    }
+
+    // Recreating the target also recomputes the layout for the new size and DPI
+    if (!CreateTargetBitmap(display))
+        return;
+
+    if (display.layout.fontSize != previousFontSize)
+        CreateTextFormat(display);
+}
+
+D2D1_RECT_F ToRectF(const PixelRect& rect)
+{
+    return D2D1::RectF(
+        static_cast<float>(rect.left),
+        static_cast<float>(rect.top),
+        static_cast<float>(rect.right),
+        static_cast<float>(rect.bottom)
     );
-    g_d2dContext->DrawText(
+}
+
+void Render(Display& display)
+{
+    // Copy out this frame's state so input can keep changing it meanwhile.
+    // Everything built for the frame comes from the arena, freed all at once by the next Reset.
+    display.frameArena.Reset();
+    Pattern pattern(&display.frameArena);
+    BuildCalibrationPattern(display.session.View(), display.layout, pattern);
+    if (g_aplNits > 0.0f)
+    {
+        // The surround is clipped where the display clips, at the max white level found so far
+        float maxWhite = display.session.GetLevel(BrightnessMode::MaxWhite);
+        FillSurround(pattern, display.width, display.height, g_aplNits,
+                     maxWhite > 0.0f ? maxWhite : display.session.GetMaxBrightness());
+    }
+
+    // Scopes of what is sent, rendered again on the CPU with the gain map and false color of the
+    // post pass; the overlay itself is left out
+    if (g_scopeInterval > 0)
+    {
+        if (display.scopeCountdown-- <= 0)
+        {
+            display.scopeCountdown = g_scopeInterval - 1;
+            display.scopeFrame.Resize(display.width, display.height, FrameEncoding::ScRgbHalf);
+            RenderPatternCpu(pattern, display.scopeFrame, display.scopeGainMap);
+            if (g_showFalseColor && display.falseColorShader)
+                display.falseColor.Apply(display.scopeFrame);
+            ComputeScopes(display.scopeFrame, ScopeSettings(), display.scopes);
+        }
+        AddScopeOverlay(display.scopes, display.width, display.height, pattern);
+    }
+
+    if (g_showMemory)
+    {
+        WorkingSet workingSet;
+        ReadWorkingSet(workingSet);
+        AddMemoryOverlay(g_memory, workingSet, display.width, display.height, pattern);
+    }
+
+    // Rects sorted into batches of one color, so the brush changes once per batch; the label
+    // stays with DirectWrite
+    DrawList draws(&display.frameArena);
+    draws.Record(pattern, display.width, display.height, false);
+    draws.Optimize();
+    display.drawStats = draws.Stats();
+
+    ID2D1DeviceContext* context = display.d2dContext.Get();
+    context->BeginDraw();
+
+    const ScRgb& background = draws.Background();
+    context->Clear(D2D1::ColorF(background.r, background.g, background.b, 1.0f));
+
+    for (const DrawBatch& batch : draws.Batches())
+    {
+        display.patchBrush->SetColor(D2D1::ColorF(batch.color.r, batch.color.g, batch.color.b, 1.0f));
+        for (size_t i = batch.first; i < batch.first + batch.count; ++i)
+        {
+            D2D1_RECT_F rect = ToRectF(draws.Rects()[i].rect);
+            context->FillRectangle(&rect, display.patchBrush.Get());
+        }
+    }
+
+    // Label text; DirectWrite renders it instead of the built-in pixel font
+    const PatternLabel& label = pattern.label;
+    std::pmr::wstring text(label.text.begin(), label.text.end(), &display.frameArena);
+    display.textBrush->SetColor(D2D1::ColorF(label.color.r, label.color.g, label.color.b, 1.0f));
+
+    D2D1_RECT_F textRect = ToRectF(label.rect);
+    context->DrawText(
         text.c_str(),
         static_cast<UINT32>(text.length()),
-        g_textFormat.Get(),
+        display.textFormat.Get(),
         &textRect,
-        g_textBrush.Get()
+        display.textBrush.Get()
     );
 
-    g_d2dContext->EndDraw();
+    // Direct2D reports a lost device as a target to recreate
+    HRESULT hr = context->EndDraw();
+    if (hr == D2DERR_RECREATE_TARGET)
+    {
+        display.recovery.ReportLost(DeviceLossReason(display, "EndDraw", hr));
+        return;
+    }
+
+    if (display.gainPixelShader)
+        ApplyPostPass(display);
+
+    // Present on this output's vsync
+    LARGE_INTEGER presentTime;
+    QueryPerformanceCounter(&presentTime);
+    hr = display.swapChain->Present(1, 0);
+    if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
+    {
+        display.recovery.ReportLost(DeviceLossReason(display, "Present", hr));
+        return;
+    }
+
+    if (g_presentDiagnostics)
+        RecordPresent(display, presentTime.QuadPart);
+}
+
+void RecordPresent(Display& display, int64_t presentTicks)
+{
+    const size_t MAX_SAMPLES = 36000; // ten minutes at 60 Hz; older samples are dropped
+    if (!display.swapChain)
+        return;
+
+    PresentSample sample;
+    sample.presentTicks = presentTicks;
+    UINT presentId = 0;
+    if (SUCCEEDED(display.swapChain->GetLastPresentCount(&presentId)))
+        sample.presentId = presentId;
+
+    // The media statistics are a superset of the plain ones; fall back when they are not supported
+    DXGI_FRAME_STATISTICS_MEDIA media = {};
+    DXGI_FRAME_STATISTICS stats = {};
+    if (display.swapChainMedia && SUCCEEDED(display.swapChainMedia->GetFrameStatisticsMedia(&media)))
+    {
+        sample.statsValid = true;
+        sample.statsPresentCount = media.PresentCount;
+        sample.statsPresentRefreshCount = media.PresentRefreshCount;
+        sample.statsSyncRefreshCount = media.SyncRefreshCount;
+        sample.statsSyncTicks = media.SyncQPCTime.QuadPart;
+        switch (media.CompositionMode)
+        {
+        case DXGI_FRAME_PRESENTATION_MODE_COMPOSED:            sample.mode = PresentationMode::Composed; break;
+        case DXGI_FRAME_PRESENTATION_MODE_OVERLAY:             sample.mode = PresentationMode::Overlay; break;
+        case DXGI_FRAME_PRESENTATION_MODE_NONE:                sample.mode = PresentationMode::IndependentFlip; break;
+        case DXGI_FRAME_PRESENTATION_MODE_COMPOSITION_FAILURE: sample.mode = PresentationMode::CompositionFailure; break;
+        default: break;
+        }
+    }
+    else if (SUCCEEDED(display.swapChain->GetFrameStatistics(&stats)))
+    {
+        sample.statsValid = true;
+        sample.statsPresentCount = stats.PresentCount;
+        sample.statsPresentRefreshCount = stats.PresentRefreshCount;
+        sample.statsSyncRefreshCount = stats.SyncRefreshCount;
+        sample.statsSyncTicks = stats.SyncQPCTime.QuadPart;
+    }
+
+    if (display.presentSamples.size() >= MAX_SAMPLES)
+        display.presentSamples.erase(display.presentSamples.begin(),
+                                     display.presentSamples.begin() + MAX_SAMPLES / 2);
+    display.presentSamples.push_back(sample);
+}
+
+void WritePresentDiagnostics(Display& display)
+{
+    PresentConfig config;
+
+    // A device lost and never rebuilt leaves no swap chain; the samples from before are still written
+    if (display.swapChain)
+    {
+        DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+        display.swapChain->GetDesc1(&swapChainDesc);
+        config.flipModel = swapChainDesc.SwapEffect == DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL ||
+                           swapChainDesc.SwapEffect == DXGI_SWAP_EFFECT_FLIP_DISCARD;
+        config.bufferWidth = static_cast<int>(swapChainDesc.Width);
+        config.bufferHeight = static_cast<int>(swapChainDesc.Height);
+    }
+
+    config.perMonitorDpiAware = GetAwarenessFromDpiAwarenessContext(GetWindowDpiAwarenessContext(display.hwnd)) ==
+                                DPI_AWARENESS_PER_MONITOR_AWARE;
+    config.dpi = display.dpi;
+
+    RECT client = {};
+    RECT window = {};
+    GetClientRect(display.hwnd, &client);
+    GetWindowRect(display.hwnd, &window);
+    config.windowWidth = client.right - client.left;
+    config.windowHeight = client.bottom - client.top;
+    if (!display.swapChain)
+    {
+        // Nothing to compare the window with, so no stretch is reported
+        config.bufferWidth = config.windowWidth;
+        config.bufferHeight = config.windowHeight;
+    }
+
+    MONITORINFO monitorInfo = {};
+    monitorInfo.cbSize = sizeof(monitorInfo);
+    if (GetMonitorInfoW(MonitorFromWindow(display.hwnd, MONITOR_DEFAULTTONEAREST), &monitorInfo))
+    {
+        const RECT& rc = monitorInfo.rcMonitor;
+        config.monitorWidth = rc.right - rc.left;
+        config.monitorHeight = rc.bottom - rc.top;
+        config.windowCoversMonitor = EqualRect(&window, &rc) && config.windowWidth == config.monitorWidth &&
+                                     config.windowHeight == config.monitorHeight;
+
+        // Anything else at the monitor's center is drawn over the window
+        POINT center = { (rc.left + rc.right) / 2, (rc.top + rc.bottom) / 2 };
+        config.topmostUnobscured = GetAncestor(WindowFromPoint(center), GA_ROOT) == display.hwnd;
+    }
 
-    // Present
-    g_swapChain->Present(1, 0);
+    DEVMODEW mode = {};
+    mode.dmSize = sizeof(mode);
+    if (EnumDisplaySettingsW(display.deviceName.c_str(), ENUM_CURRENT_SETTINGS, &mode) && mode.dmDisplayFrequency > 1)
+        config.refreshHz = mode.dmDisplayFrequency;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    // The recording can be analyzed again later, on any platform
+    char name[64];
+    sprintf_s(name, "/present-output%d", display.index);
+    std::string base = GetDataDirectory() + name;
+    SavePresentRecording(base + ".rec", config, display.presentSamples, frequency.QuadPart);
+
+    PresentReport report = AnalyzePresentation(config, display.presentSamples, frequency.QuadPart);
+    std::string text = FormatPresentReport(report) + FormatArenaStats(display.frameArena.Stats()) +
+                       FormatDrawListStats(display.drawStats) + FormatRecoveryStats(display.recovery.Stats());
+    if (!display.swapChain)
+        text += "swap chain released: its swap effect and buffer size are not known\n";
+    OutputDebugStringA(text.c_str());
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, (base + ".txt").c_str(), "w") == 0 && file)
+    {
+        fputs(text.c_str(), file);
+        fclose(file);
+    }
+}
+
+void StopRenderThreads()
+{
+    g_running = false;
+
+    // Keep pumping messages while render threads finish their last frame
+    bool finished = false;
+    while (!finished)
+    {
+        finished = true;
+        for (auto& display : g_displays)
+            finished = finished && (!display->renderThread.joinable() || display->renderFinished);
+
+        MSG msg = {};
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+            DispatchMessage(&msg);
+        if (!finished)
+            Sleep(1);
+    }
+
+    for (auto& display : g_displays)
+    {
+        if (display->renderThread.joinable())
+            display->renderThread.join();
+    }
+}
+
+void WriteMemoryReport()
+{
+    // Render threads have stopped, so the last figures they declared are final
+    for (auto& display : g_displays)
+        DeclareDeviceMemory(*display);
+
+    WorkingSet workingSet;
+    ReadWorkingSet(workingSet);
+    std::string text = FormatMemoryReport(g_memory, workingSet);
+    OutputDebugStringA(text.c_str());
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, (GetDataDirectory() + "/memory.txt").c_str(), "w") == 0 && file)
+    {
+        fputs(text.c_str(), file);
+        fclose(file);
+    }
 }
 
 void CleanUp()
 {
-    g_textFormat.Reset();
+    for (auto& display : g_displays)
+    {
+        display->session.CloseStore();
+        ReleaseDeviceObjects(*display);
+        display->output.Reset();
+        display->adapter.Reset();
+        display->factory.Reset();
+        if (display->hwnd)
+            DestroyWindow(display->hwnd);
+    }
+    g_displays.clear();
     g_dwriteFactory.Reset();
-    g_textBrush.Reset();
-    g_innerBrush.Reset();
-    g_whiteBrush.Reset();
-    g_d2dTargetBitmap.Reset();
-    g_d2dContext.Reset();
-    g_d2dDevice.Reset();
-    g_d2dFactory.Reset();
-    g_swapChain.Reset();
-    g_d3dContext.Reset();
-    g_d3dDevice.Reset();
 }
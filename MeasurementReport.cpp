@@ -0,0 +1,610 @@
+#include "MeasurementReport.h"
+#include "ColorMath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <queue>
+
+namespace
+{
+    const char* SESSION_HEADER = "index,target_r,target_g,target_b,screen_x,screen_y,luminance,x,y";
+
+    const int EOTF_BINS = 64;           // PQ spaced target luminance bins
+    const float GREY_TOLERANCE = 0.01f; // channels within 1% count as a grey
+    const float DELTA_E_STEP = 0.05f;   // fine histogram for percentiles
+    const int DELTA_E_BINS = 1000;      // up to 50; anything above lands in the last bin
+    const int DELTA_E_PLOT_BINS = 40;   // coarse histogram drawn in the report, up to 10
+    const int DELTA_E_PLOT_FOLD = 5;    // fine bins per drawn bin
+    const float UNIFORMITY_MIN_NITS = 1.0f; // darker patches are mostly meter noise
+
+    // Plot area of every chart, in SVG user units
+    const int PLOT_WIDTH = 560;
+    const int PLOT_HEIGHT = 360;
+    const int PLOT_MARGIN = 48;
+
+    // What every section needs per patch, computed once per chunk
+    struct PatchErrors
+    {
+        float targetNits = 0.0f;
+        float targetPq = 0.0f;
+        float measuredPq = 0.0f;
+        float deltaE = 0.0f;
+        bool grey = false;
+    };
+
+    void ComputeErrors(const std::vector<PatchMeasurement>& chunk, std::vector<PatchErrors>& errors)
+    {
+        errors.resize(chunk.size());
+        for (size_t i = 0; i < chunk.size(); ++i)
+        {
+            const PatchMeasurement& patch = chunk[i];
+            PatchErrors& error = errors[i];
+            const float* target = patch.target;
+            error.targetNits = Bt2020Luminance(target[0], target[1], target[2]);
+            error.targetPq = PqEncode(error.targetNits);
+            error.measuredPq = PqEncode(patch.measured.luminance);
+
+            float brightest = std::max({ target[0], target[1], target[2] });
+            float darkest = std::min({ target[0], target[1], target[2] });
+            error.grey = brightest - darkest <= GREY_TOLERANCE * brightest;
+
+            float xyz[3];
+            float measured[3];
+            float targetItp[3];
+            float measuredItp[3];
+            XyYToXyz(patch.measured.luminance, patch.measured.x, patch.measured.y, xyz);
+            XyzToBt2020(xyz, measured);
+            Bt2020ToIctcp(target, targetItp);
+            Bt2020ToIctcp(measured, measuredItp);
+            error.deltaE = DeltaEItp(targetItp, measuredItp);
+        }
+    }
+
+    std::string Format(const char* format, ...)
+    {
+        char buffer[512];
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        return buffer;
+    }
+
+    float PlotX(float value) { return PLOT_MARGIN + value * PLOT_WIDTH; }
+    float PlotY(float value) { return PLOT_MARGIN + (1.0f - value) * PLOT_HEIGHT; }
+
+    // Frame with luminance ticks on a PQ axis; both axes run over the whole PQ range
+    void WritePqAxes(std::ostream& html, const char* xLabel, const char* yLabel)
+    {
+        html << Format("<rect x='%d' y='%d' width='%d' height='%d' class='frame'/>\n", PLOT_MARGIN, PLOT_MARGIN,
+                       PLOT_WIDTH, PLOT_HEIGHT);
+        for (float nits : { 0.01f, 0.1f, 1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f })
+        {
+            float p = PqEncode(nits);
+            html << Format("<line x1='%.1f' y1='%d' x2='%.1f' y2='%d' class='grid'/>", PlotX(p), PLOT_MARGIN,
+                           PlotX(p), PLOT_MARGIN + PLOT_HEIGHT);
+            html << Format("<line x1='%d' y1='%.1f' x2='%d' y2='%.1f' class='grid'/>", PLOT_MARGIN, PlotY(p),
+                           PLOT_MARGIN + PLOT_WIDTH, PlotY(p));
+            html << Format("<text x='%.1f' y='%d' class='tick'>%g</text>", PlotX(p), PLOT_MARGIN + PLOT_HEIGHT + 16,
+                           nits);
+            html << Format("<text x='%d' y='%.1f' class='tick end'>%g</text>\n", PLOT_MARGIN - 6, PlotY(p) + 4,
+                           nits);
+        }
+        html << Format("<text x='%d' y='%d' class='axis'>%s</text>", PLOT_MARGIN + PLOT_WIDTH / 2,
+                       PLOT_MARGIN + PLOT_HEIGHT + 36, xLabel);
+        html << Format("<text x='12' y='%d' class='axis' transform='rotate(-90 12 %d)'>%s</text>\n",
+                       PLOT_MARGIN + PLOT_HEIGHT / 2, PLOT_MARGIN + PLOT_HEIGHT / 2, yLabel);
+    }
+
+    void OpenSvg(std::ostream& html)
+    {
+        html << Format("<svg width='%d' height='%d'>\n", PLOT_WIDTH + 2 * PLOT_MARGIN, PLOT_HEIGHT + 2 * PLOT_MARGIN);
+    }
+
+    // Measured against requested luminance for the grey patches
+    class EotfSection
+    {
+    public:
+        void Add(const std::vector<PatchMeasurement>& chunk, const std::vector<PatchErrors>& errors)
+        {
+            for (size_t i = 0; i < chunk.size(); ++i)
+            {
+                if (!errors[i].grey)
+                    continue;
+                int b = std::min(EOTF_BINS - 1, static_cast<int>(errors[i].targetPq * EOTF_BINS));
+                Bin& bin = m_bins[b];
+                float measured = chunk[i].measured.luminance;
+                bin.minPq = bin.count ? std::min(bin.minPq, errors[i].measuredPq) : errors[i].measuredPq;
+                bin.maxPq = bin.count ? std::max(bin.maxPq, errors[i].measuredPq) : errors[i].measuredPq;
+                ++bin.count;
+                bin.targetNits += errors[i].targetNits;
+                bin.measuredNits += measured;
+            }
+        }
+
+        void WriteHtml(std::ostream& html) const
+        {
+            html << "<h2>EOTF tracking</h2>\n";
+            size_t greys = 0;
+            for (const Bin& bin : m_bins)
+                greys += bin.count;
+            if (greys == 0)
+            {
+                html << "<p>No grey patches in this session.</p>\n";
+                return;
+            }
+
+            OpenSvg(html);
+            WritePqAxes(html, "target nits", "measured nits");
+            html << Format("<line x1='%.1f' y1='%.1f' x2='%.1f' y2='%.1f' class='ideal'/>\n", PlotX(0.0f),
+                           PlotY(0.0f), PlotX(1.0f), PlotY(1.0f));
+            std::string points;
+            for (const Bin& bin : m_bins)
+            {
+                if (bin.count == 0)
+                    continue;
+                float x = PlotX(PqEncode(static_cast<float>(bin.targetNits / bin.count)));
+                float y = PlotY(PqEncode(static_cast<float>(bin.measuredNits / bin.count)));
+                points += Format("%.1f,%.1f ", x, y);
+                html << Format("<line x1='%.1f' y1='%.1f' x2='%.1f' y2='%.1f' class='spread'/>", x,
+                               PlotY(bin.minPq), x, PlotY(bin.maxPq));
+            }
+            html << "\n<polyline points='" << points << "' class='series'/>\n</svg>\n";
+
+            html << "<table><tr><th>target nits</th><th>measured nits</th><th>error</th><th>patches</th></tr>\n";
+            for (const Bin& bin : m_bins)
+            {
+                if (bin.count == 0)
+                    continue;
+                double target = bin.targetNits / bin.count;
+                double measured = bin.measuredNits / bin.count;
+                html << Format("<tr><td>%.4g</td><td>%.4g</td><td>%+.1f%%</td><td>%zu</td></tr>\n", target, measured,
+                               target > 0.0 ? 100.0 * (measured / target - 1.0) : 0.0, bin.count);
+            }
+            html << "</table>\n";
+        }
+
+    private:
+        struct Bin
+        {
+            size_t count = 0;
+            double targetNits = 0.0;
+            double measuredNits = 0.0;
+            float minPq = 0.0f;
+            float maxPq = 0.0f;
+        };
+        Bin m_bins[EOTF_BINS];
+    };
+
+    // Distribution of Delta E ITP, where along the tone curve it is worst, and the worst patches
+    class DeltaESection
+    {
+    public:
+        explicit DeltaESection(size_t worstCount)
+            : m_worstCount(worstCount)
+        {
+        }
+
+        void Add(const std::vector<PatchMeasurement>& chunk, const std::vector<PatchErrors>& errors)
+        {
+            for (size_t i = 0; i < chunk.size(); ++i)
+            {
+                float deltaE = errors[i].deltaE;
+                ++m_count;
+                m_total += deltaE;
+                m_max = std::max(m_max, static_cast<double>(deltaE));
+                ++m_histogram[std::min(DELTA_E_BINS - 1, static_cast<int>(deltaE / DELTA_E_STEP))];
+
+                int b = std::min(EOTF_BINS - 1, static_cast<int>(errors[i].targetPq * EOTF_BINS));
+                ++m_byLevel[b].count;
+                m_byLevel[b].total += deltaE;
+                m_byLevel[b].max = std::max(m_byLevel[b].max, deltaE);
+
+                // Min-heap of the worst patches seen so far
+                if (m_worst.size() < m_worstCount || deltaE > m_worst.top().deltaE)
+                {
+                    m_worst.push(Worst{ deltaE, chunk[i] });
+                    if (m_worst.size() > m_worstCount)
+                        m_worst.pop();
+                }
+            }
+        }
+
+        size_t Count() const { return m_count; }
+        double Mean() const { return m_count ? m_total / m_count : 0.0; }
+        double Max() const { return m_max; }
+
+        double Percentile(double share) const
+        {
+            size_t rank = static_cast<size_t>(share * m_count);
+            size_t seen = 0;
+            for (int b = 0; b < DELTA_E_BINS; ++b)
+            {
+                seen += m_histogram[b];
+                if (seen > rank)
+                    return (b + 1) * DELTA_E_STEP;
+            }
+            return m_max;
+        }
+
+        void WriteHtml(std::ostream& html) const
+        {
+            html << "<h2>&Delta;E ITP</h2>\n";
+            html << Format("<p>mean %.2f, 95th percentile %.2f, max %.2f over %zu patches. "
+                           "1 is about one just noticeable difference.</p>\n",
+                           Mean(), Percentile(0.95), Max(), m_count);
+            if (m_count == 0)
+                return;
+
+            // Histogram, coarse bins folded from the fine ones
+            size_t bins[DELTA_E_PLOT_BINS] = {};
+            size_t tallest = 1;
+            for (int b = 0; b < DELTA_E_BINS; ++b)
+            {
+                int plot = std::min(DELTA_E_PLOT_BINS - 1, b / DELTA_E_PLOT_FOLD);
+                bins[plot] += m_histogram[b];
+                tallest = std::max(tallest, bins[plot]);
+            }
+            OpenSvg(html);
+            html << Format("<rect x='%d' y='%d' width='%d' height='%d' class='frame'/>\n", PLOT_MARGIN, PLOT_MARGIN,
+                           PLOT_WIDTH, PLOT_HEIGHT);
+            float barWidth = static_cast<float>(PLOT_WIDTH) / DELTA_E_PLOT_BINS;
+            for (int b = 0; b < DELTA_E_PLOT_BINS; ++b)
+            {
+                float height = PLOT_HEIGHT * static_cast<float>(bins[b]) / tallest;
+                html << Format("<rect x='%.1f' y='%.1f' width='%.1f' height='%.1f' class='bar'/>",
+                               PLOT_MARGIN + b * barWidth, PLOT_MARGIN + PLOT_HEIGHT - height, barWidth - 1.0f,
+                               height);
+            }
+            for (int tick = 0; tick <= 10; tick += 2)
+            {
+                html << Format("<text x='%.1f' y='%d' class='tick'>%d%s</text>", PLOT_MARGIN + tick * PLOT_WIDTH / 10.0f,
+                               PLOT_MARGIN + PLOT_HEIGHT + 16, tick, tick == 10 ? "+" : "");
+            }
+            html << Format("<text x='%d' y='%d' class='axis'>&#916;E ITP</text>\n</svg>\n",
+                           PLOT_MARGIN + PLOT_WIDTH / 2, PLOT_MARGIN + PLOT_HEIGHT + 36);
+
+            // Mean and max by target luminance
+            double highest = 1.0;
+            for (const Level& level : m_byLevel)
+                highest = std::max(highest, static_cast<double>(level.max));
+            OpenSvg(html);
+            html << Format("<rect x='%d' y='%d' width='%d' height='%d' class='frame'/>\n", PLOT_MARGIN, PLOT_MARGIN,
+                           PLOT_WIDTH, PLOT_HEIGHT);
+            std::string means;
+            std::string maxima;
+            for (int b = 0; b < EOTF_BINS; ++b)
+            {
+                const Level& level = m_byLevel[b];
+                if (level.count == 0)
+                    continue;
+                float x = PlotX((b + 0.5f) / EOTF_BINS);
+                means += Format("%.1f,%.1f ", x, PlotY(static_cast<float>(level.total / level.count / highest)));
+                maxima += Format("%.1f,%.1f ", x, PlotY(static_cast<float>(level.max / highest)));
+            }
+            for (float nits : { 0.1f, 1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f })
+            {
+                html << Format("<text x='%.1f' y='%d' class='tick'>%g</text>", PlotX(PqEncode(nits)),
+                               PLOT_MARGIN + PLOT_HEIGHT + 16, nits);
+            }
+            html << Format("<text x='%d' y='%d' class='tick end'>%.1f</text>", PLOT_MARGIN - 6, PLOT_MARGIN + 4,
+                           highest);
+            html << "\n<polyline points='" << maxima << "' class='series faint'/>\n";
+            html << "<polyline points='" << means << "' class='series'/>\n";
+            html << Format("<text x='%d' y='%d' class='axis'>target nits: mean and max &#916;E</text>\n</svg>\n",
+                           PLOT_MARGIN + PLOT_WIDTH / 2, PLOT_MARGIN + PLOT_HEIGHT + 36);
+
+            // Worst patches, worst first
+            std::priority_queue<Worst> heap = m_worst;
+            std::vector<Worst> worst;
+            while (!heap.empty())
+            {
+                worst.push_back(heap.top());
+                heap.pop();
+            }
+            std::reverse(worst.begin(), worst.end());
+            html << "<table><tr><th>patch</th><th>target R G B nits</th><th>measured nits</th><th>x</th><th>y</th>"
+                    "<th>&#916;E</th></tr>\n";
+            for (const Worst& entry : worst)
+            {
+                const PatchMeasurement& patch = entry.patch;
+                html << Format("<tr><td>%u</td><td>%.4g %.4g %.4g</td><td>%.4g</td><td>%.4f</td><td>%.4f</td>"
+                               "<td>%.2f</td></tr>\n",
+                               patch.index, patch.target[0], patch.target[1], patch.target[2],
+                               patch.measured.luminance, patch.measured.x, patch.measured.y, entry.deltaE);
+            }
+            html << "</table>\n";
+        }
+
+    private:
+        struct Level
+        {
+            size_t count = 0;
+            double total = 0.0;
+            float max = 0.0f;
+        };
+
+        struct Worst
+        {
+            float deltaE;
+            PatchMeasurement patch;
+
+            // Reversed, so the priority queue keeps the smallest on top
+            bool operator<(const Worst& other) const { return deltaE > other.deltaE; }
+        };
+
+        size_t m_worstCount;
+        size_t m_count = 0;
+        double m_total = 0.0;
+        double m_max = 0.0;
+        size_t m_histogram[DELTA_E_BINS] = {};
+        Level m_byLevel[EOTF_BINS];
+        std::priority_queue<Worst> m_worst;
+    };
+
+    // Luminance accuracy by screen position, relative to the center
+    class UniformitySection
+    {
+    public:
+        UniformitySection(int columns, int rows)
+            : m_columns(std::max(columns, 1))
+            , m_rows(std::max(rows, 1))
+            , m_cells(static_cast<size_t>(m_columns) * m_rows)
+        {
+        }
+
+        void Add(const std::vector<PatchMeasurement>& chunk, const std::vector<PatchErrors>& errors)
+        {
+            for (size_t i = 0; i < chunk.size(); ++i)
+            {
+                const PatchMeasurement& patch = chunk[i];
+                if (errors[i].targetNits < UNIFORMITY_MIN_NITS || patch.screenX < 0.0f || patch.screenX > 1.0f ||
+                    patch.screenY < 0.0f || patch.screenY > 1.0f)
+                    continue;
+                int column = std::min(m_columns - 1, static_cast<int>(patch.screenX * m_columns));
+                int row = std::min(m_rows - 1, static_cast<int>(patch.screenY * m_rows));
+                Cell& cell = m_cells[static_cast<size_t>(row) * m_columns + column];
+                ++cell.count;
+                cell.ratio += patch.measured.luminance / errors[i].targetNits;
+            }
+        }
+
+        void WriteHtml(std::ostream& html) const
+        {
+            html << "<h2>Uniformity</h2>\n";
+            size_t used = 0;
+            for (const Cell& cell : m_cells)
+                used += cell.count > 0;
+            const Cell& center = m_cells[static_cast<size_t>(m_rows / 2) * m_columns + m_columns / 2];
+            if (used < 2 || center.count == 0)
+            {
+                html << "<p>Every patch was measured at the same place; move the meter across the screen "
+                        "to map uniformity.</p>\n";
+                return;
+            }
+
+            double reference = center.ratio / center.count;
+            float cellWidth = static_cast<float>(PLOT_WIDTH) / m_columns;
+            float cellHeight = static_cast<float>(PLOT_HEIGHT) / m_rows;
+            OpenSvg(html);
+            for (int row = 0; row < m_rows; ++row)
+            {
+                for (int column = 0; column < m_columns; ++column)
+                {
+                    const Cell& cell = m_cells[static_cast<size_t>(row) * m_columns + column];
+                    float x = PLOT_MARGIN + column * cellWidth;
+                    float y = PLOT_MARGIN + row * cellHeight;
+                    if (cell.count == 0)
+                    {
+                        html << Format("<rect x='%.1f' y='%.1f' width='%.1f' height='%.1f' class='empty'/>\n", x, y,
+                                       cellWidth, cellHeight);
+                        continue;
+                    }
+
+                    // Red where darker than the center, blue where brighter, white within 1%
+                    double deviation = 100.0 * (cell.ratio / cell.count / reference - 1.0);
+                    int strength = static_cast<int>(std::min(1.0, std::abs(deviation) / 20.0) * 200.0);
+                    int red = deviation < 0.0 ? 255 : 255 - strength;
+                    int blue = deviation > 0.0 ? 255 : 255 - strength;
+                    html << Format("<rect x='%.1f' y='%.1f' width='%.1f' height='%.1f' fill='rgb(%d,%d,%d)' "
+                                   "class='cell'/>",
+                                   x, y, cellWidth, cellHeight, red, 255 - strength, blue);
+                    html << Format("<text x='%.1f' y='%.1f' class='tick'>%+.1f%%</text>\n", x + cellWidth / 2,
+                                   y + cellHeight / 2 + 4, deviation);
+                }
+            }
+            html << "</svg>\n";
+        }
+
+    private:
+        struct Cell
+        {
+            size_t count = 0;
+            double ratio = 0.0; // measured over target luminance, summed
+        };
+
+        int m_columns;
+        int m_rows;
+        std::vector<Cell> m_cells;
+    };
+
+    void WriteCsvRows(std::ostream& csv, const std::vector<PatchMeasurement>& chunk,
+                      const std::vector<PatchErrors>& errors)
+    {
+        std::string text;
+        for (size_t i = 0; i < chunk.size(); ++i)
+        {
+            const PatchMeasurement& patch = chunk[i];
+            float target = errors[i].targetNits;
+            text += Format("%u,%g,%g,%g,%g,%g,%g,%g,%g,%.4f\n", patch.index, patch.target[0], patch.target[1],
+                           patch.target[2], target, patch.measured.luminance, patch.measured.x, patch.measured.y,
+                           target > 0.0f ? 100.0f * (patch.measured.luminance / target - 1.0f) : 0.0f,
+                           errors[i].deltaE);
+        }
+        csv << text;
+    }
+
+    const char* HTML_STYLE =
+        "body{font-family:sans-serif;margin:2em;max-width:60em}"
+        "table{border-collapse:collapse;margin:1em 0}td,th{border:1px solid #ccc;padding:2px 8px;text-align:right}"
+        ".frame{fill:none;stroke:#444}.grid{stroke:#ddd}.ideal{stroke:#999;stroke-dasharray:4}"
+        ".series{fill:none;stroke:#1565c0;stroke-width:2}.faint{stroke:#90caf9}.spread{stroke:#90caf9}"
+        ".bar{fill:#1565c0}.empty{fill:#eee;stroke:#fff}.cell{stroke:#fff}"
+        ".tick{font-size:11px;text-anchor:middle}.end{text-anchor:end}.axis{font-size:13px;text-anchor:middle}";
+}
+
+bool MeasurementWriter::Open(const std::string& path)
+{
+    m_file.open(path, std::ios::trunc);
+    if (!m_file)
+        return false;
+    m_file << SESSION_HEADER << '\n';
+    return true;
+}
+
+void MeasurementWriter::Write(const PatchMeasurement& patch)
+{
+    m_file << patch.index << ',' << patch.target[0] << ',' << patch.target[1] << ',' << patch.target[2] << ','
+           << patch.screenX << ',' << patch.screenY << ',' << patch.measured.luminance << ',' << patch.measured.x
+           << ',' << patch.measured.y << '\n';
+}
+
+bool MeasurementWriter::Close()
+{
+    m_file.close();
+    return !m_file.fail();
+}
+
+bool MeasurementReader::Open(const std::string& path)
+{
+    m_file.open(path);
+    m_skipped = 0;
+    return static_cast<bool>(m_file);
+}
+
+void MeasurementReader::Read(std::vector<PatchMeasurement>& chunk, size_t maxCount)
+{
+    chunk.clear();
+    std::string line;
+    while (chunk.size() < maxCount && std::getline(m_file, line))
+    {
+        if (line.empty() || line.compare(0, 5, "index") == 0)
+            continue;
+
+        // strtof is much faster than a stringstream per field, which matters at this volume
+        PatchMeasurement patch;
+        float* fields[] = { &patch.target[0], &patch.target[1], &patch.target[2], &patch.screenX, &patch.screenY,
+                            &patch.measured.luminance, &patch.measured.x, &patch.measured.y };
+        const char* cursor = line.c_str();
+        char* end = nullptr;
+        patch.index = static_cast<uint32_t>(std::strtoul(cursor, &end, 10));
+        bool valid = end != cursor;
+        for (float* field : fields)
+        {
+            if (!valid || *end != ',')
+            {
+                valid = false;
+                break;
+            }
+            cursor = end + 1;
+            *field = std::strtof(cursor, &end);
+            valid = end != cursor;
+        }
+        if (!valid)
+        {
+            ++m_skipped;
+            continue;
+        }
+        patch.measured.valid = true;
+        chunk.push_back(patch);
+    }
+}
+
+bool GenerateMeasurementReport(const std::string& sessionPath, const std::string& outputPrefix,
+                               const ReportOptions& options, ReportSummary& summary, std::string& error)
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+
+    std::error_code ignored;
+    if (std::filesystem::equivalent(sessionPath, outputPrefix + ".csv", ignored))
+    {
+        error = "the report would overwrite " + sessionPath;
+        return false;
+    }
+
+    MeasurementReader reader;
+    if (!reader.Open(sessionPath))
+    {
+        error = "cannot open " + sessionPath;
+        return false;
+    }
+    std::ofstream csv(outputPrefix + ".csv", std::ios::trunc);
+    std::ofstream html(outputPrefix + ".html", std::ios::trunc);
+    if (!csv || !html)
+    {
+        error = "cannot write " + outputPrefix + ".csv or .html";
+        return false;
+    }
+    csv << "index,target_r,target_g,target_b,target_nits,measured_nits,x,y,luminance_error_pct,delta_e_itp\n";
+
+    EotfSection eotf;
+    DeltaESection deltaE(options.worstPatches);
+    UniformitySection uniformity(options.uniformityColumns, options.uniformityRows);
+
+    // Two chunks in flight: the next one is parsed while the sections work through the current one
+    const size_t chunkSize = std::max<size_t>(options.chunkSize, 1);
+    std::vector<PatchMeasurement> current;
+    std::vector<PatchMeasurement> next;
+    std::vector<PatchErrors> errors;
+    reader.Read(current, chunkSize);
+    while (!current.empty())
+    {
+        std::future<void> parse = std::async(std::launch::async, [&]() { reader.Read(next, chunkSize); });
+
+        ComputeErrors(current, errors);
+        std::future<void> sections[] = {
+            std::async(std::launch::async, [&]() { eotf.Add(current, errors); }),
+            std::async(std::launch::async, [&]() { deltaE.Add(current, errors); }),
+            std::async(std::launch::async, [&]() { uniformity.Add(current, errors); }),
+        };
+        WriteCsvRows(csv, current, errors);
+        for (std::future<void>& section : sections)
+            section.get();
+
+        parse.get();
+        std::swap(current, next);
+    }
+
+    summary.patches = deltaE.Count();
+    summary.skippedLines = reader.SkippedLines();
+    summary.meanDeltaE = deltaE.Mean();
+    summary.p95DeltaE = deltaE.Percentile(0.95);
+    summary.maxDeltaE = deltaE.Max();
+
+    html << "<!DOCTYPE html>\n<html><head><meta charset='utf-8'><title>Calibration report</title><style>"
+         << HTML_STYLE << "</style></head><body>\n";
+    html << "<h1>Calibration report</h1>\n";
+    html << Format("<p>%zu patches", summary.patches);
+    if (summary.skippedLines > 0)
+        html << Format(", %zu unreadable lines skipped", summary.skippedLines);
+    html << ".</p>\n";
+    eotf.WriteHtml(html);
+    deltaE.WriteHtml(html);
+    uniformity.WriteHtml(html);
+    html << "</body></html>\n";
+
+    summary.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (!csv || !html)
+    {
+        error = "writing " + outputPrefix + " failed";
+        return false;
+    }
+    return true;
+}
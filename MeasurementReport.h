@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Meter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// One patch of a profiling session: what was shown, where, and what the meter read
+struct PatchMeasurement
+{
+    uint32_t index = 0;
+    float target[3] = {}; // linear BT.2020 in nits, as in PatchSet
+    float screenX = 0.5f; // meter position as a share of the screen width and height
+    float screenY = 0.5f;
+    Measurement measured;
+};
+
+// Session files are CSV with one patch per line, written as measurements arrive
+class MeasurementWriter
+{
+public:
+    bool Open(const std::string& path);
+    void Write(const PatchMeasurement& patch);
+    bool Close();
+
+private:
+    std::ofstream m_file;
+};
+
+// Reads a session file a chunk at a time, so a session never has to fit in memory
+class MeasurementReader
+{
+public:
+    bool Open(const std::string& path);
+
+    // Replaces chunk with up to maxCount patches; empty at the end of the file
+    void Read(std::vector<PatchMeasurement>& chunk, size_t maxCount);
+
+    size_t SkippedLines() const { return m_skipped; }
+
+private:
+    std::ifstream m_file;
+    size_t m_skipped = 0;
+};
+
+struct ReportOptions
+{
+    size_t chunkSize = 8192;  // patches in memory per stage of the pipeline
+    int uniformityColumns = 9;
+    int uniformityRows = 9;
+    size_t worstPatches = 20; // listed individually in the HTML
+};
+
+struct ReportSummary
+{
+    size_t patches = 0;
+    size_t skippedLines = 0;
+    double meanDeltaE = 0.0;
+    double p95DeltaE = 0.0;
+    double maxDeltaE = 0.0;
+    double seconds = 0.0;
+};
+
+// Streams a session file into outputPrefix.csv (every patch with its errors) and
+// outputPrefix.html (EOTF tracking, Delta E ITP and uniformity, plots inline, no scripts).
+// While one chunk is parsed the previous one goes through the sections, each on its own thread.
+bool GenerateMeasurementReport(const std::string& sessionPath, const std::string& outputPrefix,
+                               const ReportOptions& options, ReportSummary& summary, std::string& error);
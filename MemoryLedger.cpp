@@ -0,0 +1,201 @@
+#include "MemoryLedger.h"
+#include "Arena.h"
+#include "ColorMath.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fstream>
+#include <string>
+#endif
+
+namespace
+{
+    const float OVERLAY_NITS = 100.0f;
+    const float OVERLAY_BACKGROUND_NITS = 1.0f;
+    const int OVERLAY_MARGIN_CELLS = 8;
+    const int BAR_CELLS = 128;  // the largest figure's bar
+    const int ROW_CELLS = 10;   // a 7 cell high glyph and spacing
+    const ScRgb BAR_COLORS[] = {
+        { 1.0f, 0.15f, 0.15f }, { 0.15f, 1.0f, 0.15f }, { 0.3f, 0.3f, 1.0f },  { 1.0f, 1.0f, 0.15f },
+        { 0.15f, 1.0f, 1.0f },  { 1.0f, 0.15f, 1.0f },  { 1.0f, 0.55f, 0.1f }, { 0.6f, 0.3f, 1.0f },
+    };
+
+    ScRgb Tint(const ScRgb& color)
+    {
+        float scale = OVERLAY_NITS / SCRGB_WHITE_NITS;
+        return { color.r * scale, color.g * scale, color.b * scale };
+    }
+}
+
+size_t MemoryLedger::Account(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_accounts.size(); ++i)
+    {
+        if (m_accounts[i].name == name)
+            return i;
+    }
+    MemoryAccount account;
+    account.name = name;
+    m_accounts.push_back(account);
+    return m_accounts.size() - 1;
+}
+
+void MemoryLedger::Charge(size_t account, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MemoryAccount& entry = m_accounts[account];
+    entry.bytes += bytes;
+    entry.peak = std::max(entry.peak, entry.bytes);
+    ++entry.allocations;
+}
+
+void MemoryLedger::Credit(size_t account, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MemoryAccount& entry = m_accounts[account];
+    entry.bytes -= std::min(entry.bytes, bytes);
+    entry.allocations -= entry.allocations > 0 ? 1 : 0;
+}
+
+void MemoryLedger::Declare(size_t account, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MemoryAccount& entry = m_accounts[account];
+    entry.bytes = bytes;
+    entry.peak = std::max(entry.peak, bytes);
+}
+
+std::vector<MemoryAccount> MemoryLedger::Accounts() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_accounts;
+}
+
+size_t MemoryLedger::Total() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t total = 0;
+    for (const MemoryAccount& account : m_accounts)
+        total += account.bytes;
+    return total;
+}
+
+TrackedResource::TrackedResource(MemoryLedger& ledger, const std::string& account,
+                                 std::pmr::memory_resource* upstream)
+    : m_ledger(ledger), m_account(ledger.Account(account)), m_upstream(upstream)
+{
+}
+
+void* TrackedResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void* pointer = m_upstream->allocate(bytes, alignment);
+    m_ledger.Charge(m_account, bytes);
+    return pointer;
+}
+
+void TrackedResource::do_deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+    m_upstream->deallocate(pointer, bytes, alignment);
+    m_ledger.Credit(m_account, bytes);
+}
+
+bool ReadWorkingSet(WorkingSet& workingSet)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return false;
+    workingSet.current = counters.WorkingSetSize;
+    workingSet.peak = counters.PeakWorkingSetSize;
+    return true;
+#else
+    // Resident set and its high water mark, in kB
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    int found = 0;
+    while (std::getline(status, line))
+    {
+        size_t kilobytes = 0;
+        if (std::sscanf(line.c_str(), "VmRSS: %zu", &kilobytes) == 1)
+        {
+            workingSet.current = kilobytes * 1024;
+            ++found;
+        }
+        else if (std::sscanf(line.c_str(), "VmHWM: %zu", &kilobytes) == 1)
+        {
+            workingSet.peak = kilobytes * 1024;
+            ++found;
+        }
+    }
+    return found == 2;
+#endif
+}
+
+std::string FormatMemoryReport(const MemoryLedger& ledger, const WorkingSet& workingSet)
+{
+    std::vector<MemoryAccount> accounts = ledger.Accounts();
+    size_t total = 0;
+    for (const MemoryAccount& account : accounts)
+        total += account.bytes;
+
+    std::string text = "memory: " + FormatBytes(total) + " accounted, working set " +
+                       FormatBytes(workingSet.current) + ", peak " + FormatBytes(workingSet.peak) + "\n";
+    for (const MemoryAccount& account : accounts)
+    {
+        char line[160];
+        std::snprintf(line, sizeof(line), "  %-28s %12s, peak %s\n", account.name.c_str(),
+                      FormatBytes(account.bytes).c_str(), FormatBytes(account.peak).c_str());
+        text += line;
+    }
+    return text;
+}
+
+void AddMemoryOverlay(const MemoryLedger& ledger, const WorkingSet& workingSet, int width, int height,
+                      Pattern& pattern)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    std::vector<MemoryAccount> accounts = ledger.Accounts();
+    std::vector<size_t> rows;
+    rows.push_back(workingSet.current);
+    for (const MemoryAccount& account : accounts)
+        rows.push_back(account.bytes);
+    size_t largest = std::max<size_t>(*std::max_element(rows.begin(), rows.end()), 1);
+
+    int cell = std::max(1, height / 540);
+    int margin = OVERLAY_MARGIN_CELLS * cell;
+    int textLeft = margin + (BAR_CELLS + 2) * cell;
+    const int TEXT_CELLS = 8 * 6; // "100000.0" in 5 wide glyphs and spacing
+    pattern.rects.push_back(PatternRect{ PixelRect{ 0, 0, std::min(width, textLeft + TEXT_CELLS * cell + margin),
+                                                    std::min(height, 2 * margin + static_cast<int>(rows.size()) *
+                                                                                      ROW_CELLS * cell) },
+                                         GreyFromNits(OVERLAY_BACKGROUND_NITS) });
+
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        ScRgb color = Tint(i == 0 ? ScRgb{ 1.0f, 1.0f, 1.0f }
+                                  : BAR_COLORS[(i - 1) % (sizeof(BAR_COLORS) / sizeof(BAR_COLORS[0]))]);
+        int top = margin + static_cast<int>(i) * ROW_CELLS * cell;
+        int length = static_cast<int>(static_cast<double>(rows[i]) / largest * BAR_CELLS * cell);
+        if (length > 0)
+            pattern.rects.push_back(PatternRect{ PixelRect{ margin, top, margin + length, top + 7 * cell }, color });
+
+        PatternLabel label;
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.1f", rows[i] / (1024.0 * 1024.0));
+        label.text = text;
+        label.color = color;
+        label.fontSize = 8.0f * cell;
+        int textWidth = static_cast<int>(label.text.size()) * 6 * cell - cell;
+        label.rect = PixelRect{ textLeft, top, textLeft + textWidth, top + 7 * cell };
+        RasterizeLabel(label, pattern.rects);
+    }
+}
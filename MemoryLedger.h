@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Pattern.h"
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Bytes one subsystem holds
+struct MemoryAccount
+{
+    std::string name;
+    size_t bytes = 0;
+    size_t peak = 0;
+    size_t allocations = 0; // live ones, for tracked accounts
+};
+
+// Memory by subsystem. Heap memory is charged as it is allocated, through a TrackedResource;
+// GPU resources and anything else allocated out of sight, like swap chain buffers, are
+// declared from their known sizes. Render threads and the window thread share one ledger.
+class MemoryLedger
+{
+public:
+    // Index of the named account, created on first use
+    size_t Account(const std::string& name);
+
+    void Charge(size_t account, size_t bytes);
+    void Credit(size_t account, size_t bytes);
+
+    // What a declared account holds now, replacing the last figure
+    void Declare(size_t account, size_t bytes);
+    void Declare(const std::string& name, size_t bytes) { Declare(Account(name), bytes); }
+
+    // In the order they were first used
+    std::vector<MemoryAccount> Accounts() const;
+    size_t Total() const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<MemoryAccount> m_accounts;
+};
+
+// Passes allocations to upstream and charges them to one account, for use as the upstream of an
+// Arena or the resource of a container
+class TrackedResource : public std::pmr::memory_resource
+{
+public:
+    TrackedResource(MemoryLedger& ledger, const std::string& account,
+                    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    MemoryLedger& m_ledger;
+    size_t m_account;
+    std::pmr::memory_resource* m_upstream;
+};
+
+// Physical memory of the whole process, as the OS counts it
+struct WorkingSet
+{
+    size_t current = 0;
+    size_t peak = 0;
+};
+
+bool ReadWorkingSet(WorkingSet& workingSet);
+
+// "memory: 72.4 MiB accounted, working set 95.1 MiB, peak 97.0 MiB", then a line per account
+std::string FormatMemoryReport(const MemoryLedger& ledger, const WorkingSet& workingSet);
+
+// The working set and then each account as a bar with its size in MiB, in the top left corner.
+// The font has digits only, so the bars take their colors in account order: white for the
+// working set, then red, green, blue, yellow, cyan, magenta, orange and violet.
+void AddMemoryOverlay(const MemoryLedger& ledger, const WorkingSet& workingSet, int width, int height,
+                      Pattern& pattern);
@@ -0,0 +1,57 @@
+#include "Meter.h"
+#include "DisplaySimulator.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Points averaged per reading; enough to integrate over PWM and settling
+    const int READ_SAMPLES = 256;
+}
+
+MeterEmulator::MeterEmulator(const DisplaySimulator& display, double& clockMs, const MeterModel& model)
+    : m_display(display)
+    , m_clockMs(clockMs)
+    , m_model(model)
+    , m_random(model.seed)
+    , m_normal(0.0f, 1.0f)
+{
+}
+
+bool MeterEmulator::Read(Measurement& measurement)
+{
+    double start = m_clockMs;
+    double step = m_model.integrationMs / READ_SAMPLES;
+    double total = 0.0;
+    for (int i = 0; i < READ_SAMPLES; ++i)
+        total += m_display.Instantaneous(start + (i + 0.5) * step);
+    m_clockMs = start + m_model.integrationMs;
+
+    measurement.luminance = std::max(0.0f, Noisy(static_cast<float>(total / READ_SAMPLES)));
+    measurement.x = m_display.ChromaticityX();
+    measurement.y = m_display.ChromaticityY();
+    measurement.valid = true;
+    return true;
+}
+
+bool MeterEmulator::Capture(float sampleRate, size_t count, FlickerCapture& capture)
+{
+    if (sampleRate <= 0.0f || count == 0)
+        return false;
+
+    double start = m_clockMs;
+    double step = 1000.0 / sampleRate;
+    capture.sampleRate = sampleRate;
+    capture.darkOffset = 0.0f;
+    capture.samples.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        capture.samples[i] = Noisy(m_display.Instantaneous(start + i * step));
+    m_clockMs = start + count * step;
+    return true;
+}
+
+float MeterEmulator::Noisy(float luminance)
+{
+    float deviation = m_model.relativeNoise * luminance + m_model.noiseFloor;
+    return luminance + deviation * m_normal(m_random);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Flicker.h"
+
+#include <cstdint>
+#include <random>
+
+class DisplaySimulator;
+
+// One spot reading of the patch under the meter
+struct Measurement
+{
+    float luminance = 0.0f; // nits
+    float x = 0.0f;         // CIE 1931 chromaticity
+    float y = 0.0f;
+    bool valid = false;
+};
+
+// Anything that can measure the screen: a real instrument or the emulator below
+class Meter
+{
+public:
+    virtual ~Meter() = default;
+
+    // Integrated reading over the meter's integration time
+    virtual bool Read(Measurement& measurement) = 0;
+
+    // High-rate sensor capture for flicker analysis
+    virtual bool Capture(float sampleRate, size_t count, FlickerCapture& capture) = 0;
+};
+
+struct MeterModel
+{
+    float integrationMs = 500.0f;  // time one reading averages over
+    float relativeNoise = 0.002f;  // standard deviation as a share of the reading
+    float noiseFloor = 0.0005f;    // standard deviation in nits, dominates near black
+    uint32_t seed = 1;             // readings repeat exactly for the same seed
+};
+
+// Meter that reads a DisplaySimulator. It has no clock of its own: every reading
+// advances the caller's simulated time by as long as the reading would take.
+class MeterEmulator : public Meter
+{
+public:
+    MeterEmulator(const DisplaySimulator& display, double& clockMs, const MeterModel& model = MeterModel());
+
+    bool Read(Measurement& measurement) override;
+    bool Capture(float sampleRate, size_t count, FlickerCapture& capture) override;
+
+private:
+    float Noisy(float luminance);
+
+    const DisplaySimulator& m_display;
+    double& m_clockMs;
+    MeterModel m_model;
+    std::mt19937 m_random;
+    std::normal_distribution<float> m_normal;
+};
@@ -0,0 +1,209 @@
+#include "Modes.h"
+#include "DisplayCache.h"
+#include "Pattern.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const float PATTERN_PEAK_NITS = 10000.0f;
+    const float REFERENCE_WHITE_NITS = 203.0f; // BT.2408 HDR reference white
+
+    float SnapToIncrement(float level, float increment)
+    {
+        return increment > 0.0f ? std::round(level / increment) * increment : level;
+    }
+
+    // Step models
+
+    struct LinearStep
+    {
+        static float Apply(float level, float increment, int steps)
+        {
+            return level + increment * static_cast<float>(steps);
+        }
+    };
+
+    // Label formats
+
+    struct NitsLabel
+    {
+        static std::string Apply(float level, float increment)
+        {
+            return FormatNits(level, increment);
+        }
+    };
+
+    // Mode policies: where the levels start, how they step, what is drawn and how the label reads
+
+    struct MaxWhitePolicy
+    {
+        static constexpr BrightnessMode MODE = BrightnessMode::MaxWhite;
+        static constexpr const char* NAME = "max white";
+        static constexpr const char* KEY = "maxwhite";
+        using Step = LinearStep;
+        using Label = NitsLabel;
+
+        static ModeLevels Seed(const CalibrationSeed& seed)
+        {
+            return ModeLevels{ seed.maxWhite, seed.maxWhiteIncrement, seed.maxWhiteRange };
+        }
+
+        static void Draw(float level, const PatternLayout& layout, Pattern& pattern)
+        {
+            pattern.rects.push_back(PatternRect{ layout.outer, GreyFromNits(PATTERN_PEAK_NITS) });
+            pattern.rects.push_back(PatternRect{ layout.inner, GreyFromNits(level) });
+        }
+    };
+
+    struct MinBlackPolicy
+    {
+        static constexpr BrightnessMode MODE = BrightnessMode::MinBlack;
+        static constexpr const char* NAME = "min black";
+        static constexpr const char* KEY = "minblack";
+        using Step = LinearStep;
+        using Label = NitsLabel;
+
+        static ModeLevels Seed(const CalibrationSeed& seed)
+        {
+            return ModeLevels{ seed.minBlack, seed.minBlackIncrement, seed.minBlackRange };
+        }
+
+        static void Draw(float level, const PatternLayout& layout, Pattern& pattern)
+        {
+            pattern.rects.push_back(PatternRect{ layout.inner, GreyFromNits(level) });
+        }
+    };
+
+    // Panels with a power limiter dim large areas, so full field starts well below the peak
+    struct FullFieldPeakPolicy
+    {
+        static constexpr BrightnessMode MODE = BrightnessMode::FullFieldPeak;
+        static constexpr const char* NAME = "full field peak";
+        static constexpr const char* KEY = "fullfield";
+        using Step = LinearStep;
+        using Label = NitsLabel;
+
+        static ModeLevels Seed(const CalibrationSeed& seed)
+        {
+            return ModeLevels{ SnapToIncrement(seed.maxWhite / 2.0f, seed.maxWhiteIncrement), seed.maxWhiteIncrement,
+                               seed.maxWhiteRange };
+        }
+
+        static void Draw(float level, const PatternLayout&, Pattern& pattern)
+        {
+            pattern.background = GreyFromNits(level);
+        }
+    };
+
+    struct PaperWhitePolicy
+    {
+        static constexpr BrightnessMode MODE = BrightnessMode::PaperWhite;
+        static constexpr const char* NAME = "paper white";
+        static constexpr const char* KEY = "paperwhite";
+        using Step = LinearStep;
+        using Label = NitsLabel;
+
+        static ModeLevels Seed(const CalibrationSeed& seed)
+        {
+            return ModeLevels{ std::min(REFERENCE_WHITE_NITS, seed.maxWhite), 1.0f,
+                               std::min(1000.0f, seed.maxWhiteRange) };
+        }
+
+        static void Draw(float level, const PatternLayout& layout, Pattern& pattern)
+        {
+            pattern.rects.push_back(PatternRect{ layout.outer, GreyFromNits(level) });
+        }
+    };
+
+    struct Window10Policy
+    {
+        static constexpr BrightnessMode MODE = BrightnessMode::Window10;
+        static constexpr const char* NAME = "10% window";
+        static constexpr const char* KEY = "window10";
+        using Step = LinearStep;
+        using Label = NitsLabel;
+
+        static ModeLevels Seed(const CalibrationSeed& seed)
+        {
+            return ModeLevels{ seed.maxWhite, seed.maxWhiteIncrement, seed.maxWhiteRange };
+        }
+
+        static void Draw(float level, const PatternLayout& layout, Pattern& pattern)
+        {
+            pattern.rects.push_back(PatternRect{ layout.window, GreyFromNits(level) });
+        }
+    };
+
+    template <typename Policy>
+    void BuildPattern(const SessionView& view, const PatternLayout& layout, Pattern& pattern)
+    {
+        pattern.background = ScRgb();
+        pattern.rects.clear();
+        Policy::Draw(view.brightness, layout, pattern);
+
+        // Dark blue label below the outer square
+        pattern.label.rect = layout.label;
+        pattern.label.color = ScRgb{ 0.0f, 0.0f, 0.5f };
+        pattern.label.fontSize = layout.fontSize;
+        pattern.label.text = Policy::Label::Apply(view.brightness, view.increment);
+    }
+
+    template <typename Policy>
+    constexpr ModeInfo MakeModeInfo()
+    {
+        return ModeInfo{ Policy::MODE, Policy::NAME, Policy::KEY, &Policy::Seed, &Policy::Step::Apply,
+                         &BuildPattern<Policy>, &Policy::Label::Apply };
+    }
+
+    // New modes are a policy above, an enum value and an entry here
+    constexpr ModeInfo MODE_REGISTRY[] = {
+        MakeModeInfo<MaxWhitePolicy>(),
+        MakeModeInfo<MinBlackPolicy>(),
+        MakeModeInfo<FullFieldPeakPolicy>(),
+        MakeModeInfo<PaperWhitePolicy>(),
+        MakeModeInfo<Window10Policy>(),
+    };
+
+    constexpr bool RegistryMatchesEnum()
+    {
+        for (size_t i = 0; i < MODE_COUNT; ++i)
+        {
+            if (MODE_REGISTRY[i].mode != static_cast<BrightnessMode>(i))
+                return false;
+        }
+        return true;
+    }
+
+    static_assert(sizeof(MODE_REGISTRY) / sizeof(MODE_REGISTRY[0]) == MODE_COUNT, "every mode needs a registry entry");
+    static_assert(RegistryMatchesEnum(), "registry entries must be in BrightnessMode order");
+}
+
+const ModeInfo& GetModeInfo(BrightnessMode mode)
+{
+    return MODE_REGISTRY[ModeIndex(mode)];
+}
+
+bool FindMode(const std::string& key, BrightnessMode& mode)
+{
+    for (const ModeInfo& info : MODE_REGISTRY)
+    {
+        if (key == info.key)
+        {
+            mode = info.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+BrightnessMode NextMode(BrightnessMode mode)
+{
+    return static_cast<BrightnessMode>((ModeIndex(mode) + 1) % MODE_COUNT);
+}
+
+void BuildMaxWhitePatternDirect(const SessionView& view, const PatternLayout& layout, Pattern& pattern)
+{
+    BuildPattern<MaxWhitePolicy>(view, layout, pattern);
+}
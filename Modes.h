@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct CalibrationSeed;
+struct Pattern;
+struct PatternLayout;
+struct SessionView;
+
+// Registry order is also the order the toggle button cycles through
+enum class BrightnessMode : uint32_t
+{
+    MaxWhite,      // Outer square at 10000 nits around the adjusted inner square
+    MinBlack,      // Inner square alone on black
+    FullFieldPeak, // Whole screen at the adjusted level
+    PaperWhite,    // Large square at the level SDR white should map to
+    Window10,      // Centered square covering 10% of the screen area
+
+    Count
+};
+
+const size_t MODE_COUNT = static_cast<size_t>(BrightnessMode::Count);
+
+// Level, step and upper limit of one mode, all in nits
+struct ModeLevels
+{
+    float level = 0.0f;
+    float increment = 1.0f;
+    float range = 10000.0f;
+};
+
+// One registry entry. Entries are generated from the policy types in Modes.cpp,
+// so everything mode specific is resolved at compile time and the frame loop
+// only indexes the table.
+struct ModeInfo
+{
+    BrightnessMode mode;
+    const char* name;
+    const char* key; // one word, for scripts and command lines
+    ModeLevels (*seed)(const CalibrationSeed& seed);
+    float (*step)(float level, float increment, int steps);
+    void (*buildPattern)(const SessionView& view, const PatternLayout& layout, Pattern& pattern);
+    std::string (*formatLabel)(float level, float increment);
+};
+
+inline size_t ModeIndex(BrightnessMode mode)
+{
+    return static_cast<size_t>(mode);
+}
+
+const ModeInfo& GetModeInfo(BrightnessMode mode);
+
+// Mode with the given key, such as "window10"
+bool FindMode(const std::string& key, BrightnessMode& mode);
+
+BrightnessMode NextMode(BrightnessMode mode);
+
+// Reference build that bypasses the registry, for the dispatch benchmark
+void BuildMaxWhitePatternDirect(const SessionView& view, const PatternLayout& layout, Pattern& pattern);
@@ -0,0 +1,342 @@
+#include "PatchSet.h"
+#include "ColorMath.h"
+#include "Edid.h"
+#include "Pattern.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    const uint32_t PATCH_SET_MAGIC = 0x54415048; // "HPAT" little endian
+    const uint32_t PATCH_SET_VERSION = 1;
+    const size_t HEADER_SIZE = 12;
+    const int PQ_CODES = 65536;
+    const int SOBOL_BITS = 32;
+
+    // Nits for every 16-bit PQ code. Generators snap to these codes, so generated sets
+    // survive serialization exactly, and a table lookup replaces three pow calls.
+    const std::vector<float>& PqCodeTable()
+    {
+        static const std::vector<float> table = []()
+        {
+            std::vector<float> nits(PQ_CODES);
+            for (int code = 0; code < PQ_CODES; ++code)
+                nits[code] = PqDecode(code / static_cast<float>(PQ_CODES - 1));
+            return nits;
+        }();
+        return table;
+    }
+
+    // Positive floats order like their bit patterns, so the top bits of a value pick a bucket,
+    // and each bucket holds the first code at or above its lower edge. Finding a code is then
+    // a short forward scan instead of a pow or a binary search. Buckets 1/2048 of an octave wide
+    // hold about one code each; up to 10000 nits that is about 290k buckets.
+    const int BUCKET_SHIFT = 12;
+
+    uint32_t BucketOf(float nits)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &nits, sizeof(bits));
+        return bits >> BUCKET_SHIFT;
+    }
+
+    const std::vector<uint16_t>& PqCodeBuckets()
+    {
+        static const std::vector<uint16_t> buckets = []()
+        {
+            const std::vector<float>& table = PqCodeTable();
+            std::vector<uint16_t> first(BucketOf(table.back()) + 1);
+            int code = 0;
+            for (uint32_t bucket = 0; bucket < first.size(); ++bucket)
+            {
+                uint32_t edgeBits = bucket << BUCKET_SHIFT;
+                float edge;
+                std::memcpy(&edge, &edgeBits, sizeof(edge));
+                while (code < PQ_CODES - 1 && table[code] < edge)
+                    ++code;
+                first[bucket] = static_cast<uint16_t>(code);
+            }
+            return first;
+        }();
+        return buckets;
+    }
+
+    // Nearest code, exact for values that came from the table
+    uint16_t PqCode(float nits)
+    {
+        const std::vector<float>& table = PqCodeTable();
+        const std::vector<uint16_t>& buckets = PqCodeBuckets();
+        if (!(nits > 0.0f))
+            return 0;
+        uint32_t bucket = BucketOf(nits);
+        if (bucket >= buckets.size())
+            return PQ_CODES - 1;
+
+        int code = buckets[bucket];
+        while (code < PQ_CODES - 1 && table[code] < nits)
+            ++code;
+        if (code > 0 && nits - table[code - 1] < table[code] - nits)
+            --code;
+        return static_cast<uint16_t>(code);
+    }
+
+    // Maps a position in [0, 1] to nits, evenly in PQ between two levels
+    class PqRange
+    {
+    public:
+        PqRange(float blackNits, float peakNits)
+            : m_table(PqCodeTable().data())
+            , m_low(PqEncode(std::max(blackNits, 0.0f)) * (PQ_CODES - 1))
+            , m_span(PqEncode(std::max(peakNits, blackNits)) * (PQ_CODES - 1) - m_low)
+        {
+        }
+
+        float operator()(float position) const
+        {
+            return m_table[static_cast<int>(m_low + m_span * position + 0.5f)];
+        }
+
+    private:
+        const float* m_table;
+        float m_low;
+        float m_span;
+    };
+
+    std::vector<float> PqLevels(size_t count, float blackNits, float peakNits)
+    {
+        PqRange range(blackNits, peakNits);
+        std::vector<float> levels(count);
+        for (size_t i = 0; i < count; ++i)
+            levels[i] = range(count > 1 ? i / static_cast<float>(count - 1) : 1.0f);
+        return levels;
+    }
+
+    // Direction numbers for the first three Sobol dimensions (Joe and Kuo): the van der Corput
+    // sequence, then the primitive polynomials x + 1 and x^2 + x + 1
+    struct SobolDirections
+    {
+        uint32_t v[3][SOBOL_BITS];
+
+        SobolDirections()
+        {
+            for (int k = 0; k < SOBOL_BITS; ++k)
+                v[0][k] = 1u << (31 - k);
+
+            v[1][0] = 1u << 31;
+            for (int k = 1; k < SOBOL_BITS; ++k)
+                v[1][k] = v[1][k - 1] ^ (v[1][k - 1] >> 1);
+
+            v[2][0] = 1u << 31;
+            v[2][1] = 3u << 30;
+            for (int k = 2; k < SOBOL_BITS; ++k)
+                v[2][k] = v[2][k - 1] ^ v[2][k - 2] ^ (v[2][k - 2] >> 2);
+        }
+    };
+
+    int LowestZeroBit(uint64_t value)
+    {
+        int bit = 0;
+        while (value & 1)
+        {
+            value >>= 1;
+            ++bit;
+        }
+        return bit;
+    }
+
+    void PutU32(uint8_t* out, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    uint32_t GetU32(const uint8_t* in)
+    {
+        return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+    }
+}
+
+void PatchSet::Clear()
+{
+    r.clear();
+    g.clear();
+    b.clear();
+}
+
+void PatchSet::Reserve(size_t count)
+{
+    r.reserve(count);
+    g.reserve(count);
+    b.reserve(count);
+}
+
+void PatchSet::Push(float red, float green, float blue)
+{
+    r.push_back(red);
+    g.push_back(green);
+    b.push_back(blue);
+}
+
+void GenerateLattice(size_t stepsPerAxis, float blackNits, float peakNits, PatchSet& set)
+{
+    std::vector<float> levels = PqLevels(stepsPerAxis, blackNits, peakNits);
+    set.Reserve(set.Size() + stepsPerAxis * stepsPerAxis * stepsPerAxis);
+    for (float red : levels)
+    {
+        for (float green : levels)
+        {
+            for (float blue : levels)
+                set.Push(red, green, blue);
+        }
+    }
+}
+
+void GenerateSobol(size_t count, size_t skip, float blackNits, float peakNits, PatchSet& set)
+{
+    static const SobolDirections directions;
+    PqRange range(blackNits, peakNits);
+    const float scale = 1.0f / 4294967296.0f;
+
+    size_t first = set.Size();
+    set.r.resize(first + count);
+    set.g.resize(first + count);
+    set.b.resize(first + count);
+
+    // Gray code order: each point differs from the previous one in a single direction number.
+    // Point i of the sequence is the xor of the directions of the set bits of gray(i).
+    uint32_t x[3] = {};
+    uint64_t gray = skip ^ (skip >> 1);
+    for (int bit = 0; bit < SOBOL_BITS; ++bit)
+    {
+        if (gray & (uint64_t(1) << bit))
+        {
+            for (int d = 0; d < 3; ++d)
+                x[d] ^= directions.v[d][bit];
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        set.r[first + i] = range(x[0] * scale);
+        set.g[first + i] = range(x[1] * scale);
+        set.b[first + i] = range(x[2] * scale);
+
+        int bit = std::min(LowestZeroBit(skip + i), SOBOL_BITS - 1);
+        for (int d = 0; d < 3; ++d)
+            x[d] ^= directions.v[d][bit];
+    }
+}
+
+void GeneratePqGreyscale(size_t count, float blackNits, float peakNits, PatchSet& set)
+{
+    for (float level : PqLevels(count, blackNits, peakNits))
+        set.Push(level, level, level);
+}
+
+void GenerateGamutSurface(size_t stepsPerEdge, float blackNits, float peakNits, PatchSet& set)
+{
+    std::vector<float> levels = PqLevels(stepsPerEdge, blackNits, peakNits);
+    size_t last = stepsPerEdge - 1;
+    for (size_t i = 0; i < stepsPerEdge; ++i)
+    {
+        for (size_t j = 0; j < stepsPerEdge; ++j)
+        {
+            // Skip the points with every channel strictly between black and peak
+            bool inside = i > 0 && i < last && j > 0 && j < last;
+            for (size_t k = 0; k < stepsPerEdge; ++k)
+            {
+                if (!inside || k == 0 || k == last)
+                    set.Push(levels[i], levels[j], levels[k]);
+            }
+        }
+    }
+}
+
+void ComputePatchLuminance(const PatchSet& set, std::vector<float>& luminance)
+{
+    const size_t count = set.Size();
+    luminance.resize(count);
+    const float* r = set.r.data();
+    const float* g = set.g.data();
+    const float* b = set.b.data();
+    float* y = luminance.data();
+    for (size_t i = 0; i < count; ++i)
+        y[i] = 0.2627f * r[i] + 0.6780f * g[i] + 0.0593f * b[i];
+}
+
+void BuildPatchPattern(const PatchSet& set, size_t index, const PatternLayout& layout, Pattern& pattern)
+{
+    const float bt2020[3] = { set.r[index], set.g[index], set.b[index] };
+    float bt709[3];
+    Bt2020ToBt709(bt2020, bt709);
+
+    // scRGB can hold colors outside BT.709 as negative components
+    ScRgb color{ bt709[0] / SCRGB_WHITE_NITS, bt709[1] / SCRGB_WHITE_NITS, bt709[2] / SCRGB_WHITE_NITS };
+
+    pattern.background = ScRgb();
+    pattern.rects.clear();
+    pattern.rects.push_back(PatternRect{ layout.window, color });
+
+    pattern.label.rect = layout.label;
+    pattern.label.color = ScRgb{ 0.0f, 0.0f, 0.5f };
+    pattern.label.fontSize = layout.fontSize;
+    pattern.label.text = "patch " + std::to_string(index + 1) + "/" + std::to_string(set.Size());
+}
+
+std::vector<uint8_t> SerializePatchSet(const PatchSet& set)
+{
+    const size_t count = set.Size();
+    std::vector<uint8_t> data(HEADER_SIZE + count * 3 * sizeof(uint16_t));
+    PutU32(&data[0], PATCH_SET_MAGIC);
+    PutU32(&data[4], PATCH_SET_VERSION);
+    PutU32(&data[8], static_cast<uint32_t>(count));
+
+    // One channel after another, like the arrays in memory
+    uint8_t* out = data.data() + HEADER_SIZE;
+    for (const std::vector<float>* channel : { &set.r, &set.g, &set.b })
+    {
+        for (float nits : *channel)
+        {
+            uint16_t code = PqCode(nits);
+            *out++ = static_cast<uint8_t>(code);
+            *out++ = static_cast<uint8_t>(code >> 8);
+        }
+    }
+    return data;
+}
+
+bool DeserializePatchSet(const uint8_t* data, size_t size, PatchSet& set)
+{
+    if (size < HEADER_SIZE || GetU32(data) != PATCH_SET_MAGIC || GetU32(data + 4) != PATCH_SET_VERSION)
+        return false;
+    const size_t count = GetU32(data + 8);
+    if (size != HEADER_SIZE + count * 3 * sizeof(uint16_t))
+        return false;
+
+    const std::vector<float>& table = PqCodeTable();
+    const uint8_t* in = data + HEADER_SIZE;
+    for (std::vector<float>* channel : { &set.r, &set.g, &set.b })
+    {
+        channel->resize(count);
+        for (size_t i = 0; i < count; ++i, in += 2)
+            (*channel)[i] = table[in[0] | (in[1] << 8)];
+    }
+    return true;
+}
+
+bool SavePatchSet(const std::string& path, const PatchSet& set)
+{
+    std::vector<uint8_t> data = SerializePatchSet(set);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(file);
+}
+
+bool LoadPatchSet(const std::string& path, PatchSet& set)
+{
+    std::vector<uint8_t> data;
+    return LoadBinaryFile(path, data) && DeserializePatchSet(data.data(), data.size(), set);
+}
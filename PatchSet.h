@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Layout.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Pattern;
+
+// Target colors for profiling a display, as a structure of arrays so kernels can stream
+// one channel at a time. Values are linear BT.2020 in nits: equal r, g and b is a grey
+// of that luminance.
+struct PatchSet
+{
+    std::vector<float> r;
+    std::vector<float> g;
+    std::vector<float> b;
+
+    size_t Size() const { return r.size(); }
+    void Clear();
+    void Reserve(size_t count);
+    void Push(float red, float green, float blue);
+};
+
+// Generators append, so one set can mix several of them. Levels are spaced evenly in PQ
+// between blackNits and peakNits, which keeps neighboring patches a similar perceptual
+// distance apart at every brightness.
+
+// Every combination of stepsPerAxis levels per channel
+void GenerateLattice(size_t stepsPerAxis, float blackNits, float peakNits, PatchSet& set);
+
+// The first count points of a 3D Sobol sequence in PQ space, after skipping skip points.
+// Any prefix covers the cube evenly, so a run can stop early and still be well spread.
+void GenerateSobol(size_t count, size_t skip, float blackNits, float peakNits, PatchSet& set);
+
+// count greys from black to peak
+void GeneratePqGreyscale(size_t count, float blackNits, float peakNits, PatchSet& set);
+
+// The lattice points on the surface of the RGB cube, where the gamut boundary and the
+// saturated colors are
+void GenerateGamutSurface(size_t stepsPerEdge, float blackNits, float peakNits, PatchSet& set);
+
+// Luminance of every patch, in nits
+void ComputePatchLuminance(const PatchSet& set, std::vector<float>& luminance);
+
+// One patch in the 10% window on black, labeled with its index
+void BuildPatchPattern(const PatchSet& set, size_t index, const PatternLayout& layout, Pattern& pattern);
+
+// Compact binary form: channels are stored as 16-bit PQ codes. Generated sets come back
+// exactly; other values within 1/65535 of their PQ signal, well below a visible difference.
+std::vector<uint8_t> SerializePatchSet(const PatchSet& set);
+bool DeserializePatchSet(const uint8_t* data, size_t size, PatchSet& set);
+bool SavePatchSet(const std::string& path, const PatchSet& set);
+bool LoadPatchSet(const std::string& path, PatchSet& set);
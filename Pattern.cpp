@@ -0,0 +1,200 @@
+#include "Pattern.h"
+#include "ColorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+    const int GLYPH_WIDTH = 5;
+    const int GLYPH_HEIGHT = 7;
+
+    struct Glyph
+    {
+        char character;
+        unsigned char rows[GLYPH_HEIGHT]; // bit 4 is the leftmost pixel
+    };
+
+    const Glyph GLYPHS[] = {
+        { '0', { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E } },
+        { '1', { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+        { '2', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F } },
+        { '3', { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E } },
+        { '4', { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 } },
+        { '5', { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E } },
+        { '6', { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E } },
+        { '7', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 } },
+        { '8', { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E } },
+        { '9', { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C } },
+        { '.', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C } },
+        { '-', { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 } },
+        { '%', { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 } },
+        { 'n', { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 } },
+        { 'i', { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E } },
+        { 't', { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06 } },
+        { 's', { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E } },
+    };
+
+    const Glyph* FindGlyph(char character)
+    {
+        for (const Glyph& glyph : GLYPHS)
+        {
+            if (glyph.character == character)
+                return &glyph;
+        }
+        return nullptr; // drawn as a space
+    }
+}
+
+ScRgb GreyFromNits(float nits)
+{
+    float value = nits / SCRGB_WHITE_NITS;
+    return ScRgb{ value, value, value };
+}
+
+namespace
+{
+    float ClippedNits(const ScRgb& color, float clipNits)
+    {
+        return std::min(std::max(0.0f, Bt709Luminance(color.r, color.g, color.b) * SCRGB_WHITE_NITS), clipNits);
+    }
+
+    // Light of the rects, in nits times pixels, and the pixels they cover. The screen is cut into
+    // cells at every rect edge; inside a cell the same rect is on top everywhere.
+    void MeasureRects(const Pattern& pattern, int width, int height, float clipNits, double& light, double& covered)
+    {
+        // Scratch on the stack for the few rects a calibration pattern has, the heap beyond that
+        char buffer[4096];
+        std::pmr::monotonic_buffer_resource scratch(buffer, sizeof(buffer));
+        std::pmr::vector<int> xs({ 0, width }, &scratch);
+        std::pmr::vector<int> ys({ 0, height }, &scratch);
+        for (const PatternRect& rect : pattern.rects)
+        {
+            xs.push_back(std::clamp(rect.rect.left, 0, width));
+            xs.push_back(std::clamp(rect.rect.right, 0, width));
+            ys.push_back(std::clamp(rect.rect.top, 0, height));
+            ys.push_back(std::clamp(rect.rect.bottom, 0, height));
+        }
+        std::sort(xs.begin(), xs.end());
+        xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+        std::sort(ys.begin(), ys.end());
+        ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+        std::pmr::vector<float> nits(pattern.rects.size(), 0.0f, &scratch);
+        for (size_t i = 0; i < nits.size(); ++i)
+            nits[i] = ClippedNits(pattern.rects[i].color, clipNits);
+
+        light = 0.0;
+        covered = 0.0;
+        for (size_t row = 0; row + 1 < ys.size(); ++row)
+        {
+            for (size_t column = 0; column + 1 < xs.size(); ++column)
+            {
+                int x = xs[column];
+                int y = ys[row];
+                for (size_t i = pattern.rects.size(); i-- > 0;)
+                {
+                    const PixelRect& rect = pattern.rects[i].rect;
+                    if (x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom)
+                    {
+                        double area = static_cast<double>(xs[column + 1] - x) * (ys[row + 1] - y);
+                        light += area * nits[i];
+                        covered += area;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+float PatternAverageNits(const Pattern& pattern, int width, int height, float clipNits)
+{
+    if (width <= 0 || height <= 0)
+        return 0.0f;
+    double light;
+    double covered;
+    MeasureRects(pattern, width, height, clipNits, light, covered);
+    double area = static_cast<double>(width) * height;
+    light += (area - covered) * ClippedNits(pattern.background, clipNits);
+    return static_cast<float>(light / area);
+}
+
+bool FillSurround(Pattern& pattern, int width, int height, float targetNits, float clipNits)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+    double light;
+    double covered;
+    MeasureRects(pattern, width, height, clipNits, light, covered);
+    double area = static_cast<double>(width) * height;
+    double surround = area - covered;
+    double nits = surround > 0.0 ? (targetNits * area - light) / surround : 0.0;
+    bool reached = nits >= 0.0 && nits <= clipNits;
+    pattern.background = GreyFromNits(static_cast<float>(std::min<double>(std::max(nits, 0.0), clipNits)));
+    return reached && surround > 0.0;
+}
+
+std::string FormatNits(float nits, float increment)
+{
+    int decimals = increment > 0.0f ? std::max(0, static_cast<int>(std::ceil(-std::log10(increment) - 0.001f))) : 0;
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.*f nits", decimals, nits);
+    return buffer;
+}
+
+Pattern BuildCalibrationPattern(const SessionView& view, const PatternLayout& layout)
+{
+    Pattern pattern;
+    GetModeInfo(view.mode).buildPattern(view, layout, pattern);
+    return pattern;
+}
+
+void BuildCalibrationPattern(const SessionView& view, const PatternLayout& layout, Pattern& pattern)
+{
+    GetModeInfo(view.mode).buildPattern(view, layout, pattern);
+}
+
+void RasterizeLabel(const PatternLabel& label, std::pmr::vector<PatternRect>& rects)
+{
+    // One font pixel per 1/8 of the font size leaves room for spacing like a 24px font
+    int scale = std::max(1, static_cast<int>(std::lround(label.fontSize / 8.0f)));
+    int advance = (GLYPH_WIDTH + 1) * scale;
+    int textWidth = static_cast<int>(label.text.size()) * advance - scale;
+    int originX = label.rect.left + (label.rect.Width() - textWidth) / 2;
+    int originY = label.rect.top;
+
+    for (size_t c = 0; c < label.text.size(); ++c)
+    {
+        const Glyph* glyph = FindGlyph(label.text[c]);
+        if (!glyph)
+            continue;
+
+        int glyphX = originX + static_cast<int>(c) * advance;
+        for (int row = 0; row < GLYPH_HEIGHT; ++row)
+        {
+            // Merge horizontal runs so each row is as few rects as possible
+            int column = 0;
+            while (column < GLYPH_WIDTH)
+            {
+                if (!(glyph->rows[row] & (0x10 >> column)))
+                {
+                    ++column;
+                    continue;
+                }
+                int start = column;
+                while (column < GLYPH_WIDTH && (glyph->rows[row] & (0x10 >> column)))
+                    ++column;
+
+                PatternRect rect;
+                rect.rect.left = glyphX + start * scale;
+                rect.rect.right = glyphX + column * scale;
+                rect.rect.top = originY + row * scale;
+                rect.rect.bottom = rect.rect.top + scale;
+                rect.color = label.color;
+                rects.push_back(rect);
+            }
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Layout.h"
+#include "Session.h"
+
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Linear scRGB color, 1.0 is 80 nits
+struct ScRgb
+{
+    float r = 0.0f;
+    float g = 0.0f;
+    float b = 0.0f;
+};
+
+struct PatternRect
+{
+    PixelRect rect;
+    ScRgb color;
+};
+
+struct PatternLabel
+{
+    PixelRect rect;
+    ScRgb color;
+    float fontSize = 0.0f; // pixels
+    std::string text;
+};
+
+// Everything on screen for one frame, backend independent.
+// Rects are drawn in order over the background; the label is drawn last.
+// A frame loop builds it on its frame arena, and renderers take their scratch from the same place.
+struct Pattern
+{
+    Pattern() = default;
+    explicit Pattern(std::pmr::memory_resource* resource) : rects(resource) {}
+
+    ScRgb background;
+    std::pmr::vector<PatternRect> rects;
+    PatternLabel label;
+};
+
+ScRgb GreyFromNits(float nits);
+
+// "800 nits" with as many decimals as the increment needs
+std::string FormatNits(float nits, float increment);
+
+// What is drawn comes from the mode's registry entry
+Pattern BuildCalibrationPattern(const SessionView& view, const PatternLayout& layout);
+
+// The same into an existing pattern, which keeps its memory resource
+void BuildCalibrationPattern(const SessionView& view, const PatternLayout& layout, Pattern& pattern);
+
+// Mean light of the pattern on a width x height screen in nits, each color clipped at clipNits as
+// the panel would show it. Rects may overlap and go off screen; the label is too small to count.
+float PatternAverageNits(const Pattern& pattern, int width, int height, float clipNits);
+
+// Make the background the grey that brings the average to targetNits, so the power limiter sees the
+// same average picture level whatever the rects show. False when no grey gets there: the background
+// is black when the rects alone are brighter, and clipNits when they are too dark for any surround.
+bool FillSurround(Pattern& pattern, int width, int height, float targetNits, float clipNits);
+
+// Turn the label into solid rects with a built-in 5x7 pixel font,
+// for backends that have no text renderer of their own
+void RasterizeLabel(const PatternLabel& label, std::pmr::vector<PatternRect>& rects);
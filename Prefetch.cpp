@@ -0,0 +1,219 @@
+#include "Prefetch.h"
+#include "CpuRenderer.h"
+#include "Layout.h"
+#include "Pattern.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+namespace
+{
+    const size_t NO_ITEM = static_cast<size_t>(-1);
+}
+
+FramePrefetcher::FramePrefetcher(size_t lookahead, unsigned threadCount, std::pmr::memory_resource* frames)
+{
+    lookahead = std::max<size_t>(lookahead, 1);
+    threadCount = threadCount ? threadCount : std::thread::hardware_concurrency();
+    m_threadCount = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(lookahead)));
+
+    m_slots.reserve(lookahead + 1);
+    for (size_t i = 0; i <= lookahead; ++i)
+        m_slots.emplace_back(frames);
+    m_slotItems.assign(lookahead + 1, NO_ITEM);
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+    Stop();
+}
+
+void FramePrefetcher::Start(size_t count, RenderItem render)
+{
+    Stop();
+    m_render = std::move(render);
+    m_count = count;
+    m_next = 0;
+    m_limit = Lookahead();
+    m_stopping = false;
+    std::fill(m_slotItems.begin(), m_slotItems.end(), NO_ITEM);
+    for (unsigned t = 0; t < m_threadCount; ++t)
+        m_threads.emplace_back(&FramePrefetcher::Work, this, t);
+}
+
+void FramePrefetcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work.notify_all();
+    for (std::thread& thread : m_threads)
+        thread.join();
+    m_threads.clear();
+}
+
+void FramePrefetcher::Prime()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]()
+    {
+        for (size_t item = 0; item < std::min(m_count, Lookahead()); ++item)
+        {
+            if (m_slotItems[item] != item)
+                return false;
+        }
+        return true;
+    });
+}
+
+const FrameBuffer& FramePrefetcher::Take(size_t item, bool& ready)
+{
+    size_t slot = item % m_slots.size();
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // The slots of the items after this one are free once it is on screen
+    m_limit = std::max(m_limit, item + 1 + Lookahead());
+    m_work.notify_all();
+
+    ready = m_slotItems[slot] == item;
+    m_done.wait(lock, [&]() { return m_slotItems[slot] == item; });
+    return m_slots[slot];
+}
+
+void FramePrefetcher::Work(unsigned worker)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_work.wait(lock, [&]() { return m_stopping || (m_next < m_count && m_next < m_limit); });
+        if (m_stopping)
+            return;
+
+        size_t item = m_next++;
+        size_t slot = item % m_slots.size();
+        m_slotItems[slot] = NO_ITEM;
+        lock.unlock();
+        m_render(item, worker, m_slots[slot]);
+        lock.lock();
+        m_slotItems[slot] = item;
+        m_done.notify_all();
+    }
+}
+
+SequenceStats PlaySequence(const PatchSet& set, const SequenceOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<double, std::milli>;
+
+    SequenceStats stats;
+    if (set.Size() == 0 || options.refreshHz <= 0.0)
+        return stats;
+
+    std::unique_ptr<FramePrefetcher> prefetcher;
+    if (options.lookahead > 0)
+        prefetcher = std::make_unique<FramePrefetcher>(options.lookahead, options.threadCount);
+    unsigned workers = prefetcher ? prefetcher->Threads() : 1;
+
+    // Each worker keeps a gain map and a render time of its own
+    std::vector<GainMap> gainMaps(workers);
+    for (GainMap& gainMap : gainMaps)
+        gainMap.SetGrid(options.gainGrid);
+    std::vector<double> renderMs(workers, 0.0);
+
+    PatternLayout layout = ComputePatternLayout(options.width, options.height, 1.0f);
+    auto render = [&](size_t item, unsigned worker, FrameBuffer& frame)
+    {
+        Clock::time_point start = Clock::now();
+        Pattern pattern;
+        BuildPatchPattern(set, item, layout, pattern);
+        if (options.aplNits > 0.0f)
+            FillSurround(pattern, options.width, options.height, options.aplNits, options.clipNits);
+        frame.Resize(options.width, options.height, options.encoding);
+        RenderPatternCpu(pattern, frame, gainMaps[worker]);
+        renderMs[worker] += Ms(Clock::now() - start).count();
+    };
+
+    // Prefetching starts with a full ring, rendered while the previous step of the sequence runs
+    FrameBuffer inlineFrame;
+    if (prefetcher)
+    {
+        prefetcher->Start(set.Size(), render);
+        prefetcher->Prime();
+    }
+
+    // Frames on a fixed vsync grid; a late switch does not move the frames after it
+    const Ms frameMs(1000.0 / options.refreshHz);
+    const size_t hold = static_cast<size_t>(std::max(options.holdFrames, 1));
+    const Clock::time_point start = Clock::now();
+    for (size_t frame = 0; frame < set.Size() * hold; ++frame)
+    {
+        Clock::time_point frameStart = start + std::chrono::duration_cast<Clock::duration>(frameMs * frame);
+        Clock::time_point vsync = start + std::chrono::duration_cast<Clock::duration>(frameMs * (frame + 1));
+        if (frame % hold == 0)
+        {
+            size_t item = frame / hold;
+            const FrameBuffer* shown = &inlineFrame;
+            if (prefetcher)
+            {
+                bool ready = false;
+                shown = &prefetcher->Take(item, ready);
+                stats.waited += ready ? 0 : 1;
+            }
+            else
+            {
+                render(item, 0, inlineFrame);
+            }
+
+            // Presented once per patch; the display keeps showing it for the frames it is held
+            if (options.present)
+            {
+                if (!options.present(*shown))
+                    break;
+                ++stats.presented;
+            }
+
+            Clock::time_point readyAt = Clock::now();
+            ++stats.switches;
+            stats.missed += readyAt > vsync ? 1 : 0;
+            stats.worstSwitchMs = std::max(stats.worstSwitchMs, Ms(readyAt - frameStart).count());
+        }
+        std::this_thread::sleep_until(vsync);
+    }
+
+    if (prefetcher)
+        prefetcher->Stop();
+    double totalMs = 0.0;
+    for (double ms : renderMs)
+        totalMs += ms;
+    stats.renderMs = totalMs / static_cast<double>(set.Size());
+    return stats;
+}
+
+std::string FormatSequenceStats(const SequenceStats& stats, const SequenceOptions& options)
+{
+    char mode[48];
+    if (options.lookahead > 0)
+        std::snprintf(mode, sizeof(mode), "prefetch %zu", options.lookahead);
+    else
+        std::snprintf(mode, sizeof(mode), "inline");
+
+    char buffer[200];
+    std::snprintf(buffer, sizeof(buffer),
+                  "%s: %zu of %zu switches missed their frame, worst %.1f ms, render %.1f ms per patch",
+                  mode, stats.missed, stats.switches, stats.worstSwitchMs, stats.renderMs);
+    std::string text = buffer;
+    if (options.lookahead > 0)
+    {
+        std::snprintf(buffer, sizeof(buffer), ", %zu taken before they were ready", stats.waited);
+        text += buffer;
+    }
+    if (options.present)
+    {
+        std::snprintf(buffer, sizeof(buffer), ", %zu presented", stats.presented);
+        text += buffer;
+    }
+    return text + "\n";
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "FrameBuffer.h"
+#include "GainMap.h"
+#include "PatchSet.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Renders the items of a sequence ahead of when they are shown, on worker threads, into a ring
+// of lookahead + 1 frames: the one on screen and the next lookahead. Taking the next item is
+// then a pointer swap, unless its frame is still being rendered. Items are taken in order.
+class FramePrefetcher
+{
+public:
+    // Renders one item into frame; worker tells the threads apart, for state each needs of its own
+    using RenderItem = std::function<void(size_t item, unsigned worker, FrameBuffer& frame)>;
+
+    // Frames come from the given resource, such as a PagePool that keeps them between sequences
+    FramePrefetcher(size_t lookahead, unsigned threadCount = 0,
+                    std::pmr::memory_resource* frames = std::pmr::get_default_resource());
+    ~FramePrefetcher();
+
+    FramePrefetcher(const FramePrefetcher&) = delete;
+    FramePrefetcher& operator=(const FramePrefetcher&) = delete;
+
+    // Stops any sequence in progress and starts rendering items 0 to count - 1
+    void Start(size_t count, RenderItem render);
+
+    // Waits until the first lookahead items are rendered, so a sequence can start with a full ring
+    void Prime();
+
+    // Frame of item, valid until the next Take; waits for it when it is not rendered yet, and
+    // ready says whether it was. Taking an item lets the workers start on the one lookahead after it.
+    const FrameBuffer& Take(size_t item, bool& ready);
+
+    void Stop();
+
+    size_t Lookahead() const { return m_slots.size() - 1; }
+    unsigned Threads() const { return m_threadCount; }
+
+private:
+    void Work(unsigned worker);
+
+    unsigned m_threadCount;
+    std::vector<FrameBuffer> m_slots;
+    std::vector<size_t> m_slotItems; // item rendered in each slot, or NO_ITEM
+    RenderItem m_render;
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_done;
+    size_t m_count = 0;
+    size_t m_next = 0;  // next item for a worker
+    size_t m_limit = 0; // items below this may be rendered without overwriting the one on screen
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};
+
+// A patch set played in real time, as a meter sequence shows it
+struct SequenceOptions
+{
+    int width = 3840;
+    int height = 2160;
+    FrameEncoding encoding = FrameEncoding::ScRgbHalf;
+    double refreshHz = 60.0;
+    int holdFrames = 6;       // frames each patch stays up
+    size_t lookahead = 0;     // patches rendered ahead; 0 renders each on the frame it first appears
+    unsigned threadCount = 0; // prefetch workers, 0 is one per hardware thread
+    float aplNits = 0.0f;     // grey surround, as with --apl
+    float clipNits = 1000.0f;
+    GainGrid gainGrid;        // uniformity correction while rendering, when not empty
+
+    // Shows each patch's frame as it comes up, such as VulkanRenderer::PresentFrame; false stops the
+    // sequence. Without it the frames are only rendered and timed.
+    std::function<bool(const FrameBuffer&)> present;
+};
+
+struct SequenceStats
+{
+    size_t switches = 0;
+    size_t missed = 0;         // switches whose frame was not ready by the vsync it was due on
+    size_t waited = 0;         // prefetched frames that were still being rendered when taken
+    double worstSwitchMs = 0.0; // from the start of a switch frame to its frame being ready
+    double renderMs = 0.0;     // mean per patch, on whichever thread rendered it
+    size_t presented = 0;      // switches whose frame options.present showed
+};
+
+// Plays every patch of the set for holdFrames frames on a fixed vsync grid and counts the switches
+// whose frame was late. Frames are rendered on the CPU, as the reference renderer draws them, and a
+// switch counts as ready once its frame is presented.
+SequenceStats PlaySequence(const PatchSet& set, const SequenceOptions& options);
+
+// "inline: 3 of 120 switches missed their frame, worst 21.4 ms, render 9.8 ms"
+std::string FormatSequenceStats(const SequenceStats& stats, const SequenceOptions& options);
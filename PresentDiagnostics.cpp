@@ -0,0 +1,226 @@
+#include "PresentDiagnostics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace
+{
+    const size_t MODE_SLOTS = 5;
+
+    // A missed vblank now and then is noise; more than this share of frames is a problem
+    const double MISSED_REFRESH_WARNING = 0.01;
+
+    std::string Format(const char* format, double a, double b = 0.0)
+    {
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer), format, a, b);
+        return buffer;
+    }
+}
+
+PresentReport AnalyzePresentation(const PresentConfig& config, const std::vector<PresentSample>& samples,
+                                  int64_t ticksPerSecond)
+{
+    PresentReport report;
+    report.refreshHz = config.refreshHz;
+
+    // When each present was submitted, keyed by its present id
+    std::map<uint32_t, int64_t> submitted;
+    for (const PresentSample& sample : samples)
+    {
+        if (sample.presentId != 0)
+            submitted.emplace(sample.presentId, sample.presentTicks);
+    }
+
+    // Walk the distinct statistics: each new PresentCount is a frame that reached the screen
+    std::vector<double> latencies;
+    const PresentSample* previous = nullptr;
+    double refreshTicks = 0.0;
+    size_t refreshIntervals = 0;
+    for (const PresentSample& sample : samples)
+    {
+        if (!sample.statsValid)
+            continue;
+        if (previous && sample.statsPresentCount == previous->statsPresentCount)
+            continue;
+
+        ++report.framesShown;
+        ++report.modeCounts[std::min(static_cast<size_t>(sample.mode), MODE_SLOTS - 1)];
+
+        auto it = submitted.find(sample.statsPresentCount);
+        if (it != submitted.end() && sample.statsSyncTicks >= it->second && ticksPerSecond > 0)
+            latencies.push_back(1000.0 * (sample.statsSyncTicks - it->second) / ticksPerSecond);
+
+        if (previous && sample.statsPresentCount > previous->statsPresentCount)
+        {
+            uint32_t presents = sample.statsPresentCount - previous->statsPresentCount;
+            uint32_t refreshes = sample.statsPresentRefreshCount - previous->statsPresentRefreshCount;
+            if (refreshes > presents)
+                report.refreshesMissed += refreshes - presents;
+            if (refreshes > 0 && sample.statsSyncTicks > previous->statsSyncTicks)
+            {
+                refreshTicks += static_cast<double>(sample.statsSyncTicks - previous->statsSyncTicks);
+                refreshIntervals += refreshes;
+            }
+        }
+        previous = &sample;
+    }
+
+    if (report.refreshHz <= 0.0 && refreshIntervals > 0 && ticksPerSecond > 0)
+        report.refreshHz = ticksPerSecond / (refreshTicks / refreshIntervals);
+
+    if (!latencies.empty())
+    {
+        double total = 0.0;
+        for (double latency : latencies)
+            total += latency;
+        report.meanLatencyMs = total / latencies.size();
+        std::sort(latencies.begin(), latencies.end());
+        report.p95LatencyMs = latencies[std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * 0.95))];
+    }
+
+    size_t best = 0;
+    for (size_t m = 1; m < MODE_SLOTS; ++m)
+    {
+        if (report.modeCounts[m] > report.modeCounts[best])
+            best = m;
+    }
+    report.mode = static_cast<PresentationMode>(best);
+    report.overlayUsed = report.modeCounts[static_cast<size_t>(PresentationMode::Overlay)] > 0;
+
+    // Configuration that rules out independent flip, most fundamental first
+    std::vector<std::string>& warnings = report.warnings;
+    if (!config.flipModel)
+        warnings.push_back("blt model swap chain: every frame is composed by DWM, use a flip model swap effect");
+    if (!config.perMonitorDpiAware && config.dpi != 96)
+        warnings.push_back(Format("process is not per-monitor DPI aware at %.0f DPI: DWM scales the window", config.dpi));
+    if (!config.windowCoversMonitor)
+        warnings.push_back("window does not exactly cover its monitor: only a composed present can show it");
+    if (config.bufferWidth != config.windowWidth || config.bufferHeight != config.windowHeight)
+        warnings.push_back(Format("back buffer %.0f wide differs from the %.0f pixel wide window: DWM has to stretch it",
+                                  config.bufferWidth, config.windowWidth));
+    if (!config.topmostUnobscured)
+        warnings.push_back("another window overlaps the calibration window");
+
+    // What actually happened
+    size_t composed = report.modeCounts[static_cast<size_t>(PresentationMode::Composed)];
+    size_t failed = report.modeCounts[static_cast<size_t>(PresentationMode::CompositionFailure)];
+    if (report.framesShown == 0)
+        warnings.push_back("no frame statistics: the swap chain reported none, presentation mode unknown");
+    else if (composed * 2 > report.framesShown)
+        warnings.push_back("frames are composed by DWM: expect an extra frame of latency and higher power use");
+    if (failed > 0)
+        warnings.push_back(Format("%.0f frames failed composition", static_cast<double>(failed)));
+    if (report.framesShown > 0 &&
+        report.refreshesMissed > MISSED_REFRESH_WARNING * static_cast<double>(report.framesShown))
+        warnings.push_back(Format("%.0f refreshes repeated a frame: rendering missed vsync",
+                                  static_cast<double>(report.refreshesMissed)));
+    if (report.refreshHz > 0.0 && report.meanLatencyMs > 2.5 * 1000.0 / report.refreshHz)
+        warnings.push_back(Format("mean latency %.1f ms is more than two refreshes at %.0f Hz",
+                                  report.meanLatencyMs, report.refreshHz));
+
+    return report;
+}
+
+const char* PresentationModeName(PresentationMode mode)
+{
+    switch (mode)
+    {
+    case PresentationMode::Composed:           return "composed";
+    case PresentationMode::Overlay:            return "overlay";
+    case PresentationMode::IndependentFlip:    return "independent flip";
+    case PresentationMode::CompositionFailure: return "composition failure";
+    default:                                   return "unknown";
+    }
+}
+
+std::string FormatPresentReport(const PresentReport& report)
+{
+    std::string text;
+    char line[256];
+    std::snprintf(line, sizeof(line), "presentation: %s%s\n", PresentationModeName(report.mode),
+                  report.overlayUsed ? " (overlay planes used)" : "");
+    text += line;
+    std::snprintf(line, sizeof(line), "frames shown: %zu, refreshes missed: %zu, refresh: %.2f Hz\n",
+                  report.framesShown, report.refreshesMissed, report.refreshHz);
+    text += line;
+    std::snprintf(line, sizeof(line), "latency: mean %.2f ms, p95 %.2f ms\n", report.meanLatencyMs,
+                  report.p95LatencyMs);
+    text += line;
+    for (size_t m = 0; m < MODE_SLOTS; ++m)
+    {
+        if (report.modeCounts[m] == 0)
+            continue;
+        std::snprintf(line, sizeof(line), "  %-20s %zu\n", PresentationModeName(static_cast<PresentationMode>(m)),
+                      report.modeCounts[m]);
+        text += line;
+    }
+    for (const std::string& warning : report.warnings)
+        text += "warning: " + warning + "\n";
+    return text;
+}
+
+bool SavePresentRecording(const std::string& path, const PresentConfig& config,
+                          const std::vector<PresentSample>& samples, int64_t ticksPerSecond)
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+        return false;
+
+    file << "ticks " << ticksPerSecond << '\n';
+    file << "config " << config.flipModel << ' ' << config.perMonitorDpiAware << ' ' << config.dpi << ' '
+         << config.bufferWidth << ' ' << config.bufferHeight << ' ' << config.windowWidth << ' '
+         << config.windowHeight << ' ' << config.monitorWidth << ' ' << config.monitorHeight << ' '
+         << config.windowCoversMonitor << ' ' << config.topmostUnobscured << ' ' << config.refreshHz << '\n';
+    for (const PresentSample& sample : samples)
+    {
+        file << "sample " << sample.presentId << ' ' << sample.presentTicks << ' ' << sample.statsValid << ' '
+             << sample.statsPresentCount << ' ' << sample.statsPresentRefreshCount << ' '
+             << sample.statsSyncRefreshCount << ' ' << sample.statsSyncTicks << ' '
+             << static_cast<int>(sample.mode) << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+bool LoadPresentRecording(const std::string& path, PresentConfig& config, std::vector<PresentSample>& samples,
+                          int64_t& ticksPerSecond)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    samples.clear();
+    ticksPerSecond = 0;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string tag;
+        fields >> tag;
+        if (tag == "ticks")
+        {
+            fields >> ticksPerSecond;
+        }
+        else if (tag == "config")
+        {
+            fields >> config.flipModel >> config.perMonitorDpiAware >> config.dpi >> config.bufferWidth >>
+                config.bufferHeight >> config.windowWidth >> config.windowHeight >> config.monitorWidth >>
+                config.monitorHeight >> config.windowCoversMonitor >> config.topmostUnobscured >> config.refreshHz;
+        }
+        else if (tag == "sample")
+        {
+            PresentSample sample;
+            int mode = 0;
+            if (fields >> sample.presentId >> sample.presentTicks >> sample.statsValid >> sample.statsPresentCount >>
+                sample.statsPresentRefreshCount >> sample.statsSyncRefreshCount >> sample.statsSyncTicks >> mode)
+            {
+                sample.mode = static_cast<PresentationMode>(std::clamp(mode, 0, static_cast<int>(MODE_SLOTS) - 1));
+                samples.push_back(sample);
+            }
+        }
+    }
+    return ticksPerSecond > 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// How the compositor put a frame on screen, as reported by IDXGISwapChainMedia
+enum class PresentationMode
+{
+    Unknown,
+    Composed,           // DWM copied the frame into its own, adding a frame of latency
+    Overlay,            // scanned out from a hardware overlay plane
+    IndependentFlip,    // scanned out directly from the swap chain buffer
+    CompositionFailure  // the compositor could not present the frame at all
+};
+
+// Swap chain and window setup the fast path depends on
+struct PresentConfig
+{
+    bool flipModel = true;            // FLIP_SEQUENTIAL or FLIP_DISCARD
+    bool perMonitorDpiAware = true;   // otherwise DWM scales the window
+    uint32_t dpi = 96;
+    int bufferWidth = 0;
+    int bufferHeight = 0;
+    int windowWidth = 0;              // client area, physical pixels
+    int windowHeight = 0;
+    int monitorWidth = 0;
+    int monitorHeight = 0;
+    bool windowCoversMonitor = true;  // client area exactly matches the monitor rect
+    bool topmostUnobscured = true;    // nothing is drawn over the window
+    double refreshHz = 0.0;           // 0 when unknown, then estimated from the samples
+};
+
+// One Present and the statistics read right after it. The statistics describe the most
+// recent present that reached the screen, which is usually an earlier one.
+struct PresentSample
+{
+    uint32_t presentId = 0;           // GetLastPresentCount after this Present
+    int64_t presentTicks = 0;         // QPC when Present was called
+    bool statsValid = false;
+    uint32_t statsPresentCount = 0;   // last present shown
+    uint32_t statsPresentRefreshCount = 0;
+    uint32_t statsSyncRefreshCount = 0;
+    int64_t statsSyncTicks = 0;       // QPC of the vblank that showed it
+    PresentationMode mode = PresentationMode::Unknown;
+};
+
+struct PresentReport
+{
+    PresentationMode mode = PresentationMode::Unknown; // most frequent mode
+    size_t modeCounts[5] = {};                          // indexed by PresentationMode
+    bool overlayUsed = false;
+    size_t framesShown = 0;
+    size_t refreshesMissed = 0;  // vblanks that repeated a frame instead of showing a new one
+    double refreshHz = 0.0;
+    double meanLatencyMs = 0.0;  // Present call to the vblank that showed it
+    double p95LatencyMs = 0.0;
+    std::vector<std::string> warnings;
+};
+
+PresentReport AnalyzePresentation(const PresentConfig& config, const std::vector<PresentSample>& samples,
+                                  int64_t ticksPerSecond);
+
+const char* PresentationModeName(PresentationMode mode);
+
+std::string FormatPresentReport(const PresentReport& report);
+
+// Recordings are plain text, so statistics captured on one machine can be analyzed anywhere
+bool SavePresentRecording(const std::string& path, const PresentConfig& config,
+                          const std::vector<PresentSample>& samples, int64_t ticksPerSecond);
+bool LoadPresentRecording(const std::string& path, PresentConfig& config, std::vector<PresentSample>& samples,
+                          int64_t& ticksPerSecond);
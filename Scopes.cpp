@@ -0,0 +1,618 @@
+#include "Scopes.h"
+#include "ColorMath.h"
+#include "Half.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define SCOPES_F16C 1
+#define SCOPES_TARGET __attribute__((target("avx,f16c")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define SCOPES_F16C 1
+#define SCOPES_TARGET
+#endif
+
+namespace
+{
+    const int BAND_ROWS = 16;              // sampled rows a thread takes at a time
+    const float VECTORSCOPE_MIN_NITS = 0.01f; // darker pixels have no meaningful chromaticity
+
+    // Overlay, in nits; cells scale with the screen so a 4K panel is as large as a 1080p one
+    const float OVERLAY_NITS = 100.0f;
+    const float OVERLAY_BACKGROUND_NITS = 1.0f;
+    const float GRATICULE_NITS = 8.0f;
+    const int OVERLAY_MARGIN_CELLS = 8;
+    const float GRATICULE_LEVELS[] = { 1.0f, 10.0f, 100.0f, 1000.0f };
+
+    // Positive floats to PQ codes by their top 17 bits, a relative step of 1/256 or under half a code.
+    // Indexing by bit pattern keeps the two powers of PqEncode out of the per pixel work.
+    const int CODE_TABLE_SHIFT = 15;
+
+    const std::vector<uint16_t>& CodeTable()
+    {
+        static const std::vector<uint16_t> table = []()
+        {
+            std::vector<uint16_t> codes(size_t(1) << (31 - CODE_TABLE_SHIFT));
+            for (size_t i = 0; i < codes.size(); ++i)
+            {
+                uint32_t bits = static_cast<uint32_t>(i << CODE_TABLE_SHIFT) | (1u << (CODE_TABLE_SHIFT - 1));
+                float nits;
+                std::memcpy(&nits, &bits, sizeof(nits));
+                codes[i] = static_cast<uint16_t>(std::isfinite(nits) ? std::lround(PqEncode(nits) * 1023.0f) : 1023);
+            }
+            return codes;
+        }();
+        return table;
+    }
+
+    const std::vector<float>& DecodeTable()
+    {
+        static const std::vector<float> table = []()
+        {
+            std::vector<float> decoded(SCOPE_PQ_CODES);
+            for (int code = 0; code < SCOPE_PQ_CODES; ++code)
+                decoded[code] = PqDecode(code / 1023.0f);
+            return decoded;
+        }();
+        return table;
+    }
+
+    // Code table index of a float; negatives and NaNs index code 0
+    uint32_t CodeIndex(float nits)
+    {
+        if (!(nits > 0.0f))
+            return 0;
+        uint32_t bits;
+        std::memcpy(&bits, &nits, sizeof(bits));
+        return bits >> CODE_TABLE_SHIFT;
+    }
+
+    // The conversions as matrices, read off the ColorMath functions so both kernels use their numbers
+    struct Matrix
+    {
+        float m[3][3];
+    };
+
+    Matrix MatrixOf(void (*convert)(const float*, float*))
+    {
+        Matrix matrix;
+        for (int column = 0; column < 3; ++column)
+        {
+            float unit[3] = {};
+            float out[3];
+            unit[column] = 1.0f;
+            convert(unit, out);
+            for (int row = 0; row < 3; ++row)
+                matrix.m[row][column] = out[row];
+        }
+        return matrix;
+    }
+
+    const Matrix TO_BT2020 = MatrixOf(Bt709ToBt2020);
+    const Matrix TO_XYZ = MatrixOf(Bt2020ToXyz);
+
+    // Sampled pixels of one row, converted and ready to bin, as structure of arrays
+    struct Converted
+    {
+        std::vector<uint16_t> codes[4]; // PQ codes of the luminance and of BT.2020 red, green and blue
+        std::vector<float> nits;        // luminance, 0 for negatives and NaNs
+        std::vector<int> vectorCells;   // -1 when left out of the vectorscope
+
+        void Resize(size_t count)
+        {
+            for (std::vector<uint16_t>& channel : codes)
+                channel.resize(count);
+            nits.resize(count);
+            vectorCells.resize(count);
+        }
+    };
+
+    // Vectorscope cell from the x and y it falls at in cells, compared as floats so far out ones
+    // never reach the conversion to int, which truncates anything above -1 into the first cell
+    int VectorCell(float cellX, float cellY, int size)
+    {
+        if (!(cellX > -1.0f && cellY > -1.0f && cellX < size && cellY < size))
+            return -1;
+        return static_cast<int>(cellY) * size + static_cast<int>(cellX);
+    }
+
+    void ConvertScRgbScalar(const uint64_t* row, const int* positions, int first, int count, const uint16_t* table,
+                            int vectorscopeSize, Converted& out)
+    {
+        for (int i = first; i < count; ++i)
+        {
+            uint64_t pixel = row[positions[i]];
+            float bt709[3];
+            for (int c = 0; c < 3; ++c)
+                bt709[c] = HalfToFloat(static_cast<uint16_t>(pixel >> (16 * c))) * SCRGB_WHITE_NITS;
+
+            float bt2020[3];
+            float xyz[3];
+            for (int r = 0; r < 3; ++r)
+                bt2020[r] = TO_BT2020.m[r][0] * bt709[0] + TO_BT2020.m[r][1] * bt709[1] + TO_BT2020.m[r][2] * bt709[2];
+            for (int r = 0; r < 3; ++r)
+                xyz[r] = TO_XYZ.m[r][0] * bt2020[0] + TO_XYZ.m[r][1] * bt2020[1] + TO_XYZ.m[r][2] * bt2020[2];
+
+            float nits = Bt709Luminance(bt709[0], bt709[1], bt709[2]);
+            nits = nits > 0.0f ? nits : 0.0f;
+            out.nits[i] = nits;
+            out.codes[0][i] = table[CodeIndex(nits)];
+            for (int c = 0; c < 3; ++c)
+                out.codes[c + 1][i] = table[CodeIndex(bt2020[c])];
+
+            float sum = xyz[0] + xyz[1] + xyz[2];
+            float scale = vectorscopeSize / (sum * VECTORSCOPE_RANGE);
+            bool shown = nits >= VECTORSCOPE_MIN_NITS && sum > 0.0f;
+            out.vectorCells[i] = shown ? VectorCell(xyz[0] * scale, xyz[1] * scale, vectorscopeSize) : -1;
+        }
+    }
+
+#ifdef SCOPES_F16C
+    bool DetectF16c()
+    {
+        unsigned int regs[4] = {};
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        for (int i = 0; i < 4; ++i)
+            regs[i] = static_cast<unsigned int>(info[i]);
+#else
+        if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+            return false;
+#endif
+        const unsigned int OSXSAVE = 1u << 27, AVX = 1u << 28, F16C = 1u << 29;
+        if ((regs[2] & (OSXSAVE | AVX | F16C)) != (OSXSAVE | AVX | F16C))
+            return false;
+
+        // The OS has to save the YMM registers too
+#ifdef _MSC_VER
+        unsigned long long enabled = _xgetbv(0);
+#else
+        unsigned int low, high;
+        __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        unsigned long long enabled = (static_cast<unsigned long long>(high) << 32) | low;
+#endif
+        return (enabled & 6) == 6;
+    }
+
+    const bool HAS_F16C = DetectF16c();
+
+    SCOPES_TARGET __m256 Dot3(const float* coefficients, __m256 a, __m256 b, __m256 c)
+    {
+        return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(coefficients[0]), a),
+                                           _mm256_mul_ps(_mm256_set1_ps(coefficients[1]), b)),
+                             _mm256_mul_ps(_mm256_set1_ps(coefficients[2]), c));
+    }
+
+    // Negatives and NaNs to +0, whose index is 0
+    SCOPES_TARGET __m256 ClampPositive(__m256 value)
+    {
+        return _mm256_and_ps(value, _mm256_cmp_ps(value, _mm256_setzero_ps(), _CMP_GT_OQ));
+    }
+
+    // Two RGBA half pixels to floats, the first in the low four lanes
+    SCOPES_TARGET __m256 WidenPair(uint64_t low, uint64_t high)
+    {
+        return _mm256_cvtph_ps(_mm_set_epi64x(static_cast<long long>(high), static_cast<long long>(low)));
+    }
+
+    SCOPES_TARGET void StoreIndices(__m256 value, uint32_t* indices)
+    {
+        __m128i low = _mm_castps_si128(_mm256_castps256_ps128(value));
+        __m128i high = _mm_castps_si128(_mm256_extractf128_ps(value, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), _mm_srli_epi32(low, CODE_TABLE_SHIFT));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + 4), _mm_srli_epi32(high, CODE_TABLE_SHIFT));
+    }
+
+    // Eight samples per step, as the scalar conversion does one. Pixels are paired as 0 and 4,
+    // 2 and 6, 1 and 5, 3 and 7, so that after widening, two rounds of unpacking leave red, green
+    // and blue each in one register in sample order. The matrices, luminance and vectorscope
+    // position are then computed across the eight lanes, and only the code table lookups and the
+    // vectorscope range check are left per sample.
+    SCOPES_TARGET int ConvertScRgbF16c(const uint64_t* row, const int* positions, int count, const uint16_t* table,
+                                       int vectorscopeSize, Converted& out)
+    {
+        const __m256 white = _mm256_set1_ps(SCRGB_WHITE_NITS);
+        const __m256 minNits = _mm256_set1_ps(VECTORSCOPE_MIN_NITS);
+        const __m256 size = _mm256_set1_ps(vectorscopeSize / VECTORSCOPE_RANGE);
+        const __m256 outside = _mm256_set1_ps(-1.0f);
+        const float LUMINANCE[3] = { Bt709Luminance(1.0f, 0.0f, 0.0f), Bt709Luminance(0.0f, 1.0f, 0.0f),
+                                     Bt709Luminance(0.0f, 0.0f, 1.0f) };
+
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const int* p = positions + i;
+            __m256 a0 = _mm256_mul_ps(WidenPair(row[p[0]], row[p[4]]), white);
+            __m256 a1 = _mm256_mul_ps(WidenPair(row[p[2]], row[p[6]]), white);
+            __m256 a2 = _mm256_mul_ps(WidenPair(row[p[1]], row[p[5]]), white);
+            __m256 a3 = _mm256_mul_ps(WidenPair(row[p[3]], row[p[7]]), white);
+            __m256 rg01 = _mm256_unpacklo_ps(a0, a1), ba01 = _mm256_unpackhi_ps(a0, a1);
+            __m256 rg23 = _mm256_unpacklo_ps(a2, a3), ba23 = _mm256_unpackhi_ps(a2, a3);
+            __m256 red = _mm256_unpacklo_ps(rg01, rg23);
+            __m256 green = _mm256_unpackhi_ps(rg01, rg23);
+            __m256 blue = _mm256_unpacklo_ps(ba01, ba23);
+
+            __m256 nits = ClampPositive(Dot3(LUMINANCE, red, green, blue));
+            __m256 r2020 = Dot3(TO_BT2020.m[0], red, green, blue);
+            __m256 g2020 = Dot3(TO_BT2020.m[1], red, green, blue);
+            __m256 b2020 = Dot3(TO_BT2020.m[2], red, green, blue);
+            __m256 x = Dot3(TO_XYZ.m[0], r2020, g2020, b2020);
+            __m256 y = Dot3(TO_XYZ.m[1], r2020, g2020, b2020);
+            __m256 z = Dot3(TO_XYZ.m[2], r2020, g2020, b2020);
+
+            __m256 sum = _mm256_add_ps(_mm256_add_ps(x, y), z);
+            __m256 shown = _mm256_and_ps(_mm256_cmp_ps(nits, minNits, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(sum, _mm256_setzero_ps(), _CMP_GT_OQ));
+            __m256 scale = _mm256_div_ps(size, sum);
+            alignas(32) float cellX[8];
+            alignas(32) float cellY[8];
+            _mm256_store_ps(cellX, _mm256_blendv_ps(outside, _mm256_mul_ps(x, scale), shown));
+            _mm256_store_ps(cellY, _mm256_blendv_ps(outside, _mm256_mul_ps(y, scale), shown));
+            _mm256_storeu_ps(out.nits.data() + i, nits);
+
+            uint32_t indices[4][8];
+            StoreIndices(nits, indices[0]);
+            StoreIndices(ClampPositive(r2020), indices[1]);
+            StoreIndices(ClampPositive(g2020), indices[2]);
+            StoreIndices(ClampPositive(b2020), indices[3]);
+            for (int lane = 0; lane < 8; ++lane)
+            {
+                for (int c = 0; c < 4; ++c)
+                    out.codes[c][i + lane] = table[indices[c][lane]];
+                out.vectorCells[i + lane] = VectorCell(cellX[lane], cellY[lane], vectorscopeSize);
+            }
+        }
+        return i;
+    }
+#endif
+
+    void ConvertScRgb(const uint64_t* row, const int* positions, int count, const uint16_t* table,
+                      int vectorscopeSize, Converted& out)
+    {
+        int done = 0;
+#ifdef SCOPES_F16C
+        if (HAS_F16C)
+            done = ConvertScRgbF16c(row, positions, count, table, vectorscopeSize, out);
+#endif
+        ConvertScRgbScalar(row, positions, done, count, table, vectorscopeSize, out);
+    }
+
+    void ConvertPq(const uint32_t* row, const int* positions, int count, const uint16_t* table, const float* decoded,
+                   int vectorscopeSize, Converted& out)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            uint32_t pixel = row[positions[i]];
+            float bt2020[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                uint16_t code = static_cast<uint16_t>((pixel >> (10 * c)) & 1023);
+                out.codes[c + 1][i] = code;
+                bt2020[c] = decoded[code];
+            }
+            float xyz[3];
+            for (int r = 0; r < 3; ++r)
+                xyz[r] = TO_XYZ.m[r][0] * bt2020[0] + TO_XYZ.m[r][1] * bt2020[1] + TO_XYZ.m[r][2] * bt2020[2];
+
+            float nits = Bt2020Luminance(bt2020[0], bt2020[1], bt2020[2]);
+            out.nits[i] = nits;
+            out.codes[0][i] = table[CodeIndex(nits)];
+
+            float sum = xyz[0] + xyz[1] + xyz[2];
+            float scale = vectorscopeSize / (sum * VECTORSCOPE_RANGE);
+            bool shown = nits >= VECTORSCOPE_MIN_NITS && sum > 0.0f;
+            out.vectorCells[i] = shown ? VectorCell(xyz[0] * scale, xyz[1] * scale, vectorscopeSize) : -1;
+        }
+    }
+
+    // Evenly spread pixel centers along one axis, or every pixel when count is 0 or the length
+    std::vector<int> SamplePositions(int length, int count)
+    {
+        int samples = count > 0 ? std::min(count, length) : length;
+        std::vector<int> positions(samples);
+        for (int i = 0; i < samples; ++i)
+            positions[i] = static_cast<int>((2 * static_cast<int64_t>(i) + 1) * length / (2 * samples));
+        return positions;
+    }
+
+    // Waveform and parade columns of each sampled column
+    struct SampleColumns
+    {
+        std::vector<int> positions;
+        std::vector<int> columns;
+        std::vector<int> paradeColumns;
+    };
+
+    SampleColumns BuildSampleColumns(int width, const ScopeSettings& settings)
+    {
+        SampleColumns sampled;
+        sampled.positions = SamplePositions(width, settings.sampleColumns);
+        for (int x : sampled.positions)
+        {
+            sampled.columns.push_back(static_cast<int>(static_cast<int64_t>(x) * settings.columns / width));
+            sampled.paradeColumns.push_back(static_cast<int>(static_cast<int64_t>(x) * settings.paradeColumns / width));
+        }
+        return sampled;
+    }
+
+    void ClearScopes(const ScopeSettings& settings, Scopes& scopes)
+    {
+        scopes.settings = settings;
+        scopes.waveform.assign(static_cast<size_t>(settings.levels) * settings.columns, 0);
+        scopes.parade.assign(static_cast<size_t>(3) * settings.levels * settings.paradeColumns, 0);
+        scopes.histogram.assign(SCOPE_PQ_CODES, 0);
+        scopes.vectorscope.assign(static_cast<size_t>(settings.vectorscopeSize) * settings.vectorscopeSize, 0);
+        scopes.pixels = 0;
+        scopes.peakNits = 0.0f;
+        scopes.averageNits = 0.0;
+    }
+
+    void BinRow(const Converted& converted, const SampleColumns& sampled, Scopes& scopes, double& nitsSum)
+    {
+        const ScopeSettings& settings = scopes.settings;
+        size_t channelSize = static_cast<size_t>(settings.levels) * settings.paradeColumns;
+        float peak = scopes.peakNits;
+        for (size_t i = 0; i < sampled.positions.size(); ++i)
+        {
+            uint16_t luma = converted.codes[0][i];
+            int level = luma * settings.levels / SCOPE_PQ_CODES;
+            ++scopes.waveform[static_cast<size_t>(level) * settings.columns + sampled.columns[i]];
+            for (int c = 0; c < 3; ++c)
+            {
+                int channelLevel = converted.codes[c + 1][i] * settings.levels / SCOPE_PQ_CODES;
+                ++scopes.parade[c * channelSize + static_cast<size_t>(channelLevel) * settings.paradeColumns +
+                                sampled.paradeColumns[i]];
+            }
+            ++scopes.histogram[luma];
+            if (converted.vectorCells[i] >= 0)
+                ++scopes.vectorscope[converted.vectorCells[i]];
+            nitsSum += converted.nits[i];
+            peak = std::max(peak, converted.nits[i]);
+        }
+        scopes.peakNits = peak;
+        scopes.pixels += sampled.positions.size();
+    }
+
+    void Accumulate(std::vector<uint32_t>& total, const std::vector<uint32_t>& part)
+    {
+        for (size_t i = 0; i < total.size(); ++i)
+            total[i] += part[i];
+    }
+
+    // Brightness of a cell holding count pixels out of the fullest one's most, on a log scale
+    // so a few stray pixels still show
+    ScRgb CellColor(uint32_t count, uint32_t most, const ScRgb& tint)
+    {
+        float level = 0.2f + 0.8f * std::log1p(static_cast<float>(count)) / std::log1p(static_cast<float>(most));
+        float scale = level * OVERLAY_NITS / SCRGB_WHITE_NITS;
+        return { tint.r * scale, tint.g * scale, tint.b * scale };
+    }
+
+    void AddRect(Pattern& pattern, int left, int top, int right, int bottom, const ScRgb& color)
+    {
+        PatternRect rect;
+        rect.rect.left = left;
+        rect.rect.top = top;
+        rect.rect.right = right;
+        rect.rect.bottom = bottom;
+        rect.color = color;
+        pattern.rects.push_back(rect);
+    }
+
+    // A columns x levels grid of counts, row 0 at the bottom, with its graticule
+    void AddGrid(Pattern& pattern, const uint32_t* counts, int columns, int levels, int left, int bottom, int cell,
+                 const ScRgb& tint)
+    {
+        ScRgb line = GreyFromNits(GRATICULE_NITS);
+        for (float nits : GRATICULE_LEVELS)
+        {
+            int y = bottom - static_cast<int>(PqEncode(nits) * levels * cell);
+            AddRect(pattern, left, y, left + columns * cell, y + 1, line);
+        }
+
+        uint32_t most = *std::max_element(counts, counts + static_cast<size_t>(columns) * levels);
+        if (most == 0)
+            return;
+        for (int level = 0; level < levels; ++level)
+        {
+            for (int column = 0; column < columns; ++column)
+            {
+                uint32_t count = counts[static_cast<size_t>(level) * columns + column];
+                if (count == 0)
+                    continue;
+                int x = left + column * cell;
+                int y = bottom - (level + 1) * cell;
+                AddRect(pattern, x, y, x + cell, y + cell, CellColor(count, most, tint));
+            }
+        }
+    }
+}
+
+bool ComputeScopes(const FrameBuffer& frame, const ScopeSettings& settings, Scopes& scopes, unsigned threadCount)
+{
+    if (settings.columns < 1 || settings.paradeColumns < 1 || settings.levels < 1 || settings.vectorscopeSize < 1 ||
+        settings.sampleColumns < 0 || settings.sampleRows < 0)
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+    ClearScopes(settings, scopes);
+    if (frame.width <= 0 || frame.height <= 0)
+        return true;
+
+    const uint16_t* codes = CodeTable().data();
+    const float* decoded = DecodeTable().data();
+    SampleColumns sampled = BuildSampleColumns(frame.width, settings);
+    std::vector<int> rows = SamplePositions(frame.height, settings.sampleRows);
+    const int* positions = sampled.positions.data();
+    int count = static_cast<int>(sampled.positions.size());
+
+    int bands = (static_cast<int>(rows.size()) + BAND_ROWS - 1) / BAND_ROWS;
+    threadCount = threadCount ? threadCount : std::thread::hardware_concurrency();
+    threadCount = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(bands)));
+
+    // Each thread reduces into its own scopes; the first is the result itself
+    std::vector<Scopes> partials(threadCount - 1);
+    for (Scopes& partial : partials)
+        ClearScopes(settings, partial);
+    std::vector<double> nitsSums(threadCount, 0.0);
+
+    std::atomic<int> next(0);
+    auto worker = [&](unsigned index)
+    {
+        Scopes& target = index == 0 ? scopes : partials[index - 1];
+        Converted converted;
+        converted.Resize(sampled.positions.size());
+        for (int band = next++; band < bands; band = next++)
+        {
+            size_t bottom = std::min(rows.size(), static_cast<size_t>(band + 1) * BAND_ROWS);
+            for (size_t r = static_cast<size_t>(band) * BAND_ROWS; r < bottom; ++r)
+            {
+                size_t offset = static_cast<size_t>(rows[r]) * frame.width;
+                if (frame.encoding == FrameEncoding::ScRgbHalf)
+                    ConvertScRgb(reinterpret_cast<const uint64_t*>(frame.data.data()) + offset, positions, count, codes,
+                                 settings.vectorscopeSize, converted);
+                else
+                    ConvertPq(frame.Packed() + offset, positions, count, codes, decoded, settings.vectorscopeSize,
+                              converted);
+                BinRow(converted, sampled, target, nitsSums[index]);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    double nitsSum = nitsSums[0];
+    for (size_t i = 0; i < partials.size(); ++i)
+    {
+        const Scopes& partial = partials[i];
+        Accumulate(scopes.waveform, partial.waveform);
+        Accumulate(scopes.parade, partial.parade);
+        Accumulate(scopes.histogram, partial.histogram);
+        Accumulate(scopes.vectorscope, partial.vectorscope);
+        scopes.pixels += partial.pixels;
+        scopes.peakNits = std::max(scopes.peakNits, partial.peakNits);
+        nitsSum += nitsSums[i + 1];
+    }
+    scopes.averageNits = scopes.pixels ? nitsSum / static_cast<double>(scopes.pixels) : 0.0;
+    scopes.computeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool ScopesVectorized()
+{
+#ifdef SCOPES_F16C
+    return HAS_F16C;
+#else
+    return false;
+#endif
+}
+
+std::string FormatScopes(const Scopes& scopes)
+{
+    // Code below which 99% of the pixels fall, from the histogram
+    int percentile = 0;
+    uint64_t below = 0;
+    for (int code = 0; code < static_cast<int>(scopes.histogram.size()); ++code)
+    {
+        below += scopes.histogram[code];
+        percentile = code;
+        if (below * 100 >= scopes.pixels * 99)
+            break;
+    }
+
+    char text[160];
+    std::snprintf(text, sizeof(text), "scopes: peak %.1f nits (PQ %ld), average %.2f nits, 99%% below PQ %d, %.2f ms\n",
+                  scopes.peakNits, std::lround(PqEncode(scopes.peakNits) * 1023.0f), scopes.averageNits, percentile,
+                  scopes.computeMs);
+    return text;
+}
+
+void AddScopeOverlay(const Scopes& scopes, int width, int height, Pattern& pattern)
+{
+    const ScopeSettings& settings = scopes.settings;
+    if (scopes.waveform.empty() || width <= 0 || height <= 0)
+        return;
+
+    int cell = std::max(1, height / 540);
+    int margin = OVERLAY_MARGIN_CELLS * cell;
+    int panelHeight = settings.levels * cell;
+    int bottom = height - margin;
+    int histogramBars = settings.columns;
+    int panelsWidth = (settings.columns + 3 * settings.paradeColumns + histogramBars + settings.vectorscopeSize) * cell +
+                      3 * margin;
+    int top = bottom - std::max(panelHeight, settings.vectorscopeSize * cell);
+    AddRect(pattern, 0, top - margin, std::min(width, panelsWidth + 2 * margin), height,
+            GreyFromNits(OVERLAY_BACKGROUND_NITS));
+
+    const ScRgb WHITE = { 1.0f, 1.0f, 1.0f };
+    const ScRgb CHANNELS[3] = { { 1.0f, 0.15f, 0.15f }, { 0.15f, 1.0f, 0.15f }, { 0.3f, 0.3f, 1.0f } };
+
+    int left = margin;
+    AddGrid(pattern, scopes.waveform.data(), settings.columns, settings.levels, left, bottom, cell, WHITE);
+    left += settings.columns * cell + margin;
+
+    size_t channelSize = static_cast<size_t>(settings.levels) * settings.paradeColumns;
+    for (int c = 0; c < 3; ++c)
+    {
+        AddGrid(pattern, scopes.parade.data() + c * channelSize, settings.paradeColumns, settings.levels, left, bottom,
+                cell, CHANNELS[c]);
+        left += settings.paradeColumns * cell;
+    }
+    left += margin;
+
+    // Histogram bars over runs of PQ codes, heights on a log scale
+    std::vector<uint32_t> bars(histogramBars, 0);
+    for (int code = 0; code < SCOPE_PQ_CODES; ++code)
+        bars[code * histogramBars / SCOPE_PQ_CODES] += scopes.histogram[code];
+    uint32_t most = *std::max_element(bars.begin(), bars.end());
+    for (int bar = 0; bar < histogramBars && most > 0; ++bar)
+    {
+        if (bars[bar] == 0)
+            continue;
+        int barHeight = std::max(1, static_cast<int>(panelHeight * std::log1p(static_cast<float>(bars[bar])) /
+                                                     std::log1p(static_cast<float>(most))));
+        AddRect(pattern, left + bar * cell, bottom - barHeight, left + (bar + 1) * cell, bottom,
+                CellColor(bars[bar], most, WHITE));
+    }
+    left += histogramBars * cell + margin;
+
+    // Vectorscope with the BT.709 and BT.2020 primaries marked
+    const float PRIMARIES[6][2] = { { 0.640f, 0.330f }, { 0.300f, 0.600f }, { 0.150f, 0.060f },
+                                    { 0.708f, 0.292f }, { 0.170f, 0.797f }, { 0.131f, 0.046f } };
+    int size = settings.vectorscopeSize;
+    for (const auto& primary : PRIMARIES)
+    {
+        int x = left + static_cast<int>(primary[0] / VECTORSCOPE_RANGE * size * cell);
+        int y = bottom - static_cast<int>(primary[1] / VECTORSCOPE_RANGE * size * cell);
+        AddRect(pattern, x - cell, y - cell, x + cell, y + cell, GreyFromNits(GRATICULE_NITS));
+    }
+    most = *std::max_element(scopes.vectorscope.begin(), scopes.vectorscope.end());
+    for (int y = 0; y < size && most > 0; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            uint32_t count = scopes.vectorscope[static_cast<size_t>(y) * size + x];
+            if (count == 0)
+                continue;
+            int cellLeft = left + x * cell;
+            int cellTop = bottom - (y + 1) * cell;
+            AddRect(pattern, cellLeft, cellTop, cellLeft + cell, cellTop + cell, CellColor(count, most, WHITE));
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "FrameBuffer.h"
+#include "Pattern.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// PQ code values are 10 bit, as HDR10 sends them
+const int SCOPE_PQ_CODES = 1024;
+
+// How finely the scopes are binned; the overlay draws one cell per bin
+struct ScopeSettings
+{
+    int columns = 128;        // waveform columns across the frame
+    int paradeColumns = 64;   // per channel
+    int levels = 64;          // waveform and parade rows from PQ code 0 to 1023
+    int vectorscopeSize = 64; // cells across CIE x and y from 0 to VECTORSCOPE_RANGE
+    int sampleColumns = 512;  // pixels binned per row, evenly spread; 0 bins every one
+    int sampleRows = 288;     // rows binned, evenly spread; 0 bins every one
+};
+
+const float VECTORSCOPE_RANGE = 0.85f;
+
+// Broadcast style scopes of one frame, as pixel counts. Levels are PQ code values of the HDR10
+// signal: of luminance for the waveform and histogram, and of BT.2020 red, green and blue for the
+// parade, so an scRGB frame reads as the display receives it.
+struct Scopes
+{
+    ScopeSettings settings;
+    std::vector<uint32_t> waveform;    // levels x columns, row 0 at code 0
+    std::vector<uint32_t> parade;      // red, green, then blue, each levels x paradeColumns
+    std::vector<uint32_t> histogram;   // luminance, one bin per PQ code
+    std::vector<uint32_t> vectorscope; // size x size over CIE xy, row 0 at y = 0; black is left out
+    uint64_t pixels = 0;               // sampled pixels, which every count above adds up to
+    float peakNits = 0.0f;
+    double averageNits = 0.0;
+    double computeMs = 0.0;
+};
+
+// Bins a fixed grid of sampleColumns x sampleRows pixels of an FP16 scRGB or HDR10 PQ frame, a few
+// per overlay cell, so the cost does not grow with the frame. Bands of sampled rows are reduced on
+// threadCount threads (0 is one per hardware thread), each into scopes of its own, which are then
+// summed. FP16 pixels are converted eight at a time with F16C and AVX where the CPU has them.
+bool ComputeScopes(const FrameBuffer& frame, const ScopeSettings& settings, Scopes& scopes,
+                   unsigned threadCount = 0);
+
+// True when FP16 frames take the F16C path
+bool ScopesVectorized();
+
+// "scopes: peak 800 nits (PQ 753), average 41.2 nits, 99% below PQ 621, 1.52 ms"
+std::string FormatScopes(const Scopes& scopes);
+
+// Draws the scopes into the bottom left corner of a width x height screen as a dim panel of rects:
+// waveform, parade, histogram and vectorscope, cells brighter the more pixels they hold, over
+// graticule lines at 1, 10, 100 and 1000 nits. Drawn over the pattern, so it adds to the average
+// picture level.
+void AddScopeOverlay(const Scopes& scopes, int width, int height, Pattern& pattern);
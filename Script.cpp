@@ -0,0 +1,801 @@
+#include "Script.h"
+#include "Layout.h"
+#include "MeasurementReport.h"
+#include "PatchSet.h"
+#include "Pattern.h"
+#include "Session.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    const double KEY_PRESS_MS = 50.0; // a press and a release, well short of the auto-repeat delay
+    const float DEFAULT_FLICKER_RATE = 20000.0f;
+    const float DEFAULT_FLICKER_SAMPLES = 16384.0f;
+    const float DEFAULT_REFERENCE_NITS = 100.0f;
+    const float DRIFT_TOLERANCE = 0.005f; // drift a settled panel may still have
+    const float SETTLE_TOLERANCE = 0.01f;
+    const float APL_PER_PATCH_SET = -1.0f; // apl without a level
+    const size_t MAX_LEARNED_PATCHES = 1024; // measurements one learn command may take
+
+    struct CommandSyntax
+    {
+        const char* name;
+        ScriptOp op;
+        int words;            // words before the numbers
+        int optionalWords;    // how many of those may be left out
+        int numbers;          // numeric arguments
+        int optionalNumbers;
+        const char* usage;
+    };
+
+    const CommandSyntax COMMANDS[] = {
+        { "panel",   ScriptOp::Panel,   1, 0, 1, 0, "panel <setting> <value>" },
+        { "size",    ScriptOp::Size,    0, 0, 2, 0, "size <width> <height>" },
+        { "probe",   ScriptOp::Probe,   0, 0, 2, 0, "probe <x> <y>" },
+        { "mode",    ScriptOp::Mode,    1, 0, 0, 0, "mode <key>" },
+        { "level",   ScriptOp::Level,   0, 0, 1, 0, "level <nits>" },
+        { "step",    ScriptOp::Step,    0, 0, 1, 0, "step <presses>" },
+        { "toggle",  ScriptOp::Toggle,  0, 0, 0, 0, "toggle" },
+        { "wait",    ScriptOp::Wait,    0, 0, 1, 0, "wait <ms>" },
+        { "read",    ScriptOp::Read,    1, 1, 0, 0, "read [label]" },
+        { "expect",  ScriptOp::Expect,  0, 0, 2, 0, "expect <min nits> <max nits>" },
+        { "flicker", ScriptOp::Flicker, 0, 0, 2, 2, "flicker [sample rate] [samples]" },
+        { "patches", ScriptOp::Patches, 2, 0, 1, 1, "patches <patch set> <session file> [settle ms]" },
+        { "learn",   ScriptOp::Learn,   2, 0, 2, 1, "learn <patch set> <session file> <max delta E> [settle ms]" },
+        { "drift",   ScriptOp::Drift,   0, 0, 2, 1, "drift <every n patches> [reference nits]" },
+        { "apl",     ScriptOp::Apl,     0, 0, 1, 1, "apl [nits]" },
+        { "detect",  ScriptOp::Detect,  1, 1, 0, 0, "detect [mode]" },
+        { "export",  ScriptOp::Export,  1, 0, 0, 0, "export <path>" },
+    };
+
+    // Panel settings a script may change, by name
+    float* PanelSetting(PanelModel& panel, const std::string& name)
+    {
+        if (name == "peak10")    return &panel.peak10;
+        if (name == "fullfield") return &panel.fullField;
+        if (name == "black")     return &panel.black;
+        if (name == "gain")      return &panel.gain;
+        if (name == "pwm")       return &panel.pwmHz;
+        if (name == "duty")      return &panel.pwmDuty;
+        if (name == "settle")    return &panel.settleMs;
+        if (name == "limiter")   return &panel.limiterMs;
+        if (name == "vignette")  return &panel.vignette;
+        if (name == "warmup")    return &panel.warmup;
+        if (name == "warmupmin") return &panel.warmupMinutes;
+        return nullptr;
+    }
+
+    // Check a parsed command beyond its syntax; empty when it is fine
+    std::string CheckCommand(ScriptCommand& command)
+    {
+        PanelModel panel;
+        switch (command.op)
+        {
+        case ScriptOp::Panel:
+            if (!PanelSetting(panel, command.text))
+                return "unknown panel setting " + command.text;
+            if (command.values[0] < 0.0f)
+                return "panel settings cannot be negative";
+            break;
+        case ScriptOp::Size:
+            if (command.values[0] < 1.0f || command.values[1] < 1.0f)
+                return "size must be at least 1x1";
+            break;
+        case ScriptOp::Probe:
+            if (command.values[0] < 0.0f || command.values[0] > 1.0f || command.values[1] < 0.0f ||
+                command.values[1] > 1.0f)
+                return "probe position is a share of the screen, 0 to 1";
+            break;
+        case ScriptOp::Mode:
+            if (!FindMode(command.text, command.mode))
+                return "unknown mode " + command.text;
+            break;
+        case ScriptOp::Detect:
+        {
+            LevelEdge edge;
+            if (command.text.empty())
+                break;
+            if (!FindMode(command.text, command.mode))
+                return "unknown mode " + command.text;
+            if (!GetLevelEdge(command.mode, edge))
+                return "mode " + command.text + " has no clip or crush point to detect";
+            break;
+        }
+        case ScriptOp::Level:
+        case ScriptOp::Wait:
+        case ScriptOp::Patches:
+            if (command.values[0] < 0.0f)
+                return "value cannot be negative";
+            break;
+        case ScriptOp::Learn:
+            if (command.values[0] <= 0.0f || command.values[1] < 0.0f)
+                return "learn needs a positive Delta E and a settle time of 0 or more";
+            break;
+        case ScriptOp::Expect:
+            if (command.values[0] > command.values[1])
+                return "minimum is above maximum";
+            break;
+        case ScriptOp::Flicker:
+            if (command.values[0] <= 0.0f || command.values[1] < 2.0f)
+                return "flicker needs a positive sample rate and at least 2 samples";
+            break;
+        case ScriptOp::Apl:
+            if (command.values[0] < 0.0f && command.values[0] != APL_PER_PATCH_SET)
+                return "apl level cannot be negative";
+            break;
+        case ScriptOp::Drift:
+            if (command.values[0] < 0.0f || command.values[1] <= 0.0f)
+                return "drift needs a patch count of 0 or more and a positive reference level";
+            break;
+        default:
+            break;
+        }
+        return std::string();
+    }
+
+    // Where learn writes the whole set, measured and predicted: session.csv becomes session-predicted.csv
+    std::string PredictedPath(const std::string& sessionPath)
+    {
+        size_t dot = sessionPath.find_last_of('.');
+        size_t separator = sessionPath.find_last_of("/\\");
+        if (dot == std::string::npos || (separator != std::string::npos && dot < separator))
+            return sessionPath + "-predicted";
+        return sessionPath.substr(0, dot) + "-predicted" + sessionPath.substr(dot);
+    }
+
+    // Press and release one button, the way a held key would reach the session
+    void PressButton(CalibrationSession& session, bool InputFrame::*button, double& clockMs)
+    {
+        InputFrame input;
+        input.*button = true;
+        session.ApplyInput(input, static_cast<uint32_t>(clockMs));
+        clockMs += KEY_PRESS_MS;
+        session.ApplyInput(InputFrame(), static_cast<uint32_t>(clockMs));
+    }
+}
+
+bool Script::Parse(const std::string& text, std::string& error)
+{
+    m_commands.clear();
+
+    std::istringstream lines(text);
+    std::string line;
+    for (int lineNumber = 1; std::getline(lines, line); ++lineNumber)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name))
+            continue;
+
+        auto syntax = std::find_if(std::begin(COMMANDS), std::end(COMMANDS),
+                                   [&](const CommandSyntax& entry) { return name == entry.name; });
+        if (syntax == std::end(COMMANDS))
+        {
+            error = "line " + std::to_string(lineNumber) + ": unknown command " + name;
+            return false;
+        }
+
+        ScriptCommand command;
+        command.op = syntax->op;
+        command.line = lineNumber;
+        if (command.op == ScriptOp::Flicker)
+        {
+            command.values[0] = DEFAULT_FLICKER_RATE;
+            command.values[1] = DEFAULT_FLICKER_SAMPLES;
+        }
+        else if (command.op == ScriptOp::Drift)
+        {
+            command.values[1] = DEFAULT_REFERENCE_NITS;
+        }
+        else if (command.op == ScriptOp::Apl)
+        {
+            command.values[0] = APL_PER_PATCH_SET;
+        }
+
+        std::string* words[] = { &command.text, &command.output };
+        int wordCount = 0;
+        while (wordCount < syntax->words && fields >> *words[wordCount])
+            ++wordCount;
+        bool valid = wordCount >= syntax->words - syntax->optionalWords;
+        int parsed = 0;
+        float value = 0.0f;
+        while (valid && parsed < syntax->numbers && fields >> value)
+            command.values[parsed++] = value;
+        // A failed read before the end of the line was not a number; a clean finish may still leave words
+        std::string extra;
+        bool leftover = fields.fail() ? !fields.eof() : static_cast<bool>(fields >> extra);
+        valid = valid && parsed >= syntax->numbers - syntax->optionalNumbers && !leftover;
+        if (!valid)
+        {
+            error = "line " + std::to_string(lineNumber) + ": expected " + syntax->usage;
+            return false;
+        }
+
+        std::string problem = CheckCommand(command);
+        if (!problem.empty())
+        {
+            error = "line " + std::to_string(lineNumber) + ": " + problem;
+            return false;
+        }
+        m_commands.push_back(command);
+    }
+    return true;
+}
+
+bool Script::Load(const std::string& path, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return Parse(text.str(), error);
+}
+
+ScriptResult RunScriptHeadless(const std::string& name, const Script& script, const ScriptRunOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+
+    ScriptResult result;
+    result.name = name;
+
+    // A session of its own and no store, so scripts never see each other or the saved state
+    CalibrationSession session;
+    PanelModel panel = options.panel;
+    DisplaySimulator display(panel);
+    double clockMs = 0.0;
+    MeterEmulator meter(display, clockMs, options.meter);
+
+    int width = options.width;
+    int height = options.height;
+    PatternLayout layout = ComputePatternLayout(width, height, 1.0f);
+
+    // Every new frame, with how long the light at the probe takes to settle after it
+    double settleTotalMs = 0.0;
+    auto present = [&](const Pattern& pattern)
+    {
+        display.Show(pattern, width, height, clockMs);
+        double settleMs = display.SettleTimeMs(SETTLE_TOLERANCE);
+        settleTotalMs += settleMs;
+        result.settleMaxMs = std::max(result.settleMaxMs, settleMs);
+        ++result.frames;
+    };
+
+    // Average picture level held by the surround: 0 is off, negative is per patch set
+    float aplNits = 0.0f;
+    auto show = [&]()
+    {
+        Pattern pattern = BuildCalibrationPattern(session.View(), layout);
+        if (aplNits > 0.0f)
+            FillSurround(pattern, width, height, aplNits, panel.peak10);
+        present(pattern);
+    };
+    show();
+
+    FlickerOptions flickerOptions;
+    flickerOptions.threadCount = 1; // scripts already run in parallel
+
+    // Warm-up compensation: a reference patch every referenceEvery patches, off while 0.
+    // References measured somewhere else, or on a changed panel, start a new drift segment.
+    DriftModel drift;
+    size_t referenceEvery = 0;
+    float referenceNits = DEFAULT_REFERENCE_NITS;
+    const double midReadMs = options.meter.integrationMs / 2.0;
+
+    // Measurement buffers of one patches or learn command, freed all at once when the next one starts
+    Arena sessionArena("session arena");
+
+    result.ok = true;
+    for (const ScriptCommand& command : script.Commands())
+    {
+        switch (command.op)
+        {
+        case ScriptOp::Panel:
+            *PanelSetting(panel, command.text) = command.values[0];
+            display.SetModel(panel);
+            drift.NewSegment();
+            show();
+            break;
+
+        case ScriptOp::Size:
+            width = static_cast<int>(command.values[0]);
+            height = static_cast<int>(command.values[1]);
+            layout = ComputePatternLayout(width, height, 1.0f);
+            drift.NewSegment();
+            show();
+            break;
+
+        case ScriptOp::Probe:
+            display.SetProbe(command.values[0], command.values[1]);
+            drift.NewSegment();
+            show();
+            break;
+
+        case ScriptOp::Mode:
+            session.SetMode(command.mode);
+            show();
+            break;
+
+        case ScriptOp::Level:
+            session.SetCurrentBrightness(std::min(command.values[0], session.GetMaxBrightness()));
+            show();
+            break;
+
+        case ScriptOp::Step:
+        {
+            int presses = static_cast<int>(command.values[0]);
+            for (int i = 0; i < std::abs(presses); ++i)
+                PressButton(session, presses > 0 ? &InputFrame::right : &InputFrame::left, clockMs);
+            show();
+            break;
+        }
+
+        case ScriptOp::Toggle:
+            PressButton(session, &InputFrame::toggle, clockMs);
+            show();
+            break;
+
+        case ScriptOp::Wait:
+            clockMs += command.values[0];
+            break;
+
+        case ScriptOp::Read:
+        {
+            ScriptReading reading;
+            reading.label = command.text;
+            SessionView view = session.View();
+            reading.mode = view.mode;
+            reading.level = view.brightness;
+            if (!meter.Read(reading.measurement))
+            {
+                result.ok = false;
+                result.error = "meter read failed";
+            }
+            reading.timeMs = clockMs;
+            if (referenceEvery > 0 && drift.Fit().valid)
+            {
+                reading.measurement.luminance *= drift.Correction(clockMs - midReadMs);
+                ++result.drift.corrected;
+            }
+            result.readings.push_back(reading);
+            break;
+        }
+
+        case ScriptOp::Expect:
+        {
+            if (result.readings.empty())
+            {
+                result.ok = false;
+                result.error = "expect needs a reading before it";
+                break;
+            }
+            float luminance = result.readings.back().measurement.luminance;
+            if (luminance < command.values[0] || luminance > command.values[1])
+            {
+                char message[128];
+                std::snprintf(message, sizeof(message), "read %g nits, expected %g to %g", luminance,
+                              command.values[0], command.values[1]);
+                result.ok = false;
+                result.error = message;
+            }
+            break;
+        }
+
+        case ScriptOp::Flicker:
+        {
+            std::vector<FlickerCapture> captures(1);
+            captures[0].level = session.GetCurrentBrightness();
+            if (!meter.Capture(command.values[0], static_cast<size_t>(command.values[1]), captures[0]))
+            {
+                result.ok = false;
+                result.error = "flicker capture failed";
+                break;
+            }
+            result.flicker.push_back(AnalyzeFlicker(captures, flickerOptions)[0]);
+            break;
+        }
+
+        case ScriptOp::Patches:
+        case ScriptOp::Learn:
+        {
+            bool learning = command.op == ScriptOp::Learn;
+            float settleMs = learning ? command.values[1] : command.values[0];
+            sessionArena.Reset();
+            PatchSet patches;
+            MeasurementWriter writer;
+            if (!LoadPatchSet(command.text, patches))
+            {
+                result.ok = false;
+                result.error = "cannot read patch set " + command.text;
+                break;
+            }
+            if (!writer.Open(command.output))
+            {
+                result.ok = false;
+                result.error = "cannot write " + command.output;
+                break;
+            }
+
+            // Every patch goes in the 10% window, moved so it sits under the meter
+            PatternLayout patchLayout = layout;
+            PixelRect& window = patchLayout.window;
+            int shiftX = static_cast<int>(display.ProbeX() * width) - (window.left + window.right) / 2;
+            int shiftY = static_cast<int>(display.ProbeY() * height) - (window.top + window.bottom) / 2;
+            window = PixelRect{ window.left + shiftX, window.top + shiftY, window.right + shiftX,
+                                window.bottom + shiftY };
+
+            // With drift compensation, patches are held until the closing reference and corrected by
+            // the fit to every reference, on both sides of them; early fits see too little of the curve
+            PatchSet reference;
+            reference.Push(referenceNits, referenceNits, referenceNits);
+            std::pmr::vector<PatchMeasurement> pending(&sessionArena);
+            std::pmr::vector<double> pendingMs(&sessionArena);
+            pending.reserve(referenceEvery > 0 ? patches.Size() : 0);
+            pendingMs.reserve(pending.capacity());
+
+            // Without a level of its own, the surround holds the set at its brightest pattern's average
+            Pattern pattern;
+            float surroundNits = aplNits;
+            if (aplNits == APL_PER_PATCH_SET)
+            {
+                BuildPatchPattern(reference, 0, patchLayout, pattern);
+                surroundNits = referenceEvery > 0 ? PatternAverageNits(pattern, width, height, panel.peak10) : 0.0f;
+                for (size_t i = 0; i < patches.Size(); ++i)
+                {
+                    BuildPatchPattern(patches, i, patchLayout, pattern);
+                    surroundNits = std::max(surroundNits, PatternAverageNits(pattern, width, height, panel.peak10));
+                }
+            }
+            // Not through FramePrefetcher: the simulator reads the pattern, not rendered pixels, so
+            // there is no frame to render ahead. --play presents prefetched frames.
+            auto showPatch = [&](const PatchSet& set, size_t index)
+            {
+                BuildPatchPattern(set, index, patchLayout, pattern);
+                if (surroundNits > 0.0f)
+                    FillSurround(pattern, width, height, surroundNits, panel.peak10);
+                present(pattern);
+            };
+
+            auto measureReference = [&]()
+            {
+                double shownMs = clockMs;
+                if (result.drift.references == 0)
+                    result.drift.firstReadingMs = shownMs;
+                showPatch(reference, 0);
+                clockMs += settleMs;
+
+                Measurement measured;
+                if (!meter.Read(measured))
+                    return false;
+                drift.AddReference(clockMs - midReadMs, measured.luminance);
+                ++result.drift.references;
+                result.drift.referenceMs += clockMs - shownMs;
+                return true;
+            };
+
+            // learn measures the patch the model is least sure of until it predicts the rest well enough
+            ActiveSampler sampler;
+            std::pmr::vector<PatchMeasurement> measured(&sessionArena);
+            if (learning)
+            {
+                sampler.Reset(patches, MAX_LEARNED_PATCHES);
+                measured.reserve(std::min(patches.Size(), MAX_LEARNED_PATCHES));
+            }
+
+            PatchMeasurement measurement;
+            measurement.screenX = display.ProbeX();
+            measurement.screenY = display.ProbeY();
+            size_t count = 0;
+            for (; count < patches.Size() && result.ok; ++count)
+            {
+                size_t i = count;
+                if (learning)
+                {
+                    i = sampler.Next();
+                    if (i == patches.Size() || sampler.WorstError() <= command.values[0])
+                        break;
+                }
+                if (referenceEvery > 0 && count % referenceEvery == 0)
+                    result.ok = measureReference();
+
+                showPatch(patches, i);
+                clockMs += settleMs;
+
+                measurement.index = static_cast<uint32_t>(i);
+                measurement.target[0] = patches.r[i];
+                measurement.target[1] = patches.g[i];
+                measurement.target[2] = patches.b[i];
+                result.ok = result.ok && meter.Read(measurement.measured);
+                if (learning && result.ok)
+                {
+                    // The model learns from readings corrected by the drift fit so far; files get the final fit
+                    Measurement reading = measurement.measured;
+                    if (referenceEvery > 0)
+                        reading.luminance *= drift.Correction(clockMs - midReadMs);
+                    Clock::time_point updateStart = Clock::now();
+                    sampler.Add(i, reading);
+                    result.active.slowestUpdateMs = std::max(result.active.slowestUpdateMs,
+                        std::chrono::duration<double, std::milli>(Clock::now() - updateStart).count());
+                }
+                if (referenceEvery == 0)
+                {
+                    writer.Write(measurement);
+                    if (learning)
+                        measured.push_back(measurement);
+                    continue;
+                }
+                pending.push_back(measurement);
+                pendingMs.push_back(clockMs - midReadMs);
+            }
+            if (referenceEvery > 0 && result.ok)
+                result.ok = measureReference();
+            for (size_t i = 0; i < pending.size(); ++i)
+            {
+                pending[i].measured.luminance *= drift.Correction(pendingMs[i]);
+                writer.Write(pending[i]);
+                if (learning)
+                    measured.push_back(pending[i]);
+            }
+            result.drift.corrected += drift.Fit().valid ? pending.size() : 0;
+            result.patches += count;
+            if (!writer.Close() && result.ok)
+            {
+                result.ok = false;
+                result.error = "cannot write " + command.output;
+            }
+            else if (!result.ok)
+            {
+                result.error = "meter read failed";
+            }
+
+            // The whole set for profiles and reports: measured patches as measured, the rest as predicted
+            if (learning && result.ok)
+            {
+                std::pmr::vector<PatchMeasurement> complete(patches.Size(), measurement, &sessionArena);
+                for (size_t i = 0; i < patches.Size(); ++i)
+                {
+                    complete[i].index = static_cast<uint32_t>(i);
+                    complete[i].target[0] = patches.r[i];
+                    complete[i].target[1] = patches.g[i];
+                    complete[i].target[2] = patches.b[i];
+                    if (!sampler.IsMeasured(i))
+                        complete[i].measured = sampler.Predict(i);
+                }
+                for (const PatchMeasurement& patch : measured)
+                    complete[patch.index] = patch;
+
+                MeasurementWriter predicted;
+                std::string predictedPath = PredictedPath(command.output);
+                if (predicted.Open(predictedPath))
+                {
+                    for (const PatchMeasurement& patch : complete)
+                        predicted.Write(patch);
+                }
+                if (!predicted.Close())
+                {
+                    result.ok = false;
+                    result.error = "cannot write " + predictedPath;
+                }
+
+                ActiveSummary& summary = result.active;
+                summary.candidates += patches.Size();
+                summary.measured += sampler.Measured();
+                summary.worstError = std::max(summary.worstError, sampler.WorstError());
+
+                // The files are kept, but a profile short of the error asked for is not a pass
+                if (result.ok && sampler.Next() == patches.Size() && sampler.WorstError() > command.values[0])
+                {
+                    char message[128];
+                    std::snprintf(message, sizeof(message),
+                                  "learn reached its %zu patch limit at %.2f Delta E ITP, above %.2f",
+                                  MAX_LEARNED_PATCHES, sampler.WorstError(), command.values[0]);
+                    result.ok = false;
+                    result.error = message;
+                }
+            }
+            show();
+            break;
+        }
+
+
+        case ScriptOp::Apl:
+            aplNits = command.values[0];
+            show();
+            break;
+
+        case ScriptOp::Detect:
+        {
+            if (!command.text.empty())
+                session.SetMode(command.mode);
+            ScriptDetection detection;
+            detection.mode = session.GetMode();
+            LevelEdge edge;
+            if (!GetLevelEdge(detection.mode, edge))
+            {
+                result.ok = false;
+                result.error = std::string("detect has no clip or crush point to find in ") +
+                               GetModeInfo(detection.mode).key;
+                break;
+            }
+
+            // Each reading waits for the light to settle on the new level, as a person would
+            LevelDetectOptions detectOptions;
+            detectOptions.highNits = session.GetMaxBrightness();
+            auto readLevel = [&](float level, Measurement& measurement)
+            {
+                session.SetCurrentBrightness(level);
+                show();
+                clockMs += display.SettleTimeMs(SETTLE_TOLERANCE);
+                return meter.Read(measurement);
+            };
+            detection.result = DetectLevelEdge(edge, readLevel, detectOptions);
+            if (detection.result.found)
+            {
+                session.SetCurrentBrightness(detection.result.level);
+                show();
+            }
+            else
+            {
+                result.ok = false;
+                result.error = "detect: " + detection.result.error;
+            }
+            result.detections.push_back(detection);
+            break;
+        }
+
+        case ScriptOp::Drift:
+            if (command.values[1] != referenceNits)
+                drift.NewSegment();
+            referenceEvery = static_cast<size_t>(command.values[0]);
+            referenceNits = command.values[1];
+            break;
+
+        case ScriptOp::Export:
+            if (!ExportReadings(command.text, result.readings))
+            {
+                result.ok = false;
+                result.error = "cannot write " + command.text;
+            }
+            break;
+        }
+
+        if (!result.ok)
+        {
+            result.errorLine = command.line;
+            break;
+        }
+    }
+
+    if (result.drift.references > 0)
+    {
+        DriftSummary& summary = result.drift;
+        summary.fit = drift.Fit();
+        summary.settledMs = drift.SettledMs(DRIFT_TOLERANCE);
+        summary.savedMs = std::max(0.0, summary.settledMs - summary.firstReadingMs) - summary.referenceMs;
+    }
+
+    result.sessionArena = sessionArena.Stats();
+    result.settleMs = result.frames > 0 ? settleTotalMs / result.frames : 0.0;
+    result.simulatedMs = clockMs;
+    result.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return result;
+}
+
+std::vector<ScriptResult> RunScripts(const std::vector<ScriptJob>& jobs, const ScriptRunOptions& options,
+                                     unsigned threadCount)
+{
+    std::vector<ScriptResult> results(jobs.size());
+    if (jobs.empty())
+        return results;
+
+    threadCount = threadCount ? threadCount : std::thread::hardware_concurrency();
+    threadCount = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(jobs.size())));
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < jobs.size(); i = next++)
+            results[i] = RunScriptHeadless(jobs[i].name, jobs[i].script, options);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return results;
+}
+
+bool ExportReadings(const std::string& path, const std::vector<ScriptReading>& readings)
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+        return false;
+
+    file << "label,mode,level_nits,time_ms,luminance_nits,x,y\n";
+    for (const ScriptReading& reading : readings)
+    {
+        file << reading.label << ',' << GetModeInfo(reading.mode).key << ',' << reading.level << ','
+             << reading.timeMs << ',' << reading.measurement.luminance << ',' << reading.measurement.x << ','
+             << reading.measurement.y << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+std::string FormatScriptResult(const ScriptResult& result)
+{
+    std::string text;
+    char line[256];
+    std::snprintf(line, sizeof(line), "%s: %s, %zu readings, %zu patches, %.1f s simulated in %.1f ms\n",
+                  result.name.c_str(), result.ok ? "passed" : "FAILED", result.readings.size(), result.patches,
+                  result.simulatedMs / 1000.0, result.wallMs);
+    text += line;
+    for (const ScriptReading& reading : result.readings)
+    {
+        std::snprintf(line, sizeof(line), "  %-16s %-10s %10.4f nits -> %10.4f nits\n",
+                      reading.label.empty() ? "-" : reading.label.c_str(), GetModeInfo(reading.mode).key,
+                      reading.level, reading.measurement.luminance);
+        text += line;
+    }
+    if (result.settleMaxMs > 0.0)
+    {
+        std::snprintf(line, sizeof(line), "  %zu frames settled within 1%% in %.0f ms on average, %.0f ms at most\n",
+                      result.frames, result.settleMs, result.settleMaxMs);
+        text += line;
+    }
+    const DriftSummary& drift = result.drift;
+    if (drift.references > 0)
+    {
+        if (drift.fit.valid)
+            std::snprintf(line, sizeof(line),
+                          "  drift: %zu references, %.1f%% at power-on over %.1f min (fit to %.2f%%), "
+                          "settled at %.1f min; %zu readings corrected, %.1f min saved\n",
+                          drift.references, drift.fit.amount * 100.0f, drift.fit.timeConstantMs / 60000.0,
+                          drift.fit.residual * 100.0, drift.settledMs / 60000.0, drift.corrected,
+                          drift.savedMs / 60000.0);
+        else
+            std::snprintf(line, sizeof(line), "  drift: %zu references, too few to fit\n", drift.references);
+        text += line;
+    }
+    const ActiveSummary& active = result.active;
+    if (active.candidates > 0)
+    {
+        std::snprintf(line, sizeof(line),
+                      "  learn: %zu of %zu patches measured, the rest predicted within %.2f Delta E ITP; "
+                      "slowest model update %.1f ms\n",
+                      active.measured, active.candidates, active.worstError, active.slowestUpdateMs);
+        text += line;
+    }
+    for (const ScriptDetection& detection : result.detections)
+        text += std::string("  detect ") + GetModeInfo(detection.mode).key + ": " +
+                FormatLevelDetectResult(detection.result);
+    if (result.sessionArena.highWater > 0)
+        text += "  " + FormatArenaStats(result.sessionArena);
+    for (const FlickerResult& flicker : result.flicker)
+    {
+        std::snprintf(line, sizeof(line), "  flicker at %.1f nits: %.1f Hz, %.1f%% modulation\n", flicker.level,
+                      flicker.frequency, flicker.modulationDepth);
+        text += line;
+    }
+    if (!result.ok)
+    {
+        std::snprintf(line, sizeof(line), "  line %d: %s\n", result.errorLine, result.error.c_str());
+        text += line;
+    }
+    return text;
+}
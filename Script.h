@@ -0,0 +1,119 @@
+#pragma once
+
+#include "ActiveSampler.h"
+#include "Arena.h"
+#include "DisplaySimulator.h"
+#include "Drift.h"
+#include "Flicker.h"
+#include "LevelDetect.h"
+#include "Meter.h"
+#include "Modes.h"
+
+#include <string>
+#include <vector>
+
+enum class ScriptOp
+{
+    Panel,   // panel <setting> <value>: change the simulated panel
+    Size,    // size <width> <height>: screen the pattern is laid out for
+    Probe,   // probe <x> <y>: move the meter, as a share of the screen
+    Mode,    // mode <key>
+    Level,   // level <nits>: set the current mode's level directly
+    Step,    // step <presses>: arrow presses, negative goes down
+    Toggle,  // toggle: next mode, like the toggle button
+    Wait,    // wait <ms>
+    Read,    // read [label]: one meter reading
+    Expect,  // expect <min> <max>: fail unless the last reading is in range
+    Flicker, // flicker [sample rate] [samples]: capture and analyze
+    Patches, // patches <patch set> <session file> [settle ms]: measure every patch under the meter
+    Learn,   // learn <patch set> <session file> <max delta E> [settle ms]: measure until the rest is predicted
+    Drift,   // drift <every> [reference nits]: interleave a reference patch to compensate warm-up, 0 stops
+    Apl,     // apl [nits]: grey surround that holds the average picture level, per patch set without nits, 0 stops
+    Detect,  // detect [mode]: find the clip or crush point with the meter and set the level to it
+    Export   // export <path>: readings so far as CSV
+};
+
+struct ScriptCommand
+{
+    ScriptOp op = ScriptOp::Wait;
+    int line = 0;
+    std::string text;         // setting, mode key, label or path
+    std::string output;       // where patches writes its measurements
+    float values[2] = {};
+    BrightnessMode mode = BrightnessMode::MaxWhite;
+};
+
+struct ScriptReading
+{
+    std::string label;
+    BrightnessMode mode = BrightnessMode::MaxWhite;
+    float level = 0.0f;       // what the session asked for, nits
+    double timeMs = 0.0;      // simulated time the reading finished
+    Measurement measurement;
+};
+
+struct ScriptDetection
+{
+    BrightnessMode mode = BrightnessMode::MaxWhite;
+    LevelDetectResult result;
+};
+
+struct ScriptResult
+{
+    std::string name;
+    bool ok = false;
+    std::string error;
+    int errorLine = 0;
+    std::vector<ScriptReading> readings;
+    std::vector<FlickerResult> flicker;
+    std::vector<ScriptDetection> detections;
+    size_t patches = 0;       // measured by patches commands
+    size_t frames = 0;        // patterns shown
+    double settleMs = 0.0;    // mean time the light at the probe took to settle within 1% of a new frame
+    double settleMaxMs = 0.0;
+    DriftSummary drift;
+    ActiveSummary active;
+    ArenaStats sessionArena;  // measurement buffers of patches and learn commands
+    double simulatedMs = 0.0; // time the script would take on a real panel
+    double wallMs = 0.0;      // time it took here
+};
+
+// Command file for unattended runs, one command per line; # starts a comment.
+// Every line is checked when the script is loaded, so a typo fails before anything runs.
+class Script
+{
+public:
+    bool Parse(const std::string& text, std::string& error);
+    bool Load(const std::string& path, std::string& error);
+
+    const std::vector<ScriptCommand>& Commands() const { return m_commands; }
+
+private:
+    std::vector<ScriptCommand> m_commands;
+};
+
+struct ScriptJob
+{
+    std::string name;
+    Script script;
+};
+
+struct ScriptRunOptions
+{
+    int width = 3840;
+    int height = 2160;
+    PanelModel panel;
+    MeterModel meter;
+};
+
+// Run against a simulated panel and meter in a session of its own. Waits and readings
+// advance simulated time only, so a script that takes minutes on hardware runs at once.
+ScriptResult RunScriptHeadless(const std::string& name, const Script& script, const ScriptRunOptions& options);
+
+// Every job in its own session, spread over threadCount threads (0 is one per hardware thread)
+std::vector<ScriptResult> RunScripts(const std::vector<ScriptJob>& jobs, const ScriptRunOptions& options,
+                                     unsigned threadCount = 0);
+
+bool ExportReadings(const std::string& path, const std::vector<ScriptReading>& readings);
+
+std::string FormatScriptResult(const ScriptResult& result);
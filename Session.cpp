@@ -0,0 +1,288 @@
+#include "Session.h"
+
+#include <algorithm>
+#include <iterator>
+
+static_assert(MODE_COUNT <= SESSION_MAX_MODES, "session snapshot has no room for every mode");
+
+CalibrationSession::CalibrationSession()
+{
+    Seed(CalibrationSeed(), 0);
+}
+
+void CalibrationSession::Seed(const CalibrationSeed& seed, uint64_t displayHash)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_displayHash = displayHash;
+    for (size_t i = 0; i < MODE_COUNT; ++i)
+        m_levels[i] = GetModeInfo(static_cast<BrightnessMode>(i)).seed(seed);
+    m_calibratedModes = 0;
+}
+
+bool CalibrationSession::OpenStore(const std::string& path, bool fresh)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_store.Open(path))
+        return false;
+
+    // Resume only on the display the session was started on
+    SessionSnapshot snapshot;
+    if (!fresh && m_store.Load(snapshot) && snapshot.displayHash == m_displayHash)
+    {
+        if (snapshot.mode < MODE_COUNT)
+            m_mode = static_cast<BrightnessMode>(snapshot.mode);
+        for (size_t i = 0; i < MODE_COUNT; ++i)
+            m_levels[i].level = std::clamp(snapshot.levels[i], 0.0f, m_levels[i].range);
+        m_workflowHash = snapshot.workflowHash;
+        m_completedSteps = snapshot.completedSteps;
+        std::copy(std::begin(snapshot.stepLevels), std::end(snapshot.stepLevels), m_stepLevels.begin());
+        m_calibratedModes = snapshot.calibratedModes & ((1u << MODE_COUNT) - 1);
+    }
+
+    SaveLocked();
+    return true;
+}
+
+void CalibrationSession::CloseStore()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_store.Close();
+}
+
+BrightnessMode CalibrationSession::GetMode() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_mode;
+}
+
+float CalibrationSession::GetCurrentBrightness() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return CurrentLocked().level;
+}
+
+void CalibrationSession::SetCurrentBrightness(float brightness)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SetCurrentLocked(brightness);
+}
+
+float CalibrationSession::GetIncrement() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return CurrentLocked().increment;
+}
+
+float CalibrationSession::GetMaxBrightness() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return CurrentLocked().range;
+}
+
+void CalibrationSession::ToggleMode()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mode = NextMode(m_mode);
+    SaveLocked();
+}
+
+void CalibrationSession::SetMode(BrightnessMode mode)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mode = mode;
+    SaveLocked();
+}
+
+void CalibrationSession::ApplyInput(const InputFrame& input, uint32_t timeMs)
+{
+    const uint32_t REPEAT_DELAY = 1500; // 1.5 seconds
+    const uint32_t REPEAT_INTERVAL = 200; // 0.2 seconds (5x per second)
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Handle toggle on press
+    if (input.toggle && !m_toggleWasPressed && !m_stepActive)
+    {
+        m_mode = NextMode(m_mode);
+        SaveLocked();
+    }
+    m_toggleWasPressed = input.toggle;
+
+    // Handle confirm on press; only a waiting workflow step uses it
+    if (input.confirm && !m_confirmWasPressed && m_stepActive)
+    {
+        m_stepConfirmed = true;
+        m_stepChanged.notify_all();
+    }
+    m_confirmWasPressed = input.confirm;
+
+    const ModeInfo& info = GetModeInfo(m_mode);
+    const float increment = CurrentLocked().increment;
+    const float maxBrightness = CurrentLocked().range;
+
+    // Handle left input
+    if (input.left)
+    {
+        if (!m_leftWasPressed)
+        {
+            // Initial press
+            SetCurrentLocked(std::max(0.0f, info.step(CurrentLocked().level, increment, -1)));
+            m_leftPressStartTime = timeMs;
+            m_lastRepeatTime = timeMs;
+        }
+        else if (timeMs - m_leftPressStartTime >= REPEAT_DELAY && timeMs - m_lastRepeatTime >= REPEAT_INTERVAL)
+        {
+            // Repeat after delay
+            SetCurrentLocked(std::max(0.0f, info.step(CurrentLocked().level, increment, -1)));
+            m_lastRepeatTime = timeMs;
+        }
+    }
+
+    // Handle right input
+    if (input.right)
+    {
+        if (!m_rightWasPressed)
+        {
+            // Initial press
+            SetCurrentLocked(std::min(maxBrightness, info.step(CurrentLocked().level, increment, 1)));
+            m_rightPressStartTime = timeMs;
+            m_lastRepeatTime = timeMs;
+        }
+        else if (timeMs - m_rightPressStartTime >= REPEAT_DELAY && timeMs - m_lastRepeatTime >= REPEAT_INTERVAL)
+        {
+            // Repeat after delay
+            SetCurrentLocked(std::min(maxBrightness, info.step(CurrentLocked().level, increment, 1)));
+            m_lastRepeatTime = timeMs;
+        }
+    }
+
+    m_leftWasPressed = input.left;
+    m_rightWasPressed = input.right;
+}
+
+bool CalibrationSession::RunStep(BrightnessMode mode, float startLevel, float& level)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stepsCancelled)
+        return false;
+
+    m_mode = mode;
+    if (startLevel >= 0.0f)
+        CurrentLocked().level = std::min(startLevel, CurrentLocked().range);
+    SaveLocked();
+
+    m_stepActive = true;
+    m_stepConfirmed = false;
+    m_stepChanged.wait(lock, [this]() { return m_stepConfirmed || m_stepsCancelled; });
+    m_stepActive = false;
+
+    level = CurrentLocked().level;
+    if (!m_stepConfirmed || m_stepsCancelled)
+        return false;
+
+    // Confirming a level calibrates it even if it was never adjusted
+    m_calibratedModes |= 1u << ModeIndex(m_mode);
+    SaveLocked();
+    return true;
+}
+
+void CalibrationSession::CancelSteps()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stepsCancelled = true;
+    m_stepChanged.notify_all();
+}
+
+bool CalibrationSession::StepCompleted(uint32_t workflowHash, size_t index, float& level) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (workflowHash == 0 || workflowHash != m_workflowHash || index >= SESSION_MAX_STEPS ||
+        !((m_completedSteps >> index) & 1))
+        return false;
+    level = m_stepLevels[index];
+    return true;
+}
+
+void CalibrationSession::CompleteStep(uint32_t workflowHash, size_t index, float level)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (workflowHash != m_workflowHash)
+    {
+        // Progress of another workflow no longer applies
+        m_workflowHash = workflowHash;
+        m_completedSteps = 0;
+        m_stepLevels.fill(0.0f);
+    }
+    if (index < SESSION_MAX_STEPS)
+    {
+        m_completedSteps |= 1u << index;
+        m_stepLevels[index] = level;
+    }
+    SaveLocked();
+}
+
+void CalibrationSession::ClearSteps()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_workflowHash = 0;
+    m_completedSteps = 0;
+    m_stepLevels.fill(0.0f);
+    SaveLocked();
+}
+
+float CalibrationSession::GetLevel(BrightnessMode mode) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_levels[ModeIndex(mode)].level;
+}
+
+SessionView CalibrationSession::View() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SessionView view;
+    view.mode = m_mode;
+    view.brightness = CurrentLocked().level;
+    view.increment = CurrentLocked().increment;
+    return view;
+}
+
+uint64_t CalibrationSession::DisplayHash() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_displayHash;
+}
+
+DisplayRecord CalibrationSession::Result() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DisplayRecord record;
+    size_t maxWhite = ModeIndex(BrightnessMode::MaxWhite);
+    size_t minBlack = ModeIndex(BrightnessMode::MinBlack);
+    if ((m_calibratedModes >> maxWhite) & 1)
+        record.maxWhite = m_levels[maxWhite].level;
+    if ((m_calibratedModes >> minBlack) & 1)
+        record.minBlack = m_levels[minBlack].level;
+    return record;
+}
+
+void CalibrationSession::SetCurrentLocked(float brightness)
+{
+    CurrentLocked().level = brightness;
+    m_calibratedModes |= 1u << ModeIndex(m_mode);
+    SaveLocked();
+}
+
+void CalibrationSession::SaveLocked()
+{
+    // Only copies into the mapped file, cheap enough to call on every change
+    SessionSnapshot snapshot;
+    snapshot.displayHash = m_displayHash;
+    snapshot.mode = static_cast<uint32_t>(m_mode);
+    for (size_t i = 0; i < MODE_COUNT; ++i)
+        snapshot.levels[i] = m_levels[i].level;
+    snapshot.workflowHash = m_workflowHash;
+    snapshot.completedSteps = m_completedSteps;
+    snapshot.calibratedModes = m_calibratedModes;
+    std::copy(m_stepLevels.begin(), m_stepLevels.end(), std::begin(snapshot.stepLevels));
+    m_store.Save(snapshot);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "DisplayCache.h"
+#include "Modes.h"
+#include "SessionState.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// What the renderer needs for one frame, copied out under the session lock
+struct SessionView
+{
+    BrightnessMode mode = BrightnessMode::MaxWhite;
+    float brightness = 0.0f;
+    float increment = 0.0f;
+};
+
+// Buttons held this frame, already merged from keyboard and gamepad
+struct InputFrame
+{
+    bool left = false;
+    bool right = false;
+    bool toggle = false;
+    bool confirm = false; // accept the level of the current workflow step
+};
+
+// Calibration state of one display. Input and rendering run on different
+// threads, so every public method takes the session lock.
+class CalibrationSession
+{
+public:
+    CalibrationSession();
+
+    void Seed(const CalibrationSeed& seed, uint64_t displayHash);
+
+    // Open the persisted state file and resume from it unless fresh is set
+    bool OpenStore(const std::string& path, bool fresh);
+    void CloseStore();
+
+    BrightnessMode GetMode() const;
+    float GetCurrentBrightness() const;
+    void SetCurrentBrightness(float brightness);
+    float GetIncrement() const;
+    float GetMaxBrightness() const;
+    void ToggleMode(); // next mode in registry order
+    void SetMode(BrightnessMode mode);
+
+    // Edge detection and auto-repeat for held buttons, timeMs from a millisecond tick counter
+    void ApplyInput(const InputFrame& input, uint32_t timeMs);
+
+    // Workflow steps: show a mode from a starting level (negative keeps the current one) and
+    // block until the user confirms, returning false if the steps were cancelled instead.
+    // The mode cannot be toggled away while a step waits.
+    bool RunStep(BrightnessMode mode, float startLevel, float& level);
+    void CancelSteps();
+
+    // Workflow progress, saved with the session so a restarted workflow skips the steps already
+    // confirmed on this display and gets back the level each confirmed. Modes are shared between
+    // steps, so a mode's level may since have moved. Only the first SESSION_MAX_STEPS steps are kept.
+    bool StepCompleted(uint32_t workflowHash, size_t index, float& level) const;
+    void CompleteStep(uint32_t workflowHash, size_t index, float level);
+    void ClearSteps();
+    float GetLevel(BrightnessMode mode) const;
+
+    SessionView View() const;
+    uint64_t DisplayHash() const;
+    // Only the levels that were adjusted or confirmed; the others are left negative
+    DisplayRecord Result() const;
+
+private:
+    ModeLevels& CurrentLocked() { return m_levels[ModeIndex(m_mode)]; }
+    const ModeLevels& CurrentLocked() const { return m_levels[ModeIndex(m_mode)]; }
+    void SetCurrentLocked(float brightness);
+    void SaveLocked();
+
+    mutable std::mutex m_mutex;
+    SessionStore m_store;
+    uint64_t m_displayHash = 0;
+
+    BrightnessMode m_mode = BrightnessMode::MaxWhite;
+    std::array<ModeLevels, MODE_COUNT> m_levels; // indexed by BrightnessMode
+
+    std::condition_variable m_stepChanged;
+    bool m_stepActive = false;
+    bool m_stepConfirmed = false;
+    bool m_stepsCancelled = false;
+    uint32_t m_workflowHash = 0;
+    uint32_t m_completedSteps = 0;
+    std::array<float, SESSION_MAX_STEPS> m_stepLevels = {};
+    uint32_t m_calibratedModes = 0; // bit per BrightnessMode
+
+    bool m_leftWasPressed = false;
+    bool m_rightWasPressed = false;
+    bool m_toggleWasPressed = false;
+    bool m_confirmWasPressed = false;
+    uint32_t m_leftPressStartTime = 0;
+    uint32_t m_rightPressStartTime = 0;
+    uint32_t m_lastRepeatTime = 0;
+};
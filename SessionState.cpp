@@ -0,0 +1,208 @@
+#include "SessionState.h"
+
+#include <atomic>
+#include <cstddef>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const uint32_t SESSION_MAGIC = 0x53524448; // "HDRS"
+    const uint32_t SESSION_VERSION = 3; // 2: levels for every mode, 3: levels of completed steps
+
+    struct CrcTable
+    {
+        uint32_t entries[256];
+
+        CrcTable()
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[i] = c;
+            }
+        }
+    };
+
+    uint32_t Crc32(const void* data, size_t size)
+    {
+        static const CrcTable table;
+
+        uint32_t crc = 0xFFFFFFFFu;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+            crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFu;
+    }
+}
+
+struct SessionStore::Slot
+{
+    uint64_t sequence;
+    uint32_t payloadSize;
+    uint32_t crc; // over sequence, payloadSize and payload
+    SessionSnapshot payload;
+};
+
+struct SessionStore::Layout
+{
+    uint32_t magic;
+    uint32_t version;
+    Slot slots[2];
+};
+
+namespace
+{
+    template <typename SlotType>
+    uint32_t SlotCrc(const SlotType& slot)
+    {
+        uint32_t crc = Crc32(&slot.sequence, sizeof(slot.sequence) + sizeof(slot.payloadSize));
+        return crc ^ Crc32(&slot.payload, sizeof(slot.payload));
+    }
+
+    template <typename SlotType>
+    bool SlotValid(const SlotType& slot)
+    {
+        return slot.sequence != 0 && slot.payloadSize == sizeof(slot.payload) && slot.crc == SlotCrc(slot);
+    }
+}
+
+SessionStore::~SessionStore()
+{
+    Close();
+}
+
+bool SessionStore::Open(const std::string& path)
+{
+    Close();
+    const size_t size = sizeof(Layout);
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                              OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    // Mapping with an explicit size grows a new or short file to the full layout
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(size), nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_mapping = mapping;
+#else
+    int file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (file < 0)
+        return false;
+
+    struct stat info = {};
+    if (fstat(file, &info) != 0 || (static_cast<size_t>(info.st_size) < size && ftruncate(file, size) != 0))
+    {
+        close(file);
+        return false;
+    }
+
+    void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (view == MAP_FAILED)
+    {
+        close(file);
+        return false;
+    }
+
+    m_file = file;
+#endif
+
+    m_layout = static_cast<Layout*>(view);
+
+    // A new file or one from an incompatible build starts out empty
+    if (m_layout->magic != SESSION_MAGIC || m_layout->version != SESSION_VERSION)
+    {
+        *m_layout = Layout();
+        m_layout->magic = SESSION_MAGIC;
+        m_layout->version = SESSION_VERSION;
+    }
+
+    m_sequence = 0;
+    for (const Slot& slot : m_layout->slots)
+    {
+        if (SlotValid(slot) && slot.sequence > m_sequence)
+            m_sequence = slot.sequence;
+    }
+    return true;
+}
+
+void SessionStore::Close()
+{
+    if (!m_layout)
+        return;
+
+#ifdef _WIN32
+    FlushViewOfFile(m_layout, 0);
+    UnmapViewOfFile(m_layout);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    msync(m_layout, sizeof(Layout), MS_ASYNC);
+    munmap(m_layout, sizeof(Layout));
+    close(m_file);
+    m_file = -1;
+#endif
+    m_layout = nullptr;
+}
+
+bool SessionStore::Load(SessionSnapshot& snapshot) const
+{
+    if (!m_layout)
+        return false;
+
+    const Slot* newest = nullptr;
+    for (const Slot& slot : m_layout->slots)
+    {
+        if (SlotValid(slot) && (!newest || slot.sequence > newest->sequence))
+            newest = &slot;
+    }
+    if (!newest)
+        return false;
+
+    snapshot = newest->payload;
+    return true;
+}
+
+void SessionStore::Save(const SessionSnapshot& snapshot)
+{
+    if (!m_layout)
+        return;
+
+    // Overwrite the older slot so the newest valid one stays intact until this write completes
+    Slot& slot = m_layout->slots[(m_sequence + 1) % 2];
+    slot.sequence = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.payloadSize = sizeof(SessionSnapshot);
+    slot.payload = snapshot;
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.sequence = ++m_sequence;
+    slot.crc = SlotCrc(slot);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Upper bound on BrightnessMode values the snapshot has room for
+const size_t SESSION_MAX_MODES = 8;
+const size_t SESSION_MAX_STEPS = 32; // workflow steps whose progress is kept
+
+// Everything needed to pick an interrupted session up where it stopped
+struct SessionSnapshot
+{
+    uint64_t displayHash = 0;   // DisplayIdentity::Hash() of the calibrated display, 0 if unknown
+    uint32_t mode = 0;          // BrightnessMode
+    float levels[SESSION_MAX_MODES] = {}; // nits, indexed by BrightnessMode
+    uint32_t workflowHash = 0;   // Workflow::Hash() of the workflow completedSteps belong to, 0 for none
+    uint32_t completedSteps = 0; // bit i set once step i of that workflow was confirmed on this display
+    uint32_t calibratedModes = 0; // bit i set once the level of mode i was adjusted or confirmed
+    float stepLevels[SESSION_MAX_STEPS] = {}; // nits confirmed by each completed step
+};
+
+// Session state persisted in a small memory-mapped file.
+// Saves alternate between two checksummed slots and never call into the OS,
+// so they are cheap enough for the render loop; the OS writes the pages back
+// lazily and they survive the process crashing. A save torn by a crash or
+// power loss fails its checksum and Load falls back to the other slot.
+class SessionStore
+{
+public:
+    SessionStore() = default;
+    ~SessionStore();
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    bool Load(SessionSnapshot& snapshot) const;
+    void Save(const SessionSnapshot& snapshot);
+
+private:
+    struct Slot;
+    struct Layout;
+
+    Layout* m_layout = nullptr;
+    uint64_t m_sequence = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+};
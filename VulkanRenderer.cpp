@@ -0,0 +1,1060 @@
+#include "VulkanRenderer.h"
+#include "ColorMath.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+struct VulkanState
+{
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+    uint32_t queueFamily = 0;
+
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VkSurfaceFormatKHR surfaceFormat = {};
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {};
+    FrameEncoding encoding = FrameEncoding::ScRgbHalf;
+    bool presenting = false;
+    bool canUpload = false; // images accept transfer writes, which PresentFrame needs
+
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    std::vector<VkImage> images; // swapchain images, or the single offscreen image
+    std::vector<VkImageView> views;
+    std::vector<VkFramebuffer> framebuffers;
+
+    VkImage offscreenImage = VK_NULL_HANDLE;
+    VkDeviceMemory offscreenMemory = VK_NULL_HANDLE;
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+    void* readbackMapped = nullptr;
+    VkDeviceSize readbackSize = 0;
+
+    // Frames are recorded into a ring of slots, so one frame is built while the last is still on
+    // the queue. A slot is reused only after its fence signals, which also frees its acquire semaphore.
+    struct FrameSlot
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkSemaphore imageAvailable = VK_NULL_HANDLE;
+
+        // Staging for PresentFrame, made on its first frame at the size of one image
+        VkBuffer upload = VK_NULL_HANDLE;
+        VkDeviceMemory uploadMemory = VK_NULL_HANDLE;
+        void* uploadMapped = nullptr;
+        VkDeviceSize uploadSize = 0;
+    };
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    std::vector<FrameSlot> slots;
+    size_t slot = 0;
+
+    // Per swapchain image: presentation waits on the image's own semaphore, since nothing tells when
+    // a present has finished with it; and the fence of the slot that last rendered into the image
+    std::vector<VkSemaphore> renderFinished;
+    std::vector<VkFence> imageFences;
+
+    std::string deviceName;
+    std::string status;
+
+    Arena frameArena{ "vulkan frame arena" };
+    DrawListStats drawStats; // of the last frame
+    bool deviceLost = false;
+};
+
+namespace
+{
+    const size_t FRAMES_IN_FLIGHT = 2;
+
+    VkFormat FormatFor(FrameEncoding encoding)
+    {
+        return encoding == FrameEncoding::ScRgbHalf ? VK_FORMAT_R16G16B16A16_SFLOAT
+                                                    : VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+    }
+
+    bool HasExtension(const std::vector<VkExtensionProperties>& extensions, const char* name)
+    {
+        for (const VkExtensionProperties& extension : extensions)
+        {
+            if (std::strcmp(extension.extensionName, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeBits, VkMemoryPropertyFlags properties,
+                        uint32_t& typeIndex)
+    {
+        VkPhysicalDeviceMemoryProperties memory;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memory);
+        for (uint32_t i = 0; i < memory.memoryTypeCount; ++i)
+        {
+            if ((typeBits & (1u << i)) && (memory.memoryTypes[i].propertyFlags & properties) == properties)
+            {
+                typeIndex = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Clear values are given in the attachment's logical RGBA; PQ values are snapped to
+    // whole 10-bit codes so the result matches the CPU reference exactly
+    VkClearValue ClearColor(const ScRgb& color, FrameEncoding encoding)
+    {
+        VkClearValue value = {};
+        if (encoding == FrameEncoding::ScRgbHalf)
+        {
+            value.color.float32[0] = color.r;
+            value.color.float32[1] = color.g;
+            value.color.float32[2] = color.b;
+        }
+        else
+        {
+            float bt709[3] = { color.r * SCRGB_WHITE_NITS, color.g * SCRGB_WHITE_NITS, color.b * SCRGB_WHITE_NITS };
+            float bt2020[3];
+            Bt709ToBt2020(bt709, bt2020);
+            for (int c = 0; c < 3; ++c)
+                value.color.float32[c] = std::lround(PqEncode(bt2020[c]) * 1023.0f) / 1023.0f;
+        }
+        value.color.float32[3] = 1.0f;
+        return value;
+    }
+
+    bool ChooseDisplaySurface(VulkanState& s, bool hasColorSpaces)
+    {
+        VkPhysicalDevice physicalDevice = s.physicalDevice;
+
+        uint32_t displayCount = 0;
+        vkGetPhysicalDeviceDisplayPropertiesKHR(physicalDevice, &displayCount, nullptr);
+        if (displayCount == 0)
+        {
+            s.status = "no display available to VK_KHR_display";
+            return false;
+        }
+        std::vector<VkDisplayPropertiesKHR> displays(displayCount);
+        vkGetPhysicalDeviceDisplayPropertiesKHR(physicalDevice, &displayCount, displays.data());
+        VkDisplayKHR display = displays[0].display;
+
+        // Native resolution at the highest refresh rate
+        uint32_t modeCount = 0;
+        vkGetDisplayModePropertiesKHR(physicalDevice, display, &modeCount, nullptr);
+        if (modeCount == 0)
+        {
+            s.status = "display has no modes";
+            return false;
+        }
+        std::vector<VkDisplayModePropertiesKHR> modes(modeCount);
+        vkGetDisplayModePropertiesKHR(physicalDevice, display, &modeCount, modes.data());
+        const VkDisplayModePropertiesKHR* mode = &modes[0];
+        for (const VkDisplayModePropertiesKHR& candidate : modes)
+        {
+            const VkDisplayModeParametersKHR& a = candidate.parameters;
+            const VkDisplayModeParametersKHR& b = mode->parameters;
+            uint64_t areaA = static_cast<uint64_t>(a.visibleRegion.width) * a.visibleRegion.height;
+            uint64_t areaB = static_cast<uint64_t>(b.visibleRegion.width) * b.visibleRegion.height;
+            if (areaA > areaB || (areaA == areaB && a.refreshRate > b.refreshRate))
+                mode = &candidate;
+        }
+
+        // A plane that can scan out to this display
+        uint32_t planeCount = 0;
+        vkGetPhysicalDeviceDisplayPlanePropertiesKHR(physicalDevice, &planeCount, nullptr);
+        std::vector<VkDisplayPlanePropertiesKHR> planes(planeCount);
+        vkGetPhysicalDeviceDisplayPlanePropertiesKHR(physicalDevice, &planeCount, planes.data());
+
+        uint32_t planeIndex = UINT32_MAX;
+        for (uint32_t p = 0; p < planeCount && planeIndex == UINT32_MAX; ++p)
+        {
+            if (planes[p].currentDisplay != VK_NULL_HANDLE && planes[p].currentDisplay != display)
+                continue;
+            uint32_t supportedCount = 0;
+            vkGetDisplayPlaneSupportedDisplaysKHR(physicalDevice, p, &supportedCount, nullptr);
+            std::vector<VkDisplayKHR> supported(supportedCount);
+            vkGetDisplayPlaneSupportedDisplaysKHR(physicalDevice, p, &supportedCount, supported.data());
+            if (std::find(supported.begin(), supported.end(), display) != supported.end())
+                planeIndex = p;
+        }
+        if (planeIndex == UINT32_MAX)
+        {
+            s.status = "no display plane for the display";
+            return false;
+        }
+
+        VkDisplaySurfaceCreateInfoKHR surfaceInfo = {};
+        surfaceInfo.sType = VK_STRUCTURE_TYPE_DISPLAY_SURFACE_CREATE_INFO_KHR;
+        surfaceInfo.displayMode = mode->displayMode;
+        surfaceInfo.planeIndex = planeIndex;
+        surfaceInfo.planeStackIndex = planes[planeIndex].currentStackIndex;
+        surfaceInfo.transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+        surfaceInfo.globalAlpha = 1.0f;
+        surfaceInfo.alphaMode = VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR;
+        surfaceInfo.imageExtent = mode->parameters.visibleRegion;
+
+        if (vkCreateDisplayPlaneSurfaceKHR(s.instance, &surfaceInfo, nullptr, &s.surface) != VK_SUCCESS)
+        {
+            s.status = "vkCreateDisplayPlaneSurfaceKHR failed";
+            return false;
+        }
+
+        VkBool32 presentSupported = VK_FALSE;
+        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, s.queueFamily, s.surface, &presentSupported);
+
+        // HDR needs an extended color space; the requested encoding first, then the other one
+        uint32_t formatCount = 0;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, s.surface, &formatCount, nullptr);
+        std::vector<VkSurfaceFormatKHR> formats(formatCount);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, s.surface, &formatCount, formats.data());
+
+        struct Candidate
+        {
+            VkFormat format;
+            VkColorSpaceKHR colorSpace;
+            FrameEncoding encoding;
+        };
+        const Candidate SCRGB[] = {
+            { VK_FORMAT_R16G16B16A16_SFLOAT, VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT, FrameEncoding::ScRgbHalf },
+        };
+        const Candidate PQ[] = {
+            { VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_COLOR_SPACE_HDR10_ST2084_EXT, FrameEncoding::Hdr10Pq },
+            { VK_FORMAT_A2R10G10B10_UNORM_PACK32, VK_COLOR_SPACE_HDR10_ST2084_EXT, FrameEncoding::Hdr10Pq },
+        };
+        std::vector<Candidate> candidates(std::begin(SCRGB), std::end(SCRGB));
+        candidates.insert(s.encoding == FrameEncoding::ScRgbHalf ? candidates.end() : candidates.begin(),
+                          std::begin(PQ), std::end(PQ));
+
+        bool found = false;
+        for (const Candidate& candidate : candidates)
+        {
+            for (const VkSurfaceFormatKHR& format : formats)
+            {
+                if (!found && format.format == candidate.format && format.colorSpace == candidate.colorSpace)
+                {
+                    s.surfaceFormat = format;
+                    s.format = format.format;
+                    s.encoding = candidate.encoding;
+                    found = true;
+                }
+            }
+        }
+
+        if (!presentSupported || !hasColorSpaces || !found)
+        {
+            s.status = !presentSupported ? "queue cannot present to the display"
+                                         : "display has no HDR swapchain color space";
+            vkDestroySurfaceKHR(s.instance, s.surface, nullptr);
+            s.surface = VK_NULL_HANDLE;
+            return false;
+        }
+
+        s.extent = mode->parameters.visibleRegion;
+        return true;
+    }
+
+    bool CreateSwapchain(VulkanState& s)
+    {
+        VkSurfaceCapabilitiesKHR capabilities;
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(s.physicalDevice, s.surface, &capabilities);
+        if (capabilities.currentExtent.width != UINT32_MAX)
+            s.extent = capabilities.currentExtent;
+
+        uint32_t imageCount = std::max(capabilities.minImageCount, 2u);
+        if (capabilities.maxImageCount != 0)
+            imageCount = std::min(imageCount, capabilities.maxImageCount);
+
+        VkSwapchainCreateInfoKHR swapchainInfo = {};
+        swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        swapchainInfo.surface = s.surface;
+        swapchainInfo.minImageCount = imageCount;
+        swapchainInfo.imageFormat = s.surfaceFormat.format;
+        swapchainInfo.imageColorSpace = s.surfaceFormat.colorSpace;
+        swapchainInfo.imageExtent = s.extent;
+        swapchainInfo.imageArrayLayers = 1;
+        s.canUpload = (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+        swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                   (s.canUpload ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0);
+        swapchainInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        swapchainInfo.preTransform = capabilities.currentTransform;
+        swapchainInfo.compositeAlpha = (capabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR)
+                                           ? VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR
+                                           : VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
+        swapchainInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR; // always supported, paced by vsync
+        swapchainInfo.clipped = VK_TRUE;
+        swapchainInfo.oldSwapchain = s.swapchain;
+
+        VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+        VkResult result = vkCreateSwapchainKHR(s.device, &swapchainInfo, nullptr, &swapchain);
+        if (s.swapchain)
+            vkDestroySwapchainKHR(s.device, s.swapchain, nullptr);
+        s.swapchain = swapchain;
+        if (result != VK_SUCCESS)
+            return false;
+
+        uint32_t count = 0;
+        vkGetSwapchainImagesKHR(s.device, s.swapchain, &count, nullptr);
+        s.images.resize(count);
+        vkGetSwapchainImagesKHR(s.device, s.swapchain, &count, s.images.data());
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        s.renderFinished.assign(count, VK_NULL_HANDLE);
+        s.imageFences.assign(count, VK_NULL_HANDLE);
+        for (VkSemaphore& semaphore : s.renderFinished)
+        {
+            if (vkCreateSemaphore(s.device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+                return false;
+        }
+        return true;
+    }
+
+    bool CreateOffscreenTarget(VulkanState& s, int width, int height)
+    {
+        s.format = FormatFor(s.encoding);
+        s.extent.width = static_cast<uint32_t>(std::max(width, 1));
+        s.extent.height = static_cast<uint32_t>(std::max(height, 1));
+
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = s.format;
+        imageInfo.extent = { s.extent.width, s.extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                          VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(s.device, &imageInfo, nullptr, &s.offscreenImage) != VK_SUCCESS)
+            return false;
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(s.device, s.offscreenImage, &requirements);
+        VkMemoryAllocateInfo allocation = {};
+        allocation.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocation.allocationSize = requirements.size;
+        if (!FindMemoryType(s.physicalDevice, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            allocation.memoryTypeIndex) &&
+            !FindMemoryType(s.physicalDevice, requirements.memoryTypeBits, 0, allocation.memoryTypeIndex))
+            return false;
+        if (vkAllocateMemory(s.device, &allocation, nullptr, &s.offscreenMemory) != VK_SUCCESS)
+            return false;
+        vkBindImageMemory(s.device, s.offscreenImage, s.offscreenMemory, 0);
+        s.images.push_back(s.offscreenImage);
+        s.canUpload = true;
+
+        // Host-visible buffer the image is copied into after every frame
+        s.readbackSize = static_cast<VkDeviceSize>(s.extent.width) * s.extent.height *
+                         FrameBuffer::BytesPerPixel(s.encoding);
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = s.readbackSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(s.device, &bufferInfo, nullptr, &s.readbackBuffer) != VK_SUCCESS)
+            return false;
+
+        vkGetBufferMemoryRequirements(s.device, s.readbackBuffer, &requirements);
+        allocation.allocationSize = requirements.size;
+        if (!FindMemoryType(s.physicalDevice, requirements.memoryTypeBits,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            allocation.memoryTypeIndex))
+            return false;
+        if (vkAllocateMemory(s.device, &allocation, nullptr, &s.readbackMemory) != VK_SUCCESS)
+            return false;
+        vkBindBufferMemory(s.device, s.readbackBuffer, s.readbackMemory, 0);
+        return vkMapMemory(s.device, s.readbackMemory, 0, s.readbackSize, 0, &s.readbackMapped) == VK_SUCCESS;
+    }
+
+    bool CreateRenderPass(VulkanState& s)
+    {
+        VkAttachmentDescription color = {};
+        color.format = s.format;
+        color.samples = VK_SAMPLE_COUNT_1_BIT;
+        color.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        color.finalLayout = s.presenting ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorReference;
+
+        // Clears are attachment writes; order them after acquire and before the copy or present
+        VkSubpassDependency dependencies[2] = {};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[0].srcAccessMask = 0;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = s.presenting ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+                                                    : VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].dstAccessMask = s.presenting ? 0 : VK_ACCESS_TRANSFER_READ_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &color;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 2;
+        renderPassInfo.pDependencies = dependencies;
+        return vkCreateRenderPass(s.device, &renderPassInfo, nullptr, &s.renderPass) == VK_SUCCESS;
+    }
+
+    bool CreateFramebuffers(VulkanState& s)
+    {
+        for (VkImage image : s.images)
+        {
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = s.format;
+            viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            VkImageView view = VK_NULL_HANDLE;
+            if (vkCreateImageView(s.device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+                return false;
+            s.views.push_back(view);
+
+            VkFramebufferCreateInfo framebufferInfo = {};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = s.renderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = &view;
+            framebufferInfo.width = s.extent.width;
+            framebufferInfo.height = s.extent.height;
+            framebufferInfo.layers = 1;
+
+            VkFramebuffer framebuffer = VK_NULL_HANDLE;
+            if (vkCreateFramebuffer(s.device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS)
+                return false;
+            s.framebuffers.push_back(framebuffer);
+        }
+        return true;
+    }
+
+    bool CreateCommandObjects(VulkanState& s)
+    {
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = s.queueFamily;
+        if (vkCreateCommandPool(s.device, &poolInfo, nullptr, &s.commandPool) != VK_SUCCESS)
+            return false;
+
+        VkCommandBuffer commandBuffers[FRAMES_IN_FLIGHT] = {};
+        VkCommandBufferAllocateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        bufferInfo.commandPool = s.commandPool;
+        bufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        bufferInfo.commandBufferCount = static_cast<uint32_t>(FRAMES_IN_FLIGHT);
+        if (vkAllocateCommandBuffers(s.device, &bufferInfo, commandBuffers) != VK_SUCCESS)
+            return false;
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        s.slots.resize(FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+        {
+            VulkanState::FrameSlot& slot = s.slots[i];
+            slot.commandBuffer = commandBuffers[i];
+            if (vkCreateFence(s.device, &fenceInfo, nullptr, &slot.fence) != VK_SUCCESS ||
+                vkCreateSemaphore(s.device, &semaphoreInfo, nullptr, &slot.imageAvailable) != VK_SUCCESS)
+                return false;
+        }
+        return true;
+    }
+
+    void DestroySwapchainTargets(VulkanState& s)
+    {
+        for (VkFramebuffer framebuffer : s.framebuffers)
+            vkDestroyFramebuffer(s.device, framebuffer, nullptr);
+        for (VkImageView view : s.views)
+            vkDestroyImageView(s.device, view, nullptr);
+        for (VkSemaphore semaphore : s.renderFinished)
+        {
+            if (semaphore)
+                vkDestroySemaphore(s.device, semaphore, nullptr);
+        }
+        s.framebuffers.clear();
+        s.views.clear();
+        s.renderFinished.clear();
+        s.imageFences.clear();
+    }
+
+    // After the display mode or surface changed under the swapchain: a new one at the current
+    // extent, handed the old one to retire. The format is the surface's, so the render pass stays.
+    bool RecreateSwapchain(VulkanState& s)
+    {
+        vkDeviceWaitIdle(s.device);
+        DestroySwapchainTargets(s);
+        return CreateSwapchain(s) && CreateFramebuffers(s);
+    }
+
+    void DestroyUpload(VulkanState& s, VulkanState::FrameSlot& slot)
+    {
+        if (slot.uploadMemory)
+        {
+            if (slot.uploadMapped)
+                vkUnmapMemory(s.device, slot.uploadMemory);
+            vkFreeMemory(s.device, slot.uploadMemory, nullptr);
+        }
+        if (slot.upload)
+            vkDestroyBuffer(s.device, slot.upload, nullptr);
+        slot.upload = VK_NULL_HANDLE;
+        slot.uploadMemory = VK_NULL_HANDLE;
+        slot.uploadMapped = nullptr;
+        slot.uploadSize = 0;
+    }
+
+    // Host-visible buffer a CPU frame is written into and copied to the image from
+    bool CreateUpload(VulkanState& s, VulkanState::FrameSlot& slot, VkDeviceSize size)
+    {
+        DestroyUpload(s, slot);
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(s.device, &bufferInfo, nullptr, &slot.upload) != VK_SUCCESS)
+            return false;
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(s.device, slot.upload, &requirements);
+        VkMemoryAllocateInfo allocation = {};
+        allocation.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocation.allocationSize = requirements.size;
+        if (!FindMemoryType(s.physicalDevice, requirements.memoryTypeBits,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            allocation.memoryTypeIndex))
+            return false;
+        if (vkAllocateMemory(s.device, &allocation, nullptr, &slot.uploadMemory) != VK_SUCCESS)
+            return false;
+        vkBindBufferMemory(s.device, slot.upload, slot.uploadMemory, 0);
+        if (vkMapMemory(s.device, slot.uploadMemory, 0, size, 0, &slot.uploadMapped) != VK_SUCCESS)
+            return false;
+        slot.uploadSize = size;
+        return true;
+    }
+
+    // A lost device fails every call from now on; the caller rebuilds the renderer
+    bool Check(VulkanState& s, VkResult result)
+    {
+        s.deviceLost = s.deviceLost || result == VK_ERROR_DEVICE_LOST;
+        return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+    }
+
+    // One frame through the next slot: waits for it, acquires an image when presenting, lets record
+    // fill the image, submits, then presents or copies to the readback buffer and waits. record leaves
+    // the image in PRESENT_SRC_KHR when presenting and TRANSFER_SRC_OPTIMAL offscreen; waitStage is
+    // where its first write to the acquired image happens.
+    template <typename Record>
+    bool SubmitFrame(VulkanState& s, VkPipelineStageFlags waitStage, Record&& record)
+    {
+        VulkanState::FrameSlot& slot = s.slots[s.slot];
+        s.slot = (s.slot + 1) % s.slots.size();
+        if (!Check(s, vkWaitForFences(s.device, 1, &slot.fence, VK_TRUE, UINT64_MAX)))
+            return false;
+
+        // An out of date swapchain is rebuilt and the frame skipped; a suboptimal one still presents
+        // this frame and is rebuilt after it
+        uint32_t imageIndex = 0;
+        bool recreate = false;
+        if (s.presenting)
+        {
+            VkResult acquired = vkAcquireNextImageKHR(s.device, s.swapchain, UINT64_MAX, slot.imageAvailable,
+                                                      VK_NULL_HANDLE, &imageIndex);
+            if (acquired == VK_ERROR_OUT_OF_DATE_KHR)
+                return RecreateSwapchain(s);
+            if (!Check(s, acquired))
+                return false;
+            recreate = acquired == VK_SUBOPTIMAL_KHR;
+
+            // With more images than slots, the image may still be in use by the other slot's frame
+            VkFence& imageFence = s.imageFences[imageIndex];
+            if (imageFence && imageFence != slot.fence &&
+                !Check(s, vkWaitForFences(s.device, 1, &imageFence, VK_TRUE, UINT64_MAX)))
+                return false;
+            imageFence = slot.fence;
+        }
+        vkResetFences(s.device, 1, &slot.fence);
+
+        VkCommandBuffer commandBuffer = slot.commandBuffer;
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        record(slot, imageIndex);
+
+        if (!s.presenting)
+        {
+            // Copy to the host-visible buffer and make the writes visible to the host
+            VkBufferImageCopy region = {};
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = { s.extent.width, s.extent.height, 1 };
+            vkCmdCopyImageToBuffer(commandBuffer, s.offscreenImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                   s.readbackBuffer, 1, &region);
+
+            VkBufferMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = s.readbackBuffer;
+            barrier.size = VK_WHOLE_SIZE;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                                 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        if (s.presenting)
+        {
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &slot.imageAvailable;
+            submitInfo.pWaitDstStageMask = &waitStage;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &s.renderFinished[imageIndex];
+        }
+        if (!Check(s, vkQueueSubmit(s.queue, 1, &submitInfo, slot.fence)))
+            return false;
+
+        if (s.presenting)
+        {
+            VkPresentInfoKHR presentInfo = {};
+            presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            presentInfo.waitSemaphoreCount = 1;
+            presentInfo.pWaitSemaphores = &s.renderFinished[imageIndex];
+            presentInfo.swapchainCount = 1;
+            presentInfo.pSwapchains = &s.swapchain;
+            presentInfo.pImageIndices = &imageIndex;
+            VkResult presented = vkQueuePresentKHR(s.queue, &presentInfo);
+            if (presented == VK_ERROR_OUT_OF_DATE_KHR || presented == VK_SUBOPTIMAL_KHR || recreate)
+                return RecreateSwapchain(s);
+            return Check(s, presented);
+        }
+
+        // Offscreen frames complete before returning so the readback is always current
+        return Check(s, vkWaitForFences(s.device, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+    }
+}
+
+VulkanRenderer::VulkanRenderer() = default;
+
+VulkanRenderer::~VulkanRenderer()
+{
+    Shutdown();
+}
+
+bool VulkanRenderer::Init(const VulkanOptions& options)
+{
+    Shutdown();
+    m_state = std::make_unique<VulkanState>();
+    VulkanState& s = *m_state;
+    s.encoding = options.encoding;
+
+    // Instance, with the display extensions only when presenting and available
+    uint32_t count = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> instanceExtensions(count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, instanceExtensions.data());
+
+    bool wantDisplay = options.present && HasExtension(instanceExtensions, VK_KHR_SURFACE_EXTENSION_NAME) &&
+                       HasExtension(instanceExtensions, VK_KHR_DISPLAY_EXTENSION_NAME);
+    bool hasColorSpaces = HasExtension(instanceExtensions, VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME);
+
+    std::vector<const char*> enabledExtensions;
+    if (wantDisplay)
+    {
+        enabledExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+        enabledExtensions.push_back(VK_KHR_DISPLAY_EXTENSION_NAME);
+        if (hasColorSpaces)
+            enabledExtensions.push_back(VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME);
+    }
+
+    VkApplicationInfo applicationInfo = {};
+    applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    applicationInfo.pApplicationName = "hdr-calib";
+    applicationInfo.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo instanceInfo = {};
+    instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceInfo.pApplicationInfo = &applicationInfo;
+    instanceInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    instanceInfo.ppEnabledExtensionNames = enabledExtensions.data();
+    if (vkCreateInstance(&instanceInfo, nullptr, &s.instance) != VK_SUCCESS)
+    {
+        s.status = "vkCreateInstance failed";
+        return false;
+    }
+
+    // Physical device with a graphics queue; hardware first unless a software device was asked for
+    vkEnumeratePhysicalDevices(s.instance, &count, nullptr);
+    std::vector<VkPhysicalDevice> physicalDevices(count);
+    vkEnumeratePhysicalDevices(s.instance, &count, physicalDevices.data());
+
+    int bestScore = -1;
+    for (VkPhysicalDevice physicalDevice : physicalDevices)
+    {
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+        uint32_t family = UINT32_MAX;
+        for (uint32_t f = 0; f < familyCount && family == UINT32_MAX; ++f)
+        {
+            if (families[f].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+                family = f;
+        }
+        if (family == UINT32_MAX)
+            continue;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        int score = 1;
+        if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+            score = 4;
+        else if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU)
+            score = 3;
+        else if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+            score = options.preferSoftware ? 5 : 0;
+
+        if (score > bestScore)
+        {
+            bestScore = score;
+            s.physicalDevice = physicalDevice;
+            s.queueFamily = family;
+            s.deviceName = properties.deviceName;
+        }
+    }
+    if (s.physicalDevice == VK_NULL_HANDLE)
+    {
+        s.status = "no Vulkan device with a graphics queue";
+        return false;
+    }
+
+    // Present straight to a display when it offers an HDR color space, otherwise render offscreen
+    s.presenting = wantDisplay && ChooseDisplaySurface(s, hasColorSpaces);
+    if (!options.present)
+        s.status = "offscreen";
+    else if (!wantDisplay)
+        s.status = "VK_KHR_display unavailable, rendering offscreen";
+    else if (!s.presenting)
+        s.status += ", rendering offscreen";
+
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueInfo = {};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueFamilyIndex = s.queueFamily;
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = &priority;
+
+    const char* deviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    VkDeviceCreateInfo deviceInfo = {};
+    deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceInfo.queueCreateInfoCount = 1;
+    deviceInfo.pQueueCreateInfos = &queueInfo;
+    deviceInfo.enabledExtensionCount = s.presenting ? 1 : 0;
+    deviceInfo.ppEnabledExtensionNames = deviceExtensions;
+    if (vkCreateDevice(s.physicalDevice, &deviceInfo, nullptr, &s.device) != VK_SUCCESS)
+    {
+        s.status = "vkCreateDevice failed";
+        return false;
+    }
+    vkGetDeviceQueue(s.device, s.queueFamily, 0, &s.queue);
+
+    bool created = s.presenting ? CreateSwapchain(s) : CreateOffscreenTarget(s, options.width, options.height);
+    if (!created || !CreateRenderPass(s) || !CreateFramebuffers(s) || !CreateCommandObjects(s))
+    {
+        s.status = "failed to create render targets";
+        return false;
+    }
+
+    if (s.presenting)
+        s.status = s.encoding == FrameEncoding::ScRgbHalf ? "presenting scRGB FP16" : "presenting HDR10 PQ";
+    return true;
+}
+
+void VulkanRenderer::Shutdown()
+{
+    if (!m_state)
+        return;
+
+    VulkanState& s = *m_state;
+    if (s.device)
+    {
+        vkDeviceWaitIdle(s.device);
+        for (const VulkanState::FrameSlot& slot : s.slots)
+        {
+            if (slot.imageAvailable)
+                vkDestroySemaphore(s.device, slot.imageAvailable, nullptr);
+            if (slot.fence)
+                vkDestroyFence(s.device, slot.fence, nullptr);
+        }
+        for (VulkanState::FrameSlot& slot : s.slots)
+            DestroyUpload(s, slot);
+        if (s.commandPool)
+            vkDestroyCommandPool(s.device, s.commandPool, nullptr);
+        DestroySwapchainTargets(s);
+        if (s.renderPass)
+            vkDestroyRenderPass(s.device, s.renderPass, nullptr);
+        if (s.readbackMemory)
+        {
+            if (s.readbackMapped)
+                vkUnmapMemory(s.device, s.readbackMemory);
+            vkFreeMemory(s.device, s.readbackMemory, nullptr);
+        }
+        if (s.readbackBuffer)
+            vkDestroyBuffer(s.device, s.readbackBuffer, nullptr);
+        if (s.offscreenImage)
+            vkDestroyImage(s.device, s.offscreenImage, nullptr);
+        if (s.offscreenMemory)
+            vkFreeMemory(s.device, s.offscreenMemory, nullptr);
+        if (s.swapchain)
+            vkDestroySwapchainKHR(s.device, s.swapchain, nullptr);
+        vkDestroyDevice(s.device, nullptr);
+    }
+    if (s.surface)
+        vkDestroySurfaceKHR(s.instance, s.surface, nullptr);
+    if (s.instance)
+        vkDestroyInstance(s.instance, nullptr);
+
+    m_state.reset();
+}
+
+bool VulkanRenderer::RenderFrame(const Pattern& pattern)
+{
+    if (!m_state || !m_state->device)
+        return false;
+    VulkanState& s = *m_state;
+
+    return SubmitFrame(s, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       [&](VulkanState::FrameSlot& slot, uint32_t imageIndex)
+    {
+        VkCommandBuffer commandBuffer = slot.commandBuffer;
+        s.frameArena.Reset();
+
+        // Patterns are solid rects, so attachment clears draw them without any pipeline: the render
+        // pass load clears to the background, and each batch of one color is one clear call
+        DrawList draws(&s.frameArena);
+        draws.Record(pattern, static_cast<int>(s.extent.width), static_cast<int>(s.extent.height), true);
+        draws.Optimize();
+        s.drawStats = draws.Stats();
+
+        VkClearValue background = ClearColor(draws.Background(), s.encoding);
+        VkRenderPassBeginInfo renderPassBegin = {};
+        renderPassBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassBegin.renderPass = s.renderPass;
+        renderPassBegin.framebuffer = s.framebuffers[imageIndex];
+        renderPassBegin.renderArea.extent = s.extent;
+        renderPassBegin.clearValueCount = 1;
+        renderPassBegin.pClearValues = &background;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+
+        std::pmr::vector<VkClearRect> clearRects(&s.frameArena);
+        for (const DrawBatch& batch : draws.Batches())
+        {
+            clearRects.clear();
+            for (size_t i = batch.first; i < batch.first + batch.count; ++i)
+            {
+                const PixelRect& rect = draws.Rects()[i].rect;
+                VkClearRect clearRect = {};
+                clearRect.rect.offset = { rect.left, rect.top };
+                clearRect.rect.extent = { static_cast<uint32_t>(rect.Width()), static_cast<uint32_t>(rect.Height()) };
+                clearRect.layerCount = 1;
+                clearRects.push_back(clearRect);
+            }
+
+            VkClearAttachment attachment = {};
+            attachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            attachment.colorAttachment = 0;
+            attachment.clearValue = ClearColor(batch.color, s.encoding);
+            vkCmdClearAttachments(commandBuffer, 1, &attachment, static_cast<uint32_t>(clearRects.size()),
+                                  clearRects.data());
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+    });
+}
+
+bool VulkanRenderer::PresentFrame(const FrameBuffer& frame)
+{
+    if (!m_state || !m_state->device || !m_state->canUpload)
+        return false;
+    VulkanState& s = *m_state;
+    if (frame.width != static_cast<int>(s.extent.width) || frame.height != static_cast<int>(s.extent.height) ||
+        frame.encoding != s.encoding)
+        return false;
+
+    // Staging is made before a slot is taken, so recording cannot fail halfway with its fence reset.
+    // A new size, after the swapchain came back at another extent, waits for the queue once.
+    VkDeviceSize size = static_cast<VkDeviceSize>(frame.data.size());
+    for (VulkanState::FrameSlot& slot : s.slots)
+    {
+        if (slot.uploadSize == size)
+            continue;
+        vkDeviceWaitIdle(s.device);
+        if (!CreateUpload(s, slot, size))
+        {
+            DestroyUpload(s, slot);
+            return false;
+        }
+    }
+
+    return SubmitFrame(s, VK_PIPELINE_STAGE_TRANSFER_BIT, [&](VulkanState::FrameSlot& slot, uint32_t imageIndex)
+    {
+        // The slot's fence has signalled, so its staging buffer is free. Frames keep red in the low
+        // bits of 10-bit pixels; an A2R10G10B10 surface wants blue there.
+        if (s.format == VK_FORMAT_A2R10G10B10_UNORM_PACK32)
+        {
+            const uint32_t* source = frame.Packed();
+            uint32_t* target = static_cast<uint32_t*>(slot.uploadMapped);
+            size_t count = static_cast<size_t>(frame.width) * static_cast<size_t>(frame.height);
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint32_t pixel = source[i];
+                target[i] = (pixel & 0xC00FFC00u) | ((pixel & 0x3FFu) << 20) | ((pixel >> 20) & 0x3FFu);
+            }
+        }
+        else
+        {
+            std::memcpy(slot.uploadMapped, frame.data.data(), frame.data.size());
+        }
+
+        VkCommandBuffer commandBuffer = slot.commandBuffer;
+        VkImage image = s.images[imageIndex];
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { s.extent.width, s.extent.height, 1 };
+        vkCmdCopyBufferToImage(commandBuffer, slot.upload, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        // Into the layout the render pass would have left: presentable, or ready for the readback copy
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = s.presenting ? 0 : VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = s.presenting ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             s.presenting ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+    });
+}
+
+bool VulkanRenderer::ReadBack(FrameBuffer& frame) const
+{
+    if (!m_state || m_state->presenting || !m_state->readbackMapped)
+        return false;
+
+    const VulkanState& s = *m_state;
+    frame.Resize(static_cast<int>(s.extent.width), static_cast<int>(s.extent.height), s.encoding);
+    std::memcpy(frame.data.data(), s.readbackMapped, static_cast<size_t>(s.readbackSize));
+    return true;
+}
+
+bool VulkanRenderer::IsPresenting() const
+{
+    return m_state && m_state->presenting;
+}
+
+int VulkanRenderer::Width() const
+{
+    return m_state ? static_cast<int>(m_state->extent.width) : 0;
+}
+
+int VulkanRenderer::Height() const
+{
+    return m_state ? static_cast<int>(m_state->extent.height) : 0;
+}
+
+FrameEncoding VulkanRenderer::Encoding() const
+{
+    return m_state ? m_state->encoding : FrameEncoding::ScRgbHalf;
+}
+
+std::string VulkanRenderer::DeviceName() const
+{
+    return m_state ? m_state->deviceName : std::string();
+}
+
+std::string VulkanRenderer::Status() const
+{
+    return m_state ? m_state->status : std::string("not initialized");
+}
+
+ArenaStats VulkanRenderer::FrameArenaStats() const
+{
+    return m_state ? m_state->frameArena.Stats() : ArenaStats();
+}
+
+bool VulkanRenderer::DeviceLost() const
+{
+    return m_state && m_state->deviceLost;
+}
+
+DrawListStats VulkanRenderer::DrawStats() const
+{
+    return m_state ? m_state->drawStats : DrawListStats();
+}
+
+size_t VulkanRenderer::ImageBytes() const
+{
+    if (!m_state)
+        return 0;
+    const VulkanState& s = *m_state;
+    size_t imageBytes = static_cast<size_t>(s.extent.width) * s.extent.height * FrameBuffer::BytesPerPixel(s.encoding);
+    size_t uploadBytes = 0;
+    for (const VulkanState::FrameSlot& slot : s.slots)
+        uploadBytes += static_cast<size_t>(slot.uploadSize);
+    return s.images.size() * imageBytes + static_cast<size_t>(s.readbackSize) + uploadBytes;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Arena.h"
+#include "DrawList.h"
+#include "FrameBuffer.h"
+#include "Pattern.h"
+
+#include <memory>
+#include <string>
+
+struct VulkanOptions
+{
+    int width = 1920;            // offscreen size; a display uses its native mode instead
+    int height = 1080;
+    FrameEncoding encoding = FrameEncoding::ScRgbHalf;
+    bool present = true;         // drive a display directly through VK_KHR_display
+    bool preferSoftware = false; // pick a CPU implementation such as lavapipe when there is one
+};
+
+// Vulkan objects, defined in VulkanRenderer.cpp so callers do not need vulkan.h
+struct VulkanState;
+
+// Renders patterns with Vulkan into an FP16 scRGB or HDR10 PQ image.
+// When no display with an HDR swapchain color space is available it renders
+// offscreen, and the result can be read back and compared with RenderPatternCpu.
+class VulkanRenderer
+{
+public:
+    VulkanRenderer();
+    ~VulkanRenderer();
+
+    VulkanRenderer(const VulkanRenderer&) = delete;
+    VulkanRenderer& operator=(const VulkanRenderer&) = delete;
+
+    bool Init(const VulkanOptions& options);
+    void Shutdown();
+
+    // Presents on the display's vsync, or renders offscreen and waits for completion
+    bool RenderFrame(const Pattern& pattern);
+
+    // Shows a frame rendered on the CPU, such as one a FramePrefetcher rendered ahead: copied into
+    // the image through a staging buffer, then presented, or offscreen read back as RenderFrame does.
+    // False when the frame is not at the renderer's size and encoding or the images cannot take copies.
+    bool PresentFrame(const FrameBuffer& frame);
+
+    // True once a frame failed with VK_ERROR_DEVICE_LOST; only Shutdown and Init again bring it back
+    bool DeviceLost() const;
+
+    // Offscreen only: copy of the last rendered frame
+    bool ReadBack(FrameBuffer& frame) const;
+
+    bool IsPresenting() const;
+    int Width() const;
+    int Height() const;
+    FrameEncoding Encoding() const;
+    std::string DeviceName() const;
+    std::string Status() const;
+
+    // Scratch for building each frame's clear calls, reset every RenderFrame
+    ArenaStats FrameArenaStats() const;
+
+    // Clear calls of the last frame before and after its draw list was optimized
+    DrawListStats DrawStats() const;
+
+    // Device memory of the images rendered into, the readback buffer and the PresentFrame staging,
+    // from their sizes
+    size_t ImageBytes() const;
+
+private:
+    std::unique_ptr<VulkanState> m_state;
+};
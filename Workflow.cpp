@@ -0,0 +1,486 @@
+#include "Workflow.h"
+#include "ColorMath.h"
+#include "Session.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    const float REFERENCE_WHITE_NITS = 203.0f; // BT.2408 HDR reference white
+    const float DEFAULT_SWEEP_PEAK = 1000.0f;  // sweep ceiling when no peak step ran first
+
+    float DefaultEstimate(const WorkflowStep& step)
+    {
+        switch (step.kind)
+        {
+        case StepKind::Peak10:        return 60.0f;
+        case StepKind::PeakFullField: return 60.0f;
+        case StepKind::Black:         return 45.0f;
+        case StepKind::PaperWhite:    return 30.0f;
+        case StepKind::EotfSweep:     return 10.0f * static_cast<float>(step.sweepPoints);
+        }
+        return 60.0f;
+    }
+
+    bool ParseKind(const std::string& text, WorkflowStep& step)
+    {
+        if (text == "peak10")
+            step.kind = StepKind::Peak10;
+        else if (text == "fullfield")
+            step.kind = StepKind::PeakFullField;
+        else if (text == "black")
+            step.kind = StepKind::Black;
+        else if (text == "paperwhite")
+            step.kind = StepKind::PaperWhite;
+        else if (text.compare(0, 6, "sweep:") == 0)
+        {
+            step.kind = StepKind::EotfSweep;
+            step.sweepPoints = std::atoi(text.c_str() + 6);
+        }
+        else
+            return false;
+        return true;
+    }
+
+    WorkflowStep MakeStep(const std::string& name, StepKind kind, int output, std::vector<std::string> after,
+                          int sweepPoints = 0)
+    {
+        WorkflowStep step;
+        step.name = name;
+        step.kind = kind;
+        step.output = output;
+        step.after = std::move(after);
+        step.sweepPoints = sweepPoints;
+        step.estimateSeconds = DefaultEstimate(step);
+        return step;
+    }
+}
+
+bool Workflow::Parse(const std::string& text, std::string& error)
+{
+    m_steps.clear();
+
+    std::istringstream lines(text);
+    std::string line;
+    for (int lineNumber = 1; std::getline(lines, line); ++lineNumber)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string name, kind, after;
+        WorkflowStep step;
+        if (!(fields >> name))
+            continue;
+        if (!(fields >> kind >> step.output) || !ParseKind(kind, step))
+        {
+            error = "line " + std::to_string(lineNumber) + ": expected name kind output [after,...]";
+            return false;
+        }
+
+        step.name = name;
+        if (fields >> after)
+        {
+            std::istringstream names(after);
+            std::string dependency;
+            while (std::getline(names, dependency, ','))
+            {
+                if (!dependency.empty())
+                    step.after.push_back(dependency);
+            }
+        }
+        step.estimateSeconds = DefaultEstimate(step);
+        m_steps.push_back(step);
+    }
+    return true;
+}
+
+bool Workflow::Load(const std::string& path, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return Parse(text.str(), error);
+}
+
+Workflow Workflow::Default(int outputCount)
+{
+    // Black has no dependencies, so it fills the gap while nothing else is ready
+    Workflow workflow;
+    for (int output = 0; output < outputCount; ++output)
+    {
+        std::string suffix = "@" + std::to_string(output);
+        workflow.m_steps.push_back(MakeStep("peak10" + suffix, StepKind::Peak10, output, {}));
+        workflow.m_steps.push_back(MakeStep("black" + suffix, StepKind::Black, output, {}));
+        workflow.m_steps.push_back(MakeStep("fullfield" + suffix, StepKind::PeakFullField, output,
+                                            { "peak10" + suffix }));
+        workflow.m_steps.push_back(MakeStep("paperwhite" + suffix, StepKind::PaperWhite, output,
+                                            { "peak10" + suffix }));
+        workflow.m_steps.push_back(MakeStep("sweep" + suffix, StepKind::EotfSweep, output,
+                                            { "peak10" + suffix, "black" + suffix }, 12));
+    }
+    return workflow;
+}
+
+bool Workflow::Validate(int outputCount, std::string& error) const
+{
+    std::map<std::string, size_t> index;
+    for (size_t i = 0; i < m_steps.size(); ++i)
+    {
+        const WorkflowStep& step = m_steps[i];
+        if (!index.emplace(step.name, i).second)
+        {
+            error = "duplicate step " + step.name;
+            return false;
+        }
+        if (step.output < 0 || step.output >= outputCount)
+        {
+            error = step.name + " runs on output " + std::to_string(step.output) + ", which is not being calibrated";
+            return false;
+        }
+        if (step.kind == StepKind::EotfSweep && step.sweepPoints < 2)
+        {
+            error = step.name + " needs at least 2 sweep points";
+            return false;
+        }
+    }
+
+    // Kahn's algorithm: anything left over is part of a cycle
+    std::vector<int> waiting(m_steps.size(), 0);
+    std::vector<std::vector<size_t>> dependents(m_steps.size());
+    for (size_t i = 0; i < m_steps.size(); ++i)
+    {
+        for (const std::string& dependency : m_steps[i].after)
+        {
+            auto it = index.find(dependency);
+            if (it == index.end())
+            {
+                error = m_steps[i].name + " depends on unknown step " + dependency;
+                return false;
+            }
+            dependents[it->second].push_back(i);
+            ++waiting[i];
+        }
+    }
+
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < m_steps.size(); ++i)
+    {
+        if (waiting[i] == 0)
+            ready.push_back(i);
+    }
+    size_t ordered = 0;
+    while (!ready.empty())
+    {
+        size_t i = ready.back();
+        ready.pop_back();
+        ++ordered;
+        for (size_t dependent : dependents[i])
+        {
+            if (--waiting[dependent] == 0)
+                ready.push_back(dependent);
+        }
+    }
+    if (ordered != m_steps.size())
+    {
+        error = "steps depend on each other in a cycle";
+        return false;
+    }
+    return true;
+}
+
+uint32_t Workflow::Hash() const
+{
+    uint32_t hash = 2166136261u;
+    auto add = [&hash](const std::string& text)
+    {
+        for (size_t i = 0; i <= text.size(); ++i)
+        {
+            hash ^= static_cast<uint8_t>(text.c_str()[i]);
+            hash *= 16777619u;
+        }
+    };
+    for (const WorkflowStep& step : m_steps)
+    {
+        add(step.name);
+        add(std::to_string(static_cast<int>(step.kind)) + ' ' + std::to_string(step.output) + ' ' +
+            std::to_string(step.sweepPoints));
+        for (const std::string& after : step.after)
+            add(after);
+    }
+    return hash != 0 ? hash : 1;
+}
+
+WorkflowReport Workflow::Run(const StepRunner& runner, const std::atomic<bool>* cancel) const
+{
+    using Clock = std::chrono::steady_clock;
+
+    const size_t count = m_steps.size();
+    const uint32_t hash = Hash();
+    WorkflowReport report;
+
+    std::map<std::string, size_t> index;
+    for (size_t i = 0; i < count; ++i)
+        index[m_steps[i].name] = i;
+
+    std::vector<std::vector<size_t>> dependencies(count);
+    std::vector<std::vector<size_t>> dependents(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (const std::string& dependency : m_steps[i].after)
+        {
+            size_t d = index.at(dependency);
+            dependencies[i].push_back(d);
+            dependents[d].push_back(i);
+        }
+    }
+
+    // Priority is the estimated time from a step's start to the end of its longest chain of
+    // dependents. Validate guarantees a DAG, so repeated relaxation settles within count passes.
+    std::vector<double> priority(count, 0.0);
+    for (size_t pass = 0; pass < count; ++pass)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            double tail = 0.0;
+            for (size_t dependent : dependents[i])
+                tail = std::max(tail, priority[dependent]);
+            priority[i] = m_steps[i].estimateSeconds + tail;
+        }
+    }
+    for (size_t i = 0; i < count; ++i)
+        report.criticalPathSeconds = std::max(report.criticalPathSeconds, priority[i]);
+
+    enum class State { Pending, Running, Done };
+    std::vector<State> states(count, State::Pending);
+    std::vector<size_t> waiting(count);
+    std::vector<StepResult> results(count);
+    std::vector<bool> completed(count, false);
+    std::map<int, size_t> remaining; // unfinished steps per output
+    for (size_t i = 0; i < count; ++i)
+    {
+        waiting[i] = dependencies[i].size();
+        ++remaining[m_steps[i].output];
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    const Clock::time_point start = Clock::now();
+    auto seconds = [&]() { return std::chrono::duration<double>(Clock::now() - start).count(); };
+
+    // One worker per output; each output shows one step at a time
+    auto worker = [&](int output)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (remaining[output] > 0)
+        {
+            size_t next = count;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (m_steps[i].output == output && states[i] == State::Pending && waiting[i] == 0 &&
+                    (next == count || priority[i] > priority[next]))
+                    next = i;
+            }
+            if (next == count)
+            {
+                changed.wait(lock);
+                continue;
+            }
+
+            states[next] = State::Running;
+            StepTiming timing;
+            timing.name = m_steps[next].name;
+            timing.output = output;
+            timing.startSeconds = seconds();
+
+            bool runnable = !(cancel && *cancel);
+            std::vector<const WorkflowStep*> stepDependencies;
+            std::vector<const StepResult*> dependencyResults;
+            for (size_t d : dependencies[next])
+            {
+                runnable = runnable && completed[d];
+                stepDependencies.push_back(&m_steps[d]);
+                dependencyResults.push_back(&results[d]);
+            }
+
+            if (runnable)
+            {
+                StepRequest request = PrepareStep(m_steps[next], stepDependencies, dependencyResults);
+                request.index = next;
+                request.workflowHash = hash;
+                lock.unlock();
+                StepResult result = runner(request);
+                lock.lock();
+                results[next] = result;
+                completed[next] = result.completed;
+                timing.completed = result.completed;
+                timing.result = result;
+            }
+            else
+            {
+                timing.skipped = true;
+            }
+
+            timing.endSeconds = seconds();
+            report.steps.push_back(timing);
+            states[next] = State::Done;
+            --remaining[output];
+            for (size_t dependent : dependents[next])
+                --waiting[dependent];
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (const auto& entry : remaining)
+        threads.emplace_back(worker, entry.first);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    report.totalSeconds = seconds();
+    return report;
+}
+
+StepRequest PrepareStep(const WorkflowStep& step, const std::vector<const WorkflowStep*>& dependencies,
+                        const std::vector<const StepResult*>& results)
+{
+    // Brightest peak and black measured by the steps this one waited for
+    float peak10 = -1.0f;
+    float fullField = -1.0f;
+    float black = -1.0f;
+    for (size_t i = 0; i < dependencies.size(); ++i)
+    {
+        const StepResult& result = *results[i];
+        if (!result.completed)
+            continue;
+        switch (dependencies[i]->kind)
+        {
+        case StepKind::Peak10:        peak10 = std::max(peak10, result.level); break;
+        case StepKind::PeakFullField: fullField = std::max(fullField, result.level); break;
+        case StepKind::Black:         black = black < 0.0f ? result.level : std::min(black, result.level); break;
+        default: break;
+        }
+    }
+    float peak = peak10 >= 0.0f ? peak10 : fullField;
+
+    StepRequest request;
+    request.step = &step;
+    switch (step.kind)
+    {
+    case StepKind::Peak10:
+        // A small window is at least as bright as the full field
+        request.mode = BrightnessMode::Window10;
+        request.startLevel = fullField;
+        break;
+
+    case StepKind::PeakFullField:
+        // Power limiting typically halves full field brightness or worse
+        request.mode = BrightnessMode::FullFieldPeak;
+        request.startLevel = peak10 >= 0.0f ? peak10 * 0.5f : -1.0f;
+        break;
+
+    case StepKind::Black:
+        request.mode = BrightnessMode::MinBlack;
+        break;
+
+    case StepKind::PaperWhite:
+        request.mode = BrightnessMode::PaperWhite;
+        request.startLevel = peak >= 0.0f ? std::min(REFERENCE_WHITE_NITS, peak) : -1.0f;
+        break;
+
+    case StepKind::EotfSweep:
+    {
+        // Evenly spaced in PQ, so every point is a similar perceptual step
+        request.mode = BrightnessMode::Window10;
+        float low = PqEncode(std::max(black, 0.0f));
+        float high = PqEncode(peak > 0.0f ? peak : DEFAULT_SWEEP_PEAK);
+        int points = std::max(step.sweepPoints, 2);
+        for (int p = 0; p < points; ++p)
+            request.sweepLevels.push_back(PqDecode(low + (high - low) * p / static_cast<float>(points - 1)));
+        request.startLevel = request.sweepLevels.front();
+        break;
+    }
+    }
+    return request;
+}
+
+StepResult RunStepOnSession(CalibrationSession& session, const StepRequest& request)
+{
+    StepResult result;
+    bool sweep = request.step && request.step->kind == StepKind::EotfSweep;
+    if (!sweep && session.StepCompleted(request.workflowHash, request.index, result.level))
+    {
+        // The level as confirmed: a later sweep in the same mode has moved the mode's own level
+        result.completed = true;
+        result.restored = true;
+        return result;
+    }
+
+    if (sweep)
+    {
+        for (float level : request.sweepLevels)
+        {
+            float confirmed = 0.0f;
+            if (!session.RunStep(request.mode, level, confirmed))
+                return result;
+            result.sweep.push_back(confirmed);
+            result.level = std::max(result.level, confirmed);
+        }
+        result.completed = true;
+        return result;
+    }
+
+    result.completed = session.RunStep(request.mode, request.startLevel, result.level);
+    if (result.completed)
+        session.CompleteStep(request.workflowHash, request.index, result.level);
+    return result;
+}
+
+void FinishWorkflowOnSession(CalibrationSession& session, const WorkflowReport& report)
+{
+    bool finished = std::all_of(report.steps.begin(), report.steps.end(),
+                                [](const StepTiming& step) { return step.completed; });
+    if (finished)
+        session.ClearSteps();
+}
+
+std::string FormatWorkflowReport(const WorkflowReport& report)
+{
+    std::string text;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-20s %6s %10s %10s  %s\n", "step", "output", "start s", "time s", "result");
+    text += line;
+    for (const StepTiming& step : report.steps)
+    {
+        std::string result = step.skipped ? "skipped" : !step.completed ? "cancelled" : "";
+        if (step.completed)
+        {
+            char level[32];
+            std::snprintf(level, sizeof(level), "%g nits", step.result.level);
+            result = level;
+            if (!step.result.sweep.empty())
+                result += " (" + std::to_string(step.result.sweep.size()) + " points)";
+            if (step.result.restored)
+                result += " (restored)";
+        }
+        std::snprintf(line, sizeof(line), "%-20s %6d %10.1f %10.1f  %s\n", step.name.c_str(), step.output,
+                      step.startSeconds, step.endSeconds - step.startSeconds, result.c_str());
+        text += line;
+    }
+    std::snprintf(line, sizeof(line), "total %.1f s, estimated critical path %.1f s\n", report.totalSeconds,
+                  report.criticalPathSeconds);
+    text += line;
+    return text;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Modes.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+class CalibrationSession;
+
+enum class StepKind
+{
+    Peak10,        // peak luminance on a 10% window
+    PeakFullField, // peak luminance with the whole screen lit
+    Black,         // lowest distinguishable black
+    PaperWhite,    // level SDR white maps to
+    EotfSweep      // a series of PQ spaced levels between black and peak
+};
+
+struct WorkflowStep
+{
+    std::string name;               // unique within the workflow
+    StepKind kind = StepKind::Peak10;
+    int output = 0;                 // display the step runs on
+    std::vector<std::string> after; // steps that must finish first; their results seed this one
+    int sweepPoints = 0;            // EotfSweep only
+    float estimateSeconds = 0.0f;   // expected duration, used to order the schedule
+};
+
+// What a step should show, with starting levels carried forward from the steps it depends on
+struct StepRequest
+{
+    const WorkflowStep* step = nullptr;
+    size_t index = 0;               // of the step in Workflow::Steps()
+    uint32_t workflowHash = 0;      // Workflow::Hash(), which saved progress belongs to
+    BrightnessMode mode = BrightnessMode::MaxWhite;
+    float startLevel = -1.0f;       // negative keeps the session's own level
+    std::vector<float> sweepLevels; // EotfSweep only
+};
+
+struct StepResult
+{
+    bool completed = false;
+    bool restored = false;          // confirmed before a restart, the level as saved with the session
+    float level = 0.0f;             // confirmed level; the brightest point for a sweep
+    std::vector<float> sweep;       // confirmed level of every sweep point
+};
+
+// Runs one step to completion; called from one worker thread per output
+using StepRunner = std::function<StepResult(const StepRequest& request)>;
+
+struct StepTiming
+{
+    std::string name;
+    int output = 0;
+    double startSeconds = 0.0;      // from the start of the workflow
+    double endSeconds = 0.0;
+    bool completed = false;
+    bool skipped = false;           // a dependency did not complete
+    StepResult result;
+};
+
+struct WorkflowReport
+{
+    std::vector<StepTiming> steps;  // in completion order
+    double totalSeconds = 0.0;
+    double criticalPathSeconds = 0.0; // lower bound from the estimates
+};
+
+// A set of calibration steps with dependencies. Steps on the same output run one
+// at a time; steps on different outputs run in parallel. Among the steps that are
+// ready, the one with the longest estimated chain of dependents goes first, which
+// keeps the other outputs busy and shortens the whole session.
+class Workflow
+{
+public:
+    // One step per line: name kind output [after,after...]
+    // kind is peak10, fullfield, black, paperwhite or sweep:<points>; # starts a comment
+    bool Parse(const std::string& text, std::string& error);
+    bool Load(const std::string& path, std::string& error);
+
+    // peak10, then full field, paper white and a 12 point sweep on every output
+    static Workflow Default(int outputCount);
+
+    // Unknown dependencies, duplicate names, cycles and outputs outside [0, outputCount)
+    bool Validate(int outputCount, std::string& error) const;
+
+    const std::vector<WorkflowStep>& Steps() const { return m_steps; }
+
+    // FNV-1a over every step, so progress saved for one workflow is never applied to another
+    uint32_t Hash() const;
+
+    // Blocks until every step has completed or been skipped. Setting cancel skips
+    // the steps that have not started; the runner should return early too.
+    WorkflowReport Run(const StepRunner& runner, const std::atomic<bool>* cancel = nullptr) const;
+
+private:
+    std::vector<WorkflowStep> m_steps;
+};
+
+// Work out a step's mode and starting levels from the results of its dependencies
+StepRequest PrepareStep(const WorkflowStep& step, const std::vector<const WorkflowStep*>& dependencies,
+                        const std::vector<const StepResult*>& results);
+
+// Runner for an interactive session: shows the step and waits for the user to confirm, then records
+// it in the session's saved progress. A step the session already records as confirmed for this
+// workflow returns the level the session kept for its mode at once. Sweeps keep one level per
+// point, which the session has no room for, so an interrupted sweep runs again.
+StepResult RunStepOnSession(CalibrationSession& session, const StepRequest& request);
+
+// Once every step completed, clears the saved progress so the same workflow starts over next time
+void FinishWorkflowOnSession(CalibrationSession& session, const WorkflowReport& report);
+
+std::string FormatWorkflowReport(const WorkflowReport& report);